@@ -0,0 +1,73 @@
+#include "Arithmetic.h"
+#include <stdexcept>
+#include <string>
+
+void throwDivisionByZero(Op op, std::uint32_t position) {
+    throw std::runtime_error(std::string(op == Op::Modulo ? "Modulo" : "Division") +
+                             " by zero @ char " + std::to_string(position));
+}
+
+void throwOverflow(Op op, std::uint32_t position) {
+    throw std::runtime_error(std::string("Integer overflow in ") + operatorInfo(op).name +
+                             " @ char " + std::to_string(position));
+}
+
+void throwLiteralOutOfRange(std::uint32_t position) {
+    throw std::runtime_error("Integer literal out of range @ char " + std::to_string(position));
+}
+
+void throwUnsupportedOperator(Op op) {
+    throw std::runtime_error(std::string("Unsupported operator: ") + operatorInfo(op).name);
+}
+
+BigInt BigIntArithmetic::binary(Op op, const BigInt& a, const BigInt& b, std::uint32_t position) {
+    switch (op) {
+    case Op::Add:          return a + b;
+    case Op::Subtract:     return a - b;
+    case Op::Multiply:     return a * b;
+    case Op::Divide:
+        if (b.isZero()) throwDivisionByZero(op, position);
+        return a / b;
+    case Op::Modulo:
+        if (b.isZero()) throwDivisionByZero(op, position);
+        return a % b;
+    case Op::Power: {
+        // Same rules as integerPower() for negative exponents
+        if (b.isNegative()) {
+            bool unit = a == BigInt(1) || a == BigInt(-1);
+            return unit ? (a.isNegative() && b.isOdd() ? BigInt(-1) : BigInt(1)) : BigInt(0);
+        }
+        if (a.isZero() || a == BigInt(1)) {
+            return a.isZero() && b.isZero() ? BigInt(1) : a;
+        }
+        if (a == BigInt(-1)) {
+            return b.isOdd() ? a : BigInt(1);
+        }
+        // |a| >= 2, so the result has at least b + 1 bits
+        if (!b.fitsInt64() || static_cast<std::uint64_t>(b.toInt64()) > kMaxPowerBits / (a.bitLength() - 1)) {
+            throwOverflow(op, position);
+        }
+        return a.pow(static_cast<std::uint64_t>(b.toInt64()));
+    }
+    case Op::Greater:      return BigInt(a > b);
+    case Op::GreaterEqual: return BigInt(a >= b);
+    case Op::Less:         return BigInt(a < b);
+    case Op::LessEqual:    return BigInt(a <= b);
+    case Op::Equal:        return BigInt(a == b);
+    case Op::NotEqual:     return BigInt(a != b);
+    case Op::LogicalAnd:   return BigInt(!a.isZero() && !b.isZero());
+    case Op::LogicalOr:    return BigInt(!a.isZero() || !b.isZero());
+    default:               throwUnsupportedOperator(op);
+    }
+}
+
+BigInt BigIntArithmetic::unary(Op op, const BigInt& a, std::uint32_t) {
+    switch (op) {
+    case Op::LogicalNot:   return BigInt(a.isZero());
+    case Op::Increment:    return a + BigInt(1);
+    case Op::Decrement:    return a - BigInt(1);
+    case Op::Negate:       return -a;
+    case Op::Plus:         return a;
+    default:               throwUnsupportedOperator(op);
+    }
+}
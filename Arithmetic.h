@@ -0,0 +1,352 @@
+#ifndef ARITHMETIC_H
+#define ARITHMETIC_H
+
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <type_traits>
+#include "BigInt.h"
+#include "Lexer.h"
+#include "Operators.h"
+
+/**
+ * Integer arithmetic with defined results for every input.
+ *
+ * The wrapping helpers compute in the unsigned type, so overflow wraps modulo
+ * 2^bits instead of being undefined, and the one quotient that does not fit
+ * (MIN / -1) wraps to MIN rather than trapping. Every execution path (eval(),
+ * the bytecode interpreter, the batch kernels, the JIT and constant folding)
+ * uses them, so all of them agree bit for bit.
+ */
+
+template <typename T>
+constexpr T wrappingAdd(T a, T b) {
+    using U = std::make_unsigned_t<T>;
+    return static_cast<T>(static_cast<U>(a) + static_cast<U>(b));
+}
+
+template <typename T>
+constexpr T wrappingSubtract(T a, T b) {
+    using U = std::make_unsigned_t<T>;
+    return static_cast<T>(static_cast<U>(a) - static_cast<U>(b));
+}
+
+template <typename T>
+constexpr T wrappingMultiply(T a, T b) {
+    using U = std::make_unsigned_t<T>;
+    return static_cast<T>(static_cast<U>(a) * static_cast<U>(b));
+}
+
+template <typename T>
+constexpr T wrappingNegate(T a) {
+    using U = std::make_unsigned_t<T>;
+    return static_cast<T>(U(0) - static_cast<U>(a));
+}
+
+/**
+ * @param b The divisor; must not be zero.
+ * @return a / b truncated toward zero; MIN / -1 wraps to MIN.
+ */
+template <typename T>
+constexpr T wrappingDivide(T a, T b) {
+    return b == -1 ? wrappingNegate(a) : a / b;
+}
+
+/**
+ * @param b The divisor; must not be zero.
+ * @return a % b with the sign of a; MIN % -1 is 0.
+ */
+template <typename T>
+constexpr T wrappingModulo(T a, T b) {
+    return b == -1 ? T(0) : a % b;
+}
+
+/**
+ * Raises base to an integer power by repeated squaring, wrapping on overflow.
+ * This is exact (a double round trip through pow() loses bits above 2^53) and
+ * takes at most 2 * log2(exponent) multiplications.
+ *
+ * A negative exponent gives the real result truncated toward zero: 1 for base 1,
+ * +-1 for base -1, and 0 otherwise (including base 0).
+ *
+ * @param base The base.
+ * @param exponent The exponent.
+ * @return base^exponent modulo 2^bits.
+ *
+ * Time Complexity: O(log exponent).
+ */
+template <typename T>
+constexpr T integerPower(T base, T exponent) {
+    if (exponent < 0) {
+        return base == 1 ? T(1) : base == -1 ? (exponent & 1 ? T(-1) : T(1)) : T(0);
+    }
+
+    using U = std::make_unsigned_t<T>;
+    U result = 1;
+    U square = static_cast<U>(base);
+    while (exponent) {
+        if (exponent & 1) {
+            result *= square;
+        }
+        exponent >>= 1;
+        if (exponent) {
+            square *= square;
+        }
+    }
+    return static_cast<T>(result);
+}
+
+/**
+ * Throws the "Division by zero" or "Modulo by zero" error for an operator.
+ *
+ * @param op Op::Divide or Op::Modulo.
+ * @param position Position of the operator in the expression.
+ */
+[[noreturn]] void throwDivisionByZero(Op op, std::uint32_t position);
+
+/**
+ * Throws "Integer overflow in <op> @ char <position>".
+ *
+ * @param op The operator whose result does not fit.
+ * @param position Position of the operator in the expression.
+ */
+[[noreturn]] void throwOverflow(Op op, std::uint32_t position);
+
+/**
+ * Throws "Integer literal out of range @ char <position>".
+ *
+ * @param position Position of the literal in the expression.
+ */
+[[noreturn]] void throwLiteralOutOfRange(std::uint32_t position);
+
+/**
+ * Throws "Unsupported operator: <op>".
+ *
+ * @param op The operator.
+ */
+[[noreturn]] void throwUnsupportedOperator(Op op);
+
+/**
+ * Two's complement arithmetic on T that wraps on overflow. With std::int32_t
+ * this is what eval() computes.
+ *
+ * This and the other numeric modes below are policies for Evaluator::evalAs():
+ * a Value type plus static functions that convert literals, test truth and
+ * apply operators. Comparisons and logical operators yield 0 or 1 in every mode.
+ */
+template <typename T>
+struct WrappingArithmetic {
+    using Value = T;
+
+    /**
+     * Converts a Number token; digits beyond the type's range wrap.
+     */
+    static Value literal(const Token& token, std::string_view expression) {
+        if constexpr (sizeof(T) <= sizeof(std::int32_t)) {
+            return static_cast<T>(token.value);
+        }
+        else {
+            std::make_unsigned_t<T> value = 0;
+            for (char c : tokenText(token, expression)) {
+                value = value * 10 + static_cast<unsigned>(c - '0');
+            }
+            return static_cast<T>(value);
+        }
+    }
+
+    static bool isTrue(Value v) { return v != 0; }
+
+    /**
+     * Applies a binary operator.
+     *
+     * @throws std::runtime_error on division or modulo by zero.
+     */
+    static Value binary(Op op, Value a, Value b, std::uint32_t position) {
+        switch (op) {
+        case Op::Add:          return wrappingAdd(a, b);
+        case Op::Subtract:     return wrappingSubtract(a, b);
+        case Op::Multiply:     return wrappingMultiply(a, b);
+        case Op::Divide:
+            if (b == 0) throwDivisionByZero(op, position);
+            return wrappingDivide(a, b);
+        case Op::Modulo:
+            if (b == 0) throwDivisionByZero(op, position);
+            return wrappingModulo(a, b);
+        case Op::Power:        return integerPower(a, b);
+        case Op::Greater:      return a > b;
+        case Op::GreaterEqual: return a >= b;
+        case Op::Less:         return a < b;
+        case Op::LessEqual:    return a <= b;
+        case Op::Equal:        return a == b;
+        case Op::NotEqual:     return a != b;
+        case Op::LogicalAnd:   return a && b;
+        case Op::LogicalOr:    return a || b;
+        default:               throwUnsupportedOperator(op);
+        }
+    }
+
+    /**
+     * Applies a unary operator.
+     */
+    static Value unary(Op op, Value a, std::uint32_t) {
+        switch (op) {
+        case Op::LogicalNot:   return !a;
+        case Op::Increment:    return wrappingAdd(a, T(1));
+        case Op::Decrement:    return wrappingSubtract(a, T(1));
+        case Op::Negate:       return wrappingNegate(a);
+        case Op::Plus:         return a;
+        default:               throwUnsupportedOperator(op);
+        }
+    }
+};
+
+/**
+ * Arithmetic on T that throws instead of wrapping: any result that does not fit
+ * in T, including an oversized literal, reports the operator and its position.
+ * Overflow is detected with the compiler's __builtin_*_overflow intrinsics,
+ * which compile to the operation plus a test of the overflow flag.
+ */
+template <typename T>
+struct CheckedArithmetic {
+    using Value = T;
+
+    /**
+     * Converts a Number token.
+     *
+     * @throws std::runtime_error if the literal does not fit in T.
+     */
+    static Value literal(const Token& token, std::string_view expression) {
+        T value = 0;
+        for (char c : tokenText(token, expression)) {
+            if (__builtin_mul_overflow(value, T(10), &value) || __builtin_add_overflow(value, T(c - '0'), &value)) {
+                throwLiteralOutOfRange(token.offset);
+            }
+        }
+        return value;
+    }
+
+    static bool isTrue(Value v) { return v != 0; }
+
+    /**
+     * Applies a binary operator.
+     *
+     * @throws std::runtime_error on overflow or division or modulo by zero.
+     */
+    static Value binary(Op op, Value a, Value b, std::uint32_t position) {
+        T result;
+        switch (op) {
+        case Op::Add:
+            if (__builtin_add_overflow(a, b, &result)) throwOverflow(op, position);
+            return result;
+        case Op::Subtract:
+            if (__builtin_sub_overflow(a, b, &result)) throwOverflow(op, position);
+            return result;
+        case Op::Multiply:
+            if (__builtin_mul_overflow(a, b, &result)) throwOverflow(op, position);
+            return result;
+        case Op::Divide:
+            if (b == 0) throwDivisionByZero(op, position);
+            if (b == -1 && a == std::numeric_limits<T>::min()) throwOverflow(op, position);
+            return a / b;
+        case Op::Modulo:
+            if (b == 0) throwDivisionByZero(op, position);
+            return wrappingModulo(a, b);
+        case Op::Power:
+            if (!power(a, b, result)) throwOverflow(op, position);
+            return result;
+        case Op::Greater:      return a > b;
+        case Op::GreaterEqual: return a >= b;
+        case Op::Less:         return a < b;
+        case Op::LessEqual:    return a <= b;
+        case Op::Equal:        return a == b;
+        case Op::NotEqual:     return a != b;
+        case Op::LogicalAnd:   return a && b;
+        case Op::LogicalOr:    return a || b;
+        default:               return WrappingArithmetic<T>::binary(op, a, b, position);
+        }
+    }
+
+    /**
+     * Applies a unary operator.
+     *
+     * @throws std::runtime_error on overflow.
+     */
+    static Value unary(Op op, Value a, std::uint32_t position) {
+        T result;
+        switch (op) {
+        case Op::Increment:
+            if (__builtin_add_overflow(a, T(1), &result)) throwOverflow(op, position);
+            return result;
+        case Op::Decrement:
+            if (__builtin_sub_overflow(a, T(1), &result)) throwOverflow(op, position);
+            return result;
+        case Op::Negate:
+            if (__builtin_sub_overflow(T(0), a, &result)) throwOverflow(op, position);
+            return result;
+        default:
+            return WrappingArithmetic<T>::unary(op, a, position);
+        }
+    }
+
+private:
+    /**
+     * Exponentiation by squaring that stops at the first overflow. Squaring is
+     * skipped after the last exponent bit, so it cannot report a spurious overflow.
+     *
+     * @return False if the result does not fit in T.
+     */
+    static bool power(T base, T exponent, T& result) {
+        if (exponent < 0) {
+            result = integerPower(base, exponent);
+            return true;
+        }
+        result = 1;
+        while (exponent) {
+            if ((exponent & 1) && __builtin_mul_overflow(result, base, &result)) {
+                return false;
+            }
+            exponent >>= 1;
+            if (exponent && __builtin_mul_overflow(base, base, &base)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+/**
+ * Arbitrary-precision arithmetic: results never overflow. Exponentiation is
+ * the one exception that is bounded, because a short expression like 9^9^9
+ * would otherwise run out of memory: results larger than kMaxPowerBits throw.
+ */
+struct BigIntArithmetic {
+    using Value = BigInt;
+
+    // Largest result of ^, in bits (about 315,000 decimal digits)
+    static constexpr std::size_t kMaxPowerBits = std::size_t(1) << 20;
+
+    static Value literal(const Token& token, std::string_view expression) {
+        return BigInt::fromDecimal(tokenText(token, expression));
+    }
+
+    static bool isTrue(const Value& v) { return !v.isZero(); }
+
+    /**
+     * Applies a binary operator.
+     *
+     * @throws std::runtime_error on division or modulo by zero, or if a power
+     *         result would exceed kMaxPowerBits.
+     */
+    static Value binary(Op op, const Value& a, const Value& b, std::uint32_t position);
+
+    /**
+     * Applies a unary operator.
+     */
+    static Value unary(Op op, const Value& a, std::uint32_t position);
+};
+
+using Int32Arithmetic = WrappingArithmetic<std::int32_t>;
+using Int64Arithmetic = WrappingArithmetic<std::int64_t>;
+using CheckedInt64Arithmetic = CheckedArithmetic<std::int64_t>;
+
+#endif // ARITHMETIC_H
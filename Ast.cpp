@@ -0,0 +1,245 @@
+#include "Ast.h"
+#include <climits>
+
+std::uint32_t Ast::addConstant(std::int32_t value, std::uint32_t offset) {
+    nodes.push_back({NodeKind::Constant, Op::LeftParen, offset, value, 0, 0});
+    return static_cast<std::uint32_t>(nodes.size() - 1);
+}
+
+std::uint32_t Ast::addDecimal(double value, std::uint32_t offset) {
+    decimals.push_back(value);
+    nodes.push_back({NodeKind::Decimal, Op::LeftParen, offset, static_cast<std::int32_t>(decimals.size() - 1), 0, 0});
+    return static_cast<std::uint32_t>(nodes.size() - 1);
+}
+
+std::uint32_t Ast::addVariable(std::int32_t slot, std::uint32_t offset) {
+    nodes.push_back({NodeKind::Variable, Op::LeftParen, offset, slot, 0, 0});
+    return static_cast<std::uint32_t>(nodes.size() - 1);
+}
+
+std::uint32_t Ast::addUnary(Op op, std::uint32_t operand, std::uint32_t offset) {
+    nodes.push_back({NodeKind::Unary, op, offset, 0, operand, 0});
+    return static_cast<std::uint32_t>(nodes.size() - 1);
+}
+
+std::uint32_t Ast::addBinary(Op op, std::uint32_t lhs, std::uint32_t rhs, std::uint32_t offset) {
+    nodes.push_back({NodeKind::Binary, op, offset, 0, lhs, rhs});
+    return static_cast<std::uint32_t>(nodes.size() - 1);
+}
+
+std::int32_t Ast::slotFor(const std::string& name) {
+    for (size_t i = 0; i < names.size(); i++) {
+        if (names[i] == name) {
+            return static_cast<std::int32_t>(i);
+        }
+    }
+    names.push_back(name);
+    return static_cast<std::int32_t>(names.size() - 1);
+}
+
+bool Ast::isConstant(std::uint32_t index, std::int32_t value) const {
+    return nodes[index].kind == NodeKind::Constant && nodes[index].value == value;
+}
+
+bool Ast::isBoolean(std::uint32_t index) const {
+    const AstNode& n = nodes[index];
+    switch (n.kind) {
+    case NodeKind::Constant:
+        return n.value == 0 || n.value == 1;
+    case NodeKind::Unary:
+        return n.op == Op::LogicalNot;
+    case NodeKind::Binary:
+        return operatorInfo(n.op).precedence <= operatorInfo(Op::Greater).precedence;
+    default:
+        return false;
+    }
+}
+
+std::uint32_t Ast::toBoolean(std::uint32_t index, std::uint32_t offset) {
+    if (isBoolean(index)) {
+        return index;
+    }
+    return addBinary(Op::NotEqual, index, addConstant(0, offset), offset);
+}
+
+std::uint32_t Ast::foldUnary(Op op, std::uint32_t operand, std::uint32_t offset) {
+    const AstNode x = nodes[operand];
+
+    switch (op) {
+    case Op::Plus:
+        // +x == x
+        return operand;
+    case Op::Increment:
+    case Op::Decrement:
+        // Rewrite as an addition so chains like ++ ++x or ++x - 1 merge into one constant
+        return foldBinary(Op::Add, operand, addConstant(op == Op::Increment ? 1 : -1, offset), offset);
+    default:
+        break;
+    }
+
+    if (x.kind == NodeKind::Constant) {
+        return addConstant(applyUnaryOpCode(operatorInfo(op).code, x.value), offset);
+    }
+
+    // - -x == x
+    if (op == Op::Negate && x.kind == NodeKind::Unary && x.op == Op::Negate) {
+        return x.lhs;
+    }
+
+    // !!b == b when b is already 0 or 1 (so !!!x == !x)
+    if (op == Op::LogicalNot && x.kind == NodeKind::Unary && x.op == Op::LogicalNot && isBoolean(x.lhs)) {
+        return x.lhs;
+    }
+
+    return addUnary(op, operand, offset);
+}
+
+std::uint32_t Ast::foldBinary(Op op, std::uint32_t lhs, std::uint32_t rhs, std::uint32_t offset) {
+    const AstNode a = nodes[lhs];
+    const AstNode b = nodes[rhs];
+
+    // Both operands known: evaluate now, unless that would fail at run time
+    if (a.kind == NodeKind::Constant && b.kind == NodeKind::Constant &&
+        !((op == Op::Divide || op == Op::Modulo) && b.value == 0)) {
+        return addConstant(applyBinaryOpCode(operatorInfo(op).code, a.value, b.value), offset);
+    }
+
+    switch (op) {
+    case Op::Add:
+        // Keep the constant on the right so constant chains can merge
+        if (a.kind == NodeKind::Constant) {
+            return foldBinary(Op::Add, rhs, lhs, offset);
+        }
+        if (isConstant(rhs, 0)) {
+            return lhs;
+        }
+        // (x + c1) + c2 == x + (c1 + c2)
+        if (b.kind == NodeKind::Constant && a.kind == NodeKind::Binary && a.op == Op::Add &&
+            nodes[a.rhs].kind == NodeKind::Constant) {
+            std::uint32_t sum = static_cast<std::uint32_t>(nodes[a.rhs].value) + static_cast<std::uint32_t>(b.value);
+            return foldBinary(Op::Add, a.lhs, addConstant(static_cast<std::int32_t>(sum), offset), offset);
+        }
+        break;
+    case Op::Subtract:
+        if (isConstant(rhs, 0)) {
+            return lhs;
+        }
+        // x - c == x + (-c), which can then merge with neighbouring constants
+        if (b.kind == NodeKind::Constant && b.value != INT_MIN) {
+            return foldBinary(Op::Add, lhs, addConstant(-b.value, offset), offset);
+        }
+        break;
+    case Op::Multiply:
+        if (isConstant(rhs, 1)) {
+            return lhs;
+        }
+        if (isConstant(lhs, 1)) {
+            return rhs;
+        }
+        break;
+    case Op::Divide:
+    case Op::Power:
+        if (isConstant(rhs, 1)) {
+            return lhs;
+        }
+        break;
+    case Op::LogicalAnd:
+        // 0 && x never evaluates x; c && x == (x != 0); x && c == (x != 0)
+        if (a.kind == NodeKind::Constant) {
+            return a.value == 0 ? addConstant(0, offset) : toBoolean(rhs, offset);
+        }
+        if (b.kind == NodeKind::Constant && b.value != 0) {
+            return toBoolean(lhs, offset);
+        }
+        break;
+    case Op::LogicalOr:
+        // c || x never evaluates x; 0 || x == (x != 0); x || 0 == (x != 0)
+        if (a.kind == NodeKind::Constant) {
+            return a.value != 0 ? addConstant(1, offset) : toBoolean(rhs, offset);
+        }
+        if (isConstant(rhs, 0)) {
+            return toBoolean(lhs, offset);
+        }
+        break;
+    default:
+        break;
+    }
+
+    return addBinary(op, lhs, rhs, offset);
+}
+
+void Ast::fold() {
+    std::vector<AstNode> original;
+    original.swap(nodes);
+    nodes.reserve(original.size());
+
+    // Children precede parents, so one forward pass sees folded operands first
+    std::vector<std::uint32_t> remap(original.size());
+    for (size_t i = 0; i < original.size(); i++) {
+        const AstNode& n = original[i];
+        switch (n.kind) {
+        case NodeKind::Constant:
+        case NodeKind::Decimal:
+        case NodeKind::Variable:
+            nodes.push_back(n);
+            remap[i] = static_cast<std::uint32_t>(nodes.size() - 1);
+            break;
+        case NodeKind::Unary:
+            remap[i] = foldUnary(n.op, remap[n.lhs], n.offset);
+            break;
+        case NodeKind::Binary:
+            remap[i] = foldBinary(n.op, remap[n.lhs], remap[n.rhs], n.offset);
+            break;
+        }
+    }
+
+    if (!original.empty()) {
+        rootIndex = remap[rootIndex];
+    }
+    compact();
+}
+
+void Ast::compact() {
+    if (nodes.empty()) {
+        return;
+    }
+
+    // Re-emit the tree reachable from the root in canonical post-order (left
+    // subtree, right subtree, node). Folding may leave operands out of that
+    // order (for example after moving a constant to the right of an addition);
+    // rebuilding restores contiguous subtrees and drops unreachable nodes.
+    struct Frame {
+        std::uint32_t index;
+        int visited;            // Number of children already emitted
+    };
+    std::vector<AstNode> ordered;
+    ordered.reserve(nodes.size());
+    std::vector<std::uint32_t> remap(nodes.size());
+    std::vector<Frame> pending{{rootIndex, 0}};
+
+    while (!pending.empty()) {
+        Frame& frame = pending.back();
+        const AstNode& n = nodes[frame.index];
+        int children = n.kind == NodeKind::Binary ? 2 : n.kind == NodeKind::Unary ? 1 : 0;
+
+        if (frame.visited < children) {
+            std::uint32_t child = frame.visited++ == 0 ? n.lhs : n.rhs;
+            pending.push_back({child, 0});
+            continue;
+        }
+
+        AstNode copy = n;
+        if (children >= 1) {
+            copy.lhs = remap[n.lhs];
+        }
+        if (children == 2) {
+            copy.rhs = remap[n.rhs];
+        }
+        remap[frame.index] = static_cast<std::uint32_t>(ordered.size());
+        ordered.push_back(copy);
+        pending.pop_back();
+    }
+
+    nodes.swap(ordered);
+    rootIndex = static_cast<std::uint32_t>(nodes.size() - 1);
+}
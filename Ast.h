@@ -0,0 +1,197 @@
+#ifndef AST_H
+#define AST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Operators.h"
+
+/**
+ * The kinds of AST node.
+ */
+enum class NodeKind : std::uint8_t {
+    Constant,   // Integer literal; value holds the number
+    Decimal,    // Floating-point literal; value indexes the decimal pool (see Ast::decimal())
+    Variable,   // Variable reference; value holds the slot index
+    Unary,      // Prefix operator applied to lhs
+    Binary      // Operator applied to lhs and rhs
+};
+
+/**
+ * One node of the expression tree. Children are referenced by index into
+ * the owning Ast's node array.
+ */
+struct AstNode {
+    NodeKind kind;
+    Op op;                  // Operator for Unary and Binary nodes
+    std::uint32_t offset;   // Position in the source expression (for error messages)
+    std::int32_t value;     // Constant value, decimal pool index or variable slot
+    std::uint32_t lhs;      // Operand of a Unary node, left operand of a Binary node
+    std::uint32_t rhs;      // Right operand of a Binary node
+};
+
+/**
+ * An expression tree stored in one contiguous node arena.
+ *
+ * Nodes are always stored in post-order: every child comes before its parent
+ * and each subtree occupies a contiguous index range ending at its root.
+ * That lets every pass (folding, compaction, code generation) be a simple
+ * loop over the array instead of a recursive walk, so even very deeply
+ * nested expressions cannot overflow the native stack.
+ */
+class Ast {
+public:
+    Ast() = default;
+
+    /**
+     * Appends a constant node.
+     *
+     * @return The index of the new node.
+     */
+    std::uint32_t addConstant(std::int32_t value, std::uint32_t offset);
+
+    /**
+     * Appends a floating-point literal node.
+     *
+     * @return The index of the new node.
+     */
+    std::uint32_t addDecimal(double value, std::uint32_t offset);
+
+    /**
+     * Appends a variable node.
+     *
+     * @return The index of the new node.
+     */
+    std::uint32_t addVariable(std::int32_t slot, std::uint32_t offset);
+
+    /**
+     * Appends a unary operator node. The operand must already be in the arena.
+     *
+     * @return The index of the new node.
+     */
+    std::uint32_t addUnary(Op op, std::uint32_t operand, std::uint32_t offset);
+
+    /**
+     * Appends a binary operator node. Both operands must already be in the arena.
+     *
+     * @return The index of the new node.
+     */
+    std::uint32_t addBinary(Op op, std::uint32_t lhs, std::uint32_t rhs, std::uint32_t offset);
+
+    /**
+     * Folds constant sub-expressions and applies algebraic simplifications:
+     * constant operands are evaluated, identities such as x+0, x*1, x/1, x^1
+     * and +x are removed, ++/-- chains and nested constant additions are
+     * merged into one addition, double negation and redundant '!' pairs are
+     * dropped, and '0 && ...' / 'c || ...' are short-circuited.
+     * Division or modulo by a constant zero is left in place so it still
+     * fails at run time. Unreachable nodes are removed afterwards.
+     *
+     * The rewrites assume 32-bit integer arithmetic, so trees with Decimal
+     * leaves or floating-point variables must not be folded.
+     *
+     * Time Complexity: O(n) where n is the number of nodes.
+     */
+    void fold();
+
+    /**
+     * Removes nodes that are not reachable from the root and re-orders the rest
+     * into canonical post-order (left subtree, right subtree, node).
+     *
+     * Time Complexity: O(n) where n is the number of nodes.
+     */
+    void compact();
+
+    /**
+     * @return The node at the given index.
+     */
+    const AstNode& node(std::uint32_t index) const { return nodes[index]; }
+
+    /**
+     * @return The value of a Decimal node.
+     */
+    double decimal(std::uint32_t index) const { return decimals[nodes[index].value]; }
+
+    /**
+     * @return True if the tree contains a Decimal node.
+     */
+    bool hasDecimals() const { return !decimals.empty(); }
+
+    /**
+     * @return All nodes, in post-order.
+     */
+    const std::vector<AstNode>& allNodes() const { return nodes; }
+
+    /**
+     * @return The number of nodes in the arena.
+     */
+    std::size_t size() const { return nodes.size(); }
+
+    /**
+     * @return The index of the root node.
+     */
+    std::uint32_t root() const { return rootIndex; }
+
+    /**
+     * Sets the root node.
+     */
+    void setRoot(std::uint32_t index) { rootIndex = index; }
+
+    /**
+     * @return The variable names, indexed by slot.
+     */
+    const std::vector<std::string>& variables() const { return names; }
+
+    /**
+     * Returns the slot of a variable, adding it if it is new.
+     *
+     * @param name The variable name.
+     * @return The slot index.
+     *
+     * Time Complexity: O(v) where v is the number of variables.
+     */
+    std::int32_t slotFor(const std::string& name);
+
+    /**
+     * Replaces the variable table (used when compiling against a fixed layout).
+     */
+    void setVariables(const std::vector<std::string>& variables) { names = variables; }
+
+    /**
+     * @return True if the node always evaluates to 0 or 1.
+     */
+    bool isBoolean(std::uint32_t index) const;
+
+private:
+    /**
+     * Appends the simplest node equivalent to "op operand".
+     *
+     * @return The index of the resulting node (possibly an existing one).
+     */
+    std::uint32_t foldUnary(Op op, std::uint32_t operand, std::uint32_t offset);
+
+    /**
+     * Appends the simplest node equivalent to "lhs op rhs".
+     *
+     * @return The index of the resulting node (possibly an existing one).
+     */
+    std::uint32_t foldBinary(Op op, std::uint32_t lhs, std::uint32_t rhs, std::uint32_t offset);
+
+    /**
+     * Returns a node that is 1 when the given node is non-zero and 0 otherwise.
+     */
+    std::uint32_t toBoolean(std::uint32_t index, std::uint32_t offset);
+
+    /**
+     * @return True if the node is a constant with the given value.
+     */
+    bool isConstant(std::uint32_t index, std::int32_t value) const;
+
+    std::vector<AstNode> nodes;       // Post-order node arena
+    std::uint32_t rootIndex = 0;      // Index of the root node
+    std::vector<std::string> names;   // Variable names, indexed by slot
+    std::vector<double> decimals;     // Values of Decimal nodes
+};
+
+#endif // AST_H
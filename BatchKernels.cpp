@@ -0,0 +1,327 @@
+#include "BatchKernels.h"
+#include "Arithmetic.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define BATCH_HAVE_AVX2 1
+#endif
+
+namespace batch {
+
+namespace {
+
+// Applies f to every row; f is inlined so each instantiation is one plain loop
+template <typename F>
+inline void binaryLoop(const std::int32_t* a, const std::int32_t* b, std::int32_t* out,
+                       std::size_t n, F f) {
+    for (std::size_t i = 0; i < n; i++) {
+        out[i] = f(a[i], b[i]);
+    }
+}
+
+template <typename F>
+inline void unaryLoop(const std::int32_t* a, std::int32_t* out, std::size_t n, F f) {
+    for (std::size_t i = 0; i < n; i++) {
+        out[i] = f(a[i]);
+    }
+}
+
+// Returns the first row whose divisor is zero, or n
+inline std::size_t findZero(const std::int32_t* b, std::size_t n) {
+    for (std::size_t i = 0; i < n; i++) {
+        if (b[i] == 0) {
+            return i;
+        }
+    }
+    return n;
+}
+
+std::size_t applyBinaryScalar(OpCode op, const std::int32_t* a, const std::int32_t* b,
+                              std::int32_t* out, std::size_t n) {
+    using V = std::int32_t;
+
+    switch (op) {
+    case OpCode::Add:          binaryLoop(a, b, out, n, [](V x, V y) { return wrappingAdd(x, y); }); break;
+    case OpCode::Subtract:     binaryLoop(a, b, out, n, [](V x, V y) { return wrappingSubtract(x, y); }); break;
+    case OpCode::Multiply:     binaryLoop(a, b, out, n, [](V x, V y) { return wrappingMultiply(x, y); }); break;
+    case OpCode::Divide: {
+        std::size_t zero = findZero(b, n);
+        if (zero != n) {
+            return zero;
+        }
+        binaryLoop(a, b, out, n, [](V x, V y) { return wrappingDivide(x, y); });
+        break;
+    }
+    case OpCode::Modulo: {
+        std::size_t zero = findZero(b, n);
+        if (zero != n) {
+            return zero;
+        }
+        binaryLoop(a, b, out, n, [](V x, V y) { return wrappingModulo(x, y); });
+        break;
+    }
+    case OpCode::Power:        binaryLoop(a, b, out, n, [](V x, V y) { return integerPower(x, y); }); break;
+    case OpCode::Greater:      binaryLoop(a, b, out, n, [](V x, V y) { return V(x > y); }); break;
+    case OpCode::GreaterEqual: binaryLoop(a, b, out, n, [](V x, V y) { return V(x >= y); }); break;
+    case OpCode::Less:         binaryLoop(a, b, out, n, [](V x, V y) { return V(x < y); }); break;
+    case OpCode::LessEqual:    binaryLoop(a, b, out, n, [](V x, V y) { return V(x <= y); }); break;
+    case OpCode::Equal:        binaryLoop(a, b, out, n, [](V x, V y) { return V(x == y); }); break;
+    case OpCode::NotEqual:     binaryLoop(a, b, out, n, [](V x, V y) { return V(x != y); }); break;
+    // Bitwise forms of && and || so the loop has no branches
+    case OpCode::LogicalAnd:   binaryLoop(a, b, out, n, [](V x, V y) { return V((x != 0) & (y != 0)); }); break;
+    case OpCode::LogicalOr:    binaryLoop(a, b, out, n, [](V x, V y) { return V((x != 0) | (y != 0)); }); break;
+    default:
+        break;
+    }
+
+    return n;
+}
+
+void applyUnaryScalar(OpCode op, const std::int32_t* a, std::int32_t* out, std::size_t n) {
+    using V = std::int32_t;
+
+    switch (op) {
+    case OpCode::LogicalNot: unaryLoop(a, out, n, [](V x) { return V(x == 0); }); break;
+    case OpCode::Increment:  unaryLoop(a, out, n, [](V x) { return wrappingAdd(x, 1); }); break;
+    case OpCode::Decrement:  unaryLoop(a, out, n, [](V x) { return wrappingSubtract(x, 1); }); break;
+    case OpCode::Negate:     unaryLoop(a, out, n, [](V x) { return wrappingNegate(x); }); break;
+    case OpCode::Plus:       unaryLoop(a, out, n, [](V x) { return x; }); break;
+    case OpCode::ToBool:     unaryLoop(a, out, n, [](V x) { return V(x != 0); }); break;
+    default:
+        break;
+    }
+}
+
+#ifdef BATCH_HAVE_AVX2
+
+// Everything up to the matching pop is compiled for AVX2 (lambdas included) and
+// only ever called after CPUID has confirmed support
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+// Applies f to 8 rows at a time and finishes the tail with the scalar kernel
+template <typename F>
+inline void binaryLoopAvx2(OpCode op, const std::int32_t* a, const std::int32_t* b,
+                                       std::int32_t* out, std::size_t n, F f) {
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), f(x, y));
+    }
+    applyBinaryScalar(op, a + i, b + i, out + i, n - i);
+}
+
+template <typename F>
+inline void unaryLoopAvx2(OpCode op, const std::int32_t* a, std::int32_t* out,
+                                      std::size_t n, F f) {
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), f(x));
+    }
+    applyUnaryScalar(op, a + i, out + i, n - i);
+}
+
+// Returns the first row whose divisor is zero, or n, comparing 8 divisors per step
+std::size_t findZeroAvx2(const std::int32_t* b, std::size_t n) {
+    const __m256i zero = _mm256_setzero_si256();
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(y, zero)));
+        if (mask != 0) {
+            return i + __builtin_ctz(static_cast<unsigned>(mask));
+        }
+    }
+    std::size_t tail = findZero(b + i, n - i);
+    return i + tail;
+}
+
+// Truncating 32-bit division of 8 lanes. The quotient of two int32 values is
+// computed exactly enough in double precision that truncation gives the same
+// result as integer division.
+inline __m256i divideAvx2(__m256i x, __m256i y) {
+    __m256d lo = _mm256_div_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(x)),
+                               _mm256_cvtepi32_pd(_mm256_castsi256_si128(y)));
+    __m256d hi = _mm256_div_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(x, 1)),
+                               _mm256_cvtepi32_pd(_mm256_extracti128_si256(y, 1)));
+    return _mm256_set_m128i(_mm256_cvttpd_epi32(hi), _mm256_cvttpd_epi32(lo));
+}
+
+std::size_t applyBinaryAvx2(OpCode op, const std::int32_t* a, const std::int32_t* b,
+                                        std::int32_t* out, std::size_t n) {
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i zero = _mm256_setzero_si256();
+
+    switch (op) {
+    case OpCode::Add:
+        binaryLoopAvx2(op, a, b, out, n, [&](__m256i x, __m256i y) { return _mm256_add_epi32(x, y); });
+        break;
+    case OpCode::Subtract:
+        binaryLoopAvx2(op, a, b, out, n, [&](__m256i x, __m256i y) { return _mm256_sub_epi32(x, y); });
+        break;
+    case OpCode::Multiply:
+        binaryLoopAvx2(op, a, b, out, n, [&](__m256i x, __m256i y) { return _mm256_mullo_epi32(x, y); });
+        break;
+    case OpCode::Divide: {
+        std::size_t zeroRow = findZeroAvx2(b, n);
+        if (zeroRow != n) {
+            return zeroRow;
+        }
+        binaryLoopAvx2(op, a, b, out, n, [&](__m256i x, __m256i y) { return divideAvx2(x, y); });
+        break;
+    }
+    case OpCode::Modulo: {
+        std::size_t zeroRow = findZeroAvx2(b, n);
+        if (zeroRow != n) {
+            return zeroRow;
+        }
+        binaryLoopAvx2(op, a, b, out, n, [&](__m256i x, __m256i y) {
+            return _mm256_sub_epi32(x, _mm256_mullo_epi32(divideAvx2(x, y), y));
+        });
+        break;
+    }
+    // Comparisons produce all-ones lanes; masking with 1 turns them into 0/1 results
+    case OpCode::Greater:
+        binaryLoopAvx2(op, a, b, out, n, [&](__m256i x, __m256i y) {
+            return _mm256_and_si256(_mm256_cmpgt_epi32(x, y), one);
+        });
+        break;
+    case OpCode::GreaterEqual:
+        binaryLoopAvx2(op, a, b, out, n, [&](__m256i x, __m256i y) {
+            return _mm256_andnot_si256(_mm256_cmpgt_epi32(y, x), one);
+        });
+        break;
+    case OpCode::Less:
+        binaryLoopAvx2(op, a, b, out, n, [&](__m256i x, __m256i y) {
+            return _mm256_and_si256(_mm256_cmpgt_epi32(y, x), one);
+        });
+        break;
+    case OpCode::LessEqual:
+        binaryLoopAvx2(op, a, b, out, n, [&](__m256i x, __m256i y) {
+            return _mm256_andnot_si256(_mm256_cmpgt_epi32(x, y), one);
+        });
+        break;
+    case OpCode::Equal:
+        binaryLoopAvx2(op, a, b, out, n, [&](__m256i x, __m256i y) {
+            return _mm256_and_si256(_mm256_cmpeq_epi32(x, y), one);
+        });
+        break;
+    case OpCode::NotEqual:
+        binaryLoopAvx2(op, a, b, out, n, [&](__m256i x, __m256i y) {
+            return _mm256_andnot_si256(_mm256_cmpeq_epi32(x, y), one);
+        });
+        break;
+    case OpCode::LogicalAnd:
+        binaryLoopAvx2(op, a, b, out, n, [&](__m256i x, __m256i y) {
+            __m256i eitherZero = _mm256_or_si256(_mm256_cmpeq_epi32(x, zero), _mm256_cmpeq_epi32(y, zero));
+            return _mm256_andnot_si256(eitherZero, one);
+        });
+        break;
+    case OpCode::LogicalOr:
+        binaryLoopAvx2(op, a, b, out, n, [&](__m256i x, __m256i y) {
+            __m256i bothZero = _mm256_and_si256(_mm256_cmpeq_epi32(x, zero), _mm256_cmpeq_epi32(y, zero));
+            return _mm256_andnot_si256(bothZero, one);
+        });
+        break;
+    default:
+        // No vector form (e.g. '^'); use the scalar kernel
+        return applyBinaryScalar(op, a, b, out, n);
+    }
+
+    return n;
+}
+
+void applyUnaryAvx2(OpCode op, const std::int32_t* a, std::int32_t* out, std::size_t n) {
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i zero = _mm256_setzero_si256();
+
+    switch (op) {
+    case OpCode::LogicalNot:
+        unaryLoopAvx2(op, a, out, n, [&](__m256i x) { return _mm256_and_si256(_mm256_cmpeq_epi32(x, zero), one); });
+        break;
+    case OpCode::Increment:
+        unaryLoopAvx2(op, a, out, n, [&](__m256i x) { return _mm256_add_epi32(x, one); });
+        break;
+    case OpCode::Decrement:
+        unaryLoopAvx2(op, a, out, n, [&](__m256i x) { return _mm256_sub_epi32(x, one); });
+        break;
+    case OpCode::Negate:
+        unaryLoopAvx2(op, a, out, n, [&](__m256i x) { return _mm256_sub_epi32(zero, x); });
+        break;
+    case OpCode::ToBool:
+        unaryLoopAvx2(op, a, out, n, [&](__m256i x) { return _mm256_andnot_si256(_mm256_cmpeq_epi32(x, zero), one); });
+        break;
+    default:
+        applyUnaryScalar(op, a, out, n);
+        break;
+    }
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#endif // BATCH_HAVE_AVX2
+
+// The kernel set in use, chosen once from CPUID on first use
+struct KernelSet {
+    std::size_t (*binary)(OpCode, const std::int32_t*, const std::int32_t*, std::int32_t*, std::size_t);
+    void (*unary)(OpCode, const std::int32_t*, std::int32_t*, std::size_t);
+    const char* name;
+};
+
+const KernelSet kScalarKernels = {applyBinaryScalar, applyUnaryScalar, "scalar"};
+
+#ifdef BATCH_HAVE_AVX2
+const KernelSet kAvx2Kernels = {applyBinaryAvx2, applyUnaryAvx2, "avx2"};
+#endif
+
+const KernelSet* detectKernels() {
+#ifdef BATCH_HAVE_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return &kAvx2Kernels;
+    }
+#endif
+    return &kScalarKernels;
+}
+
+const KernelSet* bestKernels() {
+    static const KernelSet* best = detectKernels();
+    return best;
+}
+
+const KernelSet* activeKernels = bestKernels();
+
+} // namespace
+
+std::size_t applyBinary(OpCode op, const std::int32_t* a, const std::int32_t* b,
+                        std::int32_t* out, std::size_t n) {
+    return activeKernels->binary(op, a, b, out, n);
+}
+
+void applyUnary(OpCode op, const std::int32_t* a, std::int32_t* out, std::size_t n) {
+    activeKernels->unary(op, a, out, n);
+}
+
+bool simdAvailable() {
+    return bestKernels() != &kScalarKernels;
+}
+
+void setSimdEnabled(bool enabled) {
+    activeKernels = enabled ? bestKernels() : &kScalarKernels;
+}
+
+const char* kernelName() {
+    return activeKernels->name;
+}
+
+} // namespace batch
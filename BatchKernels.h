@@ -0,0 +1,65 @@
+#ifndef BATCH_KERNELS_H
+#define BATCH_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include "CompiledExpression.h"
+
+/**
+ * Block-at-a-time operator kernels used by CompiledExpression::evalBatch().
+ * Each kernel applies one operator to n rows. On CPUs with AVX2 (detected at
+ * runtime via CPUID) hand-written kernels process 8 rows per instruction;
+ * otherwise plain loops that the compiler can auto-vectorize are used.
+ * Output may alias either input.
+ */
+namespace batch {
+
+/**
+ * Applies a binary operator row by row: out[i] = a[i] op b[i].
+ *
+ * @param op The binary opcode to apply.
+ * @param a The left operands.
+ * @param b The right operands.
+ * @param out Receives the results.
+ * @param n Number of rows.
+ * @return The index of the first row with a zero divisor for Divide/Modulo,
+ *         or n if there is none (no results are defined in that case).
+ *
+ * Time Complexity: O(n).
+ */
+std::size_t applyBinary(OpCode op, const std::int32_t* a, const std::int32_t* b,
+                        std::int32_t* out, std::size_t n);
+
+/**
+ * Applies a unary operator row by row: out[i] = op a[i].
+ *
+ * @param op The unary opcode to apply.
+ * @param a The operands.
+ * @param out Receives the results.
+ * @param n Number of rows.
+ *
+ * Time Complexity: O(n).
+ */
+void applyUnary(OpCode op, const std::int32_t* a, std::int32_t* out, std::size_t n);
+
+/**
+ * @return True if this CPU supports the AVX2 kernels.
+ */
+bool simdAvailable();
+
+/**
+ * Switches between the best kernels for this CPU and the scalar fallback.
+ * Not thread-safe; intended for benchmarks and tests run before evaluating.
+ *
+ * @param enabled False to force the scalar kernels.
+ */
+void setSimdEnabled(bool enabled);
+
+/**
+ * @return The name of the kernel set in use ("avx2" or "scalar").
+ */
+const char* kernelName();
+
+} // namespace batch
+
+#endif // BATCH_KERNELS_H
@@ -0,0 +1,355 @@
+#include "BigInt.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+using Limbs = std::vector<std::uint32_t>;
+
+void trim(Limbs& x) {
+    while (!x.empty() && x.back() == 0) {
+        x.pop_back();
+    }
+}
+
+int compareMagnitude(const Limbs& a, const Limbs& b) {
+    if (a.size() != b.size()) {
+        return a.size() < b.size() ? -1 : 1;
+    }
+    for (std::size_t i = a.size(); i-- > 0;) {
+        if (a[i] != b[i]) {
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+Limbs addMagnitude(const Limbs& a, const Limbs& b) {
+    const Limbs& longer = a.size() >= b.size() ? a : b;
+    const Limbs& shorter = a.size() >= b.size() ? b : a;
+
+    Limbs result(longer.size() + 1);
+    std::uint64_t carry = 0;
+    for (std::size_t i = 0; i < longer.size(); i++) {
+        std::uint64_t sum = std::uint64_t(longer[i]) + (i < shorter.size() ? shorter[i] : 0) + carry;
+        result[i] = static_cast<std::uint32_t>(sum);
+        carry = sum >> 32;
+    }
+    result[longer.size()] = static_cast<std::uint32_t>(carry);
+    trim(result);
+    return result;
+}
+
+// |a| - |b|, where |a| >= |b|
+Limbs subtractMagnitude(const Limbs& a, const Limbs& b) {
+    Limbs result(a.size());
+    std::uint64_t borrow = 0;
+    for (std::size_t i = 0; i < a.size(); i++) {
+        std::uint64_t difference = std::uint64_t(a[i]) - (i < b.size() ? b[i] : 0) - borrow;
+        result[i] = static_cast<std::uint32_t>(difference);
+        borrow = difference >> 63;
+    }
+    trim(result);
+    return result;
+}
+
+Limbs multiplyMagnitude(const Limbs& a, const Limbs& b) {
+    if (a.empty() || b.empty()) {
+        return {};
+    }
+
+    // Schoolbook multiplication; a limb product plus two limbs always fits in 64 bits
+    Limbs result(a.size() + b.size());
+    for (std::size_t i = 0; i < a.size(); i++) {
+        std::uint64_t carry = 0;
+        for (std::size_t j = 0; j < b.size(); j++) {
+            std::uint64_t t = std::uint64_t(a[i]) * b[j] + result[i + j] + carry;
+            result[i + j] = static_cast<std::uint32_t>(t);
+            carry = t >> 32;
+        }
+        result[i + b.size()] = static_cast<std::uint32_t>(carry);
+    }
+    trim(result);
+    return result;
+}
+
+// Divides x by a single limb in place and returns the remainder
+std::uint32_t divideSmall(Limbs& x, std::uint32_t divisor) {
+    std::uint64_t remainder = 0;
+    for (std::size_t i = x.size(); i-- > 0;) {
+        std::uint64_t current = (remainder << 32) | x[i];
+        x[i] = static_cast<std::uint32_t>(current / divisor);
+        remainder = current % divisor;
+    }
+    trim(x);
+    return static_cast<std::uint32_t>(remainder);
+}
+
+// Multiplies x by a single limb and adds another, in place
+void multiplyAddSmall(Limbs& x, std::uint32_t factor, std::uint32_t addend) {
+    std::uint64_t carry = addend;
+    for (std::uint32_t& limb : x) {
+        std::uint64_t t = std::uint64_t(limb) * factor + carry;
+        limb = static_cast<std::uint32_t>(t);
+        carry = t >> 32;
+    }
+    if (carry) {
+        x.push_back(static_cast<std::uint32_t>(carry));
+    }
+}
+
+// Long division of magnitudes (Knuth, TAOCP vol. 2, algorithm D)
+void divideMagnitude(const Limbs& u, const Limbs& v, Limbs& quotient, Limbs& remainder) {
+    if (compareMagnitude(u, v) < 0) {
+        quotient.clear();
+        remainder = u;
+        return;
+    }
+    if (v.size() == 1) {
+        quotient = u;
+        std::uint32_t r = divideSmall(quotient, v[0]);
+        remainder = r ? Limbs{r} : Limbs{};
+        return;
+    }
+
+    // Normalize so the divisor's top limb has its high bit set; quotient digit
+    // estimates are then off by at most two
+    int shift = 0;
+    while (!((v.back() << shift) & 0x80000000u)) {
+        shift++;
+    }
+    auto shifted = [shift](const Limbs& x, std::size_t extra) {
+        Limbs result(x.size() + extra);
+        for (std::size_t i = 0; i < x.size(); i++) {
+            result[i] |= x[i] << shift;
+            if (shift && i + 1 < result.size()) {
+                result[i + 1] = x[i] >> (32 - shift);
+            }
+        }
+        return result;
+    };
+    Limbs vn = shifted(v, 0);
+    Limbs un = shifted(u, 1);
+
+    const std::size_t n = v.size();
+    const std::size_t m = u.size() - n;
+    const std::uint64_t base = std::uint64_t(1) << 32;
+    quotient.assign(m + 1, 0);
+
+    for (std::size_t j = m + 1; j-- > 0;) {
+        // Estimate the next quotient digit from the top two limbs
+        std::uint64_t numerator = (std::uint64_t(un[j + n]) << 32) | un[j + n - 1];
+        std::uint64_t qhat = numerator / vn[n - 1];
+        std::uint64_t rhat = numerator % vn[n - 1];
+        while (qhat >= base || qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2])) {
+            qhat--;
+            rhat += vn[n - 1];
+            if (rhat >= base) {
+                break;
+            }
+        }
+
+        // Multiply and subtract
+        std::uint64_t carry = 0;
+        std::uint64_t borrow = 0;
+        for (std::size_t i = 0; i < n; i++) {
+            std::uint64_t product = qhat * vn[i] + carry;
+            carry = product >> 32;
+            std::uint64_t difference = std::uint64_t(un[i + j]) - (product & 0xFFFFFFFFu) - borrow;
+            un[i + j] = static_cast<std::uint32_t>(difference);
+            borrow = difference >> 63;
+        }
+        std::uint64_t difference = std::uint64_t(un[j + n]) - carry - borrow;
+        un[j + n] = static_cast<std::uint32_t>(difference);
+
+        // The estimate was one too large: add the divisor back
+        if (difference >> 63) {
+            qhat--;
+            std::uint64_t sum = 0;
+            for (std::size_t i = 0; i < n; i++) {
+                sum = std::uint64_t(un[i + j]) + vn[i] + (sum >> 32);
+                un[i + j] = static_cast<std::uint32_t>(sum);
+            }
+            un[j + n] += static_cast<std::uint32_t>(sum >> 32);
+        }
+        quotient[j] = static_cast<std::uint32_t>(qhat);
+    }
+    trim(quotient);
+
+    // Undo the normalization on the remainder
+    remainder.assign(n, 0);
+    for (std::size_t i = 0; i < n; i++) {
+        remainder[i] = un[i] >> shift;
+        if (shift) {
+            remainder[i] |= un[i + 1] << (32 - shift);
+        }
+    }
+    trim(remainder);
+}
+
+} // namespace
+
+BigInt::BigInt(std::int64_t value) {
+    negative = value < 0;
+    std::uint64_t magnitude = negative ? 0 - static_cast<std::uint64_t>(value) : static_cast<std::uint64_t>(value);
+    while (magnitude) {
+        limbs.push_back(static_cast<std::uint32_t>(magnitude));
+        magnitude >>= 32;
+    }
+}
+
+BigInt BigInt::fromDecimal(std::string_view digits) {
+    // Nine digits at a time: 10^9 fits in one limb
+    BigInt result;
+    std::size_t i = 0;
+    while (i < digits.size()) {
+        std::size_t chunk = std::min<std::size_t>(9, digits.size() - i);
+        std::uint32_t value = 0;
+        std::uint32_t scale = 1;
+        for (std::size_t k = 0; k < chunk; k++) {
+            value = value * 10 + static_cast<std::uint32_t>(digits[i + k] - '0');
+            scale *= 10;
+        }
+        multiplyAddSmall(result.limbs, scale, value);
+        i += chunk;
+    }
+    trim(result.limbs);
+    return result;
+}
+
+std::string BigInt::toString() const {
+    if (limbs.empty()) {
+        return "0";
+    }
+
+    // Peel off nine decimal digits at a time, least significant first
+    Limbs magnitude = limbs;
+    std::vector<std::uint32_t> chunks;
+    while (!magnitude.empty()) {
+        chunks.push_back(divideSmall(magnitude, 1000000000u));
+    }
+
+    std::string text = negative ? "-" : "";
+    text += std::to_string(chunks.back());
+    for (std::size_t i = chunks.size() - 1; i-- > 0;) {
+        std::string part = std::to_string(chunks[i]);
+        text.append(9 - part.size(), '0');
+        text += part;
+    }
+    return text;
+}
+
+std::size_t BigInt::bitLength() const {
+    if (limbs.empty()) {
+        return 0;
+    }
+    std::size_t bits = (limbs.size() - 1) * 32;
+    for (std::uint32_t top = limbs.back(); top; top >>= 1) {
+        bits++;
+    }
+    return bits;
+}
+
+bool BigInt::fitsInt64() const {
+    if (limbs.size() <= 1) {
+        return true;
+    }
+    if (limbs.size() > 2) {
+        return false;
+    }
+    std::uint64_t magnitude = (std::uint64_t(limbs[1]) << 32) | limbs[0];
+    return magnitude <= (negative ? std::uint64_t(1) << 63 : (std::uint64_t(1) << 63) - 1);
+}
+
+std::int64_t BigInt::toInt64() const {
+    std::uint64_t magnitude = 0;
+    for (std::size_t i = std::min<std::size_t>(limbs.size(), 2); i-- > 0;) {
+        magnitude = (magnitude << 32) | limbs[i];
+    }
+    return static_cast<std::int64_t>(negative ? 0 - magnitude : magnitude);
+}
+
+int BigInt::compare(const BigInt& other) const {
+    if (negative != other.negative) {
+        return negative ? -1 : 1;
+    }
+    int magnitude = compareMagnitude(limbs, other.limbs);
+    return negative ? -magnitude : magnitude;
+}
+
+BigInt BigInt::pow(std::uint64_t exponent) const {
+    BigInt result(1);
+    BigInt square = *this;
+    while (exponent) {
+        if (exponent & 1) {
+            result *= square;
+        }
+        exponent >>= 1;
+        if (exponent) {
+            square *= square;
+        }
+    }
+    return result;
+}
+
+void BigInt::divide(const BigInt& dividend, const BigInt& divisor, BigInt& quotient, BigInt& remainder) {
+    if (divisor.isZero()) {
+        throw std::runtime_error("BigInt division by zero");
+    }
+    divideMagnitude(dividend.limbs, divisor.limbs, quotient.limbs, remainder.limbs);
+    quotient.negative = !quotient.limbs.empty() && dividend.negative != divisor.negative;
+    remainder.negative = !remainder.limbs.empty() && dividend.negative;
+}
+
+BigInt BigInt::operator-() const {
+    BigInt result = *this;
+    result.negative = !limbs.empty() && !negative;
+    return result;
+}
+
+void BigInt::addSigned(const BigInt& other, bool subtract) {
+    bool otherNegative = other.negative != subtract && !other.limbs.empty();
+    if (negative == otherNegative) {
+        limbs = addMagnitude(limbs, other.limbs);
+    }
+    else if (compareMagnitude(limbs, other.limbs) >= 0) {
+        limbs = subtractMagnitude(limbs, other.limbs);
+    }
+    else {
+        limbs = subtractMagnitude(other.limbs, limbs);
+        negative = otherNegative;
+    }
+    if (limbs.empty()) {
+        negative = false;
+    }
+}
+
+BigInt& BigInt::operator+=(const BigInt& other) {
+    addSigned(other, false);
+    return *this;
+}
+
+BigInt& BigInt::operator-=(const BigInt& other) {
+    addSigned(other, true);
+    return *this;
+}
+
+BigInt& BigInt::operator*=(const BigInt& other) {
+    limbs = multiplyMagnitude(limbs, other.limbs);
+    negative = !limbs.empty() && negative != other.negative;
+    return *this;
+}
+
+BigInt operator/(const BigInt& a, const BigInt& b) {
+    BigInt quotient;
+    BigInt remainder;
+    BigInt::divide(a, b, quotient, remainder);
+    return quotient;
+}
+
+BigInt operator%(const BigInt& a, const BigInt& b) {
+    BigInt quotient;
+    BigInt remainder;
+    BigInt::divide(a, b, quotient, remainder);
+    return remainder;
+}
@@ -0,0 +1,132 @@
+#ifndef BIG_INT_H
+#define BIG_INT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * An arbitrary-precision signed integer.
+ *
+ * The magnitude is stored as little-endian 32-bit limbs with no leading zero
+ * limbs, plus a sign flag; zero has no limbs and is never negative. Division
+ * truncates toward zero and the remainder takes the sign of the dividend, as
+ * for the built-in integer types.
+ */
+class BigInt {
+public:
+    /**
+     * Creates zero.
+     */
+    BigInt() = default;
+
+    /**
+     * @param value The initial value.
+     */
+    BigInt(std::int64_t value);
+
+    /**
+     * Parses a non-negative decimal number.
+     *
+     * @param digits One or more characters '0'-'9'.
+     * @return The value.
+     *
+     * Time Complexity: O(d^2) where d is the number of digits.
+     */
+    static BigInt fromDecimal(std::string_view digits);
+
+    /**
+     * @return The value in decimal, with a leading '-' if negative.
+     *
+     * Time Complexity: O(k^2) where k is the number of limbs.
+     */
+    std::string toString() const;
+
+    bool isZero() const { return limbs.empty(); }
+    bool isNegative() const { return negative; }
+
+    /**
+     * @return True if the value is odd.
+     */
+    bool isOdd() const { return !limbs.empty() && (limbs[0] & 1); }
+
+    /**
+     * @return The number of bits in the magnitude (0 for zero).
+     */
+    std::size_t bitLength() const;
+
+    /**
+     * @return True if the value fits in a std::int64_t.
+     */
+    bool fitsInt64() const;
+
+    /**
+     * @return The value; only meaningful if fitsInt64().
+     */
+    std::int64_t toInt64() const;
+
+    /**
+     * @return A negative number, zero or a positive number as this value is
+     *         less than, equal to or greater than the other.
+     *
+     * Time Complexity: O(k) where k is the number of limbs.
+     */
+    int compare(const BigInt& other) const;
+
+    /**
+     * Raises the value to a power by repeated squaring.
+     *
+     * @param exponent The exponent.
+     * @return value^exponent (1 for exponent 0).
+     *
+     * Time Complexity: O(M(n) log e) where M(n) is the cost of multiplying
+     * numbers the size of the result.
+     */
+    BigInt pow(std::uint64_t exponent) const;
+
+    /**
+     * Computes the truncated quotient and the remainder in one pass.
+     *
+     * @param dividend The dividend.
+     * @param divisor The divisor; must not be zero.
+     * @param quotient Receives dividend / divisor.
+     * @param remainder Receives dividend % divisor.
+     *
+     * Time Complexity: O(k * m) for a k-limb dividend and an m-limb divisor.
+     */
+    static void divide(const BigInt& dividend, const BigInt& divisor, BigInt& quotient, BigInt& remainder);
+
+    BigInt operator-() const;
+    BigInt& operator+=(const BigInt& other);
+    BigInt& operator-=(const BigInt& other);
+    BigInt& operator*=(const BigInt& other);
+
+    friend BigInt operator+(BigInt a, const BigInt& b) { return a += b; }
+    friend BigInt operator-(BigInt a, const BigInt& b) { return a -= b; }
+    friend BigInt operator*(BigInt a, const BigInt& b) { return a *= b; }
+    friend BigInt operator/(const BigInt& a, const BigInt& b);
+    friend BigInt operator%(const BigInt& a, const BigInt& b);
+
+    friend bool operator==(const BigInt& a, const BigInt& b) { return a.negative == b.negative && a.limbs == b.limbs; }
+    friend bool operator!=(const BigInt& a, const BigInt& b) { return !(a == b); }
+    friend bool operator<(const BigInt& a, const BigInt& b) { return a.compare(b) < 0; }
+    friend bool operator<=(const BigInt& a, const BigInt& b) { return a.compare(b) <= 0; }
+    friend bool operator>(const BigInt& a, const BigInt& b) { return a.compare(b) > 0; }
+    friend bool operator>=(const BigInt& a, const BigInt& b) { return a.compare(b) >= 0; }
+
+    friend std::ostream& operator<<(std::ostream& out, const BigInt& value) { return out << value.toString(); }
+
+private:
+    /**
+     * Adds (subtract = false) or subtracts other, handling all sign combinations.
+     */
+    void addSigned(const BigInt& other, bool subtract);
+
+    std::vector<std::uint32_t> limbs;   // Magnitude, least significant limb first
+    bool negative = false;
+};
+
+#endif // BIG_INT_H
@@ -0,0 +1,369 @@
+#include "CompiledExpression.h"
+#include "Arithmetic.h"
+#include "BatchKernels.h"
+#include "Jit.h"
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+int executeProgram(const Instruction* code, std::size_t count, const int* slots, int* stack) {
+    int* top = stack - 1;  // Points at the current top of the value stack
+
+    for (std::size_t pc = 0; pc < count; pc++) {
+        const Instruction& ins = code[pc];
+
+        switch (ins.op) {
+        case OpCode::PushConst:
+            *++top = ins.operand;
+            break;
+        case OpCode::PushVar:
+            *++top = slots[ins.operand];
+            break;
+
+        // Binary operators: the right operand is on top, the left one below it
+        case OpCode::Add:          top[-1] = wrappingAdd(top[-1], top[0]); --top; break;
+        case OpCode::Subtract:     top[-1] = wrappingSubtract(top[-1], top[0]); --top; break;
+        case OpCode::Multiply:     top[-1] = wrappingMultiply(top[-1], top[0]); --top; break;
+        case OpCode::Divide:
+            if (top[0] == 0) {
+                throw std::runtime_error("Division by zero @ char " + std::to_string(ins.offset));
+            }
+            top[-1] = wrappingDivide(top[-1], top[0]);
+            --top;
+            break;
+        case OpCode::Modulo:
+            if (top[0] == 0) {
+                throw std::runtime_error("Modulo by zero @ char " + std::to_string(ins.offset));
+            }
+            top[-1] = wrappingModulo(top[-1], top[0]);
+            --top;
+            break;
+        case OpCode::Power:        top[-1] = integerPower(top[-1], top[0]); --top; break;
+        case OpCode::Greater:      top[-1] = top[-1] > top[0]; --top; break;
+        case OpCode::GreaterEqual: top[-1] = top[-1] >= top[0]; --top; break;
+        case OpCode::Less:         top[-1] = top[-1] < top[0]; --top; break;
+        case OpCode::LessEqual:    top[-1] = top[-1] <= top[0]; --top; break;
+        case OpCode::Equal:        top[-1] = top[-1] == top[0]; --top; break;
+        case OpCode::NotEqual:     top[-1] = top[-1] != top[0]; --top; break;
+        case OpCode::LogicalAnd:   top[-1] = top[-1] && top[0]; --top; break;
+        case OpCode::LogicalOr:    top[-1] = top[-1] || top[0]; --top; break;
+
+        // Unary operators work in place on the top of the stack
+        case OpCode::LogicalNot:   top[0] = !top[0]; break;
+        case OpCode::Increment:    top[0] = wrappingAdd(top[0], 1); break;
+        case OpCode::Decrement:    top[0] = wrappingSubtract(top[0], 1); break;
+        case OpCode::Negate:       top[0] = wrappingNegate(top[0]); break;
+        case OpCode::Plus:         break;
+        case OpCode::ToBool:       top[0] = top[0] != 0; break;
+
+        // Short-circuit jumps: the left operand of && / || decides the result
+        case OpCode::JumpIfZero:
+            if (top[0] == 0) {
+                pc = static_cast<std::size_t>(ins.operand) - 1;
+            }
+            else {
+                --top;
+            }
+            break;
+        case OpCode::JumpIfNonZero:
+            if (top[0] != 0) {
+                top[0] = 1;
+                pc = static_cast<std::size_t>(ins.operand) - 1;
+            }
+            else {
+                --top;
+            }
+            break;
+        }
+    }
+
+    return *top;
+}
+
+int applyBinaryOpCode(OpCode op, int a, int b) {
+    switch (op) {
+    case OpCode::Add:          return wrappingAdd(a, b);
+    case OpCode::Subtract:     return wrappingSubtract(a, b);
+    case OpCode::Multiply:     return wrappingMultiply(a, b);
+    case OpCode::Divide:       return wrappingDivide(a, b);
+    case OpCode::Modulo:       return wrappingModulo(a, b);
+    case OpCode::Power:        return integerPower(a, b);
+    case OpCode::Greater:      return a > b;
+    case OpCode::GreaterEqual: return a >= b;
+    case OpCode::Less:         return a < b;
+    case OpCode::LessEqual:    return a <= b;
+    case OpCode::Equal:        return a == b;
+    case OpCode::NotEqual:     return a != b;
+    case OpCode::LogicalAnd:   return a && b;
+    case OpCode::LogicalOr:    return a || b;
+    default:
+        throw std::runtime_error("Not a binary opcode");
+    }
+}
+
+int applyUnaryOpCode(OpCode op, int a) {
+    switch (op) {
+    case OpCode::LogicalNot:   return !a;
+    case OpCode::Increment:    return wrappingAdd(a, 1);
+    case OpCode::Decrement:    return wrappingSubtract(a, 1);
+    case OpCode::Negate:       return wrappingNegate(a);
+    case OpCode::Plus:         return a;
+    case OpCode::ToBool:       return a != 0;
+    default:
+        throw std::runtime_error("Not a unary opcode");
+    }
+}
+
+int CompiledExpression::evaluate() const {
+    if (!names.empty()) {
+        throw std::runtime_error("Expression uses " + std::to_string(names.size()) +
+                                 " variable(s); pass their values to evaluate()");
+    }
+    return evaluate(static_cast<const int*>(nullptr));
+}
+
+CompiledExpression::NativeTier::NativeTier() = default;
+
+CompiledExpression::NativeTier::NativeTier(const NativeTier&) {}
+
+CompiledExpression::NativeTier& CompiledExpression::NativeTier::operator=(const NativeTier&) {
+    // The assigned-to program changes, so its native code no longer applies
+    function.store(nullptr);
+    evaluations = 0;
+    settled = false;
+    code.reset();
+    return *this;
+}
+
+CompiledExpression::NativeTier::~NativeTier() = default;
+
+void CompiledExpression::countEvaluation() const {
+    if (native.settled.load(std::memory_order_relaxed) || !jit::enabled()) {
+        return;
+    }
+
+    if (native.evaluations.fetch_add(1, std::memory_order_relaxed) + 1 < jit::threshold()) {
+        return;
+    }
+
+    // Exactly one caller wins the flag and compiles; the others keep interpreting meanwhile
+    bool expected = false;
+    if (native.settled.compare_exchange_strong(expected, true)) {
+        native.code = jit::Code::compile(code, stackDepth);
+        if (native.code) {
+            native.function.store(native.code->function(), std::memory_order_release);
+        }
+    }
+}
+
+void CompiledExpression::throwDivisionError(std::size_t pc) const {
+    throw std::runtime_error(std::string(code[pc].op == OpCode::Divide ? "Division" : "Modulo") +
+                             " by zero @ char " + std::to_string(code[pc].offset));
+}
+
+int CompiledExpression::evaluate(const int* slots) const {
+    if (NativeFunction function = native.function.load(std::memory_order_acquire)) {
+        std::int32_t failedAt = -1;
+        int result = function(slots, &failedAt);
+        if (failedAt >= 0) {
+            throwDivisionError(static_cast<std::size_t>(failedAt));
+        }
+        return result;
+    }
+    countEvaluation();
+
+    if (stackDepth <= kInlineStackSize) {
+        int stack[kInlineStackSize];
+        return executeProgram(code.data(), code.size(), slots, stack);
+    }
+
+    // Very deep expressions: fall back to a heap-allocated stack
+    std::vector<int> stack(stackDepth);
+    return executeProgram(code.data(), code.size(), slots, stack.data());
+}
+
+int CompiledExpression::evaluate(const std::vector<int>& slots) const {
+    if (slots.size() < names.size()) {
+        throw std::runtime_error("Expected " + std::to_string(names.size()) + " variable value(s), got " +
+                                 std::to_string(slots.size()));
+    }
+    return evaluate(slots.data());
+}
+
+void CompiledExpression::evalBatch(const std::int32_t* const* columns, std::size_t rows, std::int32_t* out,
+                                   BatchStats* stats) const {
+    evalBatchRange(columns, 0, rows, out, stats);
+}
+
+void CompiledExpression::evalBatchRange(const std::int32_t* const* columns, std::size_t begin, std::size_t end,
+                                        std::int32_t* out, BatchStats* stats) const {
+    const std::size_t block = kBatchBlockSize;
+
+    // One scratch block per stack position, plus one pre-filled block per constant
+    std::vector<std::int32_t> scratch(stackDepth * block);
+    std::vector<std::int32_t> constants;
+    std::vector<std::size_t> constantIndex(code.size());
+    std::size_t jumps = 0;
+    for (std::size_t pc = 0; pc < code.size(); pc++) {
+        if (code[pc].op == OpCode::PushConst) {
+            constantIndex[pc] = constants.size();
+            constants.insert(constants.end(), block, code[pc].operand);
+        }
+        else if (code[pc].op == OpCode::JumpIfZero || code[pc].op == OpCode::JumpIfNonZero) {
+            jumps++;
+        }
+    }
+
+    // Each stack entry points at a block of values: a column slice, a constant
+    // block, or the scratch block owned by that stack position
+    std::vector<const std::int32_t*> stack(stackDepth);
+
+    // A && / || whose right operand is being evaluated for part of the block.
+    // 'mask' marks the rows that still need the right operand; rows outside
+    // it must not raise errors, because per row they never evaluate it.
+    struct ShortCircuit {
+        std::size_t target;     // Instruction index where the operator completes
+        OpCode jump;            // JumpIfZero (&&) or JumpIfNonZero (||)
+        std::int32_t* left;     // Copy of the left operand block
+        std::int32_t* mask;     // Active rows (0/1) inside the right operand
+    };
+    std::vector<ShortCircuit> pending(jumps);
+    std::vector<std::int32_t> leftBlocks(jumps * block), maskBlocks(jumps * block), divisors(block);
+
+    for (std::size_t start = begin; start < end; start += block) {
+        std::size_t n = std::min(block, end - start);
+        std::size_t top = 0;              // Number of entries on the stack
+        std::size_t levels = 0;           // Number of open short-circuits
+        const std::int32_t* active = nullptr;  // Rows that are evaluated, or null for all
+
+        if (stats) {
+            stats->blocks++;
+        }
+
+        for (std::size_t pc = 0; pc <= code.size(); pc++) {
+            // Complete the && / || operators whose right operand ends here
+            while (levels > 0 && pending[levels - 1].target == pc) {
+                const ShortCircuit& sc = pending[--levels];
+                std::int32_t* result = scratch.data() + block * (top - 1);
+                batch::applyBinary(sc.jump == OpCode::JumpIfZero ? OpCode::LogicalAnd : OpCode::LogicalOr,
+                                   sc.left, stack[top - 1], result, n);
+                stack[top - 1] = result;
+                active = levels > 0 ? pending[levels - 1].mask : nullptr;
+            }
+            if (pc == code.size()) {
+                break;
+            }
+
+            const Instruction& ins = code[pc];
+            switch (ins.op) {
+            case OpCode::PushConst:
+                stack[top++] = constants.data() + constantIndex[pc];
+                break;
+            case OpCode::PushVar:
+                stack[top++] = columns[ins.operand] + start;
+                break;
+            case OpCode::JumpIfZero:
+            case OpCode::JumpIfNonZero: {
+                const std::int32_t* left = stack[top - 1];
+                bool isAnd = ins.op == OpCode::JumpIfZero;
+
+                // Rows that still need the right operand: left != 0 for &&, left == 0 for ||
+                ShortCircuit& sc = pending[levels];
+                sc.target = static_cast<std::size_t>(ins.operand);
+                sc.jump = ins.op;
+                sc.left = leftBlocks.data() + block * levels;
+                sc.mask = maskBlocks.data() + block * levels;
+                batch::applyUnary(isAnd ? OpCode::ToBool : OpCode::LogicalNot, left, sc.mask, n);
+                if (active) {
+                    batch::applyBinary(OpCode::LogicalAnd, active, sc.mask, sc.mask, n);
+                }
+
+                std::size_t needed = 0;
+                for (std::size_t i = 0; i < n; i++) {
+                    needed += static_cast<std::size_t>(sc.mask[i]);
+                }
+                if (stats) {
+                    std::size_t reaching = n;
+                    if (active) {
+                        reaching = 0;
+                        for (std::size_t i = 0; i < n; i++) {
+                            reaching += static_cast<std::size_t>(active[i]);
+                        }
+                    }
+                    stats->shortCircuitChecks++;
+                    stats->shortCircuitSkips += needed == 0;
+                    stats->rowsChecked += reaching;
+                    stats->rowsSkipped += reaching - needed;
+                }
+
+                if (needed == 0) {
+                    // The left operand decides every active row: skip the right operand
+                    if (!isAnd) {
+                        std::int32_t* result = scratch.data() + block * (top - 1);
+                        batch::applyUnary(OpCode::ToBool, left, result, n);
+                        stack[top - 1] = result;
+                    }
+                    pc = sc.target - 1;
+                    break;
+                }
+
+                std::copy(left, left + n, sc.left);
+                --top;
+                levels++;
+                active = sc.mask;
+                break;
+            }
+            case OpCode::LogicalNot:
+            case OpCode::Increment:
+            case OpCode::Decrement:
+            case OpCode::Negate:
+            case OpCode::Plus:
+            case OpCode::ToBool: {
+                std::int32_t* result = scratch.data() + block * (top - 1);
+                batch::applyUnary(ins.op, stack[top - 1], result, n);
+                stack[top - 1] = result;
+                break;
+            }
+            default: {
+                std::int32_t* result = scratch.data() + block * (top - 2);
+                const std::int32_t* rhs = stack[top - 1];
+                std::size_t zero = batch::applyBinary(ins.op, stack[top - 2], rhs, result, n);
+
+                if (zero != n && active) {
+                    // Only rows that actually evaluate this operator may fail;
+                    // give the others a harmless divisor and try again
+                    zero = n;
+                    for (std::size_t i = 0; i < n; i++) {
+                        if (rhs[i] == 0 && active[i]) {
+                            zero = i;
+                            break;
+                        }
+                        divisors[i] = rhs[i] == 0 ? 1 : rhs[i];
+                    }
+                    if (zero == n) {
+                        zero = batch::applyBinary(ins.op, stack[top - 2], divisors.data(), result, n);
+                    }
+                }
+                if (zero != n) {
+                    throw std::runtime_error(std::string(ins.op == OpCode::Divide ? "Division" : "Modulo") +
+                                             " by zero @ char " + std::to_string(ins.offset) +
+                                             " (row " + std::to_string(start + zero) + ")");
+                }
+                stack[--top - 1] = result;
+                break;
+            }
+            }
+        }
+
+        std::copy(stack[0], stack[0] + n, out + start);
+    }
+}
+
+int CompiledExpression::slotOf(const std::string& name) const {
+    for (size_t i = 0; i < names.size(); i++) {
+        if (names[i] == name) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
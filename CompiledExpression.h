@@ -0,0 +1,295 @@
+#ifndef COMPILED_EXPRESSION_H
+#define COMPILED_EXPRESSION_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Opcodes understood by the bytecode interpreter.
+ * Every operator supported by Evaluator::performOperation has exactly one opcode,
+ * so the interpreter can dispatch with a switch instead of comparing strings.
+ */
+enum class OpCode : std::uint8_t {
+    PushConst,      // Push the instruction operand onto the value stack
+    PushVar,        // Push the value of variable slot <operand>
+
+    // Binary operators (pop right, pop left, push result)
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Modulo,
+    Power,
+    Greater,
+    GreaterEqual,
+    Less,
+    LessEqual,
+    Equal,
+    NotEqual,
+    LogicalAnd,
+    LogicalOr,
+
+    // Unary operators (pop operand, push result)
+    LogicalNot,
+    Increment,
+    Decrement,
+    Negate,
+    Plus,           // Unary plus; the optimizer removes it, but unoptimized programs keep it
+    ToBool,         // Replace the top value with 1 if it is non-zero, else 0
+
+    // Short-circuit jumps; operand is the target instruction index
+    JumpIfZero,     // If top == 0 keep it as the result and jump, else pop it (&&)
+    JumpIfNonZero   // If top != 0 replace it with 1 and jump, else pop it (||)
+};
+
+/**
+ * A single bytecode instruction.
+ * Instructions are stored in one contiguous array and executed in order.
+ */
+struct Instruction {
+    OpCode op;              // What to do
+    std::int32_t operand;   // Constant for PushConst, slot for PushVar, target for jumps, unused otherwise
+    std::uint32_t offset;   // Position of the operator in the expression (for error messages)
+};
+
+/**
+ * Counters filled in by CompiledExpression::evalBatch() when requested.
+ */
+struct BatchStats {
+    std::size_t blocks = 0;               // Blocks of rows processed
+    std::size_t shortCircuitChecks = 0;   // && / || jumps reached, summed over blocks
+    std::size_t shortCircuitSkips = 0;    // ... of which skipped their right operand for the whole block
+    std::size_t rowsChecked = 0;          // Rows reaching a && / || jump, summed over jumps
+    std::size_t rowsSkipped = 0;          // ... of which did not need the right operand
+};
+
+/**
+ * Signature of a program translated to machine code by the JIT (see Jit.h).
+ * On division or modulo by zero it stores the failing instruction's index in
+ * *failedAt and returns 0.
+ */
+using NativeFunction = int (*)(const int* slots, std::int32_t* failedAt);
+
+namespace jit {
+class Code;
+}
+
+/**
+ * A compiled, immutable postfix program produced by Evaluator::compile().
+ * Parsing and validation happen once at compile time; evaluate() then runs a
+ * tight interpreter loop with no string handling and no map lookups.
+ */
+class CompiledExpression {
+public:
+    /**
+     * Number of value stack slots evaluate() keeps on the native stack.
+     * Programs that need more fall back to a heap-allocated stack.
+     */
+    static constexpr std::size_t kInlineStackSize = 64;
+
+    /**
+     * Number of rows evalBatch() processes per operator pass.
+     * Small enough that every intermediate block stays in L1/L2 cache.
+     */
+    static constexpr std::size_t kBatchBlockSize = 1024;
+
+    CompiledExpression() = default;
+
+    /**
+     * Executes a program that has no variables and returns the result.
+     * Performs no heap allocation unless maxStackDepth() exceeds kInlineStackSize.
+     *
+     * @return The result of the expression evaluation.
+     * @throws std::runtime_error on division or modulo by zero, or if the
+     *         expression uses variables.
+     *
+     * Time Complexity: O(k) where k is the number of instructions.
+     */
+    int evaluate() const;
+
+    /**
+     * Executes the program with variable slot i bound to slots[i].
+     * Performs no heap allocation unless maxStackDepth() exceeds kInlineStackSize.
+     * After jit::threshold() calls the program is translated to native code
+     * (where supported), and later calls run that instead of the interpreter.
+     *
+     * @param slots The variable values, at least variableCount() of them.
+     * @return The result of the expression evaluation.
+     * @throws std::runtime_error on division or modulo by zero.
+     *
+     * Time Complexity: O(k) where k is the number of instructions.
+     */
+    int evaluate(const int* slots) const;
+
+    /**
+     * Executes the program with variable slot i bound to slots[i].
+     *
+     * @param slots The variable values.
+     * @return The result of the expression evaluation.
+     * @throws std::runtime_error if fewer than variableCount() values are given,
+     *         or on division or modulo by zero.
+     *
+     * Time Complexity: O(k) where k is the number of instructions.
+     */
+    int evaluate(const std::vector<int>& slots) const;
+
+    /**
+     * Evaluates the program over many records stored column by column
+     * (structure of arrays). Each operator is applied to a whole block of rows
+     * before moving to the next instruction, so the per-instruction dispatch
+     * cost is paid once per block instead of once per row.
+     *
+     * && and || keep their short-circuit meaning per row: a block skips the
+     * right operand entirely when the left operand decides every row, and
+     * otherwise rows whose result is already decided cannot raise errors
+     * from the right operand.
+     *
+     * @param columns columns[s] points at the values of variable slot s for every row.
+     * @param rows Number of records.
+     * @param out Receives the result for every row.
+     * @param stats If not null, receives short-circuit counters for this call.
+     * @throws std::runtime_error on division or modulo by zero, naming the first failing row.
+     *
+     * Time Complexity: O(k * rows) where k is the number of instructions.
+     */
+    void evalBatch(const std::int32_t* const* columns, std::size_t rows, std::int32_t* out,
+                   BatchStats* stats = nullptr) const;
+
+    /**
+     * Evaluates rows [begin, end) of a columnar input, exactly like evalBatch()
+     * over that slice. Columns and output are indexed with absolute row numbers
+     * and errors name the absolute row, so disjoint ranges can be evaluated
+     * concurrently into one output array.
+     *
+     * @param columns columns[s] points at the values of variable slot s for every row.
+     * @param begin First row to evaluate.
+     * @param end One past the last row to evaluate.
+     * @param out Receives the result for rows [begin, end) at out[begin, end).
+     * @param stats If not null, receives short-circuit counters for this call.
+     * @throws std::runtime_error on division or modulo by zero, naming the first failing row.
+     *
+     * Time Complexity: O(k * (end - begin)) where k is the number of instructions.
+     */
+    void evalBatchRange(const std::int32_t* const* columns, std::size_t begin, std::size_t end,
+                        std::int32_t* out, BatchStats* stats = nullptr) const;
+
+    /**
+     * Looks up the slot a variable is bound to.
+     *
+     * @param name The variable name.
+     * @return The slot index, or -1 if the expression has no such variable.
+     *
+     * Time Complexity: O(v) where v is the number of variables.
+     */
+    int slotOf(const std::string& name) const;
+
+    /**
+     * @return The variable names, in slot order.
+     */
+    const std::vector<std::string>& variables() const { return names; }
+
+    /**
+     * @return The number of variable slots the program reads.
+     */
+    std::size_t variableCount() const { return names.size(); }
+
+    /**
+     * @return The instruction stream of the program.
+     */
+    const std::vector<Instruction>& instructions() const { return code; }
+
+    /**
+     * @return The maximum number of values live on the stack during evaluation.
+     */
+    std::size_t maxStackDepth() const { return stackDepth; }
+
+    /**
+     * @return The expression text this program was compiled from.
+     */
+    const std::string& source() const { return text; }
+
+    /**
+     * @return True once evaluate() runs native code instead of the interpreter.
+     */
+    bool isNative() const { return native.function.load(std::memory_order_acquire) != nullptr; }
+
+private:
+    friend class Evaluator;
+    friend class ProgramView;     // Rebuilds programs from a ProgramFile
+
+    // Evaluation counter and the machine code it leads to. Promotion happens
+    // at most once, by the thread whose call reaches the threshold; copies of
+    // a program start cold again.
+    struct NativeTier {
+        NativeTier();
+        NativeTier(const NativeTier&);
+        NativeTier& operator=(const NativeTier&);
+        ~NativeTier();
+
+        std::atomic<NativeFunction> function{nullptr};  // Published after 'code' is set
+        std::atomic<std::uint32_t> evaluations{0};
+        std::atomic<bool> settled{false};               // Promotion started (it is attempted once)
+        std::unique_ptr<jit::Code> code;
+    };
+
+    /**
+     * Counts an interpreted evaluation and promotes the program to native
+     * code when the count reaches jit::threshold().
+     */
+    void countEvaluation() const;
+
+    /**
+     * Throws the interpreter's division or modulo error for an instruction.
+     */
+    [[noreturn]] void throwDivisionError(std::size_t pc) const;
+
+    std::vector<Instruction> code;   // Postfix instruction stream
+    std::size_t stackDepth = 0;      // Required value stack size
+    std::vector<std::string> names;  // Variable names, indexed by slot
+    std::string text;                // Original expression
+    mutable NativeTier native;       // JIT state
+};
+
+/**
+ * Applies a binary opcode exactly as the interpreter does.
+ * The caller must rule out division and modulo by zero.
+ *
+ * @param op A binary opcode.
+ * @param a The left operand.
+ * @param b The right operand.
+ * @return The result.
+ *
+ * Time Complexity: O(1).
+ */
+int applyBinaryOpCode(OpCode op, int a, int b);
+
+/**
+ * Applies a unary opcode exactly as the interpreter does.
+ *
+ * @param op A unary opcode.
+ * @param a The operand.
+ * @return The result.
+ *
+ * Time Complexity: O(1).
+ */
+int applyUnaryOpCode(OpCode op, int a);
+
+/**
+ * Runs a postfix program on a caller-provided value stack.
+ *
+ * @param code Pointer to the first instruction.
+ * @param count Number of instructions.
+ * @param slots Variable values, indexed by slot (may be null if the program has no variables).
+ * @param stack Scratch space with room for at least the program's max stack depth.
+ * @return The value left on top of the stack.
+ * @throws std::runtime_error on division or modulo by zero.
+ *
+ * Time Complexity: O(count).
+ */
+int executeProgram(const Instruction* code, std::size_t count, const int* slots, int* stack);
+
+#endif // COMPILED_EXPRESSION_H
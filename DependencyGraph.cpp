@@ -0,0 +1,233 @@
+#include "DependencyGraph.h"
+#include <algorithm>
+#include <stdexcept>
+
+DependencyGraph::DependencyGraph(const Evaluator& compiler) : compiler(compiler) {}
+
+std::uint32_t DependencyGraph::nodeFor(const std::string& name) {
+    auto it = ids.find(name);
+    if (it != ids.end()) {
+        return it->second;
+    }
+    std::uint32_t id = static_cast<std::uint32_t>(nodes.size());
+    nodes.emplace_back();
+    nodes.back().name = name;
+    ids.emplace(name, id);
+    return id;
+}
+
+void DependencyGraph::define(const std::string& name, const std::string& expression) {
+    auto program = std::make_shared<const CompiledExpression>(compiler.compile(expression));
+    const std::vector<std::string>& names = program->variables();
+
+    // A cycle needs an operand that already depends on the name (or is the name)
+    auto existing = ids.find(name);
+    if (std::find(names.begin(), names.end(), name) != names.end()) {
+        throw std::runtime_error("Circular reference: " + name + " would depend on itself");
+    }
+    if (existing != ids.end() && !nodes[existing->second].dependents.empty()) {
+        visited.assign(nodes.size(), false);
+        std::vector<std::uint32_t>& stack = order;
+        stack.assign(1, existing->second);
+        while (!stack.empty()) {
+            std::uint32_t id = stack.back();
+            stack.pop_back();
+            for (std::uint32_t dependent : nodes[id].dependents) {
+                if (!visited[dependent]) {
+                    visited[dependent] = true;
+                    stack.push_back(dependent);
+                }
+            }
+        }
+        for (const std::string& operand : names) {
+            auto it = ids.find(operand);
+            if (it != ids.end() && visited[it->second]) {
+                throw std::runtime_error("Circular reference: " + name + " would depend on itself through " + operand);
+            }
+        }
+    }
+
+    std::uint32_t id = nodeFor(name);
+    std::vector<std::uint32_t> operands;
+    for (const std::string& operand : names) {
+        operands.push_back(nodeFor(operand));
+    }
+
+    // Unlink the previous definition before linking the new one
+    for (std::uint32_t old : nodes[id].operands) {
+        std::vector<std::uint32_t>& dependents = nodes[old].dependents;
+        dependents.erase(std::find(dependents.begin(), dependents.end(), id));
+    }
+    for (std::uint32_t operand : operands) {
+        nodes[operand].dependents.push_back(id);
+    }
+
+    Node& node = nodes[id];
+    node.formula = true;
+    node.program = std::move(program);
+    node.operands = std::move(operands);
+    node.hasValue = false;
+    node.error.clear();
+    node.stale = true;
+    invalidate(id);
+}
+
+void DependencyGraph::set(const std::string& name, int value) {
+    std::uint32_t id = nodeFor(name);
+    Node& node = nodes[id];
+    if (node.formula) {
+        throw std::runtime_error(name + " is defined by an expression (use define() to change it)");
+    }
+    if (node.hasValue && node.value == value) {
+        return;
+    }
+
+    // Dependents were last checked in a pass up to 'pass', so the next one sees this as newer
+    node.value = value;
+    node.hasValue = true;
+    node.changedAt = pass + 1;
+    invalidate(id);
+}
+
+void DependencyGraph::set(const std::vector<std::pair<std::string, int>>& values) {
+    for (const auto& [name, value] : values) {
+        set(name, value);
+    }
+}
+
+void DependencyGraph::invalidate(std::uint32_t id) {
+    std::vector<std::uint32_t>& stack = order;
+    stack.assign(1, id);
+    while (!stack.empty()) {
+        std::uint32_t current = stack.back();
+        stack.pop_back();
+        for (std::uint32_t dependent : nodes[current].dependents) {
+            if (!nodes[dependent].stale) {
+                nodes[dependent].stale = true;
+                stack.push_back(dependent);
+            }
+        }
+    }
+}
+
+int DependencyGraph::value(const std::string& name) {
+    auto it = ids.find(name);
+    if (it == ids.end()) {
+        throw std::runtime_error("Unknown name: " + name);
+    }
+
+    std::uint32_t id = it->second;
+    if (nodes[id].stale) {
+        refresh({id});
+    }
+
+    const Node& node = nodes[id];
+    if (!node.error.empty()) {
+        throw std::runtime_error(node.error);
+    }
+    if (!node.hasValue) {
+        throw std::runtime_error("Input " + name + " has no value");
+    }
+    return node.value;
+}
+
+void DependencyGraph::recompute() {
+    std::vector<std::uint32_t> roots;
+    for (std::uint32_t id = 0; id < nodes.size(); id++) {
+        if (nodes[id].stale) {
+            roots.push_back(id);
+        }
+    }
+    refresh(roots);
+}
+
+bool DependencyGraph::isStale(const std::string& name) const {
+    auto it = ids.find(name);
+    return it != ids.end() && nodes[it->second].stale;
+}
+
+void DependencyGraph::refresh(const std::vector<std::uint32_t>& roots) {
+    // Post-order over the stale part of the graph: a formula is ordered once all
+    // its stale operands are, so 'order' is topological
+    visited.assign(nodes.size(), false);
+    order.clear();
+    for (std::uint32_t root : roots) {
+        if (visited[root]) {
+            continue;
+        }
+        visited[root] = true;
+        pending.assign(1, {root, 0});
+
+        while (!pending.empty()) {
+            auto& [id, next] = pending.back();
+            const std::vector<std::uint32_t>& operands = nodes[id].operands;
+            while (next < operands.size() && (!nodes[operands[next]].stale || visited[operands[next]])) {
+                next++;
+            }
+            if (next < operands.size()) {
+                std::uint32_t operand = operands[next++];
+                visited[operand] = true;
+                pending.push_back({operand, 0});
+            }
+            else {
+                order.push_back(id);
+                pending.pop_back();
+            }
+        }
+    }
+
+    if (order.empty()) {
+        return;
+    }
+    pass++;
+    counters.passes++;
+    for (std::uint32_t id : order) {
+        update(nodes[id]);
+    }
+}
+
+void DependencyGraph::update(Node& node) {
+    // Re-evaluate only if the definition is new or an operand changed since the last check
+    bool needed = !node.hasValue && node.error.empty();
+    for (std::uint32_t operand : node.operands) {
+        needed = needed || nodes[operand].changedAt > node.checkedAt;
+    }
+    node.stale = false;
+    node.checkedAt = pass;
+    if (!needed) {
+        counters.cutoffs++;
+        return;
+    }
+    counters.evaluations++;
+
+    // Errors flow from operands to dependents unchanged, so they name where they arose
+    std::string error;
+    int value = 0;
+    slots.resize(node.operands.size());
+    for (std::size_t slot = 0; slot < node.operands.size() && error.empty(); slot++) {
+        const Node& operand = nodes[node.operands[slot]];
+        if (!operand.error.empty()) {
+            error = operand.error;
+        }
+        else if (!operand.hasValue) {
+            error = "Input " + operand.name + " has no value";
+        }
+        slots[slot] = operand.value;
+    }
+    if (error.empty()) {
+        try {
+            value = node.program->evaluate(slots.data());
+        }
+        catch (const std::exception& e) {
+            error = node.name + ": " + e.what();
+        }
+    }
+
+    bool changed = error != node.error || (error.empty() && (!node.hasValue || value != node.value));
+    node.error = std::move(error);
+    node.hasValue = node.error.empty();
+    node.value = node.hasValue ? value : 0;
+    if (changed) {
+        node.changedAt = pass;
+    }
+}
@@ -0,0 +1,186 @@
+#ifndef DEPENDENCY_GRAPH_H
+#define DEPENDENCY_GRAPH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "CompiledExpression.h"
+#include "Evaluator.h"
+
+/**
+ * Counters reported by DependencyGraph::stats().
+ */
+struct GraphStats {
+    std::uint64_t passes = 0;           // Recomputation passes that found stale values
+    std::uint64_t evaluations = 0;      // Formulas actually evaluated
+    std::uint64_t cutoffs = 0;          // Stale formulas skipped because no operand changed
+};
+
+/**
+ * Named values defined as expressions over each other, like the cells of a
+ * spreadsheet: "risk = exposure * 3 > limit" is a formula over the names
+ * exposure and limit, which may be inputs set with set() or formulas themselves.
+ *
+ * Every formula is compiled once by define(). Changing an input only marks the
+ * formulas that depend on it (directly or not) as stale; nothing is evaluated
+ * until a value is read. A read evaluates just the stale formulas it needs, each
+ * once, in topological order, so setting many inputs before the next read costs
+ * one pass however many of them changed. A formula whose operands all kept
+ * their values is not evaluated again, and neither are its dependents on that
+ * account.
+ *
+ * Names a formula uses before they are defined become inputs without a value;
+ * reading anything that needs them fails until they are set. Errors (such as a
+ * division by zero) are kept with the formula that raised them and reported by
+ * every read that depends on it.
+ *
+ * Graph traversals use explicit stacks, so chains of any length are fine. Not
+ * thread-safe: even value() updates the graph.
+ */
+class DependencyGraph {
+public:
+    /**
+     * Creates an empty graph.
+     *
+     * @param compiler Evaluator whose settings are used to compile formulas.
+     */
+    explicit DependencyGraph(const Evaluator& compiler = Evaluator());
+
+    /**
+     * Defines or redefines a formula. Its dependents become stale.
+     *
+     * @param name The name; an input of that name becomes a formula.
+     * @param expression The expression, over other names of the graph.
+     * @throws std::runtime_error if the expression is invalid or would make the
+     *         name depend on itself. The graph is then unchanged.
+     *
+     * Time Complexity: O(n) to compile, plus O(d) where d is the number of
+     * formulas that depend on the name.
+     */
+    void define(const std::string& name, const std::string& expression);
+
+    /**
+     * Sets an input. If the value changes, every formula depending on it is
+     * marked stale; none is evaluated.
+     *
+     * @param name The input's name; created if the graph does not know it yet.
+     * @param value The new value.
+     * @throws std::runtime_error if the name is a formula.
+     *
+     * Time Complexity: O(d) where d is the number of formulas that become stale
+     * (formulas already stale are not visited again).
+     */
+    void set(const std::string& name, int value);
+
+    /**
+     * Sets many inputs at once; the same as calling set() for each, and like
+     * those calls, evaluates nothing.
+     *
+     * @param values Pairs of input name and value.
+     * @throws std::runtime_error if a name is a formula. Earlier pairs stay set.
+     *
+     * Time Complexity: O(v + d) where v is the number of pairs and d the number
+     * of formulas that become stale.
+     */
+    void set(const std::vector<std::pair<std::string, int>>& values);
+
+    /**
+     * Reads a value, first bringing the stale formulas it depends on up to date.
+     *
+     * @param name An input or formula.
+     * @return Its current value.
+     * @throws std::runtime_error if the name is unknown, if an input it needs has
+     *         no value, or with the error of the formula that failed.
+     *
+     * Time Complexity: O(s) evaluations, where s is the number of stale formulas
+     * the name depends on; O(1) when it is up to date.
+     */
+    int value(const std::string& name);
+
+    /**
+     * Brings every stale formula up to date in one pass. Errors are kept with
+     * the formulas that raised them rather than thrown.
+     *
+     * Time Complexity: O(s) evaluations, where s is the number of stale formulas.
+     */
+    void recompute();
+
+    /**
+     * @param name An input or formula.
+     * @return True if the name is a formula that the next read would re-check.
+     */
+    bool isStale(const std::string& name) const;
+
+    /**
+     * @param name A name.
+     * @return True if the graph knows the name, as an input or a formula.
+     */
+    bool contains(const std::string& name) const { return ids.count(name) != 0; }
+
+    /**
+     * @return The number of inputs and formulas.
+     */
+    std::size_t size() const { return nodes.size(); }
+
+    /**
+     * @return Pass, evaluation and cutoff counts since construction.
+     */
+    const GraphStats& stats() const { return counters; }
+
+private:
+    // An input or a formula
+    struct Node {
+        std::string name;
+        bool formula = false;
+        bool stale = false;                 // A formula that must be re-checked before it is read
+        bool hasValue = false;              // False for inputs never set
+        int value = 0;
+        std::string error;                  // Why the value could not be computed, if it could not
+        std::shared_ptr<const CompiledExpression> program;  // Formulas only; shared so nodes move cheaply
+        std::vector<std::uint32_t> operands;    // Node of each variable slot of the program
+        std::vector<std::uint32_t> dependents;  // Formulas using this node as an operand
+        std::uint64_t changedAt = 0;        // Pass in which the value (or error) last changed
+        std::uint64_t checkedAt = 0;        // Pass in which a formula was last brought up to date
+    };
+
+    /**
+     * Looks up a name, creating an input without a value if it is unknown.
+     */
+    std::uint32_t nodeFor(const std::string& name);
+
+    /**
+     * Marks every formula depending on a node stale, without recursion. Stale
+     * formulas are not entered, since their dependents are stale already.
+     */
+    void invalidate(std::uint32_t id);
+
+    /**
+     * Brings the stale formulas a set of nodes depend on up to date, in
+     * topological order (operands first) found by an iterative depth-first search.
+     */
+    void refresh(const std::vector<std::uint32_t>& roots);
+
+    /**
+     * Re-checks one stale formula whose operands are all up to date: evaluates it
+     * if an operand changed since it was last checked.
+     */
+    void update(Node& node);
+
+    Evaluator compiler;
+    std::vector<Node> nodes;
+    std::unordered_map<std::string, std::uint32_t> ids;
+    std::uint64_t pass = 0;             // Number of the current or last refresh
+    GraphStats counters;
+
+    // Scratch space reused between calls
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> pending;  // Search stack: node, next operand to visit
+    std::vector<std::uint32_t> order;
+    std::vector<int> slots;
+    std::vector<bool> visited;
+};
+
+#endif // DEPENDENCY_GRAPH_H
@@ -0,0 +1,33 @@
+#include "EvalContext.h"
+#include <algorithm>
+
+Arena::Arena(std::size_t initialBytes) {
+    if (initialBytes > 0) {
+        block.reset(new unsigned char[initialBytes]);
+        size = initialBytes;
+    }
+}
+
+void* Arena::allocate(std::size_t bytes, std::size_t alignment) {
+    // Blocks come from new[], which aligns for any fundamental type
+    std::size_t start = (used + alignment - 1) & ~(alignment - 1);
+    if (start + bytes <= size) {
+        used = start + bytes;
+        return block.get() + start;
+    }
+
+    overflow.emplace_back(new unsigned char[bytes]);
+    overflowBytes += bytes + alignment;
+    return overflow.back().get();
+}
+
+void Arena::reset() {
+    if (!overflow.empty()) {
+        // One block big enough for this round, so the next one fits without overflowing
+        size = std::max(size * 2, size + overflowBytes);
+        block.reset(new unsigned char[size]);
+        overflow.clear();
+        overflowBytes = 0;
+    }
+    used = 0;
+}
@@ -0,0 +1,219 @@
+#ifndef EVAL_CONTEXT_H
+#define EVAL_CONTEXT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "BigInt.h"
+#include "Operators.h"
+
+/**
+ * A bump allocator for scratch memory that lives for one evaluation.
+ *
+ * allocate() hands out pieces of one block by moving a pointer. When a request
+ * does not fit, an overflow block is allocated for it; the next reset() then
+ * replaces the main block with one large enough for everything that was needed,
+ * so once the workload's largest expression has been seen, evaluation no longer
+ * touches the heap.
+ */
+class Arena {
+public:
+    /**
+     * @param initialBytes Size of the first block; 0 defers it to the first allocation.
+     */
+    explicit Arena(std::size_t initialBytes = 0);
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /**
+     * Returns uninitialized memory that stays valid until the next reset().
+     *
+     * @param bytes Number of bytes.
+     * @param alignment Required alignment; a power of two no larger than alignof(std::max_align_t).
+     * @return The memory.
+     *
+     * Time Complexity: O(1), plus one heap allocation if the main block is full.
+     */
+    void* allocate(std::size_t bytes, std::size_t alignment);
+
+    /**
+     * Typed convenience wrapper around allocate().
+     *
+     * @param count Number of elements.
+     * @return Uninitialized storage for count elements.
+     */
+    template <typename T>
+    T* allocateArray(std::size_t count) {
+        static_assert(std::is_trivially_copyable<T>::value, "Arena memory is never destroyed");
+        return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    /**
+     * Releases everything allocated since the last reset(), growing the main
+     * block if overflow blocks were needed.
+     *
+     * Time Complexity: O(1), plus one heap allocation after an overflow.
+     */
+    void reset();
+
+    /**
+     * @return Size of the main block in bytes.
+     */
+    std::size_t capacity() const { return size; }
+
+private:
+    std::unique_ptr<unsigned char[]> block;                 // Main block
+    std::size_t size = 0;                                   // Bytes in the main block
+    std::size_t used = 0;                                   // Bytes handed out from the main block
+    std::vector<std::unique_ptr<unsigned char[]>> overflow; // Blocks for requests that did not fit
+    std::size_t overflowBytes = 0;                          // Total bytes in the overflow blocks
+};
+
+/**
+ * A stack of trivially copyable values with room for N of them inside the
+ * object. Anything larger than N lives in an Arena. push() never allocates or
+ * checks for growth: the owner compares size() with capacity() and calls grow().
+ */
+template <typename T, std::size_t N>
+class InlineStack {
+    static_assert(std::is_trivially_copyable<T>::value, "InlineStack only holds trivially copyable values");
+
+public:
+    InlineStack() = default;
+
+    // items may point into the object itself
+    InlineStack(const InlineStack&) = delete;
+    InlineStack& operator=(const InlineStack&) = delete;
+
+    /**
+     * Empties the stack and makes room for capacity values.
+     *
+     * @param capacity The most values that will be pushed before the next reset().
+     * @param arena Supplies the storage when capacity exceeds N.
+     */
+    void reset(std::size_t capacity, Arena& arena) {
+        items = capacity <= N ? inlineItems : arena.allocateArray<T>(capacity);
+        room = capacity <= N ? N : capacity;
+        count = 0;
+    }
+
+    /**
+     * Moves the values to a larger block of the arena. The old block is only
+     * reclaimed by the arena's next reset(), so grow geometrically.
+     *
+     * @param capacity The new capacity; larger than capacity().
+     * @param arena Supplies the storage.
+     *
+     * Time Complexity: O(size()).
+     */
+    void grow(std::size_t capacity, Arena& arena) {
+        T* larger = arena.allocateArray<T>(capacity);
+        std::copy(items, items + count, larger);
+        items = larger;
+        room = capacity;
+    }
+
+    std::size_t capacity() const { return room; }
+    void push(const T& value) { items[count++] = value; }
+    void pop() { count--; }
+    T& top() { return items[count - 1]; }
+    const T& top() const { return items[count - 1]; }
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+private:
+    T inlineItems[N];
+    T* items = inlineItems;
+    std::size_t room = N;
+    std::size_t count = 0;
+};
+
+/**
+ * A stack with the InlineStack interface for values that own memory (such as
+ * BigInt), backed by a std::vector whose capacity is kept between resets.
+ */
+template <typename T>
+class VectorStack {
+public:
+    void reset(std::size_t capacity, Arena&) {
+        items.clear();
+        items.reserve(capacity);
+    }
+
+    void grow(std::size_t capacity, Arena&) { items.reserve(capacity); }
+    std::size_t capacity() const { return items.capacity(); }
+
+    void push(T value) { items.push_back(std::move(value)); }
+    void pop() { items.pop_back(); }
+    T& top() { return items.back(); }
+    const T& top() const { return items.back(); }
+    std::size_t size() const { return items.size(); }
+    bool empty() const { return items.empty(); }
+
+private:
+    std::vector<T> items;
+};
+
+/**
+ * An operator waiting on a shunting-yard stack, with its position for error messages.
+ */
+struct PendingOp {
+    Op op;
+    std::uint32_t offset;
+};
+
+/**
+ * Reusable scratch state for Evaluator::eval(): the value and operator stacks,
+ * and the arena backing stacks that outgrow their inline room. eval() reads
+ * tokens straight from the lexer, so nothing here grows with the length of an
+ * expression, only with how deeply it nests.
+ *
+ * All of it is kept between calls, so after warming up on the largest
+ * expression of a workload, eval() with a context performs no heap allocations
+ * (error messages aside). A context may be used by one thread at a time;
+ * give each thread its own.
+ */
+class EvalContext {
+public:
+    // Stack entries stored inside the context before the arena is used
+    static constexpr std::size_t kInlineDepth = 64;
+
+    using ValueStack = InlineStack<int, kInlineDepth>;
+    using WideValueStack = InlineStack<std::int64_t, kInlineDepth>;
+    using BigValueStack = VectorStack<BigInt>;
+    using OpStack = InlineStack<PendingOp, kInlineDepth>;
+
+    /**
+     * @param arenaBytes Initial arena size, for workloads with known deep expressions.
+     */
+    explicit EvalContext(std::size_t arenaBytes = 0) : arena(arenaBytes) {}
+
+    EvalContext(const EvalContext&) = delete;
+    EvalContext& operator=(const EvalContext&) = delete;
+
+    /**
+     * @return Bytes of arena memory currently reserved.
+     */
+    std::size_t arenaCapacity() const { return arena.capacity(); }
+
+private:
+    friend class Evaluator;
+
+    // The value stack for each numeric mode's value type
+    ValueStack& valueStack(int*) { return values; }
+    WideValueStack& valueStack(std::int64_t*) { return wideValues; }
+    BigValueStack& valueStack(BigInt*) { return bigValues; }
+
+    Arena arena;
+    ValueStack values;
+    WideValueStack wideValues;
+    BigValueStack bigValues;                // BigInt values still allocate their limbs
+    OpStack ops;
+};
+
+#endif // EVAL_CONTEXT_H
@@ -0,0 +1,832 @@
+#include "EvalServer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+// epoll keys of the two descriptors that are not connections
+constexpr std::uint64_t kListenKey = UINT64_MAX;
+constexpr std::uint64_t kWakeKey = UINT64_MAX - 1;
+
+// Bytes a connection's input buffer can take in one read()
+constexpr std::size_t kReadChunk = 64 * 1024;
+
+// Programs a worker remembers by exact request text before starting over
+constexpr std::size_t kWorkerPrograms = 1024;
+
+constexpr std::size_t kResponseBytes = sizeof(wire::ResponseHeader);
+
+[[noreturn]] void throwSystemError(const std::string& what) {
+    throw std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+sockaddr_un socketAddress(const std::string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path must be 1 to " + std::to_string(sizeof(address.sun_path) - 1) +
+                                 " bytes: " + path);
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+std::uint64_t batchHash(std::string_view expression, std::uint16_t width) {
+    return std::hash<std::string_view>{}(expression) ^ (width * 0x9E3779B97F4A7C15ull);
+}
+
+} // namespace
+
+// Requests for one expression and value count, evaluated together
+struct EvalServer::Batch {
+    std::string expression;
+    std::uint16_t width = 0;                    // Values per request
+    std::size_t openIndex = 0;                  // Position in EvalServer::open while being filled
+    std::vector<std::int32_t> values;           // Row-major, 'width' per request
+    std::vector<std::uint64_t> targets;         // Connection key of every request
+    std::vector<std::uint32_t> ids;
+    std::vector<std::int32_t> results;
+    std::vector<std::uint8_t> failed;
+    std::vector<std::string> messages;          // Error of every failed request
+
+    std::size_t size() const { return ids.size(); }
+};
+
+struct EvalServer::Connection {
+    int fd = -1;
+    std::uint32_t slot = 0;
+    std::uint32_t generation = 0;               // Incremented on close, so stale responses are dropped
+    std::vector<char> input;
+    std::size_t inputEnd = 0;
+    std::vector<char> output;
+    std::size_t outputSent = 0;
+    std::size_t inFlight = 0;                   // Requests parsed but not yet answered
+    std::uint32_t watched = 0;                  // Events registered with epoll
+    bool peerClosed = false;                    // The client will send nothing more
+    bool dirty = false;                         // Listed in EvalServer::dirty
+
+    std::uint64_t key() const { return static_cast<std::uint64_t>(generation) << 32 | slot; }
+    std::size_t pendingOutput() const { return output.size() - outputSent; }
+};
+
+// Worker threads taking batches from a queue
+class EvalServer::Workers {
+public:
+    Workers(EvalServer& server, unsigned count) : server(server) {
+        for (unsigned i = 0; i < count; i++) {
+            threads.emplace_back([this] { loop(); });
+        }
+    }
+
+    // Stops the threads; queued batches are dropped
+    ~Workers() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    void push(Batch* batch) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            queue.push_back(batch);
+        }
+        wake.notify_one();
+    }
+
+    void push(const std::vector<Batch*>& batches) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            queue.insert(queue.end(), batches.begin(), batches.end());
+        }
+        if (batches.size() == 1) {
+            wake.notify_one();
+        }
+        else {
+            wake.notify_all();
+        }
+    }
+
+private:
+    void loop() {
+        WorkerScratch scratch;
+        while (true) {
+            Batch* batch;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wake.wait(guard, [this] { return stopping || head < queue.size(); });
+                if (stopping) {
+                    return;
+                }
+                batch = queue[head++];
+                if (head == queue.size()) {
+                    queue.clear();
+                    head = 0;
+                }
+            }
+            server.evaluate(*batch, scratch);
+            server.complete(batch);
+        }
+    }
+
+    EvalServer& server;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::vector<Batch*> queue;                  // Batches from index 'head' on are waiting
+    std::size_t head = 0;
+    bool stopping = false;
+    std::vector<std::thread> threads;
+};
+
+EvalServer::EvalServer(const ServerOptions& options, const Evaluator& compiler)
+    : options(options), threads(options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency())),
+      cache(options.cacheCapacity, 16, compiler) {
+    this->options.maxBatch = std::max<std::size_t>(this->options.maxBatch, 1);
+    sockaddr_un address = socketAddress(options.socketPath);
+
+    // Replace a stale socket, but never another kind of file
+    struct stat info;
+    if (lstat(options.socketPath.c_str(), &info) == 0) {
+        if (!S_ISSOCK(info.st_mode)) {
+            throw std::runtime_error(options.socketPath + " exists and is not a socket");
+        }
+        unlink(options.socketPath.c_str());
+    }
+
+    try {
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listenFd < 0) {
+            throwSystemError("Cannot create socket");
+        }
+        if (bind(listenFd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+            throwSystemError("Cannot bind " + options.socketPath);
+        }
+        if (listen(listenFd, SOMAXCONN) != 0) {
+            throwSystemError("Cannot listen on " + options.socketPath);
+        }
+
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        spareFd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+        if (epollFd < 0 || wakeFd < 0 || spareFd < 0) {
+            throwSystemError("Cannot create the event loop");
+        }
+        epoll_event listenEvent{};
+        listenEvent.events = EPOLLIN;
+        listenEvent.data.u64 = kListenKey;
+        epoll_event wakeEvent{};
+        wakeEvent.events = EPOLLIN;
+        wakeEvent.data.u64 = kWakeKey;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &listenEvent) != 0 ||
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &wakeEvent) != 0) {
+            throwSystemError("Cannot create the event loop");
+        }
+    }
+    catch (...) {
+        for (int fd : {listenFd, epollFd, wakeFd, spareFd}) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+        if (listenFd >= 0) {
+            unlink(options.socketPath.c_str());
+        }
+        throw;
+    }
+}
+
+EvalServer::~EvalServer() {
+    workers.reset();
+    for (auto& connection : connections) {
+        if (connection->fd >= 0) {
+            ::close(connection->fd);
+        }
+    }
+    ::close(listenFd);
+    ::close(epollFd);
+    ::close(wakeFd);
+    if (spareFd >= 0) {
+        ::close(spareFd);
+    }
+    unlink(options.socketPath.c_str());
+}
+
+void EvalServer::run() {
+    workers = std::make_unique<Workers>(*this, threads);
+    epoll_event events[256];
+
+    while (!stopping.load()) {
+        if (acceptPaused && descriptorFreed) {
+            resumeAccepting();
+        }
+        descriptorFreed = false;
+        int count = epoll_wait(epollFd, events, 256, acceptPaused ? kAcceptRetryMs : -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throwSystemError("epoll_wait failed");
+        }
+        if (count == 0 && acceptPaused) {
+            resumeAccepting();
+        }
+
+        for (int e = 0; e < count; e++) {
+            std::uint64_t key = events[e].data.u64;
+            if (key == kListenKey) {
+                accept();
+                continue;
+            }
+            if (key == kWakeKey) {
+                std::uint64_t signals;
+                if (read(wakeFd, &signals, sizeof(signals)) < 0 && errno != EAGAIN) {
+                    throwSystemError("Cannot read the wake-up counter");
+                }
+                deliverCompleted();
+                continue;
+            }
+
+            // Skip events of a connection closed earlier in this round
+            std::uint32_t slot = static_cast<std::uint32_t>(key);
+            if (slot >= connections.size() || connections[slot]->fd < 0 || connections[slot]->key() != key) {
+                continue;
+            }
+            Connection& connection = *connections[slot];
+            std::uint32_t happened = events[e].events;
+            bool ok = !(happened & (EPOLLERR | EPOLLHUP));
+            if (ok && (happened & (EPOLLIN | EPOLLRDHUP))) {
+                ok = readFrom(connection);
+            }
+            if (ok && (happened & EPOLLOUT)) {
+                ok = flush(connection);
+            }
+            if (!ok || (connection.peerClosed && connection.inFlight == 0 && connection.pendingOutput() == 0)) {
+                close(connection);
+            }
+            else {
+                watch(connection);
+            }
+        }
+
+        // Everything that arrived in this wake-up forms the batches
+        dispatchOpenBatches();
+
+        for (std::uint32_t slot : dirty) {
+            Connection& connection = *connections[slot];
+            connection.dirty = false;
+            if (connection.fd < 0) {
+                continue;
+            }
+            if (!flush(connection) ||
+                (connection.peerClosed && connection.inFlight == 0 && connection.pendingOutput() == 0)) {
+                close(connection);
+            }
+            else {
+                watch(connection);
+            }
+        }
+        dirty.clear();
+    }
+
+    workers.reset();
+    for (auto& connection : connections) {
+        if (connection->fd >= 0) {
+            close(*connection);
+        }
+    }
+    if (acceptPaused) {
+        resumeAccepting();
+    }
+    {
+        std::lock_guard<std::mutex> guard(completedLock);
+        completed.clear();
+    }
+    open.clear();
+    freeBatches.clear();
+    for (auto& batch : batchStorage) {
+        freeBatches.push_back(batch.get());
+    }
+    stopping.store(false);
+}
+
+void EvalServer::stop() {
+    stopping.store(true);
+    std::uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0) {
+        // The counter is already non-zero, so the loop wakes anyway
+    }
+}
+
+ServerStats EvalServer::stats() const {
+    ServerStats stats;
+    stats.connections = connectionCount.load();
+    stats.requests = requestCount.load();
+    stats.errors = errorCount.load();
+    stats.batches = batchCount.load();
+    stats.columnarBatches = columnarCount.load();
+    stats.rejected = rejectedCount.load();
+    stats.acceptErrors = acceptErrorCount.load();
+    return stats;
+}
+
+void EvalServer::accept() {
+    while (true) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            int error = errno;
+            if (error == EINTR || error == ECONNABORTED) {
+                continue;
+            }
+            if (error == EMFILE || error == ENFILE) {
+                // Out of descriptors: the listening socket is level-triggered, so a
+                // connection left queued would wake epoll_wait() again at once. Free
+                // the spare descriptor to accept it and close it straight away
+                if (spareFd >= 0) {
+                    ::close(spareFd);
+                    int rejectedFd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+                    error = errno;
+                    if (rejectedFd >= 0) {
+                        ::close(rejectedFd);
+                        rejectedCount++;
+                    }
+                    spareFd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+                    if (rejectedFd >= 0) {
+                        continue;
+                    }
+                    if (error == EAGAIN || error == EWOULDBLOCK) {
+                        return;     // Nothing was queued after all
+                    }
+                }
+                // Another thread took the freed descriptor: stop watching the
+                // socket until a connection closes or kAcceptRetryMs pass
+                acceptErrorCount++;
+                pauseAccepting();
+                return;
+            }
+            // EAGAIN: no more pending connections. Anything else is counted and
+            // retried on the next wake-up
+            if (error != EAGAIN && error != EWOULDBLOCK) {
+                acceptErrorCount++;
+            }
+            return;
+        }
+
+        std::uint32_t slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else {
+            slot = static_cast<std::uint32_t>(connections.size());
+            connections.push_back(std::make_unique<Connection>());
+            connections.back()->slot = slot;
+        }
+        Connection& connection = *connections[slot];
+        connection.fd = fd;
+        connection.watched = EPOLLIN | EPOLLRDHUP;
+
+        epoll_event event{};
+        event.events = connection.watched;
+        event.data.u64 = connection.key();
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close(connection);
+            continue;
+        }
+        connectionCount++;
+    }
+}
+
+bool EvalServer::readFrom(Connection& connection) {
+    // One read per event keeps a busy client from starving the others;
+    // epoll reports the connection again while bytes remain
+    if (connection.input.size() - connection.inputEnd < kReadChunk) {
+        connection.input.resize(std::max(connection.input.size() * 2, connection.inputEnd + kReadChunk));
+    }
+    ssize_t got = read(connection.fd, connection.input.data() + connection.inputEnd,
+                       connection.input.size() - connection.inputEnd);
+    if (got == 0) {
+        connection.peerClosed = true;
+    }
+    else if (got < 0) {
+        return errno == EAGAIN || errno == EINTR;
+    }
+    connection.inputEnd += static_cast<std::size_t>(std::max<ssize_t>(got, 0));
+
+    const char* data = connection.input.data();
+    std::size_t position = 0;
+    while (connection.inputEnd - position >= sizeof(wire::RequestHeader)) {
+        wire::RequestHeader header;
+        std::memcpy(&header, data + position, sizeof(header));
+        std::size_t bodyBytes = header.expressionLength + std::size_t(4) * header.valueCount;
+        if (header.length > wire::kMaxRequestBytes || header.length != sizeof(header) - 4 + bodyBytes) {
+            return false;   // Not our protocol, or out of step with it
+        }
+        if (connection.inputEnd - position < 4 + std::size_t(header.length)) {
+            break;
+        }
+        addRequest(connection, header, data + position + sizeof(header));
+        position += 4 + header.length;
+    }
+
+    // Keep only the incomplete tail
+    std::memmove(connection.input.data(), data + position, connection.inputEnd - position);
+    connection.inputEnd -= position;
+    return true;
+}
+
+void EvalServer::addRequest(Connection& connection, const wire::RequestHeader& header, const char* body) {
+    std::string_view expression(body, header.expressionLength);
+    std::uint16_t width = header.valueCount;
+
+    // Open addressing over the round's batches; entries from earlier rounds count as empty
+    if (table.size() < 2 * (open.size() + 1)) {
+        table.assign(std::max<std::size_t>(64, table.size() * 2), TableEntry{});
+        for (Batch* batch : open) {
+            std::size_t i = batchHash(batch->expression, batch->width) & (table.size() - 1);
+            while (table[i].round == round) {
+                i = (i + 1) & (table.size() - 1);
+            }
+            table[i] = {round, batch};
+        }
+    }
+    std::size_t i = batchHash(expression, width) & (table.size() - 1);
+    while (table[i].round == round && (table[i].batch->width != width || table[i].batch->expression != expression)) {
+        i = (i + 1) & (table.size() - 1);
+    }
+
+    Batch* batch = table[i].round == round ? table[i].batch : nullptr;
+    if (batch && batch->size() >= options.maxBatch) {
+        // A full batch goes to the workers now and a new one takes its place
+        open[batch->openIndex] = open.back();
+        open.back()->openIndex = batch->openIndex;
+        open.pop_back();
+        workers->push(batch);
+        batchCount++;
+        batch = nullptr;
+    }
+    if (!batch) {
+        batch = newBatch();
+        batch->expression.assign(expression);
+        batch->width = width;
+        batch->openIndex = open.size();
+        open.push_back(batch);
+        table[i] = {round, batch};
+    }
+
+    const char* values = body + header.expressionLength;
+    std::size_t offset = batch->values.size();
+    batch->values.resize(offset + width);
+    std::memcpy(batch->values.data() + offset, values, std::size_t(4) * width);
+    batch->targets.push_back(connection.key());
+    batch->ids.push_back(header.id);
+    connection.inFlight++;
+}
+
+void EvalServer::dispatchOpenBatches() {
+    if (open.empty()) {
+        return;
+    }
+    workers->push(open);
+    batchCount += open.size();
+    open.clear();
+    round++;
+}
+
+void EvalServer::deliverCompleted() {
+    {
+        std::lock_guard<std::mutex> guard(completedLock);
+        std::swap(completed, delivering);
+    }
+
+    for (Batch* batch : delivering) {
+        std::uint64_t errors = 0;
+        for (std::size_t r = 0; r < batch->size(); r++) {
+            errors += batch->failed[r];
+            std::uint32_t slot = static_cast<std::uint32_t>(batch->targets[r]);
+            Connection& connection = *connections[slot];
+            if (connection.fd < 0 || connection.key() != batch->targets[r]) {
+                continue;   // Closed while the batch was evaluated
+            }
+
+            std::string_view message = batch->failed[r] ? std::string_view(batch->messages[r]) : std::string_view();
+            wire::ResponseHeader header{static_cast<std::uint32_t>(kResponseBytes - 4 + message.size()), batch->ids[r],
+                                        batch->failed[r] ? wire::kError : wire::kOk, batch->results[r]};
+            std::size_t offset = connection.output.size();
+            connection.output.resize(offset + kResponseBytes + message.size());
+            std::memcpy(connection.output.data() + offset, &header, kResponseBytes);
+            std::memcpy(connection.output.data() + offset + kResponseBytes, message.data(), message.size());
+
+            connection.inFlight--;
+            if (!connection.dirty) {
+                connection.dirty = true;
+                dirty.push_back(slot);
+            }
+        }
+        requestCount += batch->size();
+        errorCount += errors;
+        freeBatches.push_back(batch);
+    }
+    delivering.clear();
+}
+
+bool EvalServer::flush(Connection& connection) {
+    while (connection.pendingOutput() > 0) {
+        ssize_t sent = send(connection.fd, connection.output.data() + connection.outputSent,
+                            connection.pendingOutput(), MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                return false;
+            }
+            break;
+        }
+        connection.outputSent += static_cast<std::size_t>(sent);
+    }
+
+    if (connection.pendingOutput() == 0) {
+        connection.output.clear();
+        connection.outputSent = 0;
+    }
+    else if (connection.outputSent > connection.output.size() / 2) {
+        connection.output.erase(connection.output.begin(), connection.output.begin() + connection.outputSent);
+        connection.outputSent = 0;
+    }
+    return true;
+}
+
+void EvalServer::watch(Connection& connection) {
+    std::uint32_t wanted = 0;
+    if (!connection.peerClosed && connection.pendingOutput() <= kMaxPendingOutput) {
+        wanted |= EPOLLIN | EPOLLRDHUP;
+    }
+    if (connection.pendingOutput() > 0) {
+        wanted |= EPOLLOUT;
+    }
+    if (wanted != connection.watched) {
+        epoll_event event{};
+        event.events = wanted;
+        event.data.u64 = connection.key();
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+        connection.watched = wanted;
+    }
+}
+
+void EvalServer::pauseAccepting() {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, listenFd, nullptr);
+    acceptPaused = true;
+}
+
+void EvalServer::resumeAccepting() {
+    if (spareFd < 0) {
+        spareFd = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = kListenKey;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+    acceptPaused = false;
+}
+
+void EvalServer::close(Connection& connection) {
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, connection.fd, nullptr);
+    ::close(connection.fd);
+    descriptorFreed = true;
+    connection.fd = -1;
+    connection.generation++;
+    connection.inputEnd = 0;
+    connection.output.clear();
+    connection.outputSent = 0;
+    connection.inFlight = 0;
+    connection.peerClosed = false;
+    freeSlots.push_back(connection.slot);
+}
+
+void EvalServer::evaluate(Batch& batch, WorkerScratch& scratch) {
+    std::size_t rows = batch.size();
+    batch.results.assign(rows, 0);
+    batch.failed.assign(rows, 0);
+    batch.messages.resize(rows);
+    auto failAll = [&](const char* message) {
+        for (std::size_t r = 0; r < rows; r++) {
+            batch.failed[r] = 1;
+            batch.messages[r] = message;
+        }
+    };
+
+    // Looking up the exact text first skips the cache's normalization, which allocates
+    auto found = scratch.programs.find(batch.expression);
+    if (found == scratch.programs.end()) {
+        try {
+            std::shared_ptr<const CompiledExpression> program = cache.get(batch.expression);
+            if (scratch.programs.size() >= kWorkerPrograms) {
+                scratch.programs.clear();
+            }
+            found = scratch.programs.emplace(batch.expression, std::move(program)).first;
+        }
+        catch (const std::exception& e) {
+            failAll(e.what());
+            return;
+        }
+    }
+    const CompiledExpression& program = *found->second;
+    std::size_t variables = program.variableCount();
+    if (variables > batch.width) {
+        failAll(("Expression uses " + std::to_string(variables) + " variable(s) but the request has only " +
+                 std::to_string(batch.width) + " value(s)").c_str());
+        return;
+    }
+
+    // Large batches are transposed into columns; if any row fails, every row is
+    // retried alone so each gets its own result or error
+    if (rows >= kColumnarBatch && variables > 0) {
+        scratch.columns.resize(rows * variables);
+        scratch.pointers.resize(variables);
+        for (std::size_t v = 0; v < variables; v++) {
+            std::int32_t* column = scratch.columns.data() + v * rows;
+            for (std::size_t r = 0; r < rows; r++) {
+                column[r] = batch.values[r * batch.width + v];
+            }
+            scratch.pointers[v] = column;
+        }
+        try {
+            program.evalBatch(scratch.pointers.data(), rows, batch.results.data());
+            columnarCount++;
+            return;
+        }
+        catch (const std::exception&) {
+        }
+    }
+
+    for (std::size_t r = 0; r < rows; r++) {
+        try {
+            batch.results[r] = program.evaluate(batch.values.data() + r * batch.width);
+        }
+        catch (const std::exception& e) {
+            batch.results[r] = 0;
+            batch.failed[r] = 1;
+            batch.messages[r] = e.what();
+        }
+    }
+}
+
+void EvalServer::complete(Batch* batch) {
+    bool wasEmpty;
+    {
+        std::lock_guard<std::mutex> guard(completedLock);
+        wasEmpty = completed.empty();
+        completed.push_back(batch);
+    }
+    // The I/O thread takes everything queued per wake-up, so one signal is enough
+    if (wasEmpty) {
+        std::uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) < 0) {
+            // The counter is already non-zero, so the loop wakes anyway
+        }
+    }
+}
+
+EvalServer::Batch* EvalServer::newBatch() {
+    if (freeBatches.empty()) {
+        batchStorage.push_back(std::make_unique<Batch>());
+        freeBatches.push_back(batchStorage.back().get());
+    }
+    Batch* batch = freeBatches.back();
+    freeBatches.pop_back();
+    batch->values.clear();
+    batch->targets.clear();
+    batch->ids.clear();
+    return batch;
+}
+
+EvalClient::EvalClient(const std::string& socketPath) {
+    sockaddr_un address = socketAddress(socketPath);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throwSystemError("Cannot create socket");
+    }
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        int error = errno;
+        ::close(fd);
+        errno = error;
+        throwSystemError("Cannot connect to " + socketPath);
+    }
+}
+
+EvalClient::~EvalClient() {
+    ::close(fd);
+}
+
+void EvalClient::send(std::uint32_t id, std::string_view expression, const int* values, std::size_t count) {
+    if (expression.size() > UINT16_MAX || count > UINT16_MAX) {
+        throw std::runtime_error("A request holds at most 65535 expression bytes and 65535 values");
+    }
+    std::size_t bodyBytes = expression.size() + 4 * count;
+    wire::RequestHeader header{static_cast<std::uint32_t>(sizeof(header) - 4 + bodyBytes), id,
+                               static_cast<std::uint16_t>(expression.size()), static_cast<std::uint16_t>(count)};
+    std::size_t offset = output.size();
+    output.resize(offset + sizeof(header) + bodyBytes);
+    std::memcpy(output.data() + offset, &header, sizeof(header));
+    std::memcpy(output.data() + offset + sizeof(header), expression.data(), expression.size());
+    if (count > 0) {
+        std::memcpy(output.data() + offset + sizeof(header) + expression.size(), values, 4 * count);
+    }
+}
+
+void EvalClient::flush() {
+    std::size_t sent = 0;
+    while (sent < output.size()) {
+        ssize_t n = ::send(fd, output.data() + sent, output.size() - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throwSystemError("Cannot send to the server");
+        }
+        sent += static_cast<std::size_t>(n);
+    }
+    output.clear();
+}
+
+bool EvalClient::receive(EvalResponse& response) {
+    wire::ResponseHeader header;
+    while (true) {
+        std::size_t available = inputEnd - inputStart;
+        if (available >= kResponseBytes) {
+            std::memcpy(&header, input.data() + inputStart, kResponseBytes);
+            if (header.length < kResponseBytes - 4 || header.length > wire::kMaxRequestBytes) {
+                throw std::runtime_error("Malformed response from the server");
+            }
+            if (available >= 4 + std::size_t(header.length)) {
+                break;
+            }
+        }
+
+        // Make room at the end, moving the unread bytes to the front first
+        if (inputStart > 0) {
+            std::memmove(input.data(), input.data() + inputStart, available);
+            inputStart = 0;
+            inputEnd = available;
+        }
+        if (input.size() - inputEnd < kReadChunk) {
+            input.resize(inputEnd + kReadChunk);
+        }
+        ssize_t got = read(fd, input.data() + inputEnd, input.size() - inputEnd);
+        if (got == 0) {
+            return false;
+        }
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throwSystemError("Cannot read from the server");
+        }
+        inputEnd += static_cast<std::size_t>(got);
+    }
+
+    response.id = header.id;
+    response.ok = header.status == wire::kOk;
+    response.value = header.value;
+    response.error = std::string_view(input.data() + inputStart + kResponseBytes, header.length + 4 - kResponseBytes);
+    inputStart += 4 + header.length;
+    return true;
+}
+
+bool EvalClient::hasResponse() const {
+    std::size_t available = inputEnd - inputStart;
+    if (available < kResponseBytes) {
+        return false;
+    }
+    std::uint32_t length;
+    std::memcpy(&length, input.data() + inputStart, sizeof(length));
+    return available >= 4 + std::size_t(length);
+}
+
+int EvalClient::eval(std::string_view expression, const std::vector<int>& values) {
+    send(0, expression, values.data(), values.size());
+    flush();
+    EvalResponse response;
+    if (!receive(response)) {
+        throw std::runtime_error("The server closed the connection");
+    }
+    if (!response.ok) {
+        throw std::runtime_error(std::string(response.error));
+    }
+    return response.value;
+}
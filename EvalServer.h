@@ -0,0 +1,336 @@
+#ifndef EVAL_SERVER_H
+#define EVAL_SERVER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "CompiledExpression.h"
+#include "Evaluator.h"
+#include "ExpressionCache.h"
+
+/**
+ * Wire format of the evaluation server. Every message starts with its length
+ * (the bytes after the length field), and every field is in the byte order of
+ * the machine, which client and server share on a Unix domain socket.
+ *
+ *   Request:  RequestHeader, char expression[expressionLength], int32 values[valueCount]
+ *   Response: ResponseHeader, char message[length - 12]      (message only when status is kError)
+ *
+ * Values are bound to the expression's identifiers in order of first use, as
+ * in Evaluator::compile(expression); values beyond those are ignored, so a
+ * client can send the same record with every expression. Requests on one connection may be
+ * pipelined; responses carry the request's id and can arrive in any order.
+ */
+namespace wire {
+
+constexpr std::uint32_t kMaxRequestBytes = 1 << 20;     // Larger requests close the connection
+
+constexpr std::int32_t kOk = 0;
+constexpr std::int32_t kError = 1;
+
+struct RequestHeader {
+    std::uint32_t length;               // 8 + expressionLength + 4 * valueCount
+    std::uint32_t id;                   // Echoed in the response
+    std::uint16_t expressionLength;
+    std::uint16_t valueCount;
+};
+
+struct ResponseHeader {
+    std::uint32_t length;               // 12 + length of the error message
+    std::uint32_t id;
+    std::int32_t status;                // kOk or kError
+    std::int32_t value;                 // The result when status is kOk
+};
+
+} // namespace wire
+
+/**
+ * Settings of an EvalServer.
+ */
+struct ServerOptions {
+    std::string socketPath;             // Replaced if it already exists
+    unsigned threads = 0;               // Worker threads; 0 uses std::thread::hardware_concurrency()
+    std::size_t maxBatch = 256;         // Requests per batch before it is dispatched early
+    std::size_t cacheCapacity = 4096;   // Compiled programs kept
+};
+
+/**
+ * Counters reported by EvalServer::stats().
+ */
+struct ServerStats {
+    std::uint64_t connections = 0;      // Connections accepted
+    std::uint64_t requests = 0;         // Requests answered
+    std::uint64_t errors = 0;           // ... of which failed
+    std::uint64_t batches = 0;          // Batches evaluated
+    std::uint64_t columnarBatches = 0;  // ... of which went through evalBatch()
+    std::uint64_t rejected = 0;         // Connections closed at once because the process was out of descriptors
+    std::uint64_t acceptErrors = 0;     // Other failures of accept()
+};
+
+/**
+ * A server that evaluates expressions for local clients over a Unix domain socket.
+ *
+ * One I/O thread runs an epoll loop over the listening socket and every
+ * connection. It parses every complete request that has arrived, from any
+ * connection, and groups requests for the same expression and value count into
+ * a batch; each wake-up of the loop closes the batches it opened and hands them
+ * to a pool of worker threads. A worker compiles the expression once (through
+ * an ExpressionCache) and evaluates the whole batch, column-wise with
+ * evalBatch() when it is large enough. The I/O thread then writes the
+ * responses into each connection's output buffer.
+ *
+ * Batches, connection buffers and the batch lookup table are reused, so once
+ * they have grown to the load, requests and responses cost no heap allocation.
+ * Only a failing request (its message) and a column-wise batch (evalBatch()'s
+ * block buffers, once per batch) allocate. A connection whose unsent output
+ * grows past a limit is not read until it drains, so a client that does not
+ * read its responses cannot make the server buffer without bound. When the
+ * process runs out of file descriptors, new connections are accepted with a
+ * reserved descriptor and closed at once (counted in ServerStats::rejected),
+ * so the event loop does not spin on a connection it cannot take; if even the
+ * reserve is gone, the listening socket is set aside until a connection closes
+ * or kAcceptRetryMs pass.
+ *
+ * Uses Linux epoll and eventfd.
+ */
+class EvalServer {
+public:
+    // Batches at least this large are evaluated with evalBatch()
+    static constexpr std::size_t kColumnarBatch = 8;
+
+    // Unsent output above which a connection stops being read
+    static constexpr std::size_t kMaxPendingOutput = 4 << 20;
+
+    // How long the listening socket is left unwatched after running out of descriptors
+    static constexpr int kAcceptRetryMs = 100;
+
+    /**
+     * Creates the listening socket; serving starts with run().
+     *
+     * @param options The socket path and limits.
+     * @param compiler Evaluator whose settings are used to compile requests.
+     * @throws std::runtime_error if the socket cannot be created or bound.
+     */
+    explicit EvalServer(const ServerOptions& options, const Evaluator& compiler = Evaluator());
+
+    /**
+     * Closes the socket and removes its path.
+     */
+    ~EvalServer();
+
+    EvalServer(const EvalServer&) = delete;
+    EvalServer& operator=(const EvalServer&) = delete;
+
+    /**
+     * Serves until stop() is called, then closes every connection.
+     * Responses still being evaluated at that point are dropped.
+     *
+     * @throws std::runtime_error if epoll fails.
+     */
+    void run();
+
+    /**
+     * Makes run() return. Safe to call from any thread or a signal handler's helper thread.
+     */
+    void stop();
+
+    /**
+     * @return The counters so far. Safe to call while the server runs.
+     */
+    ServerStats stats() const;
+
+    /**
+     * @return The number of worker threads.
+     */
+    unsigned threadCount() const { return threads; }
+
+private:
+    struct Batch;
+    struct Connection;
+    class Workers;
+
+    // Per-worker state: programs by exact request text, and column buffers
+    struct WorkerScratch {
+        std::unordered_map<std::string, std::shared_ptr<const CompiledExpression>> programs;
+        std::vector<std::int32_t> columns;
+        std::vector<const std::int32_t*> pointers;
+    };
+
+    // A slot in the batch lookup table, valid in the round it was written
+    struct TableEntry {
+        std::uint64_t round = 0;
+        Batch* batch = nullptr;
+    };
+
+    void accept();
+
+    /**
+     * Stops or restarts watching the listening socket, for while the process is
+     * out of descriptors. Restarting also reopens the spare descriptor if it was lost.
+     */
+    void pauseAccepting();
+    void resumeAccepting();
+
+    /**
+     * Reads what a connection has sent and parses its complete requests.
+     *
+     * @return False if the connection must be closed.
+     */
+    bool readFrom(Connection& connection);
+
+    /**
+     * Adds one request to the open batch for its expression and value count.
+     */
+    void addRequest(Connection& connection, const wire::RequestHeader& header, const char* body);
+
+    /**
+     * Hands every open batch to the workers and starts a new round.
+     */
+    void dispatchOpenBatches();
+
+    /**
+     * Appends the responses of finished batches to their connections.
+     */
+    void deliverCompleted();
+
+    /**
+     * Writes buffered output until it is sent or the socket is full.
+     *
+     * @return False if the connection must be closed.
+     */
+    bool flush(Connection& connection);
+
+    /**
+     * Updates which events epoll reports for a connection.
+     */
+    void watch(Connection& connection);
+
+    void close(Connection& connection);
+
+    /**
+     * Evaluates a batch; runs on a worker thread.
+     */
+    void evaluate(Batch& batch, WorkerScratch& scratch);
+
+    /**
+     * Queues an evaluated batch for the I/O thread; runs on a worker thread.
+     */
+    void complete(Batch* batch);
+
+    Batch* newBatch();
+
+    ServerOptions options;
+    unsigned threads;
+    ExpressionCache cache;
+    int listenFd = -1;
+    int epollFd = -1;
+    int wakeFd = -1;                                    // eventfd: stop() and finished batches
+    int spareFd = -1;                                   // Reserve descriptor, freed to turn connections away when out of them
+    bool acceptPaused = false;                          // The listening socket is not watched
+    bool descriptorFreed = false;                       // A connection was closed in this round
+    std::atomic<bool> stopping{false};
+
+    std::vector<std::unique_ptr<Connection>> connections;      // Indexed by slot
+    std::vector<std::uint32_t> freeSlots;
+    std::vector<std::uint32_t> dirty;                   // Connections with new output
+
+    std::vector<std::unique_ptr<Batch>> batchStorage;
+    std::vector<Batch*> freeBatches;
+    std::vector<Batch*> open;                           // Batches filled in this round
+    std::vector<TableEntry> table;                      // Open addressing, keyed by expression and value count
+    std::uint64_t round = 1;
+
+    std::unique_ptr<Workers> workers;
+    std::mutex completedLock;
+    std::vector<Batch*> completed;                      // Evaluated, waiting for the I/O thread
+    std::vector<Batch*> delivering;                     // Swapped with 'completed' by the I/O thread
+
+    std::atomic<std::uint64_t> connectionCount{0};
+    std::atomic<std::uint64_t> requestCount{0};
+    std::atomic<std::uint64_t> errorCount{0};
+    std::atomic<std::uint64_t> batchCount{0};
+    std::atomic<std::uint64_t> columnarCount{0};
+    std::atomic<std::uint64_t> rejectedCount{0};
+    std::atomic<std::uint64_t> acceptErrorCount{0};
+};
+
+/**
+ * One response received by EvalClient.
+ */
+struct EvalResponse {
+    std::uint32_t id = 0;
+    bool ok = false;
+    int value = 0;
+    std::string_view error;             // Valid until the next receive()
+};
+
+/**
+ * A blocking client for EvalServer. Requests are buffered by send() and written
+ * by flush(), so many can be pipelined in one write.
+ */
+class EvalClient {
+public:
+    /**
+     * Connects to a server.
+     *
+     * @throws std::runtime_error if the socket cannot be connected.
+     */
+    explicit EvalClient(const std::string& socketPath);
+
+    ~EvalClient();
+
+    EvalClient(const EvalClient&) = delete;
+    EvalClient& operator=(const EvalClient&) = delete;
+
+    /**
+     * Buffers a request.
+     *
+     * @throws std::runtime_error if the expression is longer than 65535
+     *         bytes or there are more than 65535 values.
+     */
+    void send(std::uint32_t id, std::string_view expression, const int* values, std::size_t count);
+
+    /**
+     * Writes every buffered request.
+     *
+     * @throws std::runtime_error if the connection fails.
+     */
+    void flush();
+
+    /**
+     * Waits for the next response.
+     *
+     * @return False if the server closed the connection.
+     * @throws std::runtime_error if the connection fails or a response is malformed.
+     */
+    bool receive(EvalResponse& response);
+
+    /**
+     * @return True if a complete response is already buffered, so receive() will not block.
+     */
+    bool hasResponse() const;
+
+    /**
+     * Sends one request and waits for its response; no other request may be in flight.
+     *
+     * @return The result.
+     * @throws std::runtime_error with the server's message if evaluation failed.
+     */
+    int eval(std::string_view expression, const std::vector<int>& values = {});
+
+private:
+    int fd = -1;
+    std::vector<char> output;
+    std::vector<char> input;
+    std::size_t inputStart = 0;         // First unconsumed byte of input
+    std::size_t inputEnd = 0;           // End of the bytes read
+};
+
+#endif // EVAL_SERVER_H
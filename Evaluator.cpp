@@ -1,452 +1,900 @@
-
-
 #include "Evaluator.h"
-#include <iostream>
-#include <cctype>
+#include "Syntax.h"
 #include <algorithm>
-#include <sstream>
-#include <cmath>
-#include <stack>
-#include <map>
 #include <stdexcept>
+#include <utility>
 
-Evaluator::Evaluator() {
-    // Initialize operator precedence according to requirements
-    // Higher number = higher precedence
-    precedence["!"] = 8;
-    precedence["++"] = 8;
-    precedence["--"] = 8;
-    precedence["u-"] = 8;  // Unary minus
-    precedence["^"] = 7;
-    precedence["*"] = 6;
-    precedence["/"] = 6;
-    precedence["%"] = 6;
-    precedence["+"] = 5;
-    precedence["b-"] = 5;  // Binary minus
-    precedence[">"] = 4;
-    precedence[">="] = 4;
-    precedence["<"] = 4;
-    precedence["<="] = 4;
-    precedence["=="] = 3;
-    precedence["!="] = 3;
-    precedence["&&"] = 2;
-    precedence["||"] = 1;
-
-    // Initialize binary operator flags
-    isBinary["^"] = true;
-    isBinary["*"] = true;
-    isBinary["/"] = true;
-    isBinary["%"] = true;
-    isBinary["+"] = true;
-    isBinary["b-"] = true;
-    isBinary[">"] = true;
-    isBinary[">="] = true;
-    isBinary["<"] = true;
-    isBinary["<="] = true;
-    isBinary["=="] = true;
-    isBinary["!="] = true;
-    isBinary["&&"] = true;
-    isBinary["||"] = true;
-
-    // Unary operators
-    isBinary["!"] = false;
-    isBinary["++"] = false;
-    isBinary["--"] = false;
-    isBinary["u-"] = false;
-}
+namespace {
 
-std::string Evaluator::tokenize(const std::string& expression) {
-    std::string result;
+// Scratch state for calls that do not pass a context
+EvalContext& threadContext() {
+    thread_local EvalContext context;
+    return context;
+}
 
-    // Remove all spaces
-    for (char c : expression) {
-        if (!std::isspace(c)) {
-            result += c;
-        }
-    }
+// Decimal literals only have a value in typed programs
+[[noreturn]] void throwDecimalLiteral(std::string_view text, std::uint32_t offset) {
+    throw std::runtime_error(syntax::errorMessage(syntax::Error::DecimalLiteral, {text, std::to_string(offset)}));
+}
 
-    return result;
+// An operator without enough operands; closingParen if found while closing a parenthesis
+[[noreturn]] void throwNotEnoughOperands(const OperatorInfo& info, bool closingParen) {
+    throw std::runtime_error(syntax::errorMessage(
+        closingParen ? syntax::Error::NotEnoughOperandsAtParenthesis : syntax::Error::NotEnoughOperands,
+        {info.arity == 2 ? "binary" : "unary", info.name}));
 }
 
-bool Evaluator::isOperator(char c) const {
-    return (c == '+' || c == '-' || c == '*' || c == '/' || c == '%' ||
-            c == '^' || c == '!' || c == '>' || c == '<' || c == '=' ||
-            c == '&' || c == '|');
+// Both the eval() stacks and the parse stacks fail the same way
+[[noreturn]] void throwStackLimit(std::size_t limit, std::uint32_t offset) {
+    throw std::runtime_error("Expression needs more than " + std::to_string(limit) +
+                             " stack entries @ char " + std::to_string(offset));
 }
 
-int Evaluator::performOperation(const std::string& op, int b, int a) {
-    // For binary operators
-    if (op == "+") return a + b;
-    if (op == "b-") return a - b;
-    if (op == "*") return a * b;
-    if (op == "/") {
-        if (b == 0) throw std::runtime_error("Division by zero @ char " + std::to_string(op.length()));
-        return a / b;
-    }
-    if (op == "%") {
-        if (b == 0) throw std::runtime_error("Modulo by zero @ char " + std::to_string(op.length()));
-        return a % b;
-    }
-    if (op == "^") return static_cast<int>(pow(a, b));
-    if (op == ">") return a > b;
-    if (op == ">=") return a >= b;
-    if (op == "<") return a < b;
-    if (op == "<=") return a <= b;
-    if (op == "==") return a == b;
-    if (op == "!=") return a != b;
-    if (op == "&&") return a && b;
-    if (op == "||") return a || b;
-
-    // For unary operators
-    if (op == "!") return !b;
-    if (op == "++") return b + 1;
-    if (op == "--") return b - 1;
-    if (op == "u-") return -b;
-
-    throw std::runtime_error("Unsupported operator: " + op);
+bool isComparison(Op op) {
+    return op == Op::Greater || op == Op::GreaterEqual || op == Op::Less ||
+           op == Op::LessEqual || op == Op::Equal || op == Op::NotEqual;
 }
 
-void Evaluator::validateExpression(const std::string& expression) {
-    if (expression.empty()) {
-        throw std::runtime_error("Expression is empty");
+// The opcode for an arithmetic or comparison operator on operands of the given type
+TypedOp typedOpFor(Op op, ValueType operands) {
+    bool isInt = operands == ValueType::Int;
+    switch (op) {
+    case Op::Add:          return isInt ? TypedOp::AddInt : TypedOp::AddDouble;
+    case Op::Subtract:     return isInt ? TypedOp::SubtractInt : TypedOp::SubtractDouble;
+    case Op::Multiply:     return isInt ? TypedOp::MultiplyInt : TypedOp::MultiplyDouble;
+    case Op::Divide:       return isInt ? TypedOp::DivideInt : TypedOp::DivideDouble;
+    case Op::Modulo:       return isInt ? TypedOp::ModuloInt : TypedOp::ModuloDouble;
+    case Op::Power:        return isInt ? TypedOp::PowerInt : TypedOp::PowerDouble;
+    case Op::Greater:      return isInt ? TypedOp::GreaterInt : TypedOp::GreaterDouble;
+    case Op::GreaterEqual: return isInt ? TypedOp::GreaterEqualInt : TypedOp::GreaterEqualDouble;
+    case Op::Less:         return isInt ? TypedOp::LessInt : TypedOp::LessDouble;
+    case Op::LessEqual:    return isInt ? TypedOp::LessEqualInt : TypedOp::LessEqualDouble;
+    case Op::Equal:        return isInt ? TypedOp::EqualInt : TypedOp::EqualDouble;
+    case Op::NotEqual:     return isInt ? TypedOp::NotEqualInt : TypedOp::NotEqualDouble;
+    case Op::LogicalAnd:   return TypedOp::And;
+    case Op::LogicalOr:    return TypedOp::Or;
+    case Op::Negate:       return isInt ? TypedOp::NegateInt : TypedOp::NegateDouble;
+    default:               throwUnsupportedOperator(op);
     }
+}
 
-    // Check if expression starts with a closing parenthesis or binary operator
-    if (expression[0] == ')') {
-        throw std::runtime_error("Expression can't start with a closing parenthesis @ char: 0");
+/**
+ * Infers the static type of every node of a tree in post-order: literals with a
+ * '.' or exponent are Double, arithmetic treats Bools as 0/1 Ints and is Double
+ * if either operand is, and comparisons and logical operators are Bool.
+ *
+ * @param operandTypes Receives, per operator node, the type its operands are converted to.
+ * @return The type of every node.
+ */
+std::vector<ValueType> inferTypes(const Ast& ast, const std::vector<TypedVariable>& variables,
+                                  std::vector<ValueType>& operandTypes) {
+    const std::vector<AstNode>& nodes = ast.allNodes();
+    auto arithmetic = [](ValueType type) { return type == ValueType::Bool ? ValueType::Int : type; };
+    std::vector<ValueType> types(nodes.size());
+    operandTypes.assign(nodes.size(), ValueType::Int);
+
+    for (std::uint32_t i = 0; i < nodes.size(); i++) {
+        const AstNode& n = nodes[i];
+        switch (n.kind) {
+        case NodeKind::Constant:
+            types[i] = ValueType::Int;
+            break;
+        case NodeKind::Decimal:
+            types[i] = ValueType::Double;
+            break;
+        case NodeKind::Variable:
+            types[i] = variables[n.value].type;
+            break;
+        case NodeKind::Unary:
+            operandTypes[i] = n.op == Op::LogicalNot ? ValueType::Bool : arithmetic(types[n.lhs]);
+            types[i] = operandTypes[i];
+            break;
+        case NodeKind::Binary:
+            if (n.op == Op::LogicalAnd || n.op == Op::LogicalOr) {
+                operandTypes[i] = ValueType::Bool;
+            }
+            else if (arithmetic(types[n.lhs]) == ValueType::Double || arithmetic(types[n.rhs]) == ValueType::Double) {
+                operandTypes[i] = ValueType::Double;
+            }
+            else {
+                operandTypes[i] = ValueType::Int;
+            }
+            types[i] = isComparison(n.op) ? ValueType::Bool : operandTypes[i];
+            break;
+        }
     }
+    return types;
+}
 
-    if (expression[0] == '*' || expression[0] == '/' || expression[0] == '%' ||
-        expression[0] == '^' || expression[0] == '>' || expression[0] == '<' ||
-        expression[0] == '=' || expression[0] == '&' || expression[0] == '|') {
-        throw std::runtime_error("Expression can't start with a binary operator @ char: 0");
+/**
+ * Checks an expression for syntax errors and the length and nesting limits one
+ * token at a time, so eval() and parseTree() can validate while they lex
+ * instead of buffering the tokens for a separate pass.
+ *
+ * Syntax errors take precedence over errors found while evaluating or building
+ * the tree, wherever they occur: when those fail, checkRest() validates the
+ * remaining tokens first, so the result is the same as validating up front.
+ */
+class SyntaxChecker {
+public:
+    /**
+     * @param expression The expression being checked.
+     * @param limits The evaluator's limits.
+     * @throws std::runtime_error if the expression is longer than limits.maxLength.
+     */
+    SyntaxChecker(std::string_view expression, const EvaluatorLimits& limits)
+        : text(expression), maxDepth(limits.maxNestingDepth) {
+        if (expression.length() > limits.maxLength) {
+            fail(syntax::Error::TooLong, {std::to_string(expression.length()), std::to_string(limits.maxLength)});
+        }
     }
 
-    // Check for consecutive binary operators, operands, or mismatched parentheses
-    int openParenCount = 0;
-    bool lastWasOperand = false;
-    bool lastWasOperator = false;
-    char prevChar = '\0';
-
-    for (size_t i = 0; i < expression.length(); i++) {
-        char c = expression[i];
+    /**
+     * Checks the next token against the ones before it.
+     *
+     * @param token The token.
+     * @throws std::runtime_error with a descriptive error message if the token cannot follow.
+     *
+     * Time Complexity: O(1).
+     */
+    void check(const Token& token) {
+        if (count++ == 0) {
+            checkFirst(token);
+        }
 
+        switch (token.kind) {
         // Check for opening and closing parentheses
-        if (c == '(') {
-            openParenCount++;
+        case TokenKind::LeftParen:
+            if (++openParenCount > maxDepth) {
+                fail("Parentheses nested deeper than the limit of " + std::to_string(maxDepth) +
+                     " @ char " + std::to_string(token.offset));
+            }
             lastWasOperand = false;
             lastWasOperator = false;
-            prevChar = c;
-        }
-        else if (c == ')') {
-            openParenCount--;
-            if (openParenCount < 0) {
-                throw std::runtime_error("Mismatched parentheses - too many closing @ char: " + std::to_string(i));
+            break;
+
+        case TokenKind::RightParen:
+            if (openParenCount == 0) {
+                fail(syntax::Error::TooManyClosing, token.offset);
             }
+            openParenCount--;
             lastWasOperand = true;
             lastWasOperator = false;
-            prevChar = c;
-        }
-        // Check for operands (digits)
-        else if (std::isdigit(c)) {
-            if (lastWasOperand && prevChar != '(' && !std::isdigit(prevChar)) {
-                throw std::runtime_error("Two operands in a row @ char " + std::to_string(i));
+            break;
+
+        // Check for operands (numbers and identifiers)
+        case TokenKind::Number:
+        case TokenKind::Decimal:
+        case TokenKind::Identifier:
+            if (lastWasOperand) {
+                fail(syntax::Error::TwoOperands, token.offset);
             }
             lastWasOperand = true;
             lastWasOperator = false;
-            prevChar = c;
-        }
+            break;
+
         // Check for operators
-        else if (isOperator(c)) {
-            // Handle multi-char operators
-            if (c == '&' && i + 1 < expression.length() && expression[i + 1] == '&') {
-                // Skip the next '&'
-                i++;
-            }
-            else if (c == '|' && i + 1 < expression.length() && expression[i + 1] == '|') {
-                // Skip the next '|'
-                i++;
-            }
-            else if (c == '=' && i + 1 < expression.length() && expression[i + 1] == '=') {
-                // Skip the next '='
-                i++;
-            }
-            else if (c == '!' && i + 1 < expression.length() && expression[i + 1] == '=') {
-                // Skip the next '='
-                i++;
-            }
-            else if (c == '>' && i + 1 < expression.length() && expression[i + 1] == '=') {
-                // Skip the next '='
-                i++;
-            }
-            else if (c == '<' && i + 1 < expression.length() && expression[i + 1] == '=') {
-                // Skip the next '='
-                i++;
-            }
-            else if (c == '+' && i + 1 < expression.length() && expression[i + 1] == '+') {
-                // Skip the next '+'
-                i++;
-            }
-            else if (c == '-' && i + 1 < expression.length() && expression[i + 1] == '-') {
-                // Skip the next '-'
-                i++;
+        case TokenKind::Operator: {
+            // Check for unary operator followed by binary operator
+            if (count > 1 && prev.kind == TokenKind::Operator &&
+                operatorInfo(prev.op).arity == 1 && operatorInfo(token.op).arity == 2) {
+                fail(syntax::Error::UnaryThenBinary, token.offset);
             }
 
             // Check for consecutive binary operators
+            char c = text[token.offset];
             if (lastWasOperator && c != '+' && c != '-' && c != '!') {
-                throw std::runtime_error("Two binary operators in a row @ char " + std::to_string(i));
-            }
-
-            // Check for unary operator followed by binary operator
-            if ((prevChar == '+' && c == '<') || (prevChar == '+' && c == '*') ||
-                (prevChar == '-' && c == '<') || (prevChar == '-' && c == '*')) {
-                throw std::runtime_error("A unary operand can't be followed by a binary operator @ char " + std::to_string(i));
+                fail(syntax::Error::TwoBinary, token.offset);
             }
 
             lastWasOperator = true;
             lastWasOperand = false;
-            prevChar = c;
+            break;
+        }
+
+        case TokenKind::Invalid: {
+            char c = text[token.offset];
+            fail(c == '=' || c == '&' || c == '|' ? syntax::Error::SingleOperator : syntax::Error::InvalidCharacter,
+                 {text.substr(token.offset, 1), std::to_string(token.offset)});
         }
-        else {
-            throw std::runtime_error("Invalid character in expression: " + std::string(1, c) + " @ char " + std::to_string(i));
         }
-    }
 
-    // Check for unclosed parentheses
-    if (openParenCount > 0) {
-        throw std::runtime_error("Mismatched parentheses - unclosed parentheses");
+        prev = token;
     }
-}
 
-int Evaluator::eval(const std::string& expression) {
-    // Tokenize and clean the expression
-    std::string tokenized = tokenize(expression);
+    /**
+     * Checks what can only be judged at the end of the expression.
+     *
+     * @throws std::runtime_error if the expression is empty or leaves parentheses open.
+     */
+    void finish() {
+        if (count == 0) {
+            fail(syntax::Error::Empty);
+        }
 
-    // Validate the expression
-    validateExpression(tokenized);
+        // Check for unclosed parentheses
+        if (openParenCount > 0) {
+            fail(syntax::Error::UnclosedParentheses);
+        }
+    }
 
-    std::stack<int> values;         // Stack to store operand values
-    std::stack<std::string> ops; // Stack to store operators
+    /**
+     * Called when evaluation fails: checks the tokens the lexer has not yet
+     * produced, so that a syntax error later in the expression is reported
+     * instead. Does nothing if the checker itself already failed.
+     *
+     * @param lexer The lexer the failed evaluation was reading from.
+     * @throws std::runtime_error for the first syntax error among the remaining tokens.
+     *
+     * Time Complexity: O(r) where r is the length of the rest of the expression.
+     */
+    void checkRest(Lexer& lexer) {
+        if (failed) {
+            return;
+        }
+        Token token;
+        while (lexer.next(token)) {
+            check(token);
+        }
+        finish();
+    }
 
-    for (size_t i = 0; i < tokenized.length(); i++) {
-        // Skip spaces (though they should have been removed by tokenize)
-        if (tokenized[i] == ' ') {
-            continue;
+    /**
+     * @return Number of tokens checked so far.
+     */
+    std::size_t tokens() const { return count; }
+
+private:
+    // Check if expression starts with a closing parenthesis or binary operator
+    void checkFirst(const Token& first) {
+        if (first.kind == TokenKind::RightParen) {
+            fail(syntax::Error::StartsWithClosing, first.offset);
         }
 
-        // If current character is an opening bracket, push it to 'ops'
-        else if (tokenized[i] == '(') {
-            ops.push("(");
+        char firstChar = text[first.offset];
+        if (firstChar == '*' || firstChar == '/' || firstChar == '%' ||
+            firstChar == '^' || firstChar == '>' || firstChar == '<' ||
+            firstChar == '=' || firstChar == '&' || firstChar == '|') {
+            fail(syntax::Error::StartsWithBinary, first.offset);
         }
+    }
 
-        // If current character is a digit, extract the full number
-        else if (isdigit(tokenized[i])) {
-            int val = 0;
-            while (i < tokenized.length() && isdigit(tokenized[i])) {
-                val = (val * 10) + (tokenized[i] - '0');
-                i++;
-            }
-            i--; // Move back one position since for loop will increment
-            values.push(val);
+    [[noreturn]] void fail(const std::string& message) {
+        failed = true;
+        throw std::runtime_error(message);
+    }
+
+    [[noreturn]] void fail(syntax::Error error, std::initializer_list<std::string_view> args = {}) {
+        fail(syntax::errorMessage(error, args));
+    }
+
+    [[noreturn]] void fail(syntax::Error error, std::uint32_t offset) {
+        fail(syntax::errorMessage(error, {std::to_string(offset)}));
+    }
+
+    std::string_view text;
+    std::size_t maxDepth;
+    std::size_t count = 0;              // Tokens checked
+    std::size_t openParenCount = 0;
+    bool lastWasOperand = false;
+    bool lastWasOperator = false;
+    bool failed = false;                // A syntax error has been thrown
+    Token prev{};                       // The previous token, once count > 0
+};
+
+} // namespace
+
+template <typename Arithmetic, typename Stack>
+void Evaluator::applyOperator(const PendingOp& pending, Stack& values, bool closingParen, bool skipped) const {
+    const OperatorInfo& info = operatorInfo(pending.op);
+
+    if (values.size() < static_cast<size_t>(info.arity)) {
+        throwNotEnoughOperands(info, closingParen);
+    }
+
+    // A skipped operand is never observed, so it is not computed: it can raise no
+    // error (division by zero, or overflow in the checked modes) and costs nothing
+    if (skipped) {
+        if (info.arity == 2) {
+            values.pop();
         }
+        values.top() = typename Arithmetic::Value(0);
+        return;
+    }
+
+    if (info.arity == 2) {
+        typename Arithmetic::Value val2 = std::move(values.top());
+        values.pop();
+        values.top() = Arithmetic::binary(pending.op, values.top(), val2, pending.offset);
+    }
+    else {
+        values.top() = Arithmetic::unary(pending.op, values.top(), pending.offset);
+    }
+}
 
-        // If current character is a closing bracket, solve the entire bracket
-        else if (tokenized[i] == ')') {
-            while (!ops.empty() && ops.top() != "(") {
-                std::string op = ops.top();
-                ops.pop();
+void Evaluator::setLimits(const EvaluatorLimits& limits) {
+    // Token offsets are 32-bit
+    if (limits.maxLength > UINT32_MAX) {
+        throw std::runtime_error("Expression length limit must be below 2^32");
+    }
+    if (limits.maxStackDepth == 0) {
+        throw std::runtime_error("Stack depth limit must be at least 1");
+    }
+    bounds = limits;
+}
 
-                if (isBinary[op]) {
-                    // Binary operation needs two operands
-                    if (values.size() < 2) {
-                        throw std::runtime_error("Invalid expression: Not enough operands for binary operator " + op);
-                    }
+template <typename Stack>
+void Evaluator::reserveEntry(Stack& stack, Arena& arena, std::uint32_t offset) const {
+    if (stack.size() == stack.capacity() || stack.size() == bounds.maxStackDepth) {
+        if (stack.size() >= bounds.maxStackDepth) {
+            throwStackLimit(bounds.maxStackDepth, offset);
+        }
+        stack.grow(std::min(stack.capacity() * 2, bounds.maxStackDepth), arena);
+    }
+}
 
-                    int val2 = values.top();
-                    values.pop();
+template <typename Arithmetic>
+typename Arithmetic::Value Evaluator::evalAs(std::string_view expression) const {
+    return evalAs<Arithmetic>(expression, threadContext());
+}
 
-                    int val1 = values.top();
-                    values.pop();
+template <typename Arithmetic>
+typename Arithmetic::Value Evaluator::evalAs(std::string_view expression, EvalContext& context) const {
+    using Value = typename Arithmetic::Value;
+
+    profile::Recorder recorder(profile::Activity::Evaluate, expression);
+
+    // Tokens are checked and evaluated as the lexer produces them, so nothing is
+    // buffered and memory only grows with the depth of the stacks
+    SyntaxChecker checker(expression, bounds);
+    Lexer lexer(expression);
+    context.arena.reset();
+    auto& values = context.valueStack(static_cast<Value*>(nullptr));  // Stack to store operand values
+    EvalContext::OpStack& ops = context.ops;                          // Stack to store operators
+    values.reset(0, context.arena);
+    ops.reset(0, context.arena);
+
+    // While a && / || whose left operand already decides the result is on the
+    // stack, its right operand is skipped: its value is discarded and it may not
+    // fail. 'skipFrom' is the stack index of the outermost such operator.
+    const size_t notSkipping = static_cast<size_t>(-1);
+    size_t skipFrom = notSkipping;
+    auto applyTop = [&](bool closingParen) {
+        recorder.phase(profile::Phase::Execute);
+        recorder.applied(ops.top().op);
+        applyOperator<Arithmetic>(ops.top(), values, closingParen, skipFrom != notSkipping && ops.size() > skipFrom + 1);
+        recorder.phase(profile::Phase::Parse);
+        ops.pop();
+        if (ops.size() == skipFrom) {
+            skipFrom = notSkipping;
+        }
+    };
+
+    try {
+        Token token;
+        while (lexer.next(token)) {
+            checker.check(token);
+
+            switch (token.kind) {
+            // If current token is an opening bracket, push it to 'ops'
+            case TokenKind::LeftParen:
+                reserveEntry(ops, context.arena, token.offset);
+                ops.push({Op::LeftParen, token.offset});
+                recorder.operatorDepth(ops.size());
+                break;
+
+            // A literal in a skipped operand is not converted either, so it cannot be out of range
+            case TokenKind::Number:
+                reserveEntry(values, context.arena, token.offset);
+                values.push(skipFrom == notSkipping ? Arithmetic::literal(token, expression) : Value(0));
+                recorder.valueDepth(values.size());
+                break;
+
+            case TokenKind::Decimal:
+                throwDecimalLiteral(tokenText(token, expression), token.offset);
+
+            // Identifiers only have a value in compiled programs
+            case TokenKind::Identifier:
+                throw std::runtime_error("Unbound identifier: " + std::string(tokenText(token, expression)) +
+                                         " @ char " + std::to_string(token.offset) +
+                                         " (use compile() and bind variable values)");
+
+            // If current token is a closing bracket, solve the entire bracket
+            case TokenKind::RightParen:
+                while (!ops.empty() && ops.top().op != Op::LeftParen) {
+                    applyTop(true);
+                }
 
-                    values.push(performOperation(op, val2, val1));
+                // Remove the opening bracket
+                if (!ops.empty()) {
+                    ops.pop();
                 }
-                else {
-                    // Unary operation needs one operand
-                    if (values.empty()) {
-                        throw std::runtime_error("Invalid expression: Not enough operands for unary operator " + op);
-                    }
+                break;
 
-                    int val = values.top();
-                    values.pop();
+            case TokenKind::Operator:
+                // Process operators according to precedence
+                while (!ops.empty() && appliesBefore(ops.top().op, token.op)) {
+                    applyTop(false);
+                }
 
-                    values.push(performOperation(op, val));
+                // The left operand of && / || is complete here; skip the right one if it is decided
+                if (skipFrom == notSkipping && !values.empty() &&
+                    ((token.op == Op::LogicalAnd && !Arithmetic::isTrue(values.top())) ||
+                     (token.op == Op::LogicalOr && Arithmetic::isTrue(values.top())))) {
+                    skipFrom = ops.size();
                 }
+
+                // Push current operator to stack
+                reserveEntry(ops, context.arena, token.offset);
+                ops.push({token.op, token.offset});
+                recorder.operatorDepth(ops.size());
+                break;
+
+            case TokenKind::Invalid:
+                // Rejected by the checker
+                break;
             }
+        }
+        checker.finish();
+        recorder.tokens(checker.tokens());
 
-            // Remove the opening bracket
-            if (!ops.empty()) {
-                ops.pop();
+        // Process all remaining operators in the stack
+        while (!ops.empty()) {
+            if (ops.top().op == Op::LeftParen) {
+                throw std::runtime_error("Mismatched parentheses - unclosed parenthesis");
             }
+            applyTop(false);
         }
+    }
+    catch (...) {
+        recorder.tokens(checker.tokens());
+        checker.checkRest(lexer);
+        throw;
+    }
 
-        // If current character is an operator
-        else if (isOperator(tokenized[i])) {
-            std::string currentOp;
+    // Final result should be on top of the values stack
+    if (values.size() != 1) {
+        throw std::runtime_error(syntax::errorMessage(syntax::Error::TooManyValues));
+    }
+
+    recorder.succeeded();
+    return std::move(values.top());
+}
 
-            // Handle multi-character operators
-            if (tokenized[i] == '+') {
-                if (i + 1 < tokenized.length() && tokenized[i + 1] == '+') {
-                    currentOp = "++";
-                    i++;
+template std::int32_t Evaluator::evalAs<Int32Arithmetic>(std::string_view, EvalContext&) const;
+template std::int64_t Evaluator::evalAs<Int64Arithmetic>(std::string_view, EvalContext&) const;
+template std::int32_t Evaluator::evalAs<CheckedArithmetic<std::int32_t>>(std::string_view, EvalContext&) const;
+template std::int64_t Evaluator::evalAs<CheckedInt64Arithmetic>(std::string_view, EvalContext&) const;
+template BigInt Evaluator::evalAs<BigIntArithmetic>(std::string_view, EvalContext&) const;
+template std::int32_t Evaluator::evalAs<Int32Arithmetic>(std::string_view) const;
+template std::int64_t Evaluator::evalAs<Int64Arithmetic>(std::string_view) const;
+template std::int32_t Evaluator::evalAs<CheckedArithmetic<std::int32_t>>(std::string_view) const;
+template std::int64_t Evaluator::evalAs<CheckedInt64Arithmetic>(std::string_view) const;
+template BigInt Evaluator::evalAs<BigIntArithmetic>(std::string_view) const;
+
+int Evaluator::eval(std::string_view expression) const {
+    return evalAs<Int32Arithmetic>(expression, threadContext());
+}
+
+int Evaluator::eval(std::string_view expression, EvalContext& context) const {
+    return evalAs<Int32Arithmetic>(expression, context);
+}
+
+CompiledExpression Evaluator::compile(const std::string& expression) const {
+    return compileProgram(expression, nullptr);
+}
+
+CompiledExpression Evaluator::compile(const std::string& expression, const std::vector<std::string>& variables) const {
+    return compileProgram(expression, &variables);
+}
+
+Ast Evaluator::parse(const std::string& expression) const {
+    profile::Recorder recorder(profile::Activity::Compile, expression);
+    Ast ast = parseTree(expression, nullptr, recorder);
+    recorder.succeeded();
+    return ast;
+}
+
+Ast Evaluator::parse(const std::string& expression, const std::vector<std::string>& variables) const {
+    profile::Recorder recorder(profile::Activity::Compile, expression);
+    Ast ast = parseTree(expression, &variables, recorder);
+    recorder.succeeded();
+    return ast;
+}
+
+Ast Evaluator::parseTree(const std::string& expression, const std::vector<std::string>* variables,
+                         profile::Recorder& recorder) const {
+    // Validate while lexing, exactly like eval()
+    SyntaxChecker checker(expression, bounds);
+    Lexer lexer(expression);
+
+    Ast ast;
+    if (variables) {
+        ast.setVariables(*variables);
+    }
+
+    std::vector<PendingOp> ops;
+    std::vector<std::uint32_t> operands;  // Nodes not yet consumed by an operator
+
+    // Builds the node for an operator from the operands on the stack,
+    // reporting missing operands with the same messages eval() uses
+    auto reduce = [&](const PendingOp& pending, bool closingParen) {
+        const OperatorInfo& info = operatorInfo(pending.op);
+        if (operands.size() < static_cast<size_t>(info.arity)) {
+            throwNotEnoughOperands(info, closingParen);
+        }
+        if (info.arity == 2) {
+            std::uint32_t rhs = operands.back();
+            operands.pop_back();
+            operands.back() = ast.addBinary(pending.op, operands.back(), rhs, pending.offset);
+        }
+        else {
+            operands.back() = ast.addUnary(pending.op, operands.back(), pending.offset);
+        }
+    };
+
+    // Both stacks are bounded like eval()'s
+    auto pushOp = [&](const PendingOp& pending) {
+        if (ops.size() >= bounds.maxStackDepth) {
+            throwStackLimit(bounds.maxStackDepth, pending.offset);
+        }
+        ops.push_back(pending);
+    };
+    auto pushOperand = [&](std::uint32_t node, std::uint32_t offset) {
+        if (operands.size() >= bounds.maxStackDepth) {
+            throwStackLimit(bounds.maxStackDepth, offset);
+        }
+        operands.push_back(node);
+    };
+
+    try {
+        Token token;
+        while (lexer.next(token)) {
+            checker.check(token);
+
+            switch (token.kind) {
+            case TokenKind::LeftParen:
+                pushOp({Op::LeftParen, token.offset});
+                break;
+
+            case TokenKind::Number:
+                pushOperand(ast.addConstant(token.value, token.offset), token.offset);
+                break;
+
+            case TokenKind::Decimal:
+                pushOperand(ast.addDecimal(decimalValue(token, expression), token.offset), token.offset);
+                break;
+
+            case TokenKind::Identifier: {
+                std::string name(tokenText(token, expression));
+
+                // Resolve the name to its slot once, here, instead of on every evaluation
+                std::int32_t slot;
+                if (variables) {
+                    auto it = std::find(variables->begin(), variables->end(), name);
+                    if (it == variables->end()) {
+                        throw std::runtime_error("Unknown identifier: " + name + " @ char " + std::to_string(token.offset));
+                    }
+                    slot = static_cast<std::int32_t>(it - variables->begin());
                 }
                 else {
-                    currentOp = "+";
+                    slot = ast.slotFor(name);
                 }
+
+                pushOperand(ast.addVariable(slot, token.offset), token.offset);
+                break;
             }
-            else if (tokenized[i] == '-') {
-                if (i + 1 < tokenized.length() && tokenized[i + 1] == '-') {
-                    currentOp = "--";
-                    i++;
+
+            case TokenKind::RightParen:
+                while (!ops.empty() && ops.back().op != Op::LeftParen) {
+                    reduce(ops.back(), true);
+                    ops.pop_back();
                 }
-                else {
-                    // Check if this is a unary minus (negation) or binary minus
-                    if (i == 0 || tokenized[i - 1] == '(' || isOperator(tokenized[i - 1])) {
-                        currentOp = "u-";  // unary minus
-                    }
-                    else {
-                        currentOp = "b-";  // binary minus
-                    }
+
+                // Remove the opening bracket
+                if (!ops.empty()) {
+                    ops.pop_back();
                 }
-            }
-            else if (tokenized[i] == '=') {
-                if (i + 1 < tokenized.length() && tokenized[i + 1] == '=') {
-                    currentOp = "==";
-                    i++;
+                break;
+
+            case TokenKind::Operator:
+                while (!ops.empty() && appliesBefore(ops.back().op, token.op)) {
+                    reduce(ops.back(), false);
+                    ops.pop_back();
                 }
-                else {
-                    throw std::runtime_error("Invalid operator: single '=' is not supported @ char " + std::to_string(i));
+                pushOp({token.op, token.offset});
+                break;
+
+            case TokenKind::Invalid:
+                // Rejected by the checker
+                break;
+            }
+        }
+        checker.finish();
+        recorder.tokens(checker.tokens());
+
+        // Reduce all remaining operators
+        while (!ops.empty()) {
+            if (ops.back().op == Op::LeftParen) {
+                throw std::runtime_error("Mismatched parentheses - unclosed parenthesis");
+            }
+            reduce(ops.back(), false);
+            ops.pop_back();
+        }
+    }
+    catch (...) {
+        recorder.tokens(checker.tokens());
+        checker.checkRest(lexer);
+        throw;
+    }
+
+    if (operands.size() != 1) {
+        throw std::runtime_error(syntax::errorMessage(syntax::Error::TooManyValues));
+    }
+
+    ast.setRoot(operands.back());
+    return ast;
+}
+
+CompiledExpression Evaluator::compileProgram(const std::string& expression, const std::vector<std::string>* variables) const {
+    profile::Recorder recorder(profile::Activity::Compile, expression);
+    Ast ast = parseTree(expression, variables, recorder);
+    for (const AstNode& n : ast.allNodes()) {
+        if (n.kind == NodeKind::Decimal) {
+            std::string_view text(expression);
+            Token literal;
+            Lexer(text.substr(n.offset)).next(literal);
+            throwDecimalLiteral(text.substr(n.offset, literal.length), n.offset);
+        }
+    }
+    recorder.phase(profile::Phase::Fold);
+    if (foldConstants) {
+        ast.fold();
+    }
+
+    recorder.phase(profile::Phase::Generate);
+    CompiledExpression program;
+    program.text = expression;
+    program.names = ast.variables();
+    generateCode(ast, program);
+    recorder.succeeded();
+    return program;
+}
+
+void Evaluator::generateCode(const Ast& ast, CompiledExpression& program) const {
+    const std::vector<AstNode>& nodes = ast.allNodes();
+
+    // For short-circuit operators the jump goes between the two operands, i.e. just
+    // before the first node of the right operand's subtree. A subtree's first node
+    // is the first node of its leftmost leaf, found in one pass thanks to post-order.
+    std::vector<std::uint32_t> first(nodes.size());
+    std::vector<std::int32_t> jumpBefore(nodes.size(), -1);
+    for (std::uint32_t i = 0; i < nodes.size(); i++) {
+        const AstNode& n = nodes[i];
+        first[i] = n.kind == NodeKind::Unary || n.kind == NodeKind::Binary ? first[n.lhs] : i;
+        if (shortCircuit && n.kind == NodeKind::Binary && (n.op == Op::LogicalAnd || n.op == Op::LogicalOr)) {
+            jumpBefore[first[n.rhs]] = static_cast<std::int32_t>(i);
+        }
+    }
+
+    // Post-order node storage means emitting nodes in array order yields postfix code
+    std::vector<std::size_t> jumpAt(nodes.size());  // Position of the jump owned by each && / || node
+    size_t depth = 0;
+    for (std::uint32_t i = 0; i < nodes.size(); i++) {
+        const AstNode& n = nodes[i];
+
+        if (jumpBefore[i] >= 0) {
+            // The left operand is complete: jump over the right one if it decides the result
+            const AstNode& owner = nodes[jumpBefore[i]];
+            jumpAt[jumpBefore[i]] = program.code.size();
+            program.code.push_back({owner.op == Op::LogicalAnd ? OpCode::JumpIfZero : OpCode::JumpIfNonZero,
+                                    0, owner.offset});
+            depth--;
+        }
+
+        switch (n.kind) {
+        case NodeKind::Constant:
+            program.code.push_back({OpCode::PushConst, n.value, n.offset});
+            depth++;
+            break;
+        case NodeKind::Variable:
+            program.code.push_back({OpCode::PushVar, n.value, n.offset});
+            depth++;
+            break;
+        case NodeKind::Decimal:
+            // Rejected by compileProgram()
+            break;
+        case NodeKind::Unary:
+            program.code.push_back({operatorInfo(n.op).code, 0, n.offset});
+            break;
+        case NodeKind::Binary:
+            if (shortCircuit && (n.op == Op::LogicalAnd || n.op == Op::LogicalOr)) {
+                // The right operand decides the result; normalise it and patch the jump to land here
+                if (!ast.isBoolean(n.rhs)) {
+                    program.code.push_back({OpCode::ToBool, 0, n.offset});
                 }
+                program.code[jumpAt[i]].operand = static_cast<std::int32_t>(program.code.size());
+                break;
+            }
+            program.code.push_back({operatorInfo(n.op).code, 0, n.offset});
+            depth--;
+            break;
+        }
+        program.stackDepth = std::max(program.stackDepth, depth);
+    }
+}
+
+TypedExpression Evaluator::compileTyped(const std::string& expression, const std::vector<TypedVariable>& variables) const {
+    std::vector<std::string> names;
+    bool allInt = true;
+    for (const TypedVariable& variable : variables) {
+        if (variable.type == ValueType::Bool) {
+            throw std::runtime_error("Variable " + variable.name + " must be int or double");
+        }
+        names.push_back(variable.name);
+        allInt = allInt && variable.type == ValueType::Int;
+    }
+
+    profile::Recorder recorder(profile::Activity::Compile, expression);
+    Ast ast = parseTree(expression, &names, recorder);
+    std::vector<ValueType> operandTypes;
+    ValueType resultType = inferTypes(ast, variables, operandTypes)[ast.root()];
+    recorder.phase(profile::Phase::Fold);
+    if (foldConstants && allInt && !ast.hasDecimals()) {
+        ast.fold();
+    }
+
+    recorder.phase(profile::Phase::Generate);
+    TypedExpression program;
+    program.text = expression;
+    program.vars = variables;
+    generateTypedCode(ast, program);
+
+    // Folding can turn a Bool into an Int 0/1 or back (0 && x, (x > 1) + 0);
+    // the value is the same, and the declared type must not depend on it
+    if (program.result != resultType) {
+        program.code.push_back({resultType == ValueType::Bool ? TypedOp::IntToBool : TypedOp::BoolToInt, 0, 0});
+        program.result = resultType;
+    }
+    recorder.succeeded();
+    return program;
+}
+
+void Evaluator::generateTypedCode(const Ast& ast, TypedExpression& program) const {
+    const std::vector<AstNode>& nodes = ast.allNodes();
+
+    // Pass 1: types, and where each left operand is complete. As in generateCode(),
+    // a subtree's first node is found from its leftmost leaf; the left operand of
+    // a binary node is complete just before the first node of its right operand,
+    // so that is where its conversion (and any jump) goes.
+    std::vector<ValueType> operandTypes;
+    std::vector<ValueType> types = inferTypes(ast, program.vars, operandTypes);
+    std::vector<std::uint32_t> first(nodes.size());
+    std::vector<std::int32_t> leftDoneBefore(nodes.size(), -1);
+
+    // Double products feeding + or - are computed by the parent's fused instruction
+    std::vector<TypedOp> fused(nodes.size(), TypedOp::AddDouble);
+    std::vector<bool> isFused(nodes.size(), false);
+    std::vector<bool> fusedAway(nodes.size(), false);
+    auto isDoubleProduct = [&](std::uint32_t index) {
+        const AstNode& n = nodes[index];
+        return n.kind == NodeKind::Binary && n.op == Op::Multiply && types[index] == ValueType::Double;
+    };
+
+    for (std::uint32_t i = 0; i < nodes.size(); i++) {
+        const AstNode& n = nodes[i];
+        first[i] = n.kind == NodeKind::Unary || n.kind == NodeKind::Binary ? first[n.lhs] : i;
+        if (n.kind != NodeKind::Binary) {
+            continue;
+        }
+        leftDoneBefore[first[n.rhs]] = static_cast<std::int32_t>(i);
+
+        if (fuseMultiplyAdd && types[i] == ValueType::Double && (n.op == Op::Add || n.op == Op::Subtract)) {
+            bool add = n.op == Op::Add;
+            if (isDoubleProduct(n.lhs)) {
+                isFused[i] = fusedAway[n.lhs] = true;
+                fused[i] = add ? TypedOp::MultiplyAdd : TypedOp::MultiplySubtract;
+            }
+            else if (isDoubleProduct(n.rhs)) {
+                isFused[i] = fusedAway[n.rhs] = true;
+                fused[i] = add ? TypedOp::AddMultiply : TypedOp::SubtractMultiply;
+            }
+        }
+    }
+
+    // Pass 2: emit in post-order, converting each operand as it completes
+    std::vector<TypedInstruction>& code = program.code;
+    auto convert = [&](ValueType from, ValueType to, std::uint32_t offset) {
+        if (from == to) {
+            return;
+        }
+        TypedOp op = from == ValueType::Int ? (to == ValueType::Double ? TypedOp::IntToDouble : TypedOp::IntToBool)
+                   : from == ValueType::Bool ? (to == ValueType::Int ? TypedOp::BoolToInt : TypedOp::BoolToDouble)
+                   : TypedOp::DoubleToBool;
+        code.push_back({op, 0, offset});
+    };
+
+    std::vector<std::size_t> jumpAt(nodes.size());  // Position of the jump owned by each && / || node
+    size_t depth = 0;
+    for (std::uint32_t i = 0; i < nodes.size(); i++) {
+        const AstNode& n = nodes[i];
+
+        if (leftDoneBefore[i] >= 0) {
+            std::uint32_t owner = static_cast<std::uint32_t>(leftDoneBefore[i]);
+            const AstNode& o = nodes[owner];
+            convert(types[o.lhs], operandTypes[owner], o.offset);
+
+            // Jump over the right operand if the left one decides the result
+            if (shortCircuit && (o.op == Op::LogicalAnd || o.op == Op::LogicalOr)) {
+                jumpAt[owner] = code.size();
+                code.push_back({o.op == Op::LogicalAnd ? TypedOp::JumpIfFalse : TypedOp::JumpIfTrue, 0, o.offset});
+                depth--;
             }
-            else if (tokenized[i] == '!') {
-                if (i + 1 < tokenized.length() && tokenized[i + 1] == '=') {
-                    currentOp = "!=";
-                    i++;
+        }
+
+        switch (n.kind) {
+        case NodeKind::Constant:
+            code.push_back({TypedOp::ConstInt, n.value, n.offset});
+            depth++;
+            break;
+        case NodeKind::Decimal:
+            program.constants.push_back(ast.decimal(i));
+            code.push_back({TypedOp::ConstDouble, static_cast<std::int32_t>(program.constants.size() - 1), n.offset});
+            depth++;
+            break;
+        case NodeKind::Variable:
+            code.push_back({types[i] == ValueType::Int ? TypedOp::LoadInt : TypedOp::LoadDouble, n.value, n.offset});
+            depth++;
+            break;
+        case NodeKind::Unary:
+            convert(types[n.lhs], operandTypes[i], n.offset);
+            switch (n.op) {
+            case Op::LogicalNot:
+                code.push_back({TypedOp::Not, 0, n.offset});
+                break;
+            case Op::Increment:
+            case Op::Decrement:
+                // x + 1 or x - 1 in the operand's type
+                if (types[i] == ValueType::Int) {
+                    code.push_back({TypedOp::ConstInt, 1, n.offset});
                 }
                 else {
-                    currentOp = "!";
+                    program.constants.push_back(1.0);
+                    code.push_back({TypedOp::ConstDouble, static_cast<std::int32_t>(program.constants.size() - 1),
+                                    n.offset});
                 }
+                program.stackDepth = std::max(program.stackDepth, depth + 1);
+                code.push_back({typedOpFor(n.op == Op::Increment ? Op::Add : Op::Subtract, types[i]), 0, n.offset});
+                break;
+            case Op::Plus:
+                break;
+            default:
+                code.push_back({typedOpFor(n.op, types[i]), 0, n.offset});
+                break;
             }
-            else if (tokenized[i] == '>') {
-                if (i + 1 < tokenized.length() && tokenized[i + 1] == '=') {
-                    currentOp = ">=";
-                    i++;
-                }
-                else {
-                    currentOp = ">";
-                    }
-                                }
-                                else if (tokenized[i] == '<') {
-                                    if (i + 1 < tokenized.length() && tokenized[i + 1] == '=') {
-                                        currentOp = "<=";
-                                        i++;
-                                    }
-                                    else {
-                                        currentOp = "<";
-                                    }
-                                }
-                                else if (tokenized[i] == '&') {
-                                    if (i + 1 < tokenized.length() && tokenized[i + 1] == '&') {
-                                        currentOp = "&&";
-                                        i++;
-                                    }
-                                    else {
-                                        throw std::runtime_error("Invalid operator: single '&' is not supported @ char " + std::to_string(i));
-                                    }
-                                }
-                                else if (tokenized[i] == '|') {
-                                    if (i + 1 < tokenized.length() && tokenized[i + 1] == '|') {
-                                        currentOp = "||";
-                                        i++;
-                                    }
-                                    else {
-                                        throw std::runtime_error("Invalid operator: single '|' is not supported @ char " + std::to_string(i));
-                                    }
-                                }
-                                else {
-                                    // Single character operators
-                                    currentOp = std::string(1, tokenized[i]);
-                                }
-
-                                // Process operators according to precedence
-                                while (!ops.empty() && ops.top() != "(" &&
-                                       precedence[ops.top()] >= precedence[currentOp]) {
-                                    std::string op = ops.top();
-                                    ops.pop();
-
-                                    if (isBinary[op]) {
-                                        if (values.size() < 2) {
-                                            throw std::runtime_error("Not enough operands for binary operator: " + op);
-                                        }
-                                        int val2 = values.top();
-                                        values.pop();
-
-                                        int val1 = values.top();
-                                        values.pop();
-
-                                        values.push(performOperation(op, val2, val1));
-                                    }
-                                    else {
-                                        if (values.empty()) {
-                                            throw std::runtime_error("Not enough operands for unary operator: " + op);
-                                        }
-                                        int val = values.top();
-                                        values.pop();
-
-                                        values.push(performOperation(op, val));
-                                    }
-                                }
-
-                                // Push current operator to stack
-                                ops.push(currentOp);
-                            }
-                        }
-
-                        // Process all remaining operators in the stack
-                        while (!ops.empty()) {
-                            std::string op = ops.top();
-                            ops.pop();
-
-                            if (op == "(") {
-                                throw std::runtime_error("Mismatched parentheses - unclosed parenthesis");
-                            }
-
-                            if (isBinary[op]) {
-                                if (values.size() < 2) {
-                                    throw std::runtime_error("Not enough operands for binary operator: " + op);
-                                }
-                                int val2 = values.top();
-                                values.pop();
-
-                                int val1 = values.top();
-                                values.pop();
-
-                                values.push(performOperation(op, val2, val1));
-                            }
-                            else {
-                                if (values.empty()) {
-                                    throw std::runtime_error("Not enough operands for unary operator: " + op);
-                                }
-                                int val = values.top();
-                                values.pop();
-
-                                values.push(performOperation(op, val));
-                            }
-                        }
-
-                        // Final result should be on top of the values stack
-                        if (values.size() != 1) {
-                            throw std::runtime_error("Invalid expression - too many values");
-                        }
-
-                        return values.top();
-                    }
+            break;
+        case NodeKind::Binary:
+            convert(types[n.rhs], operandTypes[i], n.offset);
+            if (shortCircuit && (n.op == Op::LogicalAnd || n.op == Op::LogicalOr)) {
+                // The right operand (now a Bool) is the result; patch the jump to land here
+                code[jumpAt[i]].operand = static_cast<std::int32_t>(code.size());
+                break;
+            }
+            if (fusedAway[i]) {
+                // Both factors stay on the stack for the parent's fused instruction
+                break;
+            }
+            if (isFused[i]) {
+                code.push_back({fused[i], 0, n.offset});
+                depth -= 2;
+                break;
+            }
+            code.push_back({typedOpFor(n.op, operandTypes[i]), 0, n.offset});
+            depth--;
+            break;
+        }
+        program.stackDepth = std::max(program.stackDepth, depth);
+    }
+
+    program.result = types[ast.root()];
+}
@@ -1,84 +1,324 @@
 #ifndef EVALUATOR_H
 #define EVALUATOR_H
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
-#include <stack>
-#include <map>
+#include <string_view>
+#include <vector>
 #include <stdexcept>
+#include "Arithmetic.h"
+#include "Ast.h"
+#include "CompiledExpression.h"
+#include "EvalContext.h"
+#include "Lexer.h"
+#include "Operators.h"
+#include "Profiler.h"
+#include "TypedExpression.h"
+
+/**
+ * Bounds on the expressions an Evaluator accepts. Expressions are handled
+ * without recursion, so these guard memory rather than the call stack: an
+ * expression that exceeds one fails with a std::runtime_error as soon as the
+ * excess is seen, before anything proportional to it is allocated.
+ */
+struct EvaluatorLimits {
+    std::size_t maxLength = std::size_t(1) << 30;   // Characters, whitespace included; at most 2^32 - 1
+    std::size_t maxNestingDepth = 100000;           // Parentheses open at once
+    std::size_t maxStackDepth = 1000000;            // Entries on the operand or the operator stack
+};
 
 /**
  * The Evaluator class provides functionality to parse and evaluate infix expressions.
  * It supports various operators with different precedences, handles parentheses,
  * and provides error checking for invalid expressions.
+ *
+ * An Evaluator holds nothing but its settings: eval(), compile() and parse() are
+ * const and keep their state on the stack or in a per-thread EvalContext, so one
+ * instance may be shared by many threads as long as the settings are not changed
+ * concurrently.
  */
 class Evaluator {
 public:
     /**
      * Constructor for the Evaluator class.
-     * Initializes operator precedence and sets up the evaluator.
-     * Time Complexity: O(1) - Constant time for initializing maps.
+     * Operator precedence lives in the compile-time kOperatorTable, so there is nothing to set up.
+     * Time Complexity: O(1).
      */
-    Evaluator();
+    Evaluator() = default;
 
     /**
      * Evaluates the given infix expression and returns the result.
+     * Scratch memory comes from a context owned by the calling thread, so
+     * repeated calls do not allocate. Tokens are consumed as they are read, so
+     * memory grows with how deeply the expression nests, not with its length.
      *
-     * @param expression The infix expression to evaluate.
+     * @param expression The infix expression to evaluate. It is only read, so a
+     *        slice of a larger buffer (such as one line of a file) needs no copy.
      * @return The result of the expression evaluation.
      * @throws std::runtime_error if the expression is invalid.
      *
      * Time Complexity: O(n) where n is the length of the expression.
      * Each character is processed once.
      */
-    int eval(const std::string& expression);
+    int eval(std::string_view expression) const;
+
+    /**
+     * Evaluates an expression using the caller's scratch context. Once the
+     * context has seen an expression at least as large, the call performs no
+     * heap allocations unless it throws.
+     *
+     * @param expression The infix expression to evaluate.
+     * @param context Scratch state reused across calls; one thread at a time.
+     * @return The result of the expression evaluation.
+     * @throws std::runtime_error if the expression is invalid.
+     *
+     * Time Complexity: O(n) where n is the length of the expression.
+     */
+    int eval(std::string_view expression, EvalContext& context) const;
+
+    /**
+     * Evaluates an expression in another numeric mode, e.g.
+     * evalAs<Int64Arithmetic>("3000000000 * 4") or evalAs<BigIntArithmetic>("2^200").
+     * Supported modes: WrappingArithmetic<std::int32_t> (what eval() uses) and
+     * <std::int64_t>, CheckedArithmetic<std::int32_t> and <std::int64_t>, and
+     * BigIntArithmetic. Literals are read in the mode's own range.
+     *
+     * @param expression The infix expression to evaluate.
+     * @return The result as Arithmetic::Value.
+     * @throws std::runtime_error if the expression is invalid, or for the checked
+     *         mode, if a literal or intermediate result does not fit.
+     *
+     * Time Complexity: O(n) arithmetic operations where n is the length of the
+     * expression; for BigIntArithmetic each costs up to O(k^2) in the operand size.
+     */
+    template <typename Arithmetic>
+    typename Arithmetic::Value evalAs(std::string_view expression) const;
+
+    /**
+     * evalAs() with the caller's scratch context.
+     *
+     * @param expression The infix expression to evaluate.
+     * @param context Scratch state reused across calls; one thread at a time.
+     * @return The result as Arithmetic::Value.
+     * @throws std::runtime_error as for evalAs(expression).
+     */
+    template <typename Arithmetic>
+    typename Arithmetic::Value evalAs(std::string_view expression, EvalContext& context) const;
+
+    /**
+     * Parses and validates the given infix expression once and returns a reusable
+     * postfix program. Evaluating the program skips tokenizing, validation and the
+     * shunting-yard pass, so it is much cheaper than calling eval() repeatedly.
+     *
+     * @param expression The infix expression to compile.
+     * @return The compiled program.
+     * @throws std::runtime_error if the expression is invalid (same messages as eval()).
+     *
+     * Time Complexity: O(n) where n is the length of the expression.
+     */
+    CompiledExpression compile(const std::string& expression) const;
+
+    /**
+     * Compiles an expression whose identifiers must come from a fixed list of variables.
+     * Variable i of the list is read from slot i of the values passed to
+     * CompiledExpression::evaluate(), so many expressions can share one record layout.
+     *
+     * @param expression The infix expression to compile.
+     * @param variables The variable names, in slot order.
+     * @return The compiled program.
+     * @throws std::runtime_error if the expression is invalid or uses an identifier
+     *         that is not in the list.
+     *
+     * Time Complexity: O(n + v) where n is the length of the expression and v the
+     * number of variables.
+     */
+    CompiledExpression compile(const std::string& expression, const std::vector<std::string>& variables) const;
+
+    /**
+     * Compiles an expression over Int and Double variables, with decimal literals
+     * such as 0.75 or 1e-3, into a TypedExpression. Every node gets a static type
+     * (see TypedExpression), so evaluation dispatches on specialised opcodes and
+     * runs the batch form on AVX2/FMA kernels where available. Constant folding
+     * applies only when every operand is an Int, because its rewrites assume
+     * 32-bit integer arithmetic.
+     *
+     * @param expression The infix expression to compile.
+     * @param variables The variables with their types (Int or Double), in slot order.
+     * @return The compiled program.
+     * @throws std::runtime_error if the expression is invalid, uses an identifier
+     *         that is not in the list, or a variable is declared as Bool.
+     *
+     * Time Complexity: O(n + v) where n is the length of the expression and v the
+     * number of variables.
+     */
+    TypedExpression compileTyped(const std::string& expression, const std::vector<TypedVariable>& variables = {}) const;
+
+    /**
+     * Parses and validates an expression into an expression tree without
+     * optimizing or compiling it. Identifiers get slots in order of first use.
+     *
+     * @param expression The infix expression to parse.
+     * @return The expression tree.
+     * @throws std::runtime_error if the expression is invalid (same messages as eval()).
+     *
+     * Time Complexity: O(n) where n is the length of the expression.
+     */
+    Ast parse(const std::string& expression) const;
+
+    /**
+     * Parses an expression whose identifiers must come from a fixed list of variables.
+     *
+     * @param expression The infix expression to parse.
+     * @param variables The variable names, in slot order.
+     * @return The expression tree.
+     * @throws std::runtime_error if the expression is invalid or uses an unknown identifier.
+     *
+     * Time Complexity: O(n + v) where n is the length of the expression and v the
+     * number of variables.
+     */
+    Ast parse(const std::string& expression, const std::vector<std::string>& variables) const;
+
+    /**
+     * Enables or disables constant folding and algebraic simplification in compile().
+     * Enabled by default; disabling it is mainly useful to measure its effect.
+     *
+     * @param enabled True to fold constants.
+     */
+    void setConstantFolding(bool enabled) { foldConstants = enabled; }
+
+    /**
+     * Enables or disables short-circuit code for && and || in compile(). When
+     * enabled (the default) the right operand is only evaluated if the left one
+     * does not decide the result, so guards such as "d != 0 && n / d > 3" never
+     * fail; when disabled both operands are always evaluated.
+     *
+     * @param enabled True to emit conditional jumps.
+     */
+    void setShortCircuit(bool enabled) { shortCircuit = enabled; }
+
+    /**
+     * Enables or disables fused multiply-add in compileTyped(). When enabled (the
+     * default) a Double product feeding + or - is computed with one rounding,
+     * which is faster and usually more accurate; disable it to get the result of
+     * rounding the product and the sum separately.
+     *
+     * @param enabled True to emit fused multiply-add instructions.
+     */
+    void setFusedMultiplyAdd(bool enabled) { fuseMultiplyAdd = enabled; }
+
+    /**
+     * Sets the bounds eval(), compile(), compileTyped() and parse() enforce.
+     * The operand stack holds values waiting for an operator ("1 + 2 * 3 ^" has
+     * three) and the operator stack the pending operators and open parentheses,
+     * so long unary chains ("!!!!x") and right-associative chains ("2^2^2^2")
+     * are bounded by maxStackDepth however shallow their parentheses.
+     *
+     * @param limits The new limits.
+     * @throws std::runtime_error if maxLength is 2^32 or more, or maxStackDepth is 0.
+     */
+    void setLimits(const EvaluatorLimits& limits);
+
+    /**
+     * @return The limits in force.
+     */
+    const EvaluatorLimits& limits() const { return bounds; }
 
 private:
-    // Maps to store operator precedence and information
-    std::map<std::string, int> precedence;         // Stores operator precedence
-    std::map<std::string, bool> isBinary; // Indicates if an operator is binary
+    bool foldConstants = true;      // Whether compile() runs Ast::fold()
+    bool shortCircuit = true;       // Whether compile() emits jumps for && and ||
+    bool fuseMultiplyAdd = true;    // Whether compileTyped() emits fused multiply-add
+    EvaluatorLimits bounds;         // Size limits on accepted expressions
 
     /**
-     * Tokenizes the expression string, removing spaces and handling multi-character operators.
+     * Shared implementation of both parse() overloads.
      *
-     * @param expression The original expression string.
-     * @return A cleaned expression string ready for parsing.
+     * @param expression The infix expression to parse.
+     * @param variables Fixed variable list, or nullptr to assign slots in order of first use.
+     * @param recorder Profile of the calling compile() or parse(); left in the Parse phase.
+     * @return The expression tree.
      *
      * Time Complexity: O(n) where n is the length of the expression.
      */
-    std::string tokenize(const std::string& expression);
+    Ast parseTree(const std::string& expression, const std::vector<std::string>* variables,
+                  profile::Recorder& recorder) const;
 
     /**
-     * Checks if a character is a valid operator.
+     * Emits the postfix instructions for an expression tree.
      *
-     * @param c The character to check.
-     * @return True if the character is an operator, false otherwise.
+     * @param ast The (optionally folded) expression tree.
+     * @param program Receives the instructions and the required stack depth.
      *
-     * Time Complexity: O(1) - Constant time check.
+     * Time Complexity: O(n) where n is the number of nodes.
      */
-    bool isOperator(char c) const;
+    void generateCode(const Ast& ast, CompiledExpression& program) const;
 
     /**
-     * Performs the operation between two operands based on the operator.
+     * Infers the type of every node and emits the typed instructions, with
+     * explicit conversions wherever an operand's type differs from what its
+     * operator needs.
      *
-     * @param op The operator to apply.
-     * @param b The right operand.
-     * @param a The left operand (not used for unary operators).
-     * @return The result of the operation.
-     * @throws std::runtime_error if an unsupported operator is provided.
+     * @param ast The (optionally folded) expression tree.
+     * @param program Receives the instructions, constants, stack depth and result
+     *        type; its variables must already be set.
      *
-     * Time Complexity: O(1) - Constant time operations.
+     * Time Complexity: O(n) where n is the number of nodes.
      */
-    int performOperation(const std::string& op, int b, int a = 0);
+    void generateTypedCode(const Ast& ast, TypedExpression& program) const;
 
     /**
-     * Validates the expression for common syntax errors.
+     * Shared implementation of both compile() overloads.
      *
-     * @param expression The expression to validate.
-     * @throws std::runtime_error with a descriptive error message if the expression is invalid.
+     * @param expression The infix expression to compile.
+     * @param variables Fixed variable list, or nullptr to assign slots in order of first use.
+     * @return The compiled program.
      *
      * Time Complexity: O(n) where n is the length of the expression.
      */
-    void validateExpression(const std::string& expression);
+    CompiledExpression compileProgram(const std::string& expression, const std::vector<std::string>* variables) const;
+
+    /**
+     * Pops the operands of an operator off the value stack and pushes its result,
+     * computed by the numeric mode.
+     *
+     * @param pending The operator to apply.
+     * @param values The value stack.
+     * @param closingParen True when called while closing a parenthesis (selects the error wording).
+     * @param skipped True inside the right operand of a short-circuited && or ||,
+     *        where the operator is not computed and yields an unused 0, so it cannot fail.
+     * @throws std::runtime_error if there are not enough operands, or whatever the
+     *         numeric mode throws.
+     *
+     * Time Complexity: O(1) operations of the numeric mode.
+     */
+    template <typename Arithmetic, typename Stack>
+    void applyOperator(const PendingOp& pending, Stack& values, bool closingParen, bool skipped) const;
+
+    /**
+     * Makes room for one more entry on an eval() stack, growing it geometrically
+     * up to the stack depth limit.
+     *
+     * @param stack An operand or operator stack of an EvalContext.
+     * @param arena The context's arena.
+     * @param offset Position of the token about to push, for the error message.
+     * @throws std::runtime_error if the stack already holds maxStackDepth entries.
+     *
+     * Time Complexity: amortized O(1).
+     */
+    template <typename Stack>
+    void reserveEntry(Stack& stack, Arena& arena, std::uint32_t offset) const;
 };
 
+// Instantiated in Evaluator.cpp for the supported numeric modes
+extern template std::int32_t Evaluator::evalAs<Int32Arithmetic>(std::string_view, EvalContext&) const;
+extern template std::int64_t Evaluator::evalAs<Int64Arithmetic>(std::string_view, EvalContext&) const;
+extern template std::int32_t Evaluator::evalAs<CheckedArithmetic<std::int32_t>>(std::string_view, EvalContext&) const;
+extern template std::int64_t Evaluator::evalAs<CheckedInt64Arithmetic>(std::string_view, EvalContext&) const;
+extern template BigInt Evaluator::evalAs<BigIntArithmetic>(std::string_view, EvalContext&) const;
+extern template std::int32_t Evaluator::evalAs<Int32Arithmetic>(std::string_view) const;
+extern template std::int64_t Evaluator::evalAs<Int64Arithmetic>(std::string_view) const;
+extern template std::int32_t Evaluator::evalAs<CheckedArithmetic<std::int32_t>>(std::string_view) const;
+extern template std::int64_t Evaluator::evalAs<CheckedInt64Arithmetic>(std::string_view) const;
+extern template BigInt Evaluator::evalAs<BigIntArithmetic>(std::string_view) const;
+
 #endif // EVALUATOR_H
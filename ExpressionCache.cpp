@@ -0,0 +1,136 @@
+#include "ExpressionCache.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <functional>
+
+namespace {
+
+// Characters that can continue a number or identifier ('.' for decimal literals)
+bool isWordChar(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.';
+}
+
+// Characters that can combine with a neighbour into a longer operator
+bool isOperatorChar(char c) {
+    return c != '\0' && std::strchr("+-=!<>&|", c) != nullptr;
+}
+
+} // namespace
+
+ExpressionCache::ExpressionCache(std::size_t capacity, std::size_t shardCount, const Evaluator& compiler)
+    : compiler(compiler) {
+    shardCount = std::max<std::size_t>(shardCount, 1);
+    shardCapacity = std::max<std::size_t>((capacity + shardCount - 1) / shardCount, 1);
+
+    shards.resize(shardCount);
+    for (auto& shard : shards) {
+        shard = std::make_unique<Shard>();
+    }
+}
+
+std::string ExpressionCache::normalize(std::string_view expression) {
+    // Whitespace never occurs inside a token, so a character scan is enough:
+    // a run of whitespace survives as one space only where the characters on
+    // both sides would otherwise lex as a single token
+    std::string text;
+    text.reserve(expression.size());
+    bool pendingSpace = false;
+    for (char c : expression) {
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            pendingSpace = !text.empty();
+            continue;
+        }
+        if (pendingSpace) {
+            char last = text.back();
+            if ((isWordChar(last) && isWordChar(c)) || (isOperatorChar(last) && isOperatorChar(c))) {
+                text += ' ';
+            }
+            pendingSpace = false;
+        }
+        text += c;
+    }
+    return text;
+}
+
+std::shared_ptr<const CompiledExpression> ExpressionCache::get(const std::string& expression) {
+    return lookup(expression, nullptr);
+}
+
+std::shared_ptr<const CompiledExpression> ExpressionCache::get(const std::string& expression,
+                                                               const std::vector<std::string>& variables) {
+    return lookup(expression, &variables);
+}
+
+ExpressionCache::Program ExpressionCache::lookup(const std::string& expression,
+                                                 const std::vector<std::string>* variables) {
+    // The same text compiled against different variable lists gives different programs,
+    // and an empty fixed list is not the same as assigning slots by first use
+    std::string key(1, variables ? 'F' : 'A');
+    key += normalize(expression);
+    if (variables) {
+        for (const std::string& name : *variables) {
+            key += '\0';
+            key += name;
+        }
+    }
+
+    Shard& shard = *shards[std::hash<std::string>{}(key) % shards.size()];
+    {
+        std::lock_guard<std::mutex> guard(shard.lock);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            shard.hits++;
+            return it->second->second;
+        }
+        shard.misses++;
+    }
+
+    // Compile without holding the lock so other lookups in this shard are not blocked.
+    // The text as given, not its normalized key, so error positions point at what the caller wrote
+    Program program = std::make_shared<const CompiledExpression>(
+        variables ? compiler.compile(expression, *variables) : compiler.compile(expression));
+
+    std::lock_guard<std::mutex> guard(shard.lock);
+
+    // Another thread may have compiled the same expression meanwhile; keep the first copy
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return it->second->second;
+    }
+
+    shard.lru.emplace_front(std::move(key), program);
+    shard.index.emplace(shard.lru.front().first, shard.lru.begin());
+
+    if (shard.lru.size() > shardCapacity) {
+        shard.index.erase(shard.lru.back().first);
+        shard.lru.pop_back();
+        shard.evictions++;
+    }
+    return program;
+}
+
+CacheStats ExpressionCache::stats() const {
+    CacheStats total;
+    for (const auto& shard : shards) {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        total.hits += shard->hits;
+        total.misses += shard->misses;
+        total.evictions += shard->evictions;
+        total.size += shard->lru.size();
+    }
+    return total;
+}
+
+void ExpressionCache::clear() {
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        shard->index.clear();
+        shard->lru.clear();
+        shard->hits = 0;
+        shard->misses = 0;
+        shard->evictions = 0;
+    }
+}
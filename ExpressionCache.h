@@ -0,0 +1,138 @@
+#ifndef EXPRESSION_CACHE_H
+#define EXPRESSION_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "CompiledExpression.h"
+#include "Evaluator.h"
+
+/**
+ * Counters reported by ExpressionCache::stats().
+ */
+struct CacheStats {
+    std::uint64_t hits = 0;         // Lookups answered from the cache
+    std::uint64_t misses = 0;       // Lookups that had to compile
+    std::uint64_t evictions = 0;    // Entries dropped to stay within capacity
+    std::size_t size = 0;           // Entries currently cached
+};
+
+/**
+ * A thread-safe cache of compiled expressions with LRU eviction.
+ *
+ * Entries are keyed by the normalized expression text (see normalize()) and the
+ * variable list, so "a + b" and "a+b" share one program. A miss compiles the
+ * text as given, so the positions in its errors are those of the spelling
+ * that was compiled first. Programs are immutable
+ * and handed out as shared pointers, so an entry evicted while a caller still
+ * uses it stays valid until the last user drops it.
+ *
+ * The cache is split into shards, each with its own lock and LRU list, so
+ * concurrent lookups of different expressions rarely contend. Compilation on a
+ * miss happens outside the lock.
+ */
+class ExpressionCache {
+public:
+    /**
+     * Creates an empty cache.
+     *
+     * @param capacity Maximum number of cached programs (at least one per shard is kept).
+     * @param shardCount Number of independently locked shards.
+     * @param compiler Evaluator whose settings are used to compile misses.
+     *
+     * Time Complexity: O(s) where s is the number of shards.
+     */
+    explicit ExpressionCache(std::size_t capacity = 4096, std::size_t shardCount = 16,
+                             const Evaluator& compiler = Evaluator());
+
+    /**
+     * Returns the compiled program for an expression, compiling it on a miss.
+     * Identifiers get slots in order of first use, as in Evaluator::compile().
+     *
+     * @param expression The infix expression.
+     * @return The shared, immutable program.
+     * @throws std::runtime_error if the expression is invalid. Failures are not
+     *         cached, and their positions refer to the expression as given.
+     *
+     * Time Complexity: O(n) to normalize and hash, plus the compile cost on a miss.
+     */
+    std::shared_ptr<const CompiledExpression> get(const std::string& expression);
+
+    /**
+     * Returns the program for an expression compiled against a fixed variable list.
+     *
+     * @param expression The infix expression.
+     * @param variables The variable names, in slot order.
+     * @return The shared, immutable program.
+     * @throws std::runtime_error if the expression is invalid or uses an unknown identifier.
+     *
+     * Time Complexity: O(n + v) plus the compile cost on a miss.
+     */
+    std::shared_ptr<const CompiledExpression> get(const std::string& expression,
+                                                  const std::vector<std::string>& variables);
+
+    /**
+     * @return Hit, miss and eviction counts and the current number of entries.
+     *
+     * Time Complexity: O(s) where s is the number of shards.
+     */
+    CacheStats stats() const;
+
+    /**
+     * Drops every entry and resets the counters.
+     *
+     * Time Complexity: O(e) where e is the number of entries.
+     */
+    void clear();
+
+    /**
+     * @return The maximum number of cached programs.
+     */
+    std::size_t capacity() const { return shardCapacity * shards.size(); }
+
+    /**
+     * Rewrites an expression into a canonical spelling: whitespace is removed
+     * except where it separates tokens that would otherwise merge (such as the
+     * two numbers in "1 2" or the operators in "+ +x").
+     *
+     * @param expression The expression text.
+     * @return The normalized text.
+     *
+     * Time Complexity: O(n) where n is the length of the expression.
+     */
+    static std::string normalize(std::string_view expression);
+
+private:
+    using Program = std::shared_ptr<const CompiledExpression>;
+
+    // One independently locked part of the cache
+    struct Shard {
+        std::mutex lock;
+        std::list<std::pair<std::string, Program>> lru;   // Most recently used first
+        std::unordered_map<std::string_view, std::list<std::pair<std::string, Program>>::iterator> index;
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t evictions = 0;
+    };
+
+    /**
+     * Shared implementation of both get() overloads.
+     *
+     * @param expression The infix expression.
+     * @param variables Fixed variable list, or nullptr to assign slots in order of first use.
+     * @return The shared, immutable program.
+     */
+    Program lookup(const std::string& expression, const std::vector<std::string>* variables);
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::size_t shardCapacity;     // Maximum entries per shard
+    Evaluator compiler;            // Only read, so sharing it between threads is safe
+};
+
+#endif // EXPRESSION_CACHE_H
@@ -0,0 +1,188 @@
+#include "ExpressionGenerator.h"
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+const Op kArithmetic[] = {Op::Add, Op::Subtract, Op::Multiply, Op::Divide, Op::Modulo, Op::Power};
+const Op kComparison[] = {Op::Greater, Op::GreaterEqual, Op::Less, Op::LessEqual, Op::Equal, Op::NotEqual};
+const Op kLogical[] = {Op::LogicalAnd, Op::LogicalOr};
+const Op kUnary[] = {Op::LogicalNot, Op::Increment, Op::Decrement, Op::Negate, Op::Plus};
+
+// Named operator mixes for parseOperatorMix()
+struct Preset {
+    const char* name;
+    const Op* ops;
+    std::size_t count;
+};
+
+const Preset kPresets[] = {
+    {"arithmetic", kArithmetic, std::size(kArithmetic)},
+    {"comparison", kComparison, std::size(kComparison)},
+    {"logical", kLogical, std::size(kLogical)},
+};
+
+// The text of an operator ("-" for both minuses, "+" for unary plus)
+const char* symbolOf(Op op) {
+    switch (op) {
+    case Op::Negate:
+    case Op::Subtract:
+        return "-";
+    case Op::Plus:
+        return "+";
+    default:
+        return operatorInfo(op).name;
+    }
+}
+
+bool isOperatorChar(char c) {
+    return std::strchr("+-*/%^<>=!&|", c) != nullptr;
+}
+
+bool isWordChar(char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+} // namespace
+
+ExpressionGenerator::ExpressionGenerator(std::uint64_t seed, GeneratorOptions options)
+    : opts(std::move(options)), rng(seed) {
+    if (opts.binaryOperators.empty()) {
+        opts.binaryOperators = parseOperatorMix("all");
+    }
+    if (opts.unaryOperators.empty()) {
+        opts.unaryOperators.assign(std::begin(kUnary), std::end(kUnary));
+    }
+    if (opts.maxOperands < opts.minOperands) {
+        opts.maxOperands = opts.minOperands;
+    }
+    if (opts.minOperands == 0 || opts.maxLiteralDigits == 0) {
+        throw std::runtime_error("Generator needs at least one operand per group and one digit per literal");
+    }
+}
+
+std::string ExpressionGenerator::next() {
+    out.clear();
+    afterDivisor = false;
+    appendGroup(0);
+    return out;
+}
+
+std::string ExpressionGenerator::next(std::size_t minLength) {
+    out.clear();
+    afterDivisor = false;
+    out.reserve(minLength + 64);
+    appendGroup(0);
+    while (out.size() < minLength) {
+        appendBinary(0);
+    }
+    return out;
+}
+
+std::vector<Op> ExpressionGenerator::parseOperatorMix(std::string_view mix) {
+    std::vector<Op> ops;
+    while (!mix.empty()) {
+        std::size_t comma = mix.find(',');
+        std::string_view name = mix.substr(0, comma);
+        mix = comma == std::string_view::npos ? std::string_view() : mix.substr(comma + 1);
+
+        bool found = false;
+        for (const Preset& preset : kPresets) {
+            if (name == "all" || name == preset.name) {
+                ops.insert(ops.end(), preset.ops, preset.ops + preset.count);
+                found = true;
+            }
+        }
+        for (const Preset& preset : kPresets) {
+            for (std::size_t i = 0; i < preset.count && !found; i++) {
+                if (name == symbolOf(preset.ops[i])) {
+                    ops.push_back(preset.ops[i]);
+                    found = true;
+                }
+            }
+        }
+        if (!found) {
+            throw std::runtime_error("Unknown operator in mix: " + std::string(name));
+        }
+    }
+    if (ops.empty()) {
+        throw std::runtime_error("Operator mix is empty");
+    }
+    return ops;
+}
+
+void ExpressionGenerator::appendToken(std::string_view token) {
+    if (!out.empty()) {
+        char last = out.back();
+        bool wouldJoin = (isOperatorChar(last) && isOperatorChar(token.front())) ||
+                         (isWordChar(last) && isWordChar(token.front()));
+        if (wouldJoin || chance(opts.spaceProbability)) {
+            out += ' ';
+        }
+    }
+    out += token;
+}
+
+void ExpressionGenerator::appendLiteral(bool nonZero, std::size_t maxDigits) {
+    char digits[24];
+    std::size_t count = 1 + below(maxDigits < sizeof(digits) ? maxDigits : sizeof(digits));
+
+    // No leading zeros, and a non-zero first digit makes the whole literal non-zero
+    bool leadingDigit = count > 1 || nonZero;
+    for (std::size_t i = 0; i < count; i++) {
+        digits[i] = static_cast<char>('0' + (i == 0 && leadingDigit ? 1 + below(9) : below(10)));
+    }
+    appendToken(std::string_view(digits, count));
+}
+
+void ExpressionGenerator::appendOperand(std::size_t depth) {
+    if (chance(opts.unaryProbability)) {
+        appendToken(symbolOf(opts.unaryOperators[below(opts.unaryOperators.size())]));
+    }
+
+    if (depth < opts.maxDepth && chance(opts.nestProbability)) {
+        appendToken("(");
+        appendGroup(depth + 1);
+        appendToken(")");
+    }
+    else if (!opts.variables.empty() && chance(opts.variableProbability)) {
+        appendToken(opts.variables[below(opts.variables.size())]);
+    }
+    else {
+        appendLiteral(false, opts.maxLiteralDigits);
+    }
+    afterDivisor = false;
+}
+
+void ExpressionGenerator::appendBinary(std::size_t depth) {
+    // After a safe divisor, '^' would take the divisor as its base ("x / 3 ^ 40")
+    // and could make it zero; the mix then contains '/' or '%' to draw instead
+    Op op;
+    do {
+        op = opts.binaryOperators[below(opts.binaryOperators.size())];
+    } while (afterDivisor && op == Op::Power);
+    appendToken(symbolOf(op));
+
+    if (opts.safe && (op == Op::Divide || op == Op::Modulo)) {
+        // Ten digits could wrap to zero in 32 bits
+        appendLiteral(true, opts.maxLiteralDigits < 9 ? opts.maxLiteralDigits : 9);
+        afterDivisor = true;
+    }
+    else if (opts.safe && op == Op::Power) {
+        appendLiteral(false, 1);
+        afterDivisor = false;
+    }
+    else {
+        appendOperand(depth);
+    }
+}
+
+void ExpressionGenerator::appendGroup(std::size_t depth) {
+    std::size_t operands = opts.minOperands + below(opts.maxOperands - opts.minOperands + 1);
+    appendOperand(depth);
+    for (std::size_t i = 1; i < operands; i++) {
+        appendBinary(depth);
+    }
+}
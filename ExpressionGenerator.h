@@ -0,0 +1,102 @@
+#ifndef EXPRESSION_GENERATOR_H
+#define EXPRESSION_GENERATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Operators.h"
+
+/**
+ * Shape of the expressions an ExpressionGenerator produces.
+ */
+struct GeneratorOptions {
+    std::vector<Op> binaryOperators;        // Operator mix; operators may repeat to weight them
+    std::vector<Op> unaryOperators;         // Prefix operators
+    std::size_t maxDepth = 4;               // Deepest parenthesis nesting
+    double nestProbability = 0.3;           // Chance an operand is a parenthesized group (below maxDepth)
+    double unaryProbability = 0.1;          // Chance an operand gets a prefix operator
+    std::size_t minOperands = 2;            // Operands per group (a group is a run of binary operators)
+    std::size_t maxOperands = 4;
+    std::size_t maxLiteralDigits = 3;       // Literals have 1 to maxLiteralDigits digits
+    std::vector<std::string> variables;     // Identifiers that may stand in for literals
+    double variableProbability = 0;         // Chance an operand is one of the variables
+    double spaceProbability = 0.5;          // Chance of a space between two tokens
+    bool safe = false;                      // Keep '/' and '%' divisors non-zero literals and '^' exponents small
+};
+
+/**
+ * Produces random, syntactically valid infix expressions for benchmarks and
+ * differential testing. The same seed and options always give the same
+ * sequence of expressions.
+ *
+ * Unless GeneratorOptions::safe is set, expressions may divide by zero and so
+ * fail at evaluation time, which differential testing wants to exercise.
+ */
+class ExpressionGenerator {
+public:
+    /**
+     * @param seed Seed of the random sequence.
+     * @param options Expression shape; empty operator lists mean every operator.
+     */
+    explicit ExpressionGenerator(std::uint64_t seed, GeneratorOptions options = {});
+
+    /**
+     * @return One expression: a single group of operands at the top level.
+     *
+     * Time Complexity: O(n) where n is the length of the result.
+     */
+    std::string next();
+
+    /**
+     * Produces an expression of at least minLength characters by chaining
+     * groups at the top level, so nesting stays within maxDepth however long
+     * the expression is.
+     *
+     * @param minLength The length to reach.
+     * @return The expression.
+     *
+     * Time Complexity: O(n) where n is the length of the result.
+     */
+    std::string next(std::size_t minLength);
+
+    /**
+     * @return The options in use.
+     */
+    const GeneratorOptions& options() const { return opts; }
+
+    /**
+     * Parses an operator mix: a comma-separated list of preset names
+     * ("arithmetic", "comparison", "logical", "all") and operator symbols
+     * ("+", "-", "*", "/", "%", "^", ">", ">=", "<", "<=", "==", "!=", "&&", "||").
+     *
+     * @param mix The mix, e.g. "arithmetic,&&".
+     * @return The binary operators.
+     * @throws std::runtime_error on an unknown name.
+     *
+     * Time Complexity: O(n) where n is the length of mix.
+     */
+    static std::vector<Op> parseOperatorMix(std::string_view mix);
+
+private:
+    // Appends one token, separating it from the previous one when they would
+    // otherwise lex as one token (or randomly)
+    void appendToken(std::string_view token);
+
+    void appendLiteral(bool nonZero, std::size_t maxDigits);
+    void appendOperand(std::size_t depth);
+    void appendBinary(std::size_t depth);   // A binary operator and its right operand
+    void appendGroup(std::size_t depth);
+
+    bool chance(double probability) { return std::uniform_real_distribution<double>(0, 1)(rng) < probability; }
+    std::size_t below(std::size_t n) { return std::uniform_int_distribution<std::size_t>(0, n - 1)(rng); }
+
+    GeneratorOptions opts;
+    std::mt19937_64 rng;
+    std::string out;            // Expression being built
+    bool afterDivisor = false;  // The last operand was a divisor forced by safe mode
+};
+
+#endif // EXPRESSION_GENERATOR_H
@@ -0,0 +1,323 @@
+#include "Jit.h"
+#include "Arithmetic.h"
+#include <cstring>
+#include <initializer_list>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__))
+#define JIT_HAVE_X86_64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace jit {
+
+namespace {
+
+bool enabledFlag = true;
+std::uint32_t thresholdValue = 1000;
+
+// Every live value but the top one occupies 8 bytes of native stack
+constexpr std::size_t kMaxNativeStackDepth = 1 << 16;
+
+#ifdef JIT_HAVE_X86_64
+
+// ^ has no short instruction sequence, so generated code calls this, matching the interpreter
+int power(int a, int b) {
+    return integerPower(a, b);
+}
+
+// Appends machine code bytes to a growing buffer
+class Emitter {
+public:
+    void bytes(std::initializer_list<std::uint8_t> values) {
+        out.insert(out.end(), values);
+    }
+
+    void imm32(std::int32_t value) {
+        std::uint8_t raw[4];
+        std::memcpy(raw, &value, 4);
+        out.insert(out.end(), raw, raw + 4);
+    }
+
+    void imm64(std::uint64_t value) {
+        std::uint8_t raw[8];
+        std::memcpy(raw, &value, 8);
+        out.insert(out.end(), raw, raw + 8);
+    }
+
+    // Emits a 32-bit displacement to be filled in by patch() and returns its position
+    std::size_t placeholder() {
+        imm32(0);
+        return out.size() - 4;
+    }
+
+    // Points the displacement at 'at' to 'target' (relative to the end of the displacement)
+    void patch(std::size_t at, std::size_t target) {
+        std::int32_t rel = static_cast<std::int32_t>(static_cast<std::int64_t>(target) -
+                                                     static_cast<std::int64_t>(at + 4));
+        std::memcpy(out.data() + at, &rel, 4);
+    }
+
+    std::size_t size() const { return out.size(); }
+
+    std::vector<std::uint8_t> out;
+};
+
+/**
+ * Translates a program into x86-64 code (System V calling convention).
+ *
+ * The top of the value stack lives in eax and the values below it are pushed
+ * on the native stack, so most operators are one or two instructions on
+ * registers. rbx holds the slots pointer and r12 the failedAt pointer; rbp
+ * lets the shared epilogue discard whatever is still pushed when a division
+ * by zero exits early. Jumps only go forward and the stack depth at a jump
+ * target equals the depth at the jump, so a linear pass knows the depth at
+ * every instruction.
+ */
+std::vector<std::uint8_t> generate(const std::vector<Instruction>& code) {
+    Emitter e;
+
+    // push rbp; mov rbp, rsp; push rbx; push r12; mov rbx, rdi; mov r12, rsi
+    e.bytes({0x55, 0x48, 0x89, 0xE5, 0x53, 0x41, 0x54, 0x48, 0x89, 0xFB, 0x49, 0x89, 0xF4});
+
+    struct Fixup {
+        std::size_t at;         // Position of a rel32 displacement
+        std::size_t target;     // Instruction index it jumps to
+    };
+    std::vector<Fixup> jumps;
+    std::vector<Fixup> errorExits;   // target = index of the failing instruction
+    std::vector<std::size_t> labels(code.size() + 1);
+    std::size_t depth = 0;
+
+    for (std::size_t pc = 0; pc < code.size(); pc++) {
+        const Instruction& ins = code[pc];
+        labels[pc] = e.size();
+
+        switch (ins.op) {
+        case OpCode::PushConst:
+            if (depth > 0) {
+                e.bytes({0x50});                            // push rax
+            }
+            e.bytes({0xB8});                                // mov eax, imm32
+            e.imm32(ins.operand);
+            depth++;
+            continue;
+        case OpCode::PushVar:
+            if (depth > 0) {
+                e.bytes({0x50});                            // push rax
+            }
+            e.bytes({0x8B, 0x83});                          // mov eax, [rbx + disp32]
+            e.imm32(ins.operand * 4);
+            depth++;
+            continue;
+
+        // Unary operators work on eax
+        case OpCode::LogicalNot:
+            e.bytes({0x85, 0xC0, 0x0F, 0x94, 0xC0, 0x0F, 0xB6, 0xC0});   // test; sete al; movzx
+            continue;
+        case OpCode::ToBool:
+            e.bytes({0x85, 0xC0, 0x0F, 0x95, 0xC0, 0x0F, 0xB6, 0xC0});   // test; setne al; movzx
+            continue;
+        case OpCode::Increment:
+            e.bytes({0x83, 0xC0, 0x01});                    // add eax, 1
+            continue;
+        case OpCode::Decrement:
+            e.bytes({0x83, 0xE8, 0x01});                    // sub eax, 1
+            continue;
+        case OpCode::Negate:
+            e.bytes({0xF7, 0xD8});                          // neg eax
+            continue;
+        case OpCode::Plus:
+            continue;
+
+        // Short-circuit jumps
+        case OpCode::JumpIfZero:
+            e.bytes({0x85, 0xC0, 0x0F, 0x84});              // test eax, eax; jz target
+            jumps.push_back({e.placeholder(), static_cast<std::size_t>(ins.operand)});
+            if (--depth > 0) {
+                e.bytes({0x58});                            // pop rax
+            }
+            continue;
+        case OpCode::JumpIfNonZero:
+            e.bytes({0x85, 0xC0, 0x74, 0x0A,                // test eax, eax; jz fall-through
+                     0xB8, 0x01, 0x00, 0x00, 0x00,          // mov eax, 1
+                     0xE9});                                // jmp target
+            jumps.push_back({e.placeholder(), static_cast<std::size_t>(ins.operand)});
+            if (--depth > 0) {
+                e.bytes({0x58});                            // pop rax
+            }
+            continue;
+
+        default:
+            break;
+        }
+
+        // Binary operators: right operand in eax, left operand popped into ecx
+        e.bytes({0x59});                                    // pop rcx
+        std::size_t pushed = depth - 2;                     // Values left on the native stack
+        depth--;
+
+        switch (ins.op) {
+        case OpCode::Add:
+            e.bytes({0x01, 0xC8});                          // add eax, ecx
+            break;
+        case OpCode::Subtract:
+            e.bytes({0x29, 0xC1, 0x89, 0xC8});              // sub ecx, eax; mov eax, ecx
+            break;
+        case OpCode::Multiply:
+            e.bytes({0x0F, 0xAF, 0xC1});                    // imul eax, ecx
+            break;
+        case OpCode::Divide:
+        case OpCode::Modulo: {
+            bool modulo = ins.op == OpCode::Modulo;
+            e.bytes({0x85, 0xC0, 0x0F, 0x84});              // test eax, eax; jz error
+            errorExits.push_back({e.placeholder(), pc});
+            e.bytes({0x41, 0x89, 0xC0,                      // mov r8d, eax
+                     0x89, 0xC8,                            // mov eax, ecx
+                     0x41, 0x83, 0xF8, 0xFF,                // cmp r8d, -1
+                     0x74, static_cast<std::uint8_t>(modulo ? 8 : 6),  // je minusOne
+                     0x99,                                  // cdq
+                     0x41, 0xF7, 0xF8});                    // idiv r8d
+            if (modulo) {
+                e.bytes({0x89, 0xD0});                      // mov eax, edx
+            }
+            e.bytes({0xEB, 0x02});                          // jmp done
+            // minusOne: idiv would trap on INT_MIN / -1, so compute the wrapped result
+            if (modulo) {
+                e.bytes({0x31, 0xC0});                      // xor eax, eax
+            }
+            else {
+                e.bytes({0xF7, 0xD8});                      // neg eax
+            }
+            break;
+        }
+        case OpCode::Power:
+            e.bytes({0x89, 0xCF, 0x89, 0xC6});              // mov edi, ecx; mov esi, eax
+            if (pushed % 2 == 1) {
+                e.bytes({0x48, 0x83, 0xEC, 0x08});          // sub rsp, 8 (keep the call 16-byte aligned)
+            }
+            e.bytes({0x48, 0xB8});                          // mov rax, imm64
+            e.imm64(reinterpret_cast<std::uint64_t>(&power));
+            e.bytes({0xFF, 0xD0});                          // call rax
+            if (pushed % 2 == 1) {
+                e.bytes({0x48, 0x83, 0xC4, 0x08});          // add rsp, 8
+            }
+            break;
+        case OpCode::Greater:
+            e.bytes({0x39, 0xC1, 0x0F, 0x9F, 0xC0, 0x0F, 0xB6, 0xC0});   // cmp ecx, eax; setg al; movzx
+            break;
+        case OpCode::GreaterEqual:
+            e.bytes({0x39, 0xC1, 0x0F, 0x9D, 0xC0, 0x0F, 0xB6, 0xC0});   // setge
+            break;
+        case OpCode::Less:
+            e.bytes({0x39, 0xC1, 0x0F, 0x9C, 0xC0, 0x0F, 0xB6, 0xC0});   // setl
+            break;
+        case OpCode::LessEqual:
+            e.bytes({0x39, 0xC1, 0x0F, 0x9E, 0xC0, 0x0F, 0xB6, 0xC0});   // setle
+            break;
+        case OpCode::Equal:
+            e.bytes({0x39, 0xC1, 0x0F, 0x94, 0xC0, 0x0F, 0xB6, 0xC0});   // sete
+            break;
+        case OpCode::NotEqual:
+            e.bytes({0x39, 0xC1, 0x0F, 0x95, 0xC0, 0x0F, 0xB6, 0xC0});   // setne
+            break;
+        case OpCode::LogicalAnd:
+        case OpCode::LogicalOr:
+            e.bytes({0x85, 0xC9, 0x0F, 0x95, 0xC1,          // test ecx, ecx; setne cl
+                     0x85, 0xC0, 0x0F, 0x95, 0xC0,          // test eax, eax; setne al
+                     static_cast<std::uint8_t>(ins.op == OpCode::LogicalAnd ? 0x20 : 0x08), 0xC8,  // and/or al, cl
+                     0x0F, 0xB6, 0xC0});                    // movzx eax, al
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Epilogue, shared by the normal exit and the error exits
+    std::size_t epilogue = e.size();
+    labels[code.size()] = epilogue;
+    e.bytes({0x48, 0x8D, 0x65, 0xF0,                        // lea rsp, [rbp - 16]
+             0x41, 0x5C, 0x5B, 0x5D, 0xC3});                // pop r12; pop rbx; pop rbp; ret
+
+    // Division by zero: report the instruction and leave through the epilogue
+    for (const Fixup& exit : errorExits) {
+        e.patch(exit.at, e.size());
+        e.bytes({0x41, 0xC7, 0x04, 0x24});                  // mov dword [r12], pc
+        e.imm32(static_cast<std::int32_t>(exit.target));
+        e.bytes({0x31, 0xC0, 0xE9});                        // xor eax, eax; jmp epilogue
+        e.patch(e.placeholder(), epilogue);
+    }
+
+    for (const Fixup& jump : jumps) {
+        e.patch(jump.at, labels[jump.target]);
+    }
+    return e.out;
+}
+
+#endif // JIT_HAVE_X86_64
+
+} // namespace
+
+bool available() {
+#ifdef JIT_HAVE_X86_64
+    return true;
+#else
+    return false;
+#endif
+}
+
+void setEnabled(bool enabled) {
+    enabledFlag = enabled;
+}
+
+bool enabled() {
+    return enabledFlag && available();
+}
+
+void setThreshold(std::uint32_t evaluations) {
+    thresholdValue = evaluations;
+}
+
+std::uint32_t threshold() {
+    return thresholdValue;
+}
+
+Code::Code(void* memory, std::size_t mapped, std::size_t length)
+    : memory(memory), mapped(mapped), length(length),
+      entry(reinterpret_cast<NativeFunction>(memory)) {}
+
+Code::~Code() {
+#ifdef JIT_HAVE_X86_64
+    munmap(memory, mapped);
+#endif
+}
+
+std::unique_ptr<Code> Code::compile(const std::vector<Instruction>& code, std::size_t stackDepth) {
+#ifdef JIT_HAVE_X86_64
+    if (code.empty() || stackDepth > kMaxNativeStackDepth) {
+        return nullptr;
+    }
+
+    std::vector<std::uint8_t> bytes = generate(code);
+    std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    std::size_t mapped = (bytes.size() + page - 1) / page * page;
+
+    // Never writable and executable at the same time
+    void* memory = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return nullptr;
+    }
+    std::memcpy(memory, bytes.data(), bytes.size());
+    if (mprotect(memory, mapped, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, mapped);
+        return nullptr;
+    }
+    return std::unique_ptr<Code>(new Code(memory, mapped, bytes.size()));
+#else
+    (void)code;
+    (void)stackDepth;
+    return nullptr;
+#endif
+}
+
+} // namespace jit
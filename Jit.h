@@ -0,0 +1,97 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "CompiledExpression.h"
+
+/**
+ * Native code tier for compiled expressions.
+ *
+ * A program that has been evaluated jit::threshold() times through
+ * CompiledExpression::evaluate() is translated into straight-line x86-64
+ * machine code in an mmap'd buffer, and later evaluations call that code
+ * instead of the bytecode interpreter. On other architectures or systems,
+ * or if executable memory cannot be mapped, programs stay interpreted.
+ */
+namespace jit {
+
+/**
+ * @return True if this build and platform can generate native code.
+ */
+bool available();
+
+/**
+ * Enables or disables promotion to native code. Programs already promoted keep
+ * their native code. Not thread-safe; intended for benchmarks and tests.
+ *
+ * @param enabled False to always use the interpreter.
+ */
+void setEnabled(bool enabled);
+
+/**
+ * @return True if promotion to native code is enabled (and available).
+ */
+bool enabled();
+
+/**
+ * Sets how many evaluate() calls a program needs before it is promoted.
+ * Not thread-safe; intended for benchmarks and tests.
+ *
+ * @param evaluations The number of calls; 1 promotes on the first call.
+ */
+void setThreshold(std::uint32_t evaluations);
+
+/**
+ * @return The number of evaluate() calls after which a program is promoted.
+ */
+std::uint32_t threshold();
+
+/**
+ * Executable machine code for one program. The buffer is mapped writable,
+ * filled, then remapped read-only and executable, and unmapped on destruction.
+ */
+class Code {
+public:
+    /**
+     * Generates native code for a program.
+     *
+     * @param code The instruction stream.
+     * @param stackDepth The program's maximum stack depth.
+     * @return The native code, or null if the platform is not supported or
+     *         the program is too deep to run on the native stack.
+     *
+     * Time Complexity: O(k) where k is the number of instructions.
+     */
+    static std::unique_ptr<Code> compile(const std::vector<Instruction>& code, std::size_t stackDepth);
+
+    ~Code();
+
+    Code(const Code&) = delete;
+    Code& operator=(const Code&) = delete;
+
+    /**
+     * @return The entry point. On division or modulo by zero the function
+     *         stores the failing instruction's index in *failedAt and returns 0.
+     */
+    NativeFunction function() const { return entry; }
+
+    /**
+     * @return The number of bytes of machine code.
+     */
+    std::size_t size() const { return length; }
+
+private:
+    Code(void* memory, std::size_t mapped, std::size_t length);
+
+    void* memory;           // Start of the mapping
+    std::size_t mapped;     // Size of the mapping
+    std::size_t length;     // Bytes of code
+    NativeFunction entry;
+};
+
+} // namespace jit
+
+#endif // JIT_H
@@ -0,0 +1,109 @@
+#include "Lexer.h"
+#include "Syntax.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <string>
+
+template <typename InRun>
+std::size_t Lexer::skip(std::size_t i, std::uint64_t scan::BlockMasks::*run, InRun inRun) const {
+    // Byte by byte for the first kLongRun bytes: most runs end there
+    std::size_t end = blocks ? std::min(i + kLongRun, text.length()) : text.length();
+    while (i < end && inRun(text[i])) {
+        i++;
+    }
+
+    // A longer run is continued 64 bytes at a time, which pays for classifying them
+    scan::BlockMasks masks;
+    while (i == end && i + scan::kBlockBytes <= text.length()) {
+        scan::classify(text.data() + i, masks);
+        std::uint64_t rest = ~(masks.*run);
+        if (rest != 0) {
+            return i + static_cast<std::size_t>(__builtin_ctzll(rest));
+        }
+        i += scan::kBlockBytes;
+        end = i;
+    }
+
+    while (i < text.length() && inRun(text[i])) {
+        i++;
+    }
+    return i;
+}
+
+bool Lexer::next(Token& token) {
+    pos = skip(pos, &scan::BlockMasks::space, syntax::isSpace);
+    if (pos == text.length()) {
+        return false;
+    }
+
+    size_t i = pos;
+    char c = text[i];
+    token = Token{TokenKind::Invalid, Op::LeftParen, static_cast<std::uint32_t>(i), 1, 0};
+
+    if (syntax::isDigit(c) || (c == '.' && syntax::isDigitAt(text, i + 1))) {
+        // Accumulate unsigned so oversized literals wrap instead of overflowing
+        std::uint32_t val = 0;
+        size_t start = i;
+        i = skip(i, &scan::BlockMasks::digit, syntax::isDigit);
+        for (size_t digit = start; digit < i; digit++) {
+            val = val * 10 + static_cast<std::uint32_t>(text[digit] - '0');
+        }
+        size_t end = syntax::scanDecimalTail(text, i);
+        token.kind = end == i ? TokenKind::Number : TokenKind::Decimal;
+        token.value = end == i ? static_cast<std::int32_t>(val) : 0;
+        token.length = static_cast<std::uint32_t>(end - start);
+        i = end;
+    }
+    else if (syntax::isIdentifierStart(c)) {
+        size_t start = i;
+        i = skip(i, &scan::BlockMasks::word, syntax::isIdentifierChar);
+        token.kind = TokenKind::Identifier;
+        token.length = static_cast<std::uint32_t>(i - start);
+    }
+    else if (c == '(' || c == ')') {
+        token.kind = c == '(' ? TokenKind::LeftParen : TokenKind::RightParen;
+        i++;
+    }
+    else {
+        std::uint32_t length = syntax::readOperator(text, i, unaryContext, token.op);
+        if (length > 0) {
+            token.kind = TokenKind::Operator;
+            token.length = length;
+        }
+        i += token.length;
+    }
+
+    // '-' and '+' are unary at the start, after '(' or after another operator
+    unaryContext = token.kind == TokenKind::LeftParen || token.kind == TokenKind::Operator ||
+                   token.kind == TokenKind::Invalid;
+    pos = i;
+    return true;
+}
+
+void tokenize(std::string_view expression, std::vector<Token>& tokens) {
+    tokens.clear();
+
+    Lexer lexer(expression);
+    Token token;
+    while (lexer.next(token)) {
+        tokens.push_back(token);
+    }
+}
+
+std::vector<Token> tokenize(std::string_view expression) {
+    std::vector<Token> tokens;
+    tokenize(expression, tokens);
+    return tokens;
+}
+
+double decimalValue(const Token& token, std::string_view expression) {
+    std::string_view text = tokenText(token, expression);
+    double value = 0;
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (result.ec == std::errc::result_out_of_range) {
+        // from_chars leaves the value alone here; strtod rounds to infinity or zero
+        return std::strtod(std::string(text).c_str(), nullptr);
+    }
+    return value;
+}
@@ -0,0 +1,130 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "Operators.h"
+#include "Scanner.h"
+
+/**
+ * The kinds of token the lexer produces.
+ */
+enum class TokenKind : std::uint8_t {
+    Number,         // Integer literal; value holds the number
+    Decimal,        // Literal with a '.' or an exponent (1.5, .5, 2e-3); see decimalValue()
+    Identifier,     // Variable name; the text is source[offset, offset + length)
+    Operator,       // op holds the operator
+    LeftParen,
+    RightParen,
+    Invalid         // A character (or single '=', '&', '|') that is not part of the grammar
+};
+
+/**
+ * One token of an expression. Positions refer to the original input,
+ * whitespace included, so error messages point at what the user typed.
+ */
+struct Token {
+    TokenKind kind;
+    Op op;                  // Only meaningful for Operator tokens
+    std::uint32_t offset;   // Byte offset of the first character in the input
+    std::uint32_t length;   // Number of bytes the token spans
+    std::int32_t value;     // Only meaningful for Number tokens
+};
+
+/**
+ * Produces the tokens of an expression one at a time, so callers that consume
+ * them in order (such as Evaluator::eval()) need no token buffer and their
+ * memory does not grow with the length of the expression. Tokens are exactly
+ * those tokenize() would produce.
+ *
+ * When the AVX2 classifier is available (see Scanner.h), a run of whitespace,
+ * digits or identifier characters longer than kLongRun bytes is continued 64
+ * bytes at a time: each block is classified into bitmasks and the run ends at
+ * the first clear bit, found with one bit scan instead of a test per byte.
+ * Shorter runs, and the last 64 bytes of the text, are read byte by byte, so
+ * inputs of short tokens cost what they did without it.
+ */
+class Lexer {
+public:
+    /**
+     * @param expression The expression text; must outlive the lexer and be
+     *        shorter than 2^32 bytes, since token offsets are 32-bit.
+     */
+    explicit Lexer(std::string_view expression) : text(expression), blocks(scan::blockLexing()) {}
+
+    /**
+     * Reads the next token, skipping whitespace.
+     *
+     * @param token Receives the token.
+     * @return False (leaving token alone) once the expression is exhausted.
+     *
+     * Time Complexity: O(k) where k is the number of characters consumed.
+     */
+    bool next(Token& token);
+
+private:
+    // Length from which a run of one class is continued with the block classifier
+    static constexpr std::size_t kLongRun = 16;
+
+    /**
+     * @param i Index to start at.
+     * @param run The class to skip, as a BlockMasks member.
+     * @param inRun The same class as a test of one byte, for the last partial block.
+     * @return The index of the first byte at or after i that is not in the class.
+     */
+    template <typename InRun>
+    std::size_t skip(std::size_t i, std::uint64_t scan::BlockMasks::*run, InRun inRun) const;
+
+    std::string_view text;
+    std::size_t pos = 0;        // Index of the next unread character
+    bool unaryContext = true;   // An operand is expected next, so '-' / '+' are unary
+    bool blocks;                // Classify the 64-byte blocks of long runs instead of testing each byte
+};
+
+/**
+ * Splits an expression into tokens in a single pass, skipping whitespace.
+ * Multi-character operators (&&, >=, ++, ...) are recognised here, and '-' / '+'
+ * are classified as unary (Op::Negate / Op::Plus) or binary (Op::Subtract /
+ * Op::Add) from the previous token. The lexer never throws: characters it does
+ * not understand become Invalid tokens for validation to report in order.
+ *
+ * @param expression The expression text.
+ * @param tokens Receives the tokens (cleared first; its capacity is reused).
+ *
+ * Time Complexity: O(n) where n is the length of the expression.
+ */
+void tokenize(std::string_view expression, std::vector<Token>& tokens);
+
+/**
+ * Convenience overload returning a fresh token vector.
+ *
+ * @param expression The expression text.
+ * @return The tokens of the expression.
+ *
+ * Time Complexity: O(n) where n is the length of the expression.
+ */
+std::vector<Token> tokenize(std::string_view expression);
+
+/**
+ * @param token The token.
+ * @param expression The expression the token came from.
+ * @return The characters the token spans.
+ */
+inline std::string_view tokenText(const Token& token, std::string_view expression) {
+    return expression.substr(token.offset, token.length);
+}
+
+/**
+ * Converts a Decimal token to the nearest double.
+ *
+ * @param token A Decimal token.
+ * @param expression The expression the token came from.
+ * @return The value; literals beyond the double range give infinity.
+ *
+ * Time Complexity: O(d) where d is the length of the literal.
+ */
+double decimalValue(const Token& token, std::string_view expression);
+
+#endif // LEXER_H
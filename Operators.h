@@ -0,0 +1,112 @@
+#ifndef OPERATORS_H
+#define OPERATORS_H
+
+#include <cstddef>
+#include <cstdint>
+#include "CompiledExpression.h"
+
+/**
+ * Every operator the evaluator understands, plus the '(' marker used on the
+ * shunting-yard operator stack. Values index kOperatorTable.
+ */
+enum class Op : std::uint8_t {
+    LogicalNot,
+    Increment,
+    Decrement,
+    Negate,         // Unary minus
+    Plus,           // Unary plus
+    Power,
+    Multiply,
+    Divide,
+    Modulo,
+    Add,
+    Subtract,       // Binary minus
+    Greater,
+    GreaterEqual,
+    Less,
+    LessEqual,
+    Equal,
+    NotEqual,
+    LogicalAnd,
+    LogicalOr,
+    LeftParen       // Not an operator; marks an open parenthesis on the operator stack
+};
+
+/**
+ * How operators of equal precedence group.
+ */
+enum class Associativity : std::uint8_t {
+    Left,   // a - b - c == (a - b) - c
+    Right   // Prefix operators: ! ! a == !(!a)
+};
+
+/**
+ * Static description of one operator.
+ */
+struct OperatorInfo {
+    const char* name;           // Name used in error messages ("u-" and "b-" for the two minuses)
+    int precedence;             // Higher number = higher precedence
+    int arity;                  // 1 for prefix unary operators, 2 for binary operators
+    Associativity associativity;
+    OpCode code;                // Bytecode instruction that implements the operator
+};
+
+/**
+ * Operator table, indexed by Op. Built at compile time, so constructing an
+ * Evaluator costs nothing and lookups are a single array index.
+ */
+constexpr OperatorInfo kOperatorTable[] = {
+    {"!",  8, 1, Associativity::Right, OpCode::LogicalNot},
+    {"++", 8, 1, Associativity::Right, OpCode::Increment},
+    {"--", 8, 1, Associativity::Right, OpCode::Decrement},
+    {"u-", 8, 1, Associativity::Right, OpCode::Negate},
+    {"u+", 8, 1, Associativity::Right, OpCode::Plus},
+    {"^",  7, 2, Associativity::Left,  OpCode::Power},
+    {"*",  6, 2, Associativity::Left,  OpCode::Multiply},
+    {"/",  6, 2, Associativity::Left,  OpCode::Divide},
+    {"%",  6, 2, Associativity::Left,  OpCode::Modulo},
+    {"+",  5, 2, Associativity::Left,  OpCode::Add},
+    {"b-", 5, 2, Associativity::Left,  OpCode::Subtract},
+    {">",  4, 2, Associativity::Left,  OpCode::Greater},
+    {">=", 4, 2, Associativity::Left,  OpCode::GreaterEqual},
+    {"<",  4, 2, Associativity::Left,  OpCode::Less},
+    {"<=", 4, 2, Associativity::Left,  OpCode::LessEqual},
+    {"==", 3, 2, Associativity::Left,  OpCode::Equal},
+    {"!=", 3, 2, Associativity::Left,  OpCode::NotEqual},
+    {"&&", 2, 2, Associativity::Left,  OpCode::LogicalAnd},
+    {"||", 1, 2, Associativity::Left,  OpCode::LogicalOr},
+    {"(",  0, 0, Associativity::Left,  OpCode::PushConst},
+};
+
+static_assert(sizeof(kOperatorTable) / sizeof(kOperatorTable[0]) == static_cast<std::size_t>(Op::LeftParen) + 1,
+              "kOperatorTable must have one entry per Op");
+
+/**
+ * @param op The operator to look up.
+ * @return The static description of the operator.
+ *
+ * Time Complexity: O(1) - Array index.
+ */
+constexpr const OperatorInfo& operatorInfo(Op op) {
+    return kOperatorTable[static_cast<std::size_t>(op)];
+}
+
+/**
+ * Decides whether the operator on top of the stack must be applied before
+ * pushing the incoming one (the shunting-yard pop condition).
+ *
+ * @param top The operator on top of the operator stack.
+ * @param incoming The operator just read.
+ * @return True if top should be applied first.
+ *
+ * Time Complexity: O(1).
+ */
+constexpr bool appliesBefore(Op top, Op incoming) {
+    const OperatorInfo& t = operatorInfo(top);
+    const OperatorInfo& in = operatorInfo(incoming);
+    return top != Op::LeftParen &&
+           (t.precedence > in.precedence ||
+            (t.precedence == in.precedence && in.associativity == Associativity::Left));
+}
+
+#endif // OPERATORS_H
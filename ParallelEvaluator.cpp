@@ -0,0 +1,33 @@
+#include "ParallelEvaluator.h"
+#include <algorithm>
+
+ParallelEvaluator::ParallelEvaluator(unsigned threads, std::size_t chunkRows)
+    : pool(threads) {
+    // Whole blocks per chunk, so chunk boundaries never split a batch block
+    const std::size_t block = CompiledExpression::kBatchBlockSize;
+    this->chunkRows = std::max<std::size_t>((chunkRows + block - 1) / block, 1) * block;
+}
+
+void ParallelEvaluator::evalBatch(const CompiledExpression& program, const std::int32_t* const* columns,
+                                  std::size_t rows, std::int32_t* out) {
+    evalBatch(std::vector<const CompiledExpression*>{&program}, columns, rows, &out);
+}
+
+void ParallelEvaluator::evalBatch(const std::vector<const CompiledExpression*>& programs,
+                                  const std::int32_t* const* columns, std::size_t rows,
+                                  std::int32_t* const* outs) {
+    if (programs.empty() || rows == 0) {
+        return;
+    }
+
+    // One task per chunk; chunk order is row order, which makes the lowest
+    // failing task the first error by row
+    std::size_t chunks = (rows + chunkRows - 1) / chunkRows;
+    pool.parallelFor(chunks, [&](std::size_t chunk) {
+        std::size_t begin = chunk * chunkRows;
+        std::size_t end = std::min(begin + chunkRows, rows);
+        for (std::size_t p = 0; p < programs.size(); p++) {
+            programs[p]->evalBatchRange(columns, begin, end, outs[p]);
+        }
+    });
+}
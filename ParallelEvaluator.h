@@ -0,0 +1,80 @@
+#ifndef PARALLEL_EVALUATOR_H
+#define PARALLEL_EVALUATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "CompiledExpression.h"
+#include "ThreadPool.h"
+
+/**
+ * Evaluates compiled expressions over large columnar inputs on several cores.
+ *
+ * The rows are cut into fixed-size chunks that are distributed over a
+ * work-stealing ThreadPool; every chunk runs CompiledExpression::evalBatchRange()
+ * into its own slice of the output, so results are identical to a single-threaded
+ * evalBatch() regardless of scheduling. If rows fail, the error of the lowest
+ * failing chunk (and, within a chunk, of the first program in list order) is
+ * rethrown, which is also independent of the number of threads.
+ */
+class ParallelEvaluator {
+public:
+    // Rows per chunk: 16 batch blocks, i.e. 64 KiB per input column
+    static constexpr std::size_t kDefaultChunkRows = 16 * CompiledExpression::kBatchBlockSize;
+
+    /**
+     * Creates the evaluator and its thread pool.
+     *
+     * @param threads Number of threads, the caller included; 0 uses all hardware threads.
+     * @param chunkRows Rows per unit of work (rounded up to whole batch blocks).
+     *
+     * Time Complexity: O(t) where t is the number of threads.
+     */
+    explicit ParallelEvaluator(unsigned threads = 0, std::size_t chunkRows = kDefaultChunkRows);
+
+    /**
+     * Evaluates one program over every row, in parallel.
+     *
+     * @param program The compiled program.
+     * @param columns columns[s] points at the values of variable slot s for every row.
+     * @param rows Number of records.
+     * @param out Receives the result for every row.
+     * @throws std::runtime_error on division or modulo by zero, naming the row.
+     *
+     * Time Complexity: O(k * rows / t) where k is the number of instructions.
+     */
+    void evalBatch(const CompiledExpression& program, const std::int32_t* const* columns,
+                   std::size_t rows, std::int32_t* out);
+
+    /**
+     * Evaluates several programs that share one column layout over every row.
+     * Each chunk of rows is loaded once and run through every program while it
+     * is still in cache.
+     *
+     * @param programs The compiled programs.
+     * @param columns columns[s] points at the values of variable slot s for every row.
+     * @param rows Number of records.
+     * @param outs outs[p] receives the results of programs[p].
+     * @throws std::runtime_error on division or modulo by zero, naming the row.
+     *
+     * Time Complexity: O(K * rows / t) where K is the total number of instructions.
+     */
+    void evalBatch(const std::vector<const CompiledExpression*>& programs, const std::int32_t* const* columns,
+                   std::size_t rows, std::int32_t* const* outs);
+
+    /**
+     * @return The number of threads evaluating chunks.
+     */
+    unsigned threadCount() const { return pool.size(); }
+
+    /**
+     * @return The number of rows per chunk.
+     */
+    std::size_t chunkSize() const { return chunkRows; }
+
+private:
+    ThreadPool pool;
+    std::size_t chunkRows;
+};
+
+#endif // PARALLEL_EVALUATOR_H
@@ -0,0 +1,347 @@
+#include "PredicateIndex.h"
+#include <algorithm>
+#include <climits>
+#include <stdexcept>
+
+namespace {
+
+// The merged comparisons of one rule on one variable
+struct Range {
+    std::int32_t slot;
+    std::int64_t lo = INT_MIN;
+    std::int64_t hi = INT_MAX;
+    std::vector<std::int32_t> excluded;
+};
+
+// x op c written as c op' x
+Op mirror(Op op) {
+    switch (op) {
+    case Op::Greater:       return Op::Less;
+    case Op::GreaterEqual:  return Op::LessEqual;
+    case Op::Less:          return Op::Greater;
+    case Op::LessEqual:     return Op::GreaterEqual;
+    default:                return op;
+    }
+}
+
+bool isComparison(Op op) {
+    return op == Op::Greater || op == Op::GreaterEqual || op == Op::Less || op == Op::LessEqual ||
+           op == Op::Equal || op == Op::NotEqual;
+}
+
+} // namespace
+
+PredicateIndex::PredicateIndex(const std::vector<std::string>& rules, const std::vector<std::string>& variables,
+                               const Evaluator& compiler)
+    : ruleCount(rules.size()), variables(variables), indexes(variables.size()), firstCheck{0} {
+    std::vector<std::vector<Interval>> intervals(variables.size());
+    for (std::size_t rule = 0; rule < rules.size(); rule++) {
+        try {
+            Ast ast = compiler.parse(rules[rule], variables);
+            if (ast.hasDecimals()) {
+                compiler.compile(rules[rule], variables);   // Throws the decimal literal error
+            }
+            ast.fold();
+            if (!addRule(static_cast<std::uint32_t>(rule), ast, intervals)) {
+                fallback.emplace_back(static_cast<std::uint32_t>(rule), compiler.compile(rules[rule], variables));
+            }
+            firstCheck.push_back(static_cast<std::uint32_t>(checks.size()));
+        }
+        catch (const std::exception& e) {
+            throw std::runtime_error("Rule " + std::to_string(rule) + ": " + e.what());
+        }
+    }
+
+    for (std::size_t slot = 0; slot < variables.size(); slot++) {
+        VariableIndex& index = indexes[slot];
+        std::sort(index.lower.begin(), index.lower.end());
+        std::sort(index.upper.begin(), index.upper.end());
+        std::sort(index.equal.begin(), index.equal.end());
+        buildTree(index, std::move(intervals[slot]));
+    }
+}
+
+bool PredicateIndex::addRule(std::uint32_t rule, const Ast& ast, std::vector<std::vector<Interval>>& intervals) {
+    const std::vector<AstNode>& nodes = ast.allNodes();
+    std::vector<Range> ranges;
+    bool never = false;
+
+    auto rangeOf = [&](std::int32_t slot) -> Range& {
+        for (Range& range : ranges) {
+            if (range.slot == slot) {
+                return range;
+            }
+        }
+        ranges.push_back(Range{slot, INT_MIN, INT_MAX, {}});
+        return ranges.back();
+    };
+
+    // Walk the && chain without recursion; every other node must be a leaf comparison
+    std::vector<std::uint32_t> pending{ast.root()};
+    while (!pending.empty()) {
+        const AstNode& n = nodes[pending.back()];
+        pending.pop_back();
+
+        if (n.kind == NodeKind::Binary && n.op == Op::LogicalAnd) {
+            pending.push_back(n.lhs);
+            pending.push_back(n.rhs);
+            continue;
+        }
+        if (n.kind == NodeKind::Constant) {
+            never = never || n.value == 0;
+            continue;
+        }
+        if (n.kind == NodeKind::Variable) {
+            rangeOf(n.value).excluded.push_back(0);             // x is x != 0
+            continue;
+        }
+        if (n.kind == NodeKind::Unary && n.op == Op::LogicalNot && nodes[n.lhs].kind == NodeKind::Variable) {
+            Range& range = rangeOf(nodes[n.lhs].value);         // !x is x == 0
+            range.lo = std::max<std::int64_t>(range.lo, 0);
+            range.hi = std::min<std::int64_t>(range.hi, 0);
+            continue;
+        }
+        if (n.kind != NodeKind::Binary || !isComparison(n.op)) {
+            return false;
+        }
+
+        const AstNode& left = nodes[n.lhs];
+        const AstNode& right = nodes[n.rhs];
+        Op op = n.op;
+        std::int32_t slot;
+        std::int64_t c;
+        if (left.kind == NodeKind::Variable && right.kind == NodeKind::Constant) {
+            slot = left.value;
+            c = right.value;
+        }
+        else if (left.kind == NodeKind::Constant && right.kind == NodeKind::Variable) {
+            slot = right.value;
+            c = left.value;
+            op = mirror(op);
+        }
+        else {
+            return false;
+        }
+
+        // In 64 bits, so c + 1 and c - 1 cannot wrap; an empty range is caught below
+        Range& range = rangeOf(slot);
+        switch (op) {
+        case Op::Greater:       range.lo = std::max(range.lo, c + 1); break;
+        case Op::GreaterEqual:  range.lo = std::max(range.lo, c); break;
+        case Op::Less:          range.hi = std::min(range.hi, c - 1); break;
+        case Op::LessEqual:     range.hi = std::min(range.hi, c); break;
+        case Op::Equal:         range.lo = std::max(range.lo, c); range.hi = std::min(range.hi, c); break;
+        default:                range.excluded.push_back(static_cast<std::int32_t>(c)); break;
+        }
+    }
+
+    for (const Range& range : ranges) {
+        never = never || range.lo > range.hi ||
+                (range.lo == range.hi &&
+                 std::find(range.excluded.begin(), range.excluded.end(), range.lo) != range.excluded.end());
+    }
+    if (never) {
+        return true;    // Indexed with no entries, so it is never reported
+    }
+
+    // The narrowest interval is the access interval; it is the only one indexed
+    // and the rest become checks
+    const Range* access = nullptr;
+    for (const Range& range : ranges) {
+        bool bounded = range.lo != INT_MIN || range.hi != INT_MAX;
+        if (bounded && (!access || range.hi - range.lo < access->hi - access->lo)) {
+            access = &range;
+        }
+    }
+    for (const Range& range : ranges) {
+        auto lo = static_cast<std::int32_t>(range.lo);
+        auto hi = static_cast<std::int32_t>(range.hi);
+        auto slot = static_cast<std::uint32_t>(range.slot);
+        if (&range != access && (range.lo != INT_MIN || range.hi != INT_MAX)) {
+            checks.push_back({slot, lo, hi, false});
+        }
+        for (std::int32_t value : range.excluded) {
+            if (value >= lo && value <= hi) {
+                checks.push_back({slot, value, value, true});
+            }
+        }
+    }
+    if (!access) {
+        unconstrained.push_back(rule);
+        return true;
+    }
+
+    VariableIndex& index = indexes[access->slot];
+    auto lo = static_cast<std::int32_t>(access->lo);
+    auto hi = static_cast<std::int32_t>(access->hi);
+    if (lo == hi) {
+        index.equal.push_back({lo, rule});
+    }
+    else if (access->lo == INT_MIN) {
+        index.upper.push_back({hi, rule});
+    }
+    else if (access->hi == INT_MAX) {
+        index.lower.push_back({lo, rule});
+    }
+    else {
+        intervals[access->slot].push_back({lo, hi, rule});
+    }
+    return true;
+}
+
+void PredicateIndex::buildTree(VariableIndex& index, std::vector<Interval> intervals) {
+    if (intervals.empty()) {
+        return;
+    }
+
+    // Each work item is a node to fill and the intervals it covers
+    struct Work {
+        std::uint32_t node;
+        std::vector<Interval> intervals;
+    };
+    std::vector<Work> work;
+    index.tree.push_back({});
+    work.push_back({0, std::move(intervals)});
+
+    std::vector<std::int32_t> endpoints;
+    while (!work.empty()) {
+        Work item = std::move(work.back());
+        work.pop_back();
+
+        // The median endpoint splits the intervals about evenly
+        endpoints.clear();
+        for (const Interval& interval : item.intervals) {
+            endpoints.push_back(interval.lo);
+            endpoints.push_back(interval.hi);
+        }
+        auto middle = endpoints.begin() + endpoints.size() / 2;
+        std::nth_element(endpoints.begin(), middle, endpoints.end());
+        std::int32_t center = *middle;
+
+        std::vector<Interval> left, right, here;
+        for (const Interval& interval : item.intervals) {
+            if (interval.hi < center) {
+                left.push_back(interval);
+            }
+            else if (interval.lo > center) {
+                right.push_back(interval);
+            }
+            else {
+                here.push_back(interval);
+            }
+        }
+
+        TreeNode node{center, static_cast<std::uint32_t>(index.byLo.size()), static_cast<std::uint32_t>(here.size()),
+                      kNoChild, kNoChild};
+        std::sort(here.begin(), here.end(), [](const Interval& a, const Interval& b) { return a.lo < b.lo; });
+        index.byLo.insert(index.byLo.end(), here.begin(), here.end());
+        std::sort(here.begin(), here.end(), [](const Interval& a, const Interval& b) { return a.hi > b.hi; });
+        index.byHi.insert(index.byHi.end(), here.begin(), here.end());
+
+        if (!left.empty()) {
+            node.left = static_cast<std::uint32_t>(index.tree.size());
+            index.tree.push_back({});
+            work.push_back({node.left, std::move(left)});
+        }
+        if (!right.empty()) {
+            node.right = static_cast<std::uint32_t>(index.tree.size());
+            index.tree.push_back({});
+            work.push_back({node.right, std::move(right)});
+        }
+        index.tree[item.node] = node;
+    }
+}
+
+void PredicateIndex::match(const int* slots, std::vector<std::uint32_t>& matches, MatchStats* stats) const {
+    std::size_t candidates = 0;
+    std::size_t visited = 0;
+
+    // Every rule is a candidate at most once: its access interval is filed once
+    matches.clear();
+    auto check = [&](std::uint32_t rule) {
+        candidates++;
+        for (std::uint32_t i = firstCheck[rule]; i < firstCheck[rule + 1]; i++) {
+            const Check& c = checks[i];
+            int x = slots[c.slot];
+            if (c.excluded ? x == c.lo : x < c.lo || x > c.hi) {
+                return;
+            }
+        }
+        matches.push_back(rule);
+    };
+
+    for (std::size_t slot = 0; slot < indexes.size(); slot++) {
+        const VariableIndex& index = indexes[slot];
+        const Bound key{slots[slot], 0};
+
+        // x >= value holds for the prefix with value <= x, x <= value for the suffix with value >= x
+        auto lowerEnd = std::upper_bound(index.lower.begin(), index.lower.end(), key);
+        for (auto it = index.lower.begin(); it != lowerEnd; ++it) {
+            check(it->rule);
+        }
+        auto upperBegin = std::lower_bound(index.upper.begin(), index.upper.end(), key);
+        for (auto it = upperBegin; it != index.upper.end(); ++it) {
+            check(it->rule);
+        }
+        auto equal = std::equal_range(index.equal.begin(), index.equal.end(), key);
+        for (auto it = equal.first; it != equal.second; ++it) {
+            check(it->rule);
+        }
+
+        // Only intervals of the nodes on the path to x can contain it; each node's
+        // list is scanned from the end nearest x and stops at the first miss
+        std::int32_t x = key.value;
+        std::uint32_t id = index.tree.empty() ? kNoChild : 0;
+        while (id != kNoChild) {
+            const TreeNode& node = index.tree[id];
+            visited++;
+            if (x < node.center) {
+                for (std::uint32_t i = node.first; i < node.first + node.count && index.byLo[i].lo <= x; i++) {
+                    check(index.byLo[i].rule);
+                }
+                id = node.left;
+            }
+            else if (x > node.center) {
+                for (std::uint32_t i = node.first; i < node.first + node.count && index.byHi[i].hi >= x; i++) {
+                    check(index.byHi[i].rule);
+                }
+                id = node.right;
+            }
+            else {
+                for (std::uint32_t i = node.first; i < node.first + node.count; i++) {
+                    check(index.byLo[i].rule);
+                }
+                id = kNoChild;
+            }
+        }
+    }
+    for (std::uint32_t rule : unconstrained) {
+        check(rule);
+    }
+
+    for (const auto& [rule, program] : fallback) {
+        try {
+            if (program.evaluate(slots) != 0) {
+                matches.push_back(rule);
+            }
+        }
+        catch (const std::exception&) {
+            // A failing rule does not match
+        }
+    }
+    std::sort(matches.begin(), matches.end());
+
+    if (stats) {
+        stats->candidates = candidates;
+        stats->nodesVisited = visited;
+        stats->fallbackEvaluations = fallback.size();
+    }
+}
+
+std::vector<std::uint32_t> PredicateIndex::fallbackRules() const {
+    std::vector<std::uint32_t> rules;
+    for (const auto& entry : fallback) {
+        rules.push_back(entry.first);
+    }
+    return rules;
+}
@@ -0,0 +1,163 @@
+#ifndef PREDICATE_INDEX_H
+#define PREDICATE_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Ast.h"
+#include "CompiledExpression.h"
+#include "Evaluator.h"
+
+/**
+ * Counters filled in by PredicateIndex::match() when requested.
+ */
+struct MatchStats {
+    std::size_t candidates = 0;             // Indexed rules whose access interval holds, so were checked
+    std::size_t nodesVisited = 0;           // Interval tree nodes visited
+    std::size_t fallbackEvaluations = 0;    // Rules evaluated because they could not be indexed
+};
+
+/**
+ * Finds which of many rules a record satisfies without evaluating every rule.
+ *
+ * Rules that are conjunctions of comparisons between a variable and a constant
+ * ("price > 100 && qty <= 5 && region == 3 && flag != 0", after constant folding)
+ * are indexed. Each rule's comparisons on one variable are merged into an
+ * interval lo <= x <= hi and a list of excluded values. The narrowest interval
+ * of a rule is its access interval, filed under its variable:
+ * - one-sided intervals in arrays sorted by threshold, where the satisfied
+ *   ones form a prefix or suffix found by binary search,
+ * - points (x == c) in an array sorted by value,
+ * - two-sided intervals in a static interval tree.
+ *
+ * match() looks up each variable's value to find the rules whose access
+ * interval holds, then checks only those rules' other intervals and excluded
+ * values. The cost is O(v log n) plus the number of such candidates, not the
+ * number of rules, so a selective comparison such as "region == 3" in each
+ * rule keeps matching fast however many rules there are.
+ * Rules of any other shape are compiled and evaluated on every record.
+ */
+class PredicateIndex {
+public:
+    /**
+     * Builds the index.
+     *
+     * @param rules The rule expressions; rule i is reported as i.
+     * @param variables The variable names, in slot order, shared by every rule.
+     * @param compiler Evaluator whose limits are used to parse the rules.
+     * @throws std::runtime_error if a rule is invalid, prefixed with "Rule <i>: ".
+     *
+     * Time Complexity: O(p log p) where p is the number of comparisons.
+     */
+    PredicateIndex(const std::vector<std::string>& rules, const std::vector<std::string>& variables,
+                   const Evaluator& compiler = Evaluator());
+
+    /**
+     * Finds the rules a record satisfies (those eval() would give a non-zero
+     * result). A rule that is not indexed and fails on the record, for example
+     * by dividing by zero, does not match. match() is const and keeps no state,
+     * so several threads can match against one index at once, and it does not
+     * allocate beyond growing matches, whose capacity is reused across calls.
+     *
+     * @param slots The variable values, at least variableCount() of them.
+     * @param matches Receives the matching rule indices in increasing order.
+     * @param stats If not null, receives counters for this call.
+     *
+     * Time Complexity: O(v log n + c + m log m + f) where c is the number of
+     * candidates (times their comparisons), m the number of matches and f the
+     * cost of the rules that are not indexed.
+     */
+    void match(const int* slots, std::vector<std::uint32_t>& matches, MatchStats* stats = nullptr) const;
+
+    /**
+     * @return The number of rules.
+     */
+    std::size_t size() const { return ruleCount; }
+
+    /**
+     * @return The number of variable slots the rules read.
+     */
+    std::size_t variableCount() const { return variables.size(); }
+
+    /**
+     * @return The number of rules answered by the index.
+     */
+    std::size_t indexedCount() const { return ruleCount - fallback.size(); }
+
+    /**
+     * @return The indices of the rules that are evaluated on every record.
+     */
+    std::vector<std::uint32_t> fallbackRules() const;
+
+private:
+    // A threshold or value and the rule it belongs to
+    struct Bound {
+        std::int32_t value;
+        std::uint32_t rule;
+
+        bool operator<(const Bound& other) const { return value < other.value; }
+    };
+
+    struct Interval {
+        std::int32_t lo;
+        std::int32_t hi;
+        std::uint32_t rule;
+    };
+
+    // A node of a centered interval tree: the intervals containing 'center',
+    // sorted by lo ascending and by hi descending, and the subtrees for
+    // intervals entirely left or right of it
+    struct TreeNode {
+        std::int32_t center;
+        std::uint32_t first;        // Range of this node's intervals in byLo / byHi
+        std::uint32_t count;
+        std::uint32_t left;         // kNoChild if absent
+        std::uint32_t right;
+    };
+
+    static constexpr std::uint32_t kNoChild = UINT32_MAX;
+
+    // Everything indexed for one variable
+    struct VariableIndex {
+        std::vector<Bound> lower;       // x >= value, sorted by value
+        std::vector<Bound> upper;       // x <= value, sorted by value
+        std::vector<Bound> equal;       // x == value, sorted by value
+        std::vector<TreeNode> tree;     // Two-sided intervals; the root is tree[0]
+        std::vector<Interval> byLo;
+        std::vector<Interval> byHi;
+    };
+
+    // One comparison a candidate must pass: lo <= slots[slot] <= hi, or
+    // slots[slot] != lo when 'excluded' is set
+    struct Check {
+        std::uint32_t slot;
+        std::int32_t lo;
+        std::int32_t hi;
+        bool excluded;
+    };
+
+    /**
+     * Builds a variable's interval tree from its two-sided intervals, without recursion.
+     */
+    static void buildTree(VariableIndex& index, std::vector<Interval> intervals);
+
+    /**
+     * Tries to file a folded rule's access interval and store its checks; false
+     * if the rule is not a conjunction of variable-constant comparisons.
+     * Two-sided access intervals are collected in 'intervals' (per variable)
+     * for buildTree().
+     */
+    bool addRule(std::uint32_t rule, const Ast& ast, std::vector<std::vector<Interval>>& intervals);
+
+    std::size_t ruleCount = 0;
+    std::vector<std::string> variables;
+    std::vector<VariableIndex> indexes;         // Per variable slot
+    std::vector<Check> checks;                  // Rule r's are [firstCheck[r], firstCheck[r + 1])
+    std::vector<std::uint32_t> firstCheck;
+    std::vector<std::uint32_t> unconstrained;   // Indexed rules with no interval, checked every time
+    std::vector<std::pair<std::uint32_t, CompiledExpression>> fallback;     // Rules evaluated every time
+};
+
+#endif // PREDICATE_INDEX_H
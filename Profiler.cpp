@@ -0,0 +1,289 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace profile {
+
+namespace {
+
+const char* const kPhaseNames[kPhaseCount] = {"parse", "fold", "generate", "execute"};
+
+// Appends s as a JSON string literal
+void appendString(std::string& out, std::string_view s) {
+    out += '"';
+    for (char c : s) {
+        switch (c) {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+                out += escaped;
+            }
+            else {
+                out += c;
+            }
+        }
+    }
+    out += '"';
+}
+
+void appendField(std::string& out, const char* name, std::uint64_t value, bool comma = true) {
+    appendString(out, name);
+    out += ':';
+    out += std::to_string(value);
+    if (comma) {
+        out += ',';
+    }
+}
+
+#if EVALUATOR_PROFILE
+
+// The records of one thread. Only that thread adds to it, but snapshot() and
+// reset() read and clear it from others, hence the (uncontended) mutex.
+struct Collector {
+    std::mutex lock;
+    ProfileStats totals;                                    // Counters (its expressions stay empty), in ticks
+    std::vector<ExpressionProfile> expressions;             // Times in ticks
+    std::unordered_map<std::size_t, std::size_t> index;     // Text hash -> position in expressions
+
+    // Finds or adds the entry for text, or returns nullptr when the table is full
+    ExpressionProfile* entry(std::string_view text) {
+        // Probe successive keys on a hash collision, so the lookup never builds a std::string
+        for (std::size_t key = std::hash<std::string_view>()(text);; key++) {
+            auto it = index.find(key);
+            if (it == index.end()) {
+                if (expressions.size() >= kMaxTrackedExpressions) {
+                    return nullptr;
+                }
+                index.emplace(key, expressions.size());
+                expressions.push_back({std::string(text)});
+                return &expressions.back();
+            }
+            if (expressions[it->second].expression == text) {
+                return &expressions[it->second];
+            }
+        }
+    }
+};
+
+#ifdef PROFILE_HAVE_TSC
+
+// A steady_clock reading and the time stamp counter at the same moment
+struct ClockSample {
+    std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
+    std::uint64_t ticks = __rdtsc();
+};
+
+// The sample taken when the first thread started recording
+const ClockSample& firstSample() {
+    static const ClockSample sample;
+    return sample;
+}
+
+#endif
+
+// Nanoseconds per tick of Recorder::now(), measured against steady_clock since
+// the first thread started recording (waiting until 10 ms have passed)
+double nanosecondsPerTick() {
+#ifdef PROFILE_HAVE_TSC
+    const ClockSample& first = firstSample();
+    ClockSample now;
+    while (now.time - first.time < std::chrono::milliseconds(10)) {
+        now = ClockSample();
+    }
+    return std::chrono::duration<double, std::nano>(now.time - first.time).count() /
+           static_cast<double>(now.ticks - first.ticks);
+#else
+    return 1.0;
+#endif
+}
+
+std::uint64_t toNanoseconds(std::uint64_t ticks, double scale) {
+    return static_cast<std::uint64_t>(static_cast<double>(ticks) * scale);
+}
+
+std::mutex registryLock;
+std::vector<std::shared_ptr<Collector>> registry;   // Every thread's collector, kept after the thread exits
+
+Collector& threadCollector() {
+    thread_local std::shared_ptr<Collector> collector = [] {
+#ifdef PROFILE_HAVE_TSC
+        firstSample();
+#endif
+        auto created = std::make_shared<Collector>();
+        std::lock_guard<std::mutex> guard(registryLock);
+        registry.push_back(created);
+        return created;
+    }();
+    return *collector;
+}
+
+#endif
+
+} // namespace
+
+const char* phaseName(Phase phase) {
+    return kPhaseNames[static_cast<std::size_t>(phase)];
+}
+
+#if EVALUATOR_PROFILE
+
+Recorder::~Recorder() {
+    std::uint64_t finished = now();
+    phaseTicks[static_cast<std::size_t>(current)] += finished - last;
+    std::uint64_t elapsed = finished - started;
+
+    Collector& collector = threadCollector();
+    std::lock_guard<std::mutex> guard(collector.lock);
+    ProfileStats& totals = collector.totals;
+    bool evaluating = kind == Activity::Evaluate;
+    totals.evaluations += evaluating;
+    totals.compilations += !evaluating;
+    totals.errors += !ok;
+    totals.tokens += tokenCount;
+    for (std::size_t i = 0; i < kPhaseCount; i++) {
+        totals.phaseNanoseconds[i] += phaseTicks[i];
+    }
+    for (std::size_t i = 0; i < kOperatorCount; i++) {
+        totals.operatorCounts[i] += operatorCounts[i];
+    }
+    totals.maxValueStack = std::max(totals.maxValueStack, maxValueStack);
+    totals.maxOperatorStack = std::max(totals.maxOperatorStack, maxOperatorStack);
+    totals.maxTokens = std::max(totals.maxTokens, tokenCount);
+
+    ExpressionProfile* entry = collector.entry(text);
+    if (!entry) {
+        totals.untrackedCalls++;
+        return;
+    }
+    entry->evaluations += evaluating;
+    entry->compilations += !evaluating;
+    entry->errors += !ok;
+    entry->nanoseconds += elapsed;
+    entry->maxNanoseconds = std::max(entry->maxNanoseconds, elapsed);
+}
+
+ProfileStats snapshot() {
+    ProfileStats stats;
+    std::unordered_map<std::string, std::size_t> positions;    // Text -> position in stats.expressions
+
+    std::lock_guard<std::mutex> registryGuard(registryLock);
+    for (const std::shared_ptr<Collector>& collector : registry) {
+        std::lock_guard<std::mutex> guard(collector->lock);
+        const ProfileStats& totals = collector->totals;
+        stats.evaluations += totals.evaluations;
+        stats.compilations += totals.compilations;
+        stats.errors += totals.errors;
+        stats.tokens += totals.tokens;
+        for (std::size_t i = 0; i < kPhaseCount; i++) {
+            stats.phaseNanoseconds[i] += totals.phaseNanoseconds[i];
+        }
+        for (std::size_t i = 0; i < kOperatorCount; i++) {
+            stats.operatorCounts[i] += totals.operatorCounts[i];
+        }
+        stats.maxValueStack = std::max(stats.maxValueStack, totals.maxValueStack);
+        stats.maxOperatorStack = std::max(stats.maxOperatorStack, totals.maxOperatorStack);
+        stats.maxTokens = std::max(stats.maxTokens, totals.maxTokens);
+        stats.untrackedCalls += totals.untrackedCalls;
+
+        for (const ExpressionProfile& expression : collector->expressions) {
+            auto inserted = positions.emplace(expression.expression, stats.expressions.size());
+            if (inserted.second) {
+                stats.expressions.push_back(expression);
+                continue;
+            }
+            ExpressionProfile& merged = stats.expressions[inserted.first->second];
+            merged.evaluations += expression.evaluations;
+            merged.compilations += expression.compilations;
+            merged.errors += expression.errors;
+            merged.nanoseconds += expression.nanoseconds;
+            merged.maxNanoseconds = std::max(merged.maxNanoseconds, expression.maxNanoseconds);
+        }
+    }
+
+    // Everything above was summed in ticks
+    double scale = registry.empty() ? 1.0 : nanosecondsPerTick();
+    for (std::uint64_t& time : stats.phaseNanoseconds) {
+        time = toNanoseconds(time, scale);
+    }
+    for (ExpressionProfile& expression : stats.expressions) {
+        expression.nanoseconds = toNanoseconds(expression.nanoseconds, scale);
+        expression.maxNanoseconds = toNanoseconds(expression.maxNanoseconds, scale);
+    }
+
+    std::sort(stats.expressions.begin(), stats.expressions.end(),
+              [](const ExpressionProfile& a, const ExpressionProfile& b) { return a.nanoseconds > b.nanoseconds; });
+    return stats;
+}
+
+void reset() {
+    std::lock_guard<std::mutex> registryGuard(registryLock);
+    for (const std::shared_ptr<Collector>& collector : registry) {
+        std::lock_guard<std::mutex> guard(collector->lock);
+        collector->totals = ProfileStats();
+        collector->expressions.clear();
+        collector->index.clear();
+    }
+}
+
+#else
+
+ProfileStats snapshot() {
+    return ProfileStats();
+}
+
+void reset() {
+}
+
+#endif
+
+std::string toJson(const ProfileStats& stats, std::size_t maxExpressions) {
+    std::string out = "{";
+    out += "\"enabled\":";
+    out += stats.enabled ? "true," : "false,";
+    appendField(out, "evaluations", stats.evaluations);
+    appendField(out, "compilations", stats.compilations);
+    appendField(out, "errors", stats.errors);
+    appendField(out, "tokens", stats.tokens);
+    appendField(out, "maxTokens", stats.maxTokens);
+    appendField(out, "maxValueStack", stats.maxValueStack);
+    appendField(out, "maxOperatorStack", stats.maxOperatorStack);
+    appendField(out, "untrackedCalls", stats.untrackedCalls);
+
+    out += "\"phaseNanoseconds\":{";
+    for (std::size_t i = 0; i < kPhaseCount; i++) {
+        appendField(out, kPhaseNames[i], stats.phaseNanoseconds[i], i + 1 < kPhaseCount);
+    }
+    out += "},\"operators\":{";
+    for (std::size_t i = 0; i < kOperatorCount; i++) {
+        appendField(out, kOperatorTable[i].name, stats.operatorCounts[i], i + 1 < kOperatorCount);
+    }
+    out += "},\"expressions\":[";
+
+    std::size_t count = std::min(maxExpressions, stats.expressions.size());
+    for (std::size_t i = 0; i < count; i++) {
+        const ExpressionProfile& expression = stats.expressions[i];
+        out += "{\"expression\":";
+        appendString(out, expression.expression);
+        out += ',';
+        appendField(out, "evaluations", expression.evaluations);
+        appendField(out, "compilations", expression.compilations);
+        appendField(out, "errors", expression.errors);
+        appendField(out, "nanoseconds", expression.nanoseconds);
+        appendField(out, "maxNanoseconds", expression.maxNanoseconds, false);
+        out += i + 1 < count ? "}," : "}";
+    }
+    out += "]}";
+    return out;
+}
+
+} // namespace profile
@@ -0,0 +1,215 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Operators.h"
+
+// Build every translation unit with -DEVALUATOR_PROFILE=1 to record profiles.
+// Otherwise the hooks below are empty inline functions and compile to nothing.
+#ifndef EVALUATOR_PROFILE
+#define EVALUATOR_PROFILE 0
+#endif
+
+#if EVALUATOR_PROFILE
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <x86intrin.h>
+#define PROFILE_HAVE_TSC 1
+#else
+#include <chrono>
+#endif
+#endif
+
+/**
+ * Opt-in instrumentation of eval(), evalAs(), compile(), compileTyped() and parse().
+ *
+ * Each call records the time spent in each phase, how often each operator was
+ * applied, the deepest the value and operator stacks got, and its total time
+ * under the expression's text, so the expressions that cost the most can be
+ * found in a running process. Records go to a per-thread collector, so
+ * threads never contend; snapshot() merges them.
+ */
+namespace profile {
+
+/**
+ * True when the library was built with EVALUATOR_PROFILE.
+ */
+constexpr bool kEnabled = EVALUATOR_PROFILE != 0;
+
+/**
+ * The phases a call is split into. Tokens are lexed and validated as they are
+ * parsed, so Parse covers all three; eval() interleaves it with Execute, the
+ * operator applications. Fold and Generate only occur when compiling.
+ */
+enum class Phase : std::uint8_t {
+    Parse,
+    Fold,
+    Generate,
+    Execute
+};
+
+constexpr std::size_t kPhaseCount = static_cast<std::size_t>(Phase::Execute) + 1;
+
+// Operators counted by the profile (every Op except the '(' marker)
+constexpr std::size_t kOperatorCount = static_cast<std::size_t>(Op::LeftParen);
+
+/**
+ * @return The lower-case name of a phase ("parse", "fold", ...).
+ */
+const char* phaseName(Phase phase);
+
+/**
+ * What a profiled call did.
+ */
+enum class Activity : std::uint8_t {
+    Evaluate,   // eval() and evalAs()
+    Compile     // compile(), compileTyped() and parse()
+};
+
+/**
+ * Totals for one expression text.
+ */
+struct ExpressionProfile {
+    std::string expression;
+    std::uint64_t evaluations = 0;
+    std::uint64_t compilations = 0;
+    std::uint64_t errors = 0;               // Calls that threw
+    std::uint64_t nanoseconds = 0;          // Time of all calls
+    std::uint64_t maxNanoseconds = 0;       // Slowest single call
+};
+
+/**
+ * Everything recorded since the last reset(), summed over all threads.
+ */
+struct ProfileStats {
+    bool enabled = kEnabled;
+    std::uint64_t evaluations = 0;
+    std::uint64_t compilations = 0;
+    std::uint64_t errors = 0;
+    std::uint64_t tokens = 0;                           // Tokens of all calls
+    std::uint64_t phaseNanoseconds[kPhaseCount] = {};
+    std::uint64_t operatorCounts[kOperatorCount] = {};  // eval() operator applications, indexed by Op
+    std::size_t maxValueStack = 0;                      // eval() value stack high-water mark
+    std::size_t maxOperatorStack = 0;                   // eval() operator stack high-water mark
+    std::size_t maxTokens = 0;                          // Most tokens in one expression
+    std::uint64_t untrackedCalls = 0;                   // Calls whose expression found the table full
+    std::vector<ExpressionProfile> expressions;         // Most total time first
+};
+
+/**
+ * Maximum number of distinct expression texts each thread keeps totals for;
+ * calls for further expressions only count towards the global totals.
+ */
+constexpr std::size_t kMaxTrackedExpressions = 4096;
+
+/**
+ * Merges the records of every thread. Calls still in progress are not included.
+ *
+ * @return The totals; all zero (and enabled == false) in builds without EVALUATOR_PROFILE.
+ *
+ * Time Complexity: O(t + e log e) where t is the number of threads and e the
+ * number of tracked expressions.
+ */
+ProfileStats snapshot();
+
+/**
+ * Discards everything recorded so far.
+ *
+ * Time Complexity: O(t + e).
+ */
+void reset();
+
+/**
+ * Formats a snapshot as a JSON object.
+ *
+ * @param stats The snapshot.
+ * @param maxExpressions Include at most this many expressions (the most expensive ones).
+ * @return The JSON text.
+ *
+ * Time Complexity: O(e) where e is the number of expressions written.
+ */
+std::string toJson(const ProfileStats& stats, std::size_t maxExpressions = 100);
+
+#if EVALUATOR_PROFILE
+
+/**
+ * Records one call. Created at the start of the call (in the Parse phase),
+ * told about phase changes, operators and stack depths as they happen, and
+ * added to the thread's collector when destroyed; a call that is not marked
+ * succeeded() counts as an error.
+ */
+class Recorder {
+public:
+    Recorder(Activity activity, std::string_view expression)
+        : kind(activity), text(expression), started(now()), last(started) {}
+
+    Recorder(const Recorder&) = delete;
+    Recorder& operator=(const Recorder&) = delete;
+
+    ~Recorder();
+
+    /**
+     * Ends the current phase and starts another.
+     *
+     * Time Complexity: O(1) - One read of the time stamp counter.
+     */
+    void phase(Phase next) {
+        std::uint64_t time = now();
+        phaseTicks[static_cast<std::size_t>(current)] += time - last;
+        last = time;
+        current = next;
+    }
+
+    void tokens(std::size_t count) { tokenCount = count; }
+    void applied(Op op) { operatorCounts[static_cast<std::size_t>(op)]++; }
+    void valueDepth(std::size_t depth) { maxValueStack = depth > maxValueStack ? depth : maxValueStack; }
+    void operatorDepth(std::size_t depth) { maxOperatorStack = depth > maxOperatorStack ? depth : maxOperatorStack; }
+    void succeeded() { ok = true; }
+
+private:
+    // Ticks of the time stamp counter (a few cycles to read), or nanoseconds
+    // without one; snapshot() converts ticks to nanoseconds
+    static std::uint64_t now() {
+#ifdef PROFILE_HAVE_TSC
+        return __rdtsc();
+#else
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    Activity kind;
+    std::string_view text;
+    std::uint64_t started;
+    std::uint64_t last;
+    Phase current = Phase::Parse;
+    bool ok = false;
+    std::size_t tokenCount = 0;
+    std::size_t maxValueStack = 0;
+    std::size_t maxOperatorStack = 0;
+    std::uint64_t phaseTicks[kPhaseCount] = {};
+    std::uint32_t operatorCounts[kOperatorCount] = {};
+};
+
+#else
+
+// Profiling disabled: every hook is empty and the object has no state
+class Recorder {
+public:
+    Recorder(Activity, std::string_view) {}
+    void phase(Phase) {}
+    void tokens(std::size_t) {}
+    void applied(Op) {}
+    void valueDepth(std::size_t) {}
+    void operatorDepth(std::size_t) {}
+    void succeeded() {}
+};
+
+#endif
+
+} // namespace profile
+
+#endif // PROFILER_H
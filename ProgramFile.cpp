@@ -0,0 +1,449 @@
+#include "ProgramFile.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using programfile::Header;
+using programfile::NameRecord;
+using programfile::ProgramRecord;
+
+// Instructions are executed straight from the mapping
+static_assert(std::is_trivially_copyable<Instruction>::value && std::is_standard_layout<Instruction>::value,
+              "Instruction must have a fixed memory layout");
+static_assert(alignof(Instruction) <= 8 && alignof(ProgramRecord) <= 8 && alignof(Header) <= 8,
+              "Sections are 8-byte aligned");
+
+namespace {
+
+std::size_t alignTo8(std::size_t offset) {
+    return (offset + 7) & ~std::size_t(7);
+}
+
+// Appends the bytes of a trivially copyable value
+template <typename T>
+void append(std::string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+std::uint32_t checkedIndex(std::size_t value, const char* what) {
+    if (value > UINT32_MAX) {
+        throw std::runtime_error(std::string("Too many ") + what + " for the program file format");
+    }
+    return static_cast<std::uint32_t>(value);
+}
+
+std::uint64_t rotateLeft(std::uint64_t x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+/**
+ * Checks that code can run on a stack of stackDepth entries with slotCount
+ * variables: every opcode is known, every slot exists, every jump lands
+ * ahead of it inside the enclosing && / || (as compile() nests them) with the
+ * stack as high as when it jumped, no operator pops an empty stack, and one
+ * value remains. The checksum only catches damage; this keeps a crafted record
+ * from overrunning the stack or reading outside the mapping.
+ *
+ * Time Complexity: O(k) where k is the number of instructions.
+ */
+bool validCode(const Instruction* code, std::uint32_t count, std::uint32_t slotCount, std::uint32_t stackDepth) {
+    if (stackDepth > count) {
+        return false;
+    }
+
+    // The && / || jumps not yet landed, innermost last; only programs nested
+    // deeper than the inline array spill to the heap
+    struct OpenJump {
+        std::uint32_t target;
+        std::uint32_t depth;
+    };
+    OpenJump inlineJumps[64];
+    std::vector<OpenJump> spilled;
+    OpenJump* open = inlineJumps;
+    std::size_t openCount = 0;
+    std::size_t capacity = 64;
+    std::uint32_t depth = 0;
+
+    for (std::uint32_t pc = 0; pc <= count; pc++) {
+        for (; openCount > 0 && open[openCount - 1].target == pc; openCount--) {
+            if (open[openCount - 1].depth != depth) {
+                return false;
+            }
+        }
+        if (pc == count) {
+            break;
+        }
+
+        const Instruction& ins = code[pc];
+        auto op = static_cast<std::uint8_t>(ins.op);
+        if (op > static_cast<std::uint8_t>(OpCode::JumpIfNonZero)) {
+            return false;
+        }
+        switch (ins.op) {
+        case OpCode::PushVar:
+            if (ins.operand < 0 || static_cast<std::uint32_t>(ins.operand) >= slotCount) {
+                return false;
+            }
+            [[fallthrough]];
+        case OpCode::PushConst:
+            if (++depth > stackDepth) {
+                return false;
+            }
+            break;
+        case OpCode::JumpIfZero:
+        case OpCode::JumpIfNonZero: {
+            std::uint32_t limit = openCount == 0 ? count : open[openCount - 1].target;
+            if (depth == 0 || ins.operand <= static_cast<std::int64_t>(pc) ||
+                static_cast<std::uint32_t>(ins.operand) > limit) {
+                return false;
+            }
+            if (openCount == capacity) {
+                if (spilled.empty()) {
+                    spilled.assign(inlineJumps, inlineJumps + openCount);
+                }
+                spilled.resize(capacity * 2);
+                open = spilled.data();
+                capacity = spilled.size();
+            }
+            open[openCount++] = {static_cast<std::uint32_t>(ins.operand), depth};
+            depth--;
+            break;
+        }
+        default:
+            // Unary operators need one operand, binary ones two
+            if (op >= static_cast<std::uint8_t>(OpCode::LogicalNot)) {
+                if (depth == 0) {
+                    return false;
+                }
+            }
+            else if (depth < 2) {
+                return false;
+            }
+            else {
+                depth--;
+            }
+            break;
+        }
+    }
+    return depth == 1;
+}
+
+} // namespace
+
+std::uint64_t programfile::checksum(const void* data, std::size_t size) {
+    const std::uint64_t k1 = 0x9E3779B185EBCA87ull;
+    const std::uint64_t k2 = 0xC2B2AE3D27D4EB4Full;
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+    std::uint64_t h = k1 ^ size;
+    std::size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, bytes + i, 8);
+        h = rotateLeft(h ^ (word * k2), 31) * k1;
+    }
+
+    // The tail, zero-padded; the length is already mixed in
+    std::uint64_t tail = 0;
+    std::memcpy(&tail, bytes + i, size - i);
+    h = rotateLeft(h ^ (tail * k2), 31) * k1;
+
+    h ^= h >> 33;
+    h *= k2;
+    h ^= h >> 29;
+    return h;
+}
+
+int ProgramView::evaluate(const int* slots) const {
+    std::size_t depth = record->stackDepth;
+    if (depth <= CompiledExpression::kInlineStackSize) {
+        int stack[CompiledExpression::kInlineStackSize];
+        return executeProgram(code, record->instructionCount, slots, stack);
+    }
+
+    // Very deep expressions: fall back to a heap-allocated stack
+    std::vector<int> stack(depth);
+    return executeProgram(code, record->instructionCount, slots, stack.data());
+}
+
+int ProgramView::evaluate() const {
+    if (record->nameCount != 0) {
+        throw std::runtime_error("Expression uses " + std::to_string(record->nameCount) +
+                                 " variable(s); pass their values to evaluate()");
+    }
+    return evaluate(static_cast<const int*>(nullptr));
+}
+
+CompiledExpression ProgramView::toCompiled() const {
+    CompiledExpression program;
+    program.code.assign(code, code + record->instructionCount);
+    program.stackDepth = record->stackDepth;
+    for (std::size_t slot = 0; slot < variableCount(); slot++) {
+        program.names.emplace_back(variable(slot));
+    }
+    program.text = std::string(source());
+    return program;
+}
+
+std::string_view ProgramView::variable(std::size_t slot) const {
+    return std::string_view(strings + names[slot].offset, names[slot].length);
+}
+
+int ProgramView::slotOf(std::string_view name) const {
+    for (std::size_t slot = 0; slot < variableCount(); slot++) {
+        if (variable(slot) == name) {
+            return static_cast<int>(slot);
+        }
+    }
+    return -1;
+}
+
+std::string ProgramFile::serialize(const std::vector<CompiledExpression>& programs) {
+    // Lay out the string section and count everything first, so every offset is known
+    std::vector<ProgramRecord> records;
+    std::vector<NameRecord> names;
+    std::string strings;
+    std::size_t instructionCount = 0;
+    for (const CompiledExpression& program : programs) {
+        ProgramRecord record{};
+        record.firstInstruction = checkedIndex(instructionCount, "instructions");
+        record.instructionCount = checkedIndex(program.instructions().size(), "instructions");
+        record.stackDepth = checkedIndex(program.maxStackDepth(), "stack entries");
+        record.firstName = checkedIndex(names.size(), "variable names");
+        record.nameCount = checkedIndex(program.variableCount(), "variable names");
+        for (const std::string& name : program.variables()) {
+            names.push_back({checkedIndex(strings.size(), "string bytes"), checkedIndex(name.size(), "string bytes")});
+            strings += name;
+        }
+        record.textOffset = checkedIndex(strings.size(), "string bytes");
+        record.textLength = checkedIndex(program.source().size(), "string bytes");
+        strings += program.source();
+        checkedIndex(strings.size(), "string bytes");
+        instructionCount += program.instructions().size();
+        records.push_back(record);
+    }
+    checkedIndex(instructionCount, "instructions");
+
+    Header header{};
+    std::memcpy(header.magic, programfile::kMagic, sizeof(header.magic));
+    header.version = programfile::kVersion;
+    header.byteOrder = programfile::kByteOrderMark;
+    header.instructionSize = sizeof(Instruction);
+    header.programCount = checkedIndex(programs.size(), "programs");
+    header.instructionCount = instructionCount;
+    header.nameCount = names.size();
+    header.stringBytes = strings.size();
+    header.indexOffset = alignTo8(sizeof(Header));
+    header.codeOffset = alignTo8(header.indexOffset + records.size() * sizeof(ProgramRecord));
+    header.namesOffset = alignTo8(header.codeOffset + instructionCount * sizeof(Instruction));
+    header.stringsOffset = header.namesOffset + names.size() * sizeof(NameRecord);
+    header.fileSize = header.stringsOffset + strings.size();
+
+    std::string out;
+    out.reserve(header.fileSize);
+    append(out, header);
+    out.resize(header.indexOffset, '\0');
+    for (const ProgramRecord& record : records) {
+        append(out, record);
+    }
+    out.resize(header.codeOffset, '\0');
+    for (const CompiledExpression& program : programs) {
+        // Written field by field so padding bytes are zero, not whatever was in memory
+        for (Instruction ins : program.instructions()) {
+            Instruction clean;
+            std::memset(&clean, 0, sizeof(clean));
+            clean.op = ins.op;
+            clean.operand = ins.operand;
+            clean.offset = ins.offset;
+            append(out, clean);
+        }
+    }
+    out.resize(header.namesOffset, '\0');
+    for (const NameRecord& name : names) {
+        append(out, name);
+    }
+    out += strings;
+
+    std::uint64_t sum = programfile::checksum(out.data() + sizeof(Header), out.size() - sizeof(Header));
+    std::memcpy(&out[offsetof(Header, checksum)], &sum, sizeof(sum));
+    return out;
+}
+
+void ProgramFile::write(const std::string& path, const std::vector<CompiledExpression>& programs) {
+    std::string contents = serialize(programs);
+
+    // Written beside the target and renamed over it: processes that have the old
+    // file mapped keep its inode, and never see a half-written file. The name is
+    // unique, so concurrent writers of one target do not share a temporary file
+    std::string temporary = path + ".XXXXXX";
+    int fd = mkostemp(&temporary[0], O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot write " + temporary + ": " + std::strerror(errno));
+    }
+    auto fail = [&] {
+        std::string message = "Cannot write " + path + ": " + std::strerror(errno);
+        if (fd >= 0) {
+            close(fd);
+        }
+        unlink(temporary.c_str());
+        throw std::runtime_error(message);
+    };
+
+    const char* data = contents.data();
+    std::size_t left = contents.size();
+    while (left > 0) {
+        ssize_t written = ::write(fd, data, left);
+        if (written <= 0) {
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            errno = written == 0 ? EIO : errno;
+            fail();
+        }
+        data += written;
+        left -= static_cast<std::size_t>(written);
+    }
+    // mkostemp() creates the file readable by its owner only
+    if (fchmod(fd, 0644) != 0 || fsync(fd) != 0) {
+        fail();
+    }
+    int closed = close(fd);
+    fd = -1;
+    if (closed != 0 || rename(temporary.c_str(), path.c_str()) != 0) {
+        fail();
+    }
+
+    // The rename is only durable once the directory entry is on disk
+    std::size_t slash = path.rfind('/');
+    std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int dirFd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    bool synced = dirFd >= 0 && fsync(dirFd) == 0;
+    int error = errno;
+    if (dirFd >= 0) {
+        close(dirFd);
+    }
+    if (!synced) {
+        throw std::runtime_error("Cannot sync the directory of " + path + ": " + std::strerror(error));
+    }
+}
+
+ProgramFile::ProgramFile(const std::string& path, bool verify) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open " + path + ": " + std::strerror(errno));
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < sizeof(Header)) {
+        close(fd);
+        throw std::runtime_error(path + " is not a program file (too short)");
+    }
+    mappingSize = static_cast<std::size_t>(info.st_size);
+    void* memory = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        throw std::runtime_error("Cannot map " + path + ": " + std::strerror(errno));
+    }
+    mapping = static_cast<const char*>(memory);
+
+    try {
+        checkHeader(path);
+        validated.reset(new std::atomic<std::uint64_t>[(header().programCount + 63) / 64]());
+        if (verify && !this->verify()) {
+            throw std::runtime_error(path + " is damaged (checksum mismatch)");
+        }
+    }
+    catch (...) {
+        munmap(memory, mappingSize);
+        throw;
+    }
+}
+
+ProgramFile::~ProgramFile() {
+    munmap(const_cast<char*>(mapping), mappingSize);
+}
+
+void ProgramFile::checkHeader(const std::string& path) const {
+    const Header& h = header();
+    if (std::memcmp(h.magic, programfile::kMagic, sizeof(h.magic)) != 0) {
+        throw std::runtime_error(path + " is not a program file");
+    }
+    if (h.byteOrder != programfile::kByteOrderMark) {
+        throw std::runtime_error(path + " was written with another byte order");
+    }
+    if (h.version != programfile::kVersion) {
+        throw std::runtime_error(path + " has format version " + std::to_string(h.version) +
+                                 ", expected " + std::to_string(programfile::kVersion));
+    }
+    if (h.instructionSize != sizeof(Instruction)) {
+        throw std::runtime_error(path + " was written with another instruction layout");
+    }
+    if (h.fileSize != mappingSize) {
+        throw std::runtime_error(path + " is truncated or has trailing data");
+    }
+
+    // Each section must be aligned, lie after the previous one and fit in the file;
+    // counts are checked before multiplying so the products cannot overflow
+    auto fits = [&](std::uint64_t offset, std::uint64_t count, std::size_t size) {
+        return offset % 8 == 0 && offset <= mappingSize && count <= (mappingSize - offset) / size;
+    };
+    bool ok = h.indexOffset >= sizeof(Header) && fits(h.indexOffset, h.programCount, sizeof(ProgramRecord)) &&
+              h.codeOffset >= h.indexOffset + h.programCount * sizeof(ProgramRecord) &&
+              fits(h.codeOffset, h.instructionCount, sizeof(Instruction)) &&
+              h.namesOffset >= h.codeOffset + h.instructionCount * sizeof(Instruction) &&
+              fits(h.namesOffset, h.nameCount, sizeof(NameRecord)) &&
+              h.stringsOffset >= h.namesOffset + h.nameCount * sizeof(NameRecord) &&
+              h.stringsOffset <= mappingSize && h.stringBytes <= mappingSize - h.stringsOffset;
+    if (!ok) {
+        throw std::runtime_error(path + " has an invalid section table");
+    }
+}
+
+bool ProgramFile::verify() const {
+    return programfile::checksum(mapping + sizeof(Header), mappingSize - sizeof(Header)) == header().checksum;
+}
+
+ProgramView ProgramFile::program(std::size_t index) const {
+    const Header& h = header();
+    if (index >= h.programCount) {
+        throw std::runtime_error("Program index " + std::to_string(index) + " out of range (" +
+                                 std::to_string(h.programCount) + " programs)");
+    }
+
+    const ProgramRecord* record = reinterpret_cast<const ProgramRecord*>(mapping + h.indexOffset) + index;
+    const NameRecord* names = reinterpret_cast<const NameRecord*>(mapping + h.namesOffset);
+    const char* strings = mapping + h.stringsOffset;
+    const Instruction* code = reinterpret_cast<const Instruction*>(mapping + h.codeOffset) + record->firstInstruction;
+
+    // Each record is checked on first use only. Threads racing on a new record may
+    // both check it, which is harmless: the mapping is read-only
+    std::atomic<std::uint64_t>& word = validated[index / 64];
+    std::uint64_t bit = std::uint64_t(1) << (index % 64);
+    if (word.load(std::memory_order_relaxed) & bit) {
+        return ProgramView(record, code, names + record->firstName, strings);
+    }
+
+    // The record's ranges must stay inside their sections
+    bool ok = std::uint64_t(record->firstInstruction) + record->instructionCount <= h.instructionCount &&
+              std::uint64_t(record->firstName) + record->nameCount <= h.nameCount &&
+              std::uint64_t(record->textOffset) + record->textLength <= h.stringBytes;
+    for (std::uint32_t i = 0; ok && i < record->nameCount; i++) {
+        const NameRecord& name = names[record->firstName + i];
+        ok = std::uint64_t(name.offset) + name.length <= h.stringBytes;
+    }
+    ok = ok && validCode(code, record->instructionCount, record->nameCount, record->stackDepth);
+    if (!ok) {
+        throw std::runtime_error("Program " + std::to_string(index) + " has an invalid record");
+    }
+    word.fetch_or(bit, std::memory_order_relaxed);
+
+    return ProgramView(record, code, names + record->firstName, strings);
+}
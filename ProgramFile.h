@@ -0,0 +1,250 @@
+#ifndef PROGRAM_FILE_H
+#define PROGRAM_FILE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "CompiledExpression.h"
+
+/**
+ * On-disk layout of a program file. Every offset is relative to the start of
+ * the file, so a file can be mapped at any address. Multi-byte fields use the
+ * writer's byte order; byteOrder lets a reader with the other order reject the
+ * file instead of misreading it.
+ *
+ *   Header
+ *   ProgramRecord[programCount]          (8-byte aligned)
+ *   Instruction[instructionCount]        (8-byte aligned, exactly as in memory)
+ *   NameRecord[nameCount]                (variable names of every program)
+ *   char[stringBytes]                    (names and source texts)
+ *
+ * Instructions are stored in the layout of struct Instruction, so a mapped file
+ * is executed in place. Programs produced by compile() keep their constants in
+ * the PushConst operands, so the instruction stream doubles as the constant pool.
+ */
+namespace programfile {
+
+constexpr char kMagic[8] = {'E', 'V', 'A', 'L', 'P', 'R', 'O', 'G'};
+constexpr std::uint32_t kVersion = 1;
+constexpr std::uint32_t kByteOrderMark = 0x01020304;
+
+struct Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrder;            // kByteOrderMark as written by the writer
+    std::uint32_t instructionSize;      // sizeof(Instruction) of the writer
+    std::uint32_t programCount;
+    std::uint64_t fileSize;
+    std::uint64_t checksum;             // checksum() of everything after the header
+    std::uint64_t instructionCount;
+    std::uint64_t nameCount;
+    std::uint64_t stringBytes;
+    std::uint64_t indexOffset;
+    std::uint64_t codeOffset;
+    std::uint64_t namesOffset;
+    std::uint64_t stringsOffset;
+};
+
+// One compiled program; indices refer to the code, name and string sections
+struct ProgramRecord {
+    std::uint32_t firstInstruction;
+    std::uint32_t instructionCount;
+    std::uint32_t stackDepth;
+    std::uint32_t firstName;
+    std::uint32_t nameCount;
+    std::uint32_t textOffset;
+    std::uint32_t textLength;
+    std::uint32_t reserved;             // Zero
+};
+
+// A string in the string section
+struct NameRecord {
+    std::uint32_t offset;
+    std::uint32_t length;
+};
+
+/**
+ * A fast 64-bit checksum for detecting corruption (not tampering).
+ *
+ * Time Complexity: O(n), eight bytes per step.
+ */
+std::uint64_t checksum(const void* data, std::size_t size);
+
+} // namespace programfile
+
+/**
+ * One program of a ProgramFile, read in place from the mapping. Views are
+ * cheap to copy and valid as long as the file is open.
+ */
+class ProgramView {
+public:
+    /**
+     * Executes the program with variable slot i bound to slots[i], like
+     * CompiledExpression::evaluate() but always interpreted.
+     * Performs no heap allocation unless maxStackDepth() exceeds
+     * CompiledExpression::kInlineStackSize.
+     *
+     * @param slots The variable values, at least variableCount() of them.
+     * @return The result of the expression evaluation.
+     * @throws std::runtime_error on division or modulo by zero.
+     *
+     * Time Complexity: O(k) where k is the number of instructions.
+     */
+    int evaluate(const int* slots) const;
+
+    /**
+     * Executes a program that has no variables.
+     *
+     * @throws std::runtime_error if the program uses variables, or on division
+     *         or modulo by zero.
+     */
+    int evaluate() const;
+
+    /**
+     * Copies the program into a CompiledExpression, which can then be
+     * batch-evaluated and promoted to native code like one from compile().
+     *
+     * Time Complexity: O(k + v) where v is the total length of the names.
+     */
+    CompiledExpression toCompiled() const;
+
+    /**
+     * @param slot A slot below variableCount().
+     * @return The name of the variable bound to the slot.
+     */
+    std::string_view variable(std::size_t slot) const;
+
+    /**
+     * @param name The variable name.
+     * @return The slot index, or -1 if the program has no such variable.
+     *
+     * Time Complexity: O(v) where v is the number of variables.
+     */
+    int slotOf(std::string_view name) const;
+
+    std::size_t variableCount() const { return record->nameCount; }
+    std::size_t instructionCount() const { return record->instructionCount; }
+    std::size_t maxStackDepth() const { return record->stackDepth; }
+    const Instruction* instructions() const { return code; }
+    std::string_view source() const { return std::string_view(strings + record->textOffset, record->textLength); }
+
+private:
+    friend class ProgramFile;
+
+    ProgramView(const programfile::ProgramRecord* record, const Instruction* code,
+                const programfile::NameRecord* names, const char* strings)
+        : record(record), code(code), names(names), strings(strings) {}
+
+    const programfile::ProgramRecord* record;
+    const Instruction* code;                // First instruction of this program
+    const programfile::NameRecord* names;   // First variable name of this program
+    const char* strings;                    // The string section
+};
+
+/**
+ * A file of compiled programs that is memory-mapped instead of parsed.
+ *
+ * write() stores programs from Evaluator::compile() once. Opening the file maps
+ * it and checks only the header, so startup costs about the same for ten
+ * programs as for a million; a program's pages are read from disk, and its
+ * record and code checked, when it is first used. Opening with verification
+ * also checksums the whole file, which reads every page.
+ *
+ * Uses the POSIX open/mmap calls.
+ */
+class ProgramFile {
+public:
+    /**
+     * Encodes programs in the file format.
+     *
+     * @param programs The programs, in the order they will be indexed.
+     * @return The file contents.
+     * @throws std::runtime_error if a section would exceed the format's 32-bit indices.
+     *
+     * Time Complexity: O(t) where t is the total size of the programs.
+     */
+    static std::string serialize(const std::vector<CompiledExpression>& programs);
+
+    /**
+     * Writes programs to a file (see serialize()). The contents go to a new file
+     * named path + a unique suffix, are flushed to disk and then renamed over
+     * path, and the directory is flushed so the new name survives a crash. A
+     * process that has the old file mapped keeps reading it until it opens the
+     * file again, and concurrent writers of one path each rename a complete file.
+     *
+     * @throws std::runtime_error if the file cannot be written.
+     */
+    static void write(const std::string& path, const std::vector<CompiledExpression>& programs);
+
+    /**
+     * Maps a file written by write().
+     *
+     * @param path The file.
+     * @param verify Whether to compare the checksum, reading the whole file.
+     *        Without it only the header is checked, and a damaged instruction
+     *        stream goes undetected: only skip it for files this process can trust.
+     * @throws std::runtime_error if the file cannot be mapped, is not a program
+     *         file, has another version, byte order or instruction layout, is
+     *         truncated, or fails verification.
+     *
+     * Time Complexity: O(p / 64) without verification, for a bit per program
+     * that records whether program() has checked it; O(file size) with it.
+     */
+    explicit ProgramFile(const std::string& path, bool verify = true);
+
+    /**
+     * Unmaps the file; views into it become invalid.
+     */
+    ~ProgramFile();
+
+    ProgramFile(const ProgramFile&) = delete;
+    ProgramFile& operator=(const ProgramFile&) = delete;
+
+    /**
+     * @param index A program index below size().
+     * @return A view of the program.
+     * @throws std::runtime_error if the index is out of range, or if the program's
+     *         record leaves its sections or its code could not run safely on the
+     *         stack depth the record claims (unknown opcodes, slots or jump targets).
+     *
+     * Time Complexity: O(k) where k is the number of instructions of the program
+     * on the first call for it, which checks the record; O(1) without allocation
+     * after that. Safe to call from several threads at once.
+     */
+    ProgramView program(std::size_t index) const;
+
+    /**
+     * @return True if the checksum matches the contents.
+     *
+     * Time Complexity: O(file size).
+     */
+    bool verify() const;
+
+    /**
+     * @return The number of programs.
+     */
+    std::size_t size() const { return header().programCount; }
+
+    /**
+     * @return The size of the mapped file in bytes.
+     */
+    std::size_t bytes() const { return mappingSize; }
+
+private:
+    const programfile::Header& header() const { return *reinterpret_cast<const programfile::Header*>(mapping); }
+
+    /**
+     * Checks the header against the mapping, so program() can trust its sections.
+     */
+    void checkHeader(const std::string& path) const;
+
+    const char* mapping = nullptr;
+    std::size_t mappingSize = 0;
+    std::unique_ptr<std::atomic<std::uint64_t>[]> validated;   // Bit i: program i's record has been checked
+};
+
+#endif // PROGRAM_FILE_H
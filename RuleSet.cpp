@@ -0,0 +1,239 @@
+#include "RuleSet.h"
+#include "Arithmetic.h"
+#include "Ast.h"
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+namespace {
+
+// A node of the shared DAG before registers are assigned
+struct DagNode {
+    NodeKind kind;          // Constant, Variable, Unary or Binary
+    OpCode op;
+    std::int32_t value;     // Constant value or variable slot
+    std::uint32_t a;
+    std::uint32_t b;
+    bool mayFail;           // Some division or modulo below it can see a zero divisor
+};
+
+struct DagKey {
+    NodeKind kind;
+    OpCode op;
+    std::int32_t value;
+    std::uint32_t a;
+    std::uint32_t b;
+
+    bool operator==(const DagKey& other) const {
+        return kind == other.kind && op == other.op && value == other.value && a == other.a && b == other.b;
+    }
+};
+
+struct DagKeyHash {
+    std::size_t operator()(const DagKey& key) const {
+        std::uint64_t h = static_cast<std::uint64_t>(key.kind) << 8 | static_cast<std::uint64_t>(key.op);
+        h = h * 0x9E3779B97F4A7C15ull ^ static_cast<std::uint32_t>(key.value);
+        h = h * 0x9E3779B97F4A7C15ull ^ key.a;
+        h = h * 0x9E3779B97F4A7C15ull ^ key.b;
+        return static_cast<std::size_t>(h ^ (h >> 29));
+    }
+};
+
+} // namespace
+
+RuleSet::RuleSet(const std::vector<std::string>& rules, const std::vector<std::string>& variables,
+                 const Evaluator& compiler)
+    : compiler(compiler), rules(rules), variables(variables) {
+    std::vector<DagNode> dag;
+    std::unordered_map<DagKey, std::uint32_t, DagKeyHash> ids;
+
+    // Returns the existing node equal to 'node', or adds it
+    auto intern = [&](DagNode node) {
+        DagKey key{node.kind, node.op, node.value, node.a, node.b};
+        auto [it, added] = ids.emplace(key, static_cast<std::uint32_t>(dag.size()));
+        if (added) {
+            dag.push_back(node);
+        }
+        return it->second;
+    };
+
+    std::vector<std::uint32_t> ruleRoots;
+    std::vector<std::uint32_t> remap;
+    for (std::size_t rule = 0; rule < rules.size(); rule++) {
+        Ast ast;
+        try {
+            ast = this->compiler.parse(rules[rule], variables);
+            if (ast.hasDecimals()) {
+                this->compiler.compile(rules[rule], variables);     // Throws the decimal literal error
+            }
+        }
+        catch (const std::exception& e) {
+            throw std::runtime_error("Rule " + std::to_string(rule) + ": " + e.what());
+        }
+        ast.fold();
+
+        // Post-order, so operands are interned before the operators using them
+        const std::vector<AstNode>& nodes = ast.allNodes();
+        remap.assign(nodes.size(), 0);
+        for (std::uint32_t i = 0; i < nodes.size(); i++) {
+            const AstNode& n = nodes[i];
+            DagNode node{n.kind, OpCode::PushConst, 0, 0, 0, false};
+            switch (n.kind) {
+            case NodeKind::Constant:
+            case NodeKind::Variable:
+                node.value = n.value;
+                break;
+            case NodeKind::Decimal:
+                // Rejected above
+                break;
+            case NodeKind::Unary:
+                node.op = operatorInfo(n.op).code;
+                node.a = node.b = remap[n.lhs];
+                node.mayFail = dag[node.a].mayFail;
+                counts.ruleOperators++;
+                break;
+            case NodeKind::Binary: {
+                Op op = n.op;
+                std::uint32_t a = remap[n.lhs];
+                std::uint32_t b = remap[n.rhs];
+
+                // Canonical operand order, so mirrored spellings share a node. && and ||
+                // only commute when neither side can fail: the left one decides which
+                // errors count.
+                if (op == Op::Greater || op == Op::GreaterEqual) {
+                    op = op == Op::Greater ? Op::Less : Op::LessEqual;
+                    std::swap(a, b);
+                }
+                bool commutes = op == Op::Add || op == Op::Multiply || op == Op::Equal || op == Op::NotEqual ||
+                                ((op == Op::LogicalAnd || op == Op::LogicalOr) && !dag[a].mayFail && !dag[b].mayFail);
+                if (commutes && a > b) {
+                    std::swap(a, b);
+                }
+
+                const DagNode& divisor = dag[b];
+                bool zeroPossible = divisor.kind != NodeKind::Constant || divisor.value == 0;
+                node.op = operatorInfo(op).code;
+                node.a = a;
+                node.b = b;
+                node.mayFail = dag[a].mayFail || dag[b].mayFail ||
+                               ((op == Op::Divide || op == Op::Modulo) && zeroPossible);
+                counts.ruleOperators++;
+                break;
+            }
+            }
+            remap[i] = intern(node);
+        }
+        ruleRoots.push_back(remap[ast.root()]);
+    }
+
+    // Registers: constants, then one per variable slot, then one per operator in
+    // DAG order, which is topological because nodes are interned operands first
+    std::vector<std::uint32_t> registers(dag.size());
+    for (std::uint32_t id = 0; id < dag.size(); id++) {
+        if (dag[id].kind == NodeKind::Constant) {
+            registers[id] = static_cast<std::uint32_t>(constants.size());
+            constants.push_back(dag[id].value);
+        }
+    }
+    base = static_cast<std::uint32_t>(constants.size() + variables.size());
+    for (std::uint32_t id = 0; id < dag.size(); id++) {
+        const DagNode& node = dag[id];
+        if (node.kind == NodeKind::Variable) {
+            registers[id] = static_cast<std::uint32_t>(constants.size()) + static_cast<std::uint32_t>(node.value);
+        }
+        else if (node.kind == NodeKind::Unary || node.kind == NodeKind::Binary) {
+            registers[id] = base + static_cast<std::uint32_t>(code.size());
+            std::uint8_t flags = (dag[node.a].mayFail ? kLeftMayFail : 0) | (dag[node.b].mayFail ? kRightMayFail : 0) |
+                                 (node.mayFail ? kResultMayFail : 0);
+            code.push_back({node.op, flags, registers[node.a], registers[node.b]});
+        }
+    }
+
+    for (std::uint32_t id : ruleRoots) {
+        roots.push_back(registers[id]);
+        rootMayFail.push_back(dag[id].mayFail);
+    }
+    counts.rules = rules.size();
+    counts.sharedOperators = code.size();
+    counts.constants = constants.size();
+}
+
+void RuleSet::evaluate(const int* slots, int* results, std::uint8_t* failed) const {
+    thread_local std::vector<int> registerFile;
+    thread_local std::vector<std::uint8_t> poisonFile;
+    std::size_t registerCount = base + code.size();
+    if (registerFile.size() < registerCount) {
+        registerFile.resize(registerCount);
+        poisonFile.resize(registerCount);
+    }
+    int* r = registerFile.data();
+    std::uint8_t* poisoned = poisonFile.data();  // Only meaningful for registers that may fail
+
+    std::copy(constants.begin(), constants.end(), r);
+    std::copy(slots, slots + variables.size(), r + constants.size());
+
+    int* out = r + base;
+    for (std::size_t k = 0; k < code.size(); k++) {
+        const RuleInstruction& ins = code[k];
+        int x = r[ins.a];
+        int y = r[ins.b];
+        bool leftBad = (ins.flags & kLeftMayFail) && poisoned[ins.a];
+        bool rightBad = (ins.flags & kRightMayFail) && poisoned[ins.b];
+        bool bad = leftBad || rightBad;
+        int v = 0;
+
+        switch (ins.op) {
+        case OpCode::Add:          v = wrappingAdd(x, y); break;
+        case OpCode::Subtract:     v = wrappingSubtract(x, y); break;
+        case OpCode::Multiply:     v = wrappingMultiply(x, y); break;
+        case OpCode::Divide:       bad = bad || y == 0; v = y == 0 ? 0 : wrappingDivide(x, y); break;
+        case OpCode::Modulo:       bad = bad || y == 0; v = y == 0 ? 0 : wrappingModulo(x, y); break;
+        case OpCode::Power:        v = integerPower(x, y); break;
+        case OpCode::Less:         v = x < y; break;
+        case OpCode::LessEqual:    v = x <= y; break;
+        case OpCode::Equal:        v = x == y; break;
+        case OpCode::NotEqual:     v = x != y; break;
+
+        // A left operand that decides the result hides errors in the right one, as in eval()
+        case OpCode::LogicalAnd:   v = x != 0 && y != 0; bad = leftBad || (x != 0 && rightBad); break;
+        case OpCode::LogicalOr:    v = x != 0 || y != 0; bad = leftBad || (x == 0 && rightBad); break;
+
+        case OpCode::LogicalNot:   v = !x; break;
+        case OpCode::Increment:    v = wrappingAdd(x, 1); break;
+        case OpCode::Decrement:    v = wrappingSubtract(x, 1); break;
+        case OpCode::Negate:       v = wrappingNegate(x); break;
+        case OpCode::Plus:         v = x; break;
+        default:                   break;  // Greater/GreaterEqual are canonicalized away; no jumps or pushes
+        }
+
+        out[k] = v;
+        if (ins.flags & kResultMayFail) {
+            poisoned[base + k] = bad;
+        }
+    }
+
+    for (std::size_t rule = 0; rule < roots.size(); rule++) {
+        bool ruleFailed = rootMayFail[rule] && poisoned[roots[rule]];
+        if (ruleFailed && !failed) {
+            throwRuleError(rule, slots);
+        }
+        results[rule] = ruleFailed ? 0 : r[roots[rule]];
+        if (failed) {
+            failed[rule] = ruleFailed;
+        }
+    }
+}
+
+void RuleSet::throwRuleError(std::size_t rule, const int* slots) const {
+    // Errors are rare, so the message comes from the rule compiled on its own
+    // instead of tracking an error position for every register
+    std::string message = "evaluation failed";
+    try {
+        compiler.compile(rules[rule], variables).evaluate(slots);
+    }
+    catch (const std::exception& e) {
+        message = e.what();
+    }
+    throw std::runtime_error("Rule " + std::to_string(rule) + ": " + message);
+}
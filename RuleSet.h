@@ -0,0 +1,119 @@
+#ifndef RULE_SET_H
+#define RULE_SET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "CompiledExpression.h"
+#include "Evaluator.h"
+
+/**
+ * Sizes reported by RuleSet::stats().
+ */
+struct RuleSetStats {
+    std::size_t rules = 0;
+    std::size_t ruleOperators = 0;      // Operators of the rules compiled one by one, summed
+    std::size_t sharedOperators = 0;    // Operators of the fused program, each run once per record
+    std::size_t constants = 0;          // Distinct constants
+};
+
+/**
+ * One step of a fused RuleSet program: applies 'op' to registers a (and b) and
+ * writes register base + index of the step.
+ */
+struct RuleInstruction {
+    OpCode op;              // A binary or unary operator opcode
+    std::uint8_t flags;     // RuleSet::kLeftMayFail, kRightMayFail and kResultMayFail
+    std::uint32_t a;        // Left (or only) operand register
+    std::uint32_t b;        // Right operand register
+};
+
+/**
+ * Many rules over the same variables, compiled together into one program.
+ *
+ * Every rule is parsed and folded, and its operators are merged into a DAG
+ * shared by all rules: structurally identical sub-expressions, such as the
+ * (a+b)*3 in "(a+b)*3 > x" and "(a+b)*3 <= y", become one node, so evaluate()
+ * computes each of them once per record however many rules use it. Operands
+ * of + * == != are ordered, and > >= are rewritten as < <=, so "b+a" and "a+b"
+ * are shared as well.
+ *
+ * The fused program is straight-line: the right operand of && and || is
+ * computed even when the left one decides the result, since other rules may
+ * need it. Results are still those of eval(): a division or modulo by zero only
+ * fails a rule whose result depends on it, exactly where eval() would throw.
+ */
+class RuleSet {
+public:
+    static constexpr std::uint8_t kLeftMayFail = 1;     // Operand a can be poisoned by a division by zero
+    static constexpr std::uint8_t kRightMayFail = 2;    // Operand b can be poisoned
+    static constexpr std::uint8_t kResultMayFail = 4;   // The result can be poisoned
+
+    /**
+     * Compiles rules into one program.
+     *
+     * @param rules The rule expressions; rule i's result is written to results[i].
+     * @param variables The variable names, in slot order, shared by every rule.
+     * @param compiler Evaluator whose limits are used to parse the rules.
+     * @throws std::runtime_error if a rule is invalid, prefixed with "Rule <i>: ".
+     *
+     * Time Complexity: O(n) expected, where n is the total length of the rules.
+     */
+    RuleSet(const std::vector<std::string>& rules, const std::vector<std::string>& variables,
+            const Evaluator& compiler = Evaluator());
+
+    /**
+     * Evaluates every rule on one record. Scratch registers are owned by the
+     * calling thread, so after the first call this does not allocate, and
+     * several threads can evaluate one RuleSet at once.
+     *
+     * @param slots The variable values, at least variableCount() of them.
+     * @param results Receives size() results.
+     * @param failed If not null, receives size() flags: 1 where the rule failed
+     *        (its result is then 0) and 0 elsewhere. If null, a failing rule throws.
+     * @throws std::runtime_error for the lowest failing rule, when failed is null,
+     *         with the message eval() gives for that rule prefixed with "Rule <i>: ".
+     *
+     * Time Complexity: O(s + r) where s is stats().sharedOperators and r is size().
+     */
+    void evaluate(const int* slots, int* results, std::uint8_t* failed = nullptr) const;
+
+    /**
+     * @return The number of rules.
+     */
+    std::size_t size() const { return rules.size(); }
+
+    /**
+     * @return The number of variable slots the rules read.
+     */
+    std::size_t variableCount() const { return variables.size(); }
+
+    /**
+     * @return Rule, operator and constant counts.
+     */
+    const RuleSetStats& stats() const { return counts; }
+
+    /**
+     * @return The fused program, in execution order.
+     */
+    const std::vector<RuleInstruction>& instructions() const { return code; }
+
+private:
+    /**
+     * Compiles one rule by itself to report its error.
+     */
+    [[noreturn]] void throwRuleError(std::size_t rule, const int* slots) const;
+
+    Evaluator compiler;
+    std::vector<std::string> rules;
+    std::vector<std::string> variables;
+    std::vector<int> constants;                 // Registers [0, c)
+    std::vector<RuleInstruction> code;          // Instruction i writes register base + i
+    std::uint32_t base = 0;                     // First instruction register (after the variables)
+    std::vector<std::uint32_t> roots;           // Result register of every rule
+    std::vector<std::uint8_t> rootMayFail;      // Whether that register can be poisoned
+    RuleSetStats counts;
+};
+
+#endif // RULE_SET_H
@@ -0,0 +1,363 @@
+#include "Scanner.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define SCAN_HAVE_AVX2 1
+#endif
+
+namespace scan {
+
+namespace {
+
+constexpr std::uint64_t kEvenBits = 0x5555555555555555ull;
+
+/**
+ * Prefix sums of the parentheses of one block: +1 for '(' and -1 for ')',
+ * relative to the depth before the block.
+ */
+struct BlockBalance {
+    int total;          // Depth change over the block
+    int lowest;         // Lowest depth after any byte of the block
+    int highest;        // Highest depth after any byte of the block
+};
+
+struct KernelSet {
+    void (*classify)(const char* block, BlockMasks& masks);
+    void (*balance)(const char* block, BlockBalance& balance);
+    const char* name;
+};
+
+void classifyScalar(const char* block, BlockMasks& m) {
+    m = BlockMasks{};
+    for (std::size_t i = 0; i < kBlockBytes; i++) {
+        auto c = static_cast<unsigned char>(block[i]);
+        std::uint64_t bit = std::uint64_t(1) << i;
+        bool digit = c >= '0' && c <= '9';
+        bool letter = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+        bool op = c != '\0' && std::strchr("+-*/%^!<>=&|", c) != nullptr;
+
+        if (c == ' ' || (c >= '\t' && c <= '\r')) m.space |= bit;
+        else if (digit || letter)                 m.word |= bit;
+        else if (op)                              m.operators |= bit;
+        else if (c == '(')                        m.open |= bit;
+        else if (c == ')')                        m.close |= bit;
+        else if (c != '.')                        m.invalid |= bit;
+
+        m.digit |= digit ? bit : 0;
+        m.equals |= c == '=' ? bit : 0;
+        m.ampersand |= c == '&' ? bit : 0;
+        m.bar |= c == '|' ? bit : 0;
+        m.comparison |= c == '!' || c == '<' || c == '>' ? bit : 0;
+    }
+}
+
+void balanceScalar(const char* block, BlockBalance& balance) {
+    int depth = 0;
+    balance = {0, INT_MAX, INT_MIN};
+    for (std::size_t i = 0; i < kBlockBytes; i++) {
+        depth += block[i] == '(' ? 1 : block[i] == ')' ? -1 : 0;
+        balance.lowest = std::min(balance.lowest, depth);
+        balance.highest = std::max(balance.highest, depth);
+    }
+    balance.total = depth;
+}
+
+const KernelSet kScalarKernels = {classifyScalar, balanceScalar, "scalar"};
+
+#ifdef SCAN_HAVE_AVX2
+
+// Everything up to the matching pop is compiled for AVX2 (lambdas included) and
+// only ever called after CPUID has confirmed support
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+// Classes of 32 bytes as 32-bit masks
+struct HalfMasks {
+    std::uint32_t space, digit, word, operators, open, close, invalid, equals, ampersand, bar, comparison;
+};
+
+// Bytes in lo..hi. Signed compares: bytes >= 0x80 are negative and fall outside every range.
+inline __m256i within(__m256i v, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(static_cast<char>(lo - 1))),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(hi + 1)), v));
+}
+
+inline std::uint32_t bits(__m256i v) {
+    return static_cast<std::uint32_t>(_mm256_movemask_epi8(v));
+}
+
+inline HalfMasks classifyHalf(const char* bytes) {
+    const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes));
+    auto eq = [&](char x) { return _mm256_cmpeq_epi8(c, _mm256_set1_epi8(x)); };
+
+    // The operator characters by nibble: the low nibble's entry holds one bit
+    // per high nibble (2, 3, 5, 7) that forms an operator with it, and the high
+    // nibble's entry selects its bit
+    const __m256i lowTable = _mm256_setr_epi8(0, 1, 0, 0, 0, 1, 1, 0, 0, 0, 1, 1, 10, 3, 6, 1,
+                                              0, 1, 0, 0, 0, 1, 1, 0, 0, 0, 1, 1, 10, 3, 6, 1);
+    const __m256i highTable = _mm256_setr_epi8(0, 0, 1, 2, 0, 4, 0, 8, 0, 0, 0, 0, 0, 0, 0, 0,
+                                               0, 0, 1, 2, 0, 4, 0, 8, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    __m256i low = _mm256_and_si256(c, nibble);
+    __m256i high = _mm256_and_si256(_mm256_srli_epi16(c, 4), nibble);
+    __m256i hits = _mm256_and_si256(_mm256_shuffle_epi8(lowTable, low), _mm256_shuffle_epi8(highTable, high));
+    __m256i notOperator = _mm256_cmpeq_epi8(hits, _mm256_setzero_si256());
+
+    __m256i space = _mm256_or_si256(eq(' '), within(c, '\t', '\r'));
+    __m256i digit = within(c, '0', '9');
+    __m256i letter = _mm256_or_si256(within(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), 'a', 'z'), eq('_'));
+    __m256i open = eq('(');
+    __m256i close = eq(')');
+    __m256i known = _mm256_or_si256(_mm256_or_si256(space, _mm256_or_si256(digit, letter)),
+                                    _mm256_or_si256(_mm256_or_si256(open, close), eq('.')));
+
+    HalfMasks m;
+    m.space = bits(space);
+    m.digit = bits(digit);
+    m.word = bits(_mm256_or_si256(digit, letter));
+    m.operators = ~bits(notOperator);
+    m.open = bits(open);
+    m.close = bits(close);
+    m.invalid = ~bits(known) & ~m.operators;
+    m.equals = bits(eq('='));
+    m.ampersand = bits(eq('&'));
+    m.bar = bits(eq('|'));
+    m.comparison = bits(_mm256_or_si256(eq('!'), _mm256_or_si256(eq('<'), eq('>'))));
+    return m;
+}
+
+void classifyAvx2(const char* block, BlockMasks& m) {
+    HalfMasks lo = classifyHalf(block);
+    HalfMasks hi = classifyHalf(block + 32);
+    auto join = [](std::uint32_t a, std::uint32_t b) { return std::uint64_t(a) | std::uint64_t(b) << 32; };
+    m.space = join(lo.space, hi.space);
+    m.digit = join(lo.digit, hi.digit);
+    m.word = join(lo.word, hi.word);
+    m.operators = join(lo.operators, hi.operators);
+    m.open = join(lo.open, hi.open);
+    m.close = join(lo.close, hi.close);
+    m.invalid = join(lo.invalid, hi.invalid);
+    m.equals = join(lo.equals, hi.equals);
+    m.ampersand = join(lo.ampersand, hi.ampersand);
+    m.bar = join(lo.bar, hi.bar);
+    m.comparison = join(lo.comparison, hi.comparison);
+}
+
+// Inclusive prefix sum of 32 signed bytes: log-step shifts within each 128-bit
+// lane, then the low lane's total added to the high lane
+inline __m256i prefixSum(__m256i x) {
+    x = _mm256_add_epi8(x, _mm256_slli_si256(x, 1));
+    x = _mm256_add_epi8(x, _mm256_slli_si256(x, 2));
+    x = _mm256_add_epi8(x, _mm256_slli_si256(x, 4));
+    x = _mm256_add_epi8(x, _mm256_slli_si256(x, 8));
+    __m256i laneTotals = _mm256_shuffle_epi8(x, _mm256_set1_epi8(15));
+    return _mm256_add_epi8(x, _mm256_permute2x128_si256(laneTotals, laneTotals, 0x08));
+}
+
+// Smallest or largest of 32 signed bytes, folding halves together
+template <typename Fold128>
+inline int reduce(__m256i x, Fold128 fold) {
+    __m128i v = fold(_mm256_castsi256_si128(x), _mm256_extracti128_si256(x, 1));
+    v = fold(v, _mm_srli_si128(v, 8));
+    v = fold(v, _mm_srli_si128(v, 4));
+    v = fold(v, _mm_srli_si128(v, 2));
+    v = fold(v, _mm_srli_si128(v, 1));
+    return static_cast<signed char>(_mm_cvtsi128_si32(v) & 0xFF);
+}
+
+// +1 for '(' and -1 for ')': the compares give -1 for a match
+inline __m256i parenthesisDeltas(const char* bytes) {
+    __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes));
+    return _mm256_sub_epi8(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(')')), _mm256_cmpeq_epi8(c, _mm256_set1_epi8('(')));
+}
+
+// Depths within a block stay within -64..64, so signed bytes hold them
+void balanceAvx2(const char* block, BlockBalance& balance) {
+    __m256i first = prefixSum(parenthesisDeltas(block));
+    auto carry = static_cast<char>(_mm256_extract_epi8(first, 31));
+    __m256i second = _mm256_add_epi8(prefixSum(parenthesisDeltas(block + 32)), _mm256_set1_epi8(carry));
+
+    balance.lowest = reduce(_mm256_min_epi8(first, second), [](__m128i a, __m128i b) { return _mm_min_epi8(a, b); });
+    balance.highest = reduce(_mm256_max_epi8(first, second), [](__m128i a, __m128i b) { return _mm_max_epi8(a, b); });
+    balance.total = static_cast<signed char>(_mm256_extract_epi8(second, 31));
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+const KernelSet kAvx2Kernels = {classifyAvx2, balanceAvx2, "avx2"};
+
+#endif
+
+const KernelSet* detectKernels() {
+#ifdef SCAN_HAVE_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return &kAvx2Kernels;
+    }
+#endif
+    return &kScalarKernels;
+}
+
+const KernelSet* bestKernels() {
+    static const KernelSet* best = detectKernels();
+    return best;
+}
+
+const KernelSet* activeKernels = bestKernels();
+
+/**
+ * Finds the bytes left unpaired in runs of one character, block by block.
+ * Within a run, bytes pair up from the left, so a run of odd length leaves
+ * its last byte alone.
+ */
+class PairFinder {
+public:
+    /**
+     * @param runs The run bytes of the next block.
+     * @param previousLone Set if the last byte of the previous block was left alone.
+     * @return The bytes of this block left alone whose run ends in this block.
+     */
+    std::uint64_t next(std::uint64_t runs, bool& previousLone) {
+        std::uint64_t continuing = inRun ? runs & 1 : 0;
+        previousLone = inRun && oddSoFar && !(runs & 1);
+
+        // A run continuing from the previous block counts as starting at bit 0
+        // if its earlier bytes paired up, else at bit -1
+        std::uint64_t starts = runs & ~(runs << 1) & ~continuing;
+        std::uint64_t evenStarts = (starts & kEvenBits) | (oddSoFar ? 0 : continuing);
+        std::uint64_t oddStarts = (starts & ~kEvenBits) | (oddSoFar ? continuing : 0);
+
+        // Adding a run's start bit carries through the run into the bit after
+        // it; the run has odd length when that bit's parity differs from the start's
+        std::uint64_t evenEnds = (runs + evenStarts) & ~runs;
+        std::uint64_t oddEnds = (runs + oddStarts) & ~runs;
+        std::uint64_t after = (evenEnds & ~kEvenBits) | (oddEnds & kEvenBits);
+
+        // A run reaching bit 63 carries out of the addition and is settled by the next block
+        bool reachesEnd = runs >> 63;
+        if (reachesEnd) {
+            int length = ~runs == 0 ? 64 : __builtin_clzll(~runs);
+            bool spansBlock = length == 64 && continuing;
+            oddSoFar = ((length & 1) != 0) != (spansBlock && oddSoFar);
+        }
+        else {
+            oddSoFar = false;
+        }
+        inRun = reachesEnd;
+        return after >> 1;
+    }
+
+    /**
+     * @return True if the text ended inside a run of odd length.
+     */
+    bool endsAlone() const { return inRun && oddSoFar; }
+
+private:
+    bool inRun = false;         // The previous block ended inside a run
+    bool oddSoFar = false;      // ... whose bytes so far are odd in number
+};
+
+} // namespace
+
+void classify(const char* block, BlockMasks& masks) {
+    activeKernels->classify(block, masks);
+}
+
+ScanSummary scanExpression(std::string_view text) {
+    ScanSummary summary;
+    PairFinder equals;
+    PairFinder ampersands;
+    PairFinder bars;
+    bool previousEquals = false;
+    bool previousComparison = false;
+    char padded[kBlockBytes];
+
+    auto found = [&](std::size_t position) {
+        summary.firstInvalid = std::min(summary.firstInvalid, position);
+    };
+
+    for (std::size_t start = 0; start < text.size(); start += kBlockBytes) {
+        const char* block = text.data() + start;
+        if (text.size() - start < kBlockBytes) {
+            // Spaces end every run and change no depth
+            std::memset(padded, ' ', kBlockBytes);
+            std::memcpy(padded, block, text.size() - start);
+            block = padded;
+        }
+        BlockMasks m;
+        activeKernels->classify(block, m);
+
+        if (summary.firstInvalid == ScanSummary::npos) {
+            // A '=' right after '!', '<' or '>' completes that operator, so its run pairs up from the next byte
+            std::uint64_t equalsStarts = m.equals & ~((m.equals << 1) | std::uint64_t(previousEquals));
+            std::uint64_t completing = equalsStarts & ((m.comparison << 1) | std::uint64_t(previousComparison));
+
+            bool before[3];
+            std::uint64_t alone = equals.next(m.equals & ~completing, before[0]) |
+                                  ampersands.next(m.ampersand, before[1]) | bars.next(m.bar, before[2]);
+            if (before[0] || before[1] || before[2]) {
+                found(start - 1);
+            }
+            if (alone | m.invalid) {
+                found(start + static_cast<std::size_t>(__builtin_ctzll(alone | m.invalid)));
+            }
+            previousEquals = m.equals >> 63;
+            previousComparison = m.comparison >> 63;
+        }
+
+        if (m.open | m.close) {
+            BlockBalance balance;
+            activeKernels->balance(block, balance);
+            if (summary.firstUnmatchedClose == ScanSummary::npos && summary.depth + balance.lowest < 0) {
+                // Rare, so the exact byte is found by walking the block's parentheses
+                std::int64_t depth = summary.depth;
+                std::uint64_t parens = m.open | m.close;
+                while (depth >= 0) {
+                    int i = __builtin_ctzll(parens);
+                    parens &= parens - 1;
+                    depth += (m.open >> i & 1) ? 1 : -1;
+                    if (depth < 0) {
+                        summary.firstUnmatchedClose = start + static_cast<std::size_t>(i);
+                    }
+                }
+            }
+            summary.maxDepth = std::max(summary.maxDepth, summary.depth + balance.highest);
+            summary.depth += balance.total;
+        }
+    }
+
+    if (summary.firstInvalid == ScanSummary::npos &&
+        (equals.endsAlone() || ampersands.endsAlone() || bars.endsAlone())) {
+        summary.firstInvalid = text.size() - 1;
+    }
+    return summary;
+}
+
+bool simdAvailable() {
+    return bestKernels() != &kScalarKernels;
+}
+
+void setSimdEnabled(bool enabled) {
+    activeKernels = enabled ? bestKernels() : &kScalarKernels;
+}
+
+bool blockLexing() {
+    return activeKernels != &kScalarKernels;
+}
+
+const char* kernelName() {
+    return activeKernels->name;
+}
+
+} // namespace scan
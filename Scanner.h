@@ -0,0 +1,110 @@
+#ifndef SCANNER_H
+#define SCANNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * Byte classification of expression text 64 bytes at a time. On CPUs with
+ * AVX2 (detected at runtime via CPUID) a block is classified with 32-byte
+ * compares and nibble lookups and turned into bitmasks with movemask;
+ * otherwise a plain loop builds the same masks.
+ *
+ * The Lexer reads these masks to skip whitespace and to find the end of
+ * numbers and identifiers with one bit scan instead of a test per byte.
+ */
+namespace scan {
+
+constexpr std::size_t kBlockBytes = 64;
+
+/**
+ * The classes of the bytes of one block, one bit per byte: bit i is byte i.
+ * '.' is in no class; every other byte is in exactly one of space, word,
+ * operators, open, close and invalid.
+ */
+struct BlockMasks {
+    std::uint64_t space;        // ' ', '\t', '\n', '\v', '\f', '\r' (std::isspace in the C locale)
+    std::uint64_t digit;        // 0-9
+    std::uint64_t word;         // Identifier characters: letters, digits and '_'
+    std::uint64_t operators;    // + - * / % ^ ! < > = & |
+    std::uint64_t open;         // (
+    std::uint64_t close;        // )
+    std::uint64_t invalid;      // Bytes that are never part of a token
+    std::uint64_t equals;       // =   (the operator characters that only exist in pairs,
+    std::uint64_t ampersand;    // &    and those that can precede a '=' in one operator)
+    std::uint64_t bar;          // |
+    std::uint64_t comparison;   // ! < >
+};
+
+/**
+ * Classifies one block.
+ *
+ * @param block 64 readable bytes.
+ * @param masks Receives the classes.
+ *
+ * Time Complexity: O(1).
+ */
+void classify(const char* block, BlockMasks& masks);
+
+/**
+ * What scanExpression() finds. Positions are byte offsets, or npos.
+ */
+struct ScanSummary {
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    std::size_t firstInvalid = npos;            // First byte that lexes as an Invalid token in any context
+    std::size_t firstUnmatchedClose = npos;     // First ')' without an open '(' before it
+    std::int64_t depth = 0;                     // '(' minus ')' over the whole text
+    std::int64_t maxDepth = 0;                  // Deepest parenthesis nesting reached
+};
+
+/**
+ * Checks the parentheses and the alphabet of an expression in one pass over
+ * 64-byte blocks, without lexing it:
+ * - bytes outside the grammar, and single '=', '&' and '|': in each run of
+ *   one of those characters the lexer pairs bytes from the left (a '=' right
+ *   after '!', '<' or '>' pairs with that character instead), so a run of odd
+ *   length leaves its last byte alone. The runs are resolved with carries
+ *   through 64-bit additions, as odd-length escape runs are found in SIMD
+ *   JSON parsers;
+ * - the parenthesis depth after every byte, as a prefix sum of +1 for '(' and
+ *   -1 for ')' computed 32 bytes at a time, giving the first unmatched ')' and
+ *   the maximum depth.
+ * Any finding is an error eval() and compile() also report, though they may
+ * report an earlier error first; a '.' outside a number is only found by the lexer.
+ *
+ * @param text The expression.
+ * @return The findings.
+ *
+ * Time Complexity: O(n) where n is the length of the text.
+ */
+ScanSummary scanExpression(std::string_view text);
+
+/**
+ * @return True if this CPU supports the AVX2 classifier.
+ */
+bool simdAvailable();
+
+/**
+ * Switches between the best classifier for this CPU and the scalar fallback.
+ * With the fallback the Lexer also goes back to testing one byte at a time.
+ * Not thread-safe; intended for benchmarks and tests run before lexing.
+ *
+ * @param enabled False to force the scalar classifier.
+ */
+void setSimdEnabled(bool enabled);
+
+/**
+ * @return True if the Lexer should classify blocks (the AVX2 classifier is in use).
+ */
+bool blockLexing();
+
+/**
+ * @return The name of the classifier in use ("avx2" or "scalar").
+ */
+const char* kernelName();
+
+} // namespace scan
+
+#endif // SCANNER_H
@@ -0,0 +1,692 @@
+#ifndef STATIC_EXPRESSION_H
+#define STATIC_EXPRESSION_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include "Arithmetic.h"
+#include "Ast.h"
+#include "Lexer.h"
+#include "Operators.h"
+#include "Syntax.h"
+
+/**
+ * Parsing and evaluation of expressions that are fixed in the source code,
+ * done by the compiler instead of at run time.
+ *
+ * Everything here is constexpr: the lexer, the syntax checks and the
+ * shunting-yard mirror Lexer::next(), validateExpression() and
+ * Evaluator::parse() step for step, and build the same post-order tree into a
+ * fixed-size array. StaticExpression (below) turns that tree into one type per
+ * node, so the compiler inlines the whole expression into the caller. The
+ * functions can also run at run time, which is how the regression harness
+ * checks them against eval().
+ */
+namespace staticexpr {
+
+/**
+ * What went wrong in a parse, if anything. Each value has exactly one message,
+ * the one Evaluator::compile() throws (see errorMessage()).
+ */
+using Error = syntax::Error;
+
+/**
+ * A parsed expression: its nodes in post-order, as in Ast, and its variables
+ * in order of first use, as Evaluator::compile(expression) assigns slots.
+ *
+ * @tparam Capacity The most characters the expression may have; it bounds
+ *         every array, since each node and each name needs at least one character.
+ */
+template <std::size_t Capacity>
+struct StaticAst {
+    std::array<AstNode, Capacity> nodes{};
+    std::uint32_t count = 0;
+    std::uint32_t root = 0;
+    std::array<std::string_view, Capacity> names{};     // Views into the parsed text
+    std::uint32_t variableCount = 0;
+
+    Error error = Error::None;
+    std::uint32_t errorOffset = 0;      // Position the message names
+    std::uint32_t errorLength = 0;      // Length of the decimal literal
+    Op errorOp = Op::LeftParen;         // Operator lacking operands
+
+    constexpr bool ok() const { return error == Error::None; }
+};
+
+namespace detail {
+
+/**
+ * Lexer::next() in constexpr form; produces exactly the same tokens.
+ */
+class Lexer {
+public:
+    constexpr explicit Lexer(std::string_view expression) : text(expression) {}
+
+    constexpr bool next(Token& token) {
+        while (pos < text.size() && syntax::isSpace(text[pos])) {
+            pos++;
+        }
+        if (pos == text.size()) {
+            return false;
+        }
+
+        std::size_t i = pos;
+        char c = text[i];
+        token = Token{TokenKind::Invalid, Op::LeftParen, static_cast<std::uint32_t>(i), 1, 0};
+
+        if (syntax::isDigit(c) || (c == '.' && syntax::isDigitAt(text, i + 1))) {
+            std::uint32_t val = 0;
+            std::size_t start = i;
+            while (i < text.size() && syntax::isDigit(text[i])) {
+                val = val * 10 + static_cast<std::uint32_t>(text[i] - '0');
+                i++;
+            }
+            std::size_t end = syntax::scanDecimalTail(text, i);
+            token.kind = end == i ? TokenKind::Number : TokenKind::Decimal;
+            token.value = end == i ? static_cast<std::int32_t>(val) : 0;
+            token.length = static_cast<std::uint32_t>(end - start);
+            i = end;
+        }
+        else if (syntax::isIdentifierStart(c)) {
+            std::size_t start = i;
+            while (i < text.size() && syntax::isIdentifierChar(text[i])) {
+                i++;
+            }
+            token.kind = TokenKind::Identifier;
+            token.length = static_cast<std::uint32_t>(i - start);
+        }
+        else if (c == '(' || c == ')') {
+            token.kind = c == '(' ? TokenKind::LeftParen : TokenKind::RightParen;
+            i++;
+        }
+        else {
+            std::uint32_t length = syntax::readOperator(text, i, unaryContext, token.op);
+            if (length > 0) {
+                token.kind = TokenKind::Operator;
+                token.length = length;
+            }
+            i += token.length;
+        }
+
+        unaryContext = token.kind == TokenKind::LeftParen || token.kind == TokenKind::Operator ||
+                       token.kind == TokenKind::Invalid;
+        pos = i;
+        return true;
+    }
+
+private:
+    std::string_view text;
+    std::size_t pos = 0;
+    bool unaryContext = true;
+};
+
+template <std::size_t Capacity>
+constexpr void fail(StaticAst<Capacity>& ast, Error error, std::uint32_t offset) {
+    ast.error = error;
+    ast.errorOffset = offset;
+}
+
+/**
+ * The syntax checks of validateExpression(), in the same order, over the
+ * whole expression. Syntax errors win over errors found while building the
+ * tree wherever they occur, so running them first gives the same message.
+ *
+ * @return False, with the error recorded, if the expression is invalid.
+ */
+template <std::size_t Capacity>
+constexpr bool checkSyntax(std::string_view text, StaticAst<Capacity>& ast) {
+    Lexer lexer(text);
+    Token token{};
+    Token prev{};
+    std::size_t count = 0;
+    std::size_t openParenCount = 0;
+    bool lastWasOperand = false;
+    bool lastWasOperator = false;
+
+    while (lexer.next(token)) {
+        if (count++ == 0) {
+            char first = text[token.offset];
+            if (token.kind == TokenKind::RightParen) {
+                fail(ast, Error::StartsWithClosing, token.offset);
+                return false;
+            }
+            if (first == '*' || first == '/' || first == '%' || first == '^' || first == '>' || first == '<' ||
+                first == '=' || first == '&' || first == '|') {
+                fail(ast, Error::StartsWithBinary, token.offset);
+                return false;
+            }
+        }
+
+        switch (token.kind) {
+        case TokenKind::LeftParen:
+            openParenCount++;
+            lastWasOperand = false;
+            lastWasOperator = false;
+            break;
+
+        case TokenKind::RightParen:
+            if (openParenCount == 0) {
+                fail(ast, Error::TooManyClosing, token.offset);
+                return false;
+            }
+            openParenCount--;
+            lastWasOperand = true;
+            lastWasOperator = false;
+            break;
+
+        case TokenKind::Number:
+        case TokenKind::Decimal:
+        case TokenKind::Identifier:
+            if (lastWasOperand) {
+                fail(ast, Error::TwoOperands, token.offset);
+                return false;
+            }
+            lastWasOperand = true;
+            lastWasOperator = false;
+            break;
+
+        case TokenKind::Operator: {
+            if (count > 1 && prev.kind == TokenKind::Operator &&
+                operatorInfo(prev.op).arity == 1 && operatorInfo(token.op).arity == 2) {
+                fail(ast, Error::UnaryThenBinary, token.offset);
+                return false;
+            }
+            char c = text[token.offset];
+            if (lastWasOperator && c != '+' && c != '-' && c != '!') {
+                fail(ast, Error::TwoBinary, token.offset);
+                return false;
+            }
+            lastWasOperator = true;
+            lastWasOperand = false;
+            break;
+        }
+
+        case TokenKind::Invalid: {
+            char c = text[token.offset];
+            fail(ast, c == '=' || c == '&' || c == '|' ? Error::SingleOperator : Error::InvalidCharacter, token.offset);
+            return false;
+        }
+        }
+        prev = token;
+    }
+
+    if (count == 0) {
+        fail(ast, Error::Empty, 0);
+        return false;
+    }
+    if (openParenCount > 0) {
+        fail(ast, Error::UnclosedParentheses, 0);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Result of a unary operator, as Int32Arithmetic::unary() computes it.
+ */
+template <Op O>
+constexpr int unary(int a) {
+    if constexpr (O == Op::LogicalNot) return !a;
+    else if constexpr (O == Op::Increment) return wrappingAdd(a, 1);
+    else if constexpr (O == Op::Decrement) return wrappingSubtract(a, 1);
+    else if constexpr (O == Op::Negate) return wrappingNegate(a);
+    else return a;
+}
+
+/**
+ * Result of a binary operator other than && and ||, as Int32Arithmetic::binary()
+ * computes it.
+ *
+ * @throws std::runtime_error on division or modulo by zero.
+ */
+template <Op O>
+constexpr int binary(int a, int b, std::uint32_t offset) {
+    if constexpr (O == Op::Add) return wrappingAdd(a, b);
+    else if constexpr (O == Op::Subtract) return wrappingSubtract(a, b);
+    else if constexpr (O == Op::Multiply) return wrappingMultiply(a, b);
+    else if constexpr (O == Op::Divide || O == Op::Modulo) {
+        if (b == 0) {
+            throwDivisionByZero(O, offset);     // Not constexpr: a constant divisor of 0 fails to compile
+        }
+        return O == Op::Divide ? wrappingDivide(a, b) : wrappingModulo(a, b);
+    }
+    else if constexpr (O == Op::Power) return integerPower(a, b);
+    else if constexpr (O == Op::Greater) return a > b;
+    else if constexpr (O == Op::GreaterEqual) return a >= b;
+    else if constexpr (O == Op::Less) return a < b;
+    else if constexpr (O == Op::LessEqual) return a <= b;
+    else if constexpr (O == Op::Equal) return a == b;
+    else return a != b;
+}
+
+constexpr int applyUnary(Op op, int a) {
+    switch (op) {
+    case Op::LogicalNot: return unary<Op::LogicalNot>(a);
+    case Op::Increment:  return unary<Op::Increment>(a);
+    case Op::Decrement:  return unary<Op::Decrement>(a);
+    case Op::Negate:     return unary<Op::Negate>(a);
+    default:             return a;
+    }
+}
+
+constexpr int applyBinary(Op op, int a, int b, std::uint32_t offset) {
+    switch (op) {
+    case Op::Add:          return binary<Op::Add>(a, b, offset);
+    case Op::Subtract:     return binary<Op::Subtract>(a, b, offset);
+    case Op::Multiply:     return binary<Op::Multiply>(a, b, offset);
+    case Op::Divide:       return binary<Op::Divide>(a, b, offset);
+    case Op::Modulo:       return binary<Op::Modulo>(a, b, offset);
+    case Op::Power:        return binary<Op::Power>(a, b, offset);
+    case Op::Greater:      return binary<Op::Greater>(a, b, offset);
+    case Op::GreaterEqual: return binary<Op::GreaterEqual>(a, b, offset);
+    case Op::Less:         return binary<Op::Less>(a, b, offset);
+    case Op::LessEqual:    return binary<Op::LessEqual>(a, b, offset);
+    case Op::Equal:        return binary<Op::Equal>(a, b, offset);
+    default:               return binary<Op::NotEqual>(a, b, offset);
+    }
+}
+
+} // namespace detail
+
+/**
+ * Parses an expression the way Evaluator::compile(expression) does: variables
+ * get slots in order of first use, and the first failure is recorded in the
+ * result instead of thrown, so this can run inside a constant expression.
+ * Nothing is folded; the compiler folds the constants of a StaticExpression.
+ *
+ * @tparam Capacity Size of the node and name arrays; longer expressions fail with Error::TooLong.
+ * @param text The expression.
+ * @return The tree, or the error.
+ *
+ * Time Complexity: O(n + t * v) where t is the number of tokens and v the number of distinct variables.
+ */
+template <std::size_t Capacity>
+constexpr StaticAst<Capacity> parse(std::string_view text) {
+    StaticAst<Capacity> ast{};
+    if (text.size() > Capacity) {
+        ast.error = Error::TooLong;
+        ast.errorOffset = static_cast<std::uint32_t>(text.size());
+        return ast;
+    }
+    if (!detail::checkSyntax(text, ast)) {
+        return ast;
+    }
+
+    struct PendingOp {
+        Op op;
+        std::uint32_t offset;
+    };
+    std::array<PendingOp, Capacity> ops{};
+    std::array<std::uint32_t, Capacity> operands{};     // Nodes not yet consumed by an operator
+    std::size_t opCount = 0;
+    std::size_t operandCount = 0;
+    std::uint32_t decimalOffset = 0;
+    std::uint32_t decimalLength = 0;                    // Of the first decimal literal; 0 if none
+
+    auto add = [&](AstNode node) {
+        ast.nodes[ast.count] = node;
+        return ast.count++;
+    };
+    auto reduce = [&](const PendingOp& pending, bool closingParen) {
+        int arity = operatorInfo(pending.op).arity;
+        if (operandCount < static_cast<std::size_t>(arity)) {
+            ast.error = closingParen ? Error::NotEnoughOperandsAtParenthesis : Error::NotEnoughOperands;
+            ast.errorOp = pending.op;
+            return false;
+        }
+        if (arity == 2) {
+            std::uint32_t rhs = operands[--operandCount];
+            std::uint32_t lhs = operands[operandCount - 1];
+            operands[operandCount - 1] = add({NodeKind::Binary, pending.op, pending.offset, 0, lhs, rhs});
+        }
+        else {
+            std::uint32_t operand = operands[operandCount - 1];
+            operands[operandCount - 1] = add({NodeKind::Unary, pending.op, pending.offset, 0, operand, 0});
+        }
+        return true;
+    };
+
+    detail::Lexer lexer(text);
+    Token token{};
+    while (lexer.next(token)) {
+        switch (token.kind) {
+        case TokenKind::LeftParen:
+            ops[opCount++] = {Op::LeftParen, token.offset};
+            break;
+
+        case TokenKind::Number:
+            operands[operandCount++] = add({NodeKind::Constant, Op::LeftParen, token.offset, token.value, 0, 0});
+            break;
+
+        // Kept as a placeholder so the other errors still come first, as in compile()
+        case TokenKind::Decimal:
+            if (decimalLength == 0) {
+                decimalOffset = token.offset;
+                decimalLength = token.length;
+            }
+            operands[operandCount++] = add({NodeKind::Constant, Op::LeftParen, token.offset, 0, 0, 0});
+            break;
+
+        case TokenKind::Identifier: {
+            std::string_view name = text.substr(token.offset, token.length);
+            std::uint32_t slot = 0;
+            while (slot < ast.variableCount && ast.names[slot] != name) {
+                slot++;
+            }
+            if (slot == ast.variableCount) {
+                ast.names[ast.variableCount++] = name;
+            }
+            operands[operandCount++] =
+                add({NodeKind::Variable, Op::LeftParen, token.offset, static_cast<std::int32_t>(slot), 0, 0});
+            break;
+        }
+
+        case TokenKind::RightParen:
+            while (opCount > 0 && ops[opCount - 1].op != Op::LeftParen) {
+                if (!reduce(ops[--opCount], true)) {
+                    return ast;
+                }
+            }
+            opCount--;      // The opening bracket; checkSyntax() guarantees it is there
+            break;
+
+        case TokenKind::Operator:
+            while (opCount > 0 && appliesBefore(ops[opCount - 1].op, token.op)) {
+                if (!reduce(ops[--opCount], false)) {
+                    return ast;
+                }
+            }
+            ops[opCount++] = {token.op, token.offset};
+            break;
+
+        case TokenKind::Invalid:
+            // Rejected by checkSyntax()
+            break;
+        }
+    }
+
+    // No parenthesis is left open, so every remaining entry is an operator
+    while (opCount > 0) {
+        if (!reduce(ops[--opCount], false)) {
+            return ast;
+        }
+    }
+    if (operandCount != 1) {
+        ast.error = Error::TooManyValues;
+        return ast;
+    }
+    if (decimalLength > 0) {
+        ast.error = Error::DecimalLiteral;
+        ast.errorOffset = decimalOffset;
+        ast.errorLength = decimalLength;
+        return ast;
+    }
+    ast.root = operands[0];
+    return ast;
+}
+
+/**
+ * Evaluates a parsed expression without recursion, with the same results and
+ * division errors as eval(); && and || skip their right operand when the left
+ * one decides the result.
+ *
+ * @param ast A tree parse() accepted.
+ * @param slots The variable values in slot order; may be null if there are none.
+ * @return The result.
+ * @throws std::runtime_error on division or modulo by zero.
+ *
+ * Time Complexity: O(n) where n is the number of nodes.
+ */
+template <std::size_t Capacity>
+constexpr int evaluate(const StaticAst<Capacity>& ast, const int* slots) {
+    // Each frame is a node and how many of its operands are done
+    std::array<std::uint32_t, Capacity> frames{};
+    std::array<std::uint8_t, Capacity> done{};
+    std::array<int, Capacity> values{};
+    std::size_t depth = 0;
+    std::size_t valueCount = 0;
+
+    frames[depth++] = ast.root;
+    while (depth > 0) {
+        const AstNode& n = ast.nodes[frames[depth - 1]];
+        std::uint8_t& stage = done[depth - 1];
+
+        if (n.kind == NodeKind::Constant || n.kind == NodeKind::Variable) {
+            values[valueCount++] = n.kind == NodeKind::Constant ? n.value : slots[n.value];
+            depth--;
+        }
+        else if (stage == 0) {
+            stage = 1;
+            done[depth] = 0;
+            frames[depth++] = n.lhs;
+        }
+        else if (n.kind == NodeKind::Unary) {
+            values[valueCount - 1] = detail::applyUnary(n.op, values[valueCount - 1]);
+            depth--;
+        }
+        else if (stage == 1) {
+            int left = values[valueCount - 1];
+            if ((n.op == Op::LogicalAnd && left == 0) || (n.op == Op::LogicalOr && left != 0)) {
+                values[valueCount - 1] = left != 0;
+                depth--;
+            }
+            else {
+                stage = 2;
+                done[depth] = 0;
+                frames[depth++] = n.rhs;
+            }
+        }
+        else {
+            int right = values[--valueCount];
+            int& left = values[valueCount - 1];
+            left = n.op == Op::LogicalAnd || n.op == Op::LogicalOr ? right != 0
+                                                                   : detail::applyBinary(n.op, left, right, n.offset);
+            depth--;
+        }
+    }
+    return values[0];
+}
+
+/**
+ * @param ast A tree parse() rejected.
+ * @param text The expression it was parsed from.
+ * @return The message Evaluator::compile(text) throws for the same expression.
+ */
+template <std::size_t Capacity>
+std::string errorMessage(const StaticAst<Capacity>& ast, std::string_view text) {
+    std::string at = std::to_string(ast.errorOffset);
+    std::string_view c = ast.errorOffset < text.size() ? text.substr(ast.errorOffset, 1) : std::string_view("\0", 1);
+    const OperatorInfo& info = operatorInfo(ast.errorOp);
+    std::string_view kind = info.arity == 2 ? "binary" : "unary";
+
+    switch (ast.error) {
+    case Error::TooLong:
+        return syntax::errorMessage(ast.error, {at, std::to_string(Capacity)});
+    case Error::SingleOperator:
+    case Error::InvalidCharacter:
+        return syntax::errorMessage(ast.error, {c, at});
+    case Error::NotEnoughOperands:
+    case Error::NotEnoughOperandsAtParenthesis:
+        return syntax::errorMessage(ast.error, {kind, info.name});
+    case Error::DecimalLiteral:
+        return syntax::errorMessage(ast.error, {text.substr(ast.errorOffset, ast.errorLength), at});
+    default:
+        return syntax::errorMessage(ast.error, {at});
+    }
+}
+
+namespace detail {
+
+/**
+ * The parse of a StaticExpression's text, computed once per expression.
+ */
+template <typename Source>
+struct Parsed {
+    static constexpr std::string_view text = Source::text();
+    static constexpr StaticAst<text.size() + 1> ast = parse<text.size() + 1>(text);
+};
+
+/**
+ * Turns a parse error into a compile error. Only the static_assert for the
+ * error fails, so the diagnostic shows compile()'s message, and the position
+ * (AtChar) and operator appear in the template arguments it quotes.
+ */
+template <Error E, std::uint32_t AtChar, Op Operator>
+struct CompileTimeCheck {
+    static_assert(E != Error::TooLong, "Expression is too long");
+    static_assert(E != Error::StartsWithClosing, "Expression can't start with a closing parenthesis");
+    static_assert(E != Error::StartsWithBinary, "Expression can't start with a binary operator");
+    static_assert(E != Error::TooManyClosing, "Mismatched parentheses - too many closing");
+    static_assert(E != Error::TwoOperands, "Two operands in a row");
+    static_assert(E != Error::UnaryThenBinary, "A unary operand can't be followed by a binary operator");
+    static_assert(E != Error::TwoBinary, "Two binary operators in a row");
+    static_assert(E != Error::SingleOperator, "Invalid operator: single '=', '&' or '|' is not supported");
+    static_assert(E != Error::InvalidCharacter, "Invalid character in expression");
+    static_assert(E != Error::Empty, "Expression is empty");
+    static_assert(E != Error::UnclosedParentheses, "Mismatched parentheses - unclosed parentheses");
+    static_assert(E != Error::NotEnoughOperands, "Not enough operands for operator");
+    static_assert(E != Error::NotEnoughOperandsAtParenthesis, "Invalid expression: Not enough operands for operator");
+    static_assert(E != Error::TooManyValues, "Invalid expression - too many values");
+    static_assert(E != Error::DecimalLiteral, "Decimal literal needs typed evaluation (use compileTyped())");
+
+    static constexpr bool reported = true;  // Referenced to instantiate the checks
+};
+
+/**
+ * One node of a parsed expression as a type. evaluate() is the node's
+ * operation applied to its operands' evaluate(), chosen with if constexpr, so
+ * an expression compiles to straight-line code with its constants in place.
+ */
+template <typename Source, std::uint32_t Index>
+struct Node {
+    static constexpr AstNode node = Parsed<Source>::ast.nodes[Index];
+
+    static constexpr int evaluate(const int* slots) {
+        if constexpr (node.kind == NodeKind::Constant) {
+            return node.value;
+        }
+        else if constexpr (node.kind == NodeKind::Variable) {
+            return slots[node.value];
+        }
+        else if constexpr (node.kind == NodeKind::Unary) {
+            return unary<node.op>(Node<Source, node.lhs>::evaluate(slots));
+        }
+        else if constexpr (node.op == Op::LogicalAnd) {
+            return Node<Source, node.lhs>::evaluate(slots) != 0 && Node<Source, node.rhs>::evaluate(slots) != 0;
+        }
+        else if constexpr (node.op == Op::LogicalOr) {
+            return Node<Source, node.lhs>::evaluate(slots) != 0 || Node<Source, node.rhs>::evaluate(slots) != 0;
+        }
+        else {
+            int left = Node<Source, node.lhs>::evaluate(slots);
+            return binary<node.op>(left, Node<Source, node.rhs>::evaluate(slots), node.offset);
+        }
+    }
+};
+
+// Stands in for the root of an expression that failed to parse
+struct InvalidNode {
+    static constexpr int evaluate(const int*) { return 0; }
+};
+
+} // namespace detail
+} // namespace staticexpr
+
+/**
+ * An expression parsed and checked by the compiler. Create one with
+ * STATIC_EXPRESSION("price * qty > limit"); a syntax error in the literal is a
+ * compile error carrying the message compile() would throw.
+ *
+ * Calling it costs what the hand-written C++ would: there is no token, tree or
+ * bytecode at run time, and an expression made only of literals is a
+ * compile-time constant (value()). Arithmetic wraps and && / || short-circuit
+ * exactly as in eval(); a division or modulo by zero throws eval()'s error at
+ * run time, and fails to compile if it happens in a constant expression.
+ * Decimal literals are rejected as compile() rejects them.
+ *
+ * Each node is a template instantiation, so the nesting depth is bounded by
+ * the compiler's template depth (900 by default in GCC and Clang).
+ *
+ * @tparam Source A type whose static constexpr text() returns the expression.
+ */
+template <typename Source>
+class StaticExpression {
+    using Parsed = staticexpr::detail::Parsed<Source>;
+    static_assert(staticexpr::detail::CompileTimeCheck<Parsed::ast.error, Parsed::ast.errorOffset,
+                                                       Parsed::ast.errorOp>::reported);
+
+    using Root = std::conditional_t<Parsed::ast.ok(), staticexpr::detail::Node<Source, Parsed::ast.root>,
+                                    staticexpr::detail::InvalidNode>;
+
+public:
+    // Number of variables, in order of first use
+    static constexpr std::size_t variableCount = Parsed::ast.variableCount;
+
+    // True if the expression has no variables, so value() is a constant
+    static constexpr bool isConstant = variableCount == 0;
+
+    /**
+     * @return The expression text.
+     */
+    static constexpr std::string_view text() { return Parsed::text; }
+
+    /**
+     * @param slot A slot below variableCount.
+     * @return The name of the variable in that slot.
+     */
+    static constexpr std::string_view variable(std::size_t slot) { return Parsed::ast.names[slot]; }
+
+    /**
+     * @return The value of an expression without variables; usable in static_assert.
+     */
+    static constexpr int value() {
+        static_assert(isConstant, "value() needs an expression without variables; call it with their values");
+        return Root::evaluate(nullptr);
+    }
+
+    /**
+     * Evaluates with the variable values given in order of first use.
+     *
+     * @return The result.
+     * @throws std::runtime_error on division or modulo by zero.
+     */
+    template <typename... Values>
+    constexpr int operator()(Values... values) const {
+        static_assert(sizeof...(Values) == variableCount, "Pass one value per variable, in order of first use");
+        if constexpr (sizeof...(Values) == 0) {
+            return Root::evaluate(nullptr);
+        }
+        else {
+            const int slots[] = {static_cast<int>(values)...};
+            return Root::evaluate(slots);
+        }
+    }
+
+    /**
+     * Evaluates with the variable values in a slot array, as CompiledExpression::evaluate() takes them.
+     *
+     * @param slots variableCount values, in order of first use.
+     * @return The result.
+     * @throws std::runtime_error on division or modulo by zero.
+     */
+    static constexpr int evaluate(const int* slots) { return Root::evaluate(slots); }
+};
+
+/**
+ * A StaticExpression for a string literal. C++17 cannot take a string literal
+ * as a template argument, so the literal is returned from a local type's
+ * function, and that type is the argument.
+ */
+#define STATIC_EXPRESSION(literal)                                                      \
+    ([] {                                                                               \
+        struct StaticExpressionSource {                                                 \
+            static constexpr std::string_view text() { return literal; }                \
+        };                                                                              \
+        return StaticExpression<StaticExpressionSource>();                              \
+    }())
+
+#endif // STATIC_EXPRESSION_H
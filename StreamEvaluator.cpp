@@ -0,0 +1,172 @@
+#include "StreamEvaluator.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+LineReader::LineReader(const std::string& path) {
+    if (path == "-") {
+        fd = STDIN_FILENO;
+    }
+    else {
+        fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open " + path + ": " + std::strerror(errno));
+        }
+        ownsFd = true;
+    }
+
+    // Map regular files; pipes, terminals and failed mappings use block reads
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* memory = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (memory != MAP_FAILED) {
+            mapping = static_cast<const char*>(memory);
+            mappingSize = static_cast<std::size_t>(info.st_size);
+            madvise(memory, mappingSize, MADV_SEQUENTIAL);
+            data = mapping;
+            size = mappingSize;
+            return;
+        }
+    }
+    buffer.resize(kBlockSize);
+}
+
+LineReader::~LineReader() {
+    if (mapping) {
+        munmap(const_cast<char*>(mapping), mappingSize);
+    }
+    if (ownsFd) {
+        close(fd);
+    }
+}
+
+bool LineReader::next(std::string_view& line) {
+    while (true) {
+        const char* start = data + position;
+        std::size_t left = size - position;
+
+        std::size_t length;
+        const void* newline = left > 0 ? std::memchr(start, '\n', left) : nullptr;
+        if (newline) {
+            length = static_cast<std::size_t>(static_cast<const char*>(newline) - start);
+            position += length + 1;
+            consumed += length + 1;
+        }
+        else if (mapping || eof) {
+            // The last line may lack a terminator
+            if (left == 0) {
+                return false;
+            }
+            length = left;
+            position = size;
+            consumed += left;
+        }
+        else {
+            // The line continues past the buffered bytes
+            eof = !refill();
+            continue;
+        }
+
+        if (length > 0 && start[length - 1] == '\r') {
+            length--;
+        }
+        line = std::string_view(start, length);
+        return true;
+    }
+}
+
+bool LineReader::refill() {
+    // Keep the unfinished line, growing the buffer if it fills the whole buffer
+    std::size_t tail = size - position;
+    if (tail > 0 && data + position != buffer.data()) {
+        std::memmove(buffer.data(), data + position, tail);
+    }
+    if (tail == buffer.size()) {
+        buffer.resize(buffer.size() * 2);
+    }
+    data = buffer.data();
+    size = tail;
+    position = 0;
+
+    while (true) {
+        ssize_t n = read(fd, buffer.data() + tail, buffer.size() - tail);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            throw std::runtime_error(std::string("Read error: ") + std::strerror(errno));
+        }
+        size = tail + static_cast<std::size_t>(n);
+        return n > 0;
+    }
+}
+
+BufferedWriter::BufferedWriter(std::FILE* out) : out(out), buffer(kBufferSize) {}
+
+BufferedWriter::~BufferedWriter() {
+    try {
+        flush();
+    }
+    catch (const std::exception&) {
+        // Destructors must not throw; call flush() explicitly to see write errors
+    }
+}
+
+void BufferedWriter::write(std::string_view text) {
+    while (!text.empty()) {
+        if (length == buffer.size()) {
+            flush();
+        }
+        std::size_t chunk = std::min(text.size(), buffer.size() - length);
+        std::memcpy(buffer.data() + length, text.data(), chunk);
+        length += chunk;
+        text.remove_prefix(chunk);
+    }
+}
+
+void BufferedWriter::writeInt(std::int64_t value) {
+    // 20 digits and a sign cover every 64-bit value
+    if (buffer.size() - length < 21) {
+        flush();
+    }
+    auto result = std::to_chars(buffer.data() + length, buffer.data() + buffer.size(), value);
+    length = static_cast<std::size_t>(result.ptr - buffer.data());
+}
+
+void BufferedWriter::flush() {
+    if (length > 0 && std::fwrite(buffer.data(), 1, length, out) != length) {
+        length = 0;
+        throw std::runtime_error("Write error");
+    }
+    length = 0;
+    std::fflush(out);
+}
+
+StreamStats evaluateStream(const Evaluator& evaluator, LineReader& input, BufferedWriter& output) {
+    StreamStats stats;
+    std::string_view line;
+    EvalContext context;
+
+    while (input.next(line)) {
+        stats.lines++;
+        try {
+            output.writeInt(evaluator.eval(line, context));
+        }
+        catch (const std::exception& e) {
+            // Report the failure in place of the result and carry on with the next line
+            stats.errors++;
+            output.write("error: ");
+            output.write(e.what());
+        }
+        output.put('\n');
+    }
+
+    stats.bytes = input.bytesConsumed();
+    return stats;
+}
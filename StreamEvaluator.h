@@ -0,0 +1,166 @@
+#ifndef STREAM_EVALUATOR_H
+#define STREAM_EVALUATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Evaluator.h"
+
+/**
+ * Reads an input one line at a time without copying lines.
+ *
+ * Regular files are memory-mapped where the platform allows it, and each line
+ * is a std::string_view into the mapping. Other inputs (pipes, stdin) are read
+ * in large blocks; lines are views into the block buffer and stay valid until
+ * the next call to next().
+ */
+class LineReader {
+public:
+    // Bytes requested per read() when the input cannot be mapped
+    static constexpr std::size_t kBlockSize = 1 << 20;
+
+    /**
+     * Opens a file, or standard input for "-".
+     *
+     * @param path The file to read.
+     * @throws std::runtime_error if the file cannot be opened.
+     */
+    explicit LineReader(const std::string& path);
+
+    /**
+     * Closes the input and releases the mapping or buffer.
+     */
+    ~LineReader();
+
+    LineReader(const LineReader&) = delete;
+    LineReader& operator=(const LineReader&) = delete;
+
+    /**
+     * Returns the next line, without its line terminator ("\n" or "\r\n").
+     * A final line without a terminator is returned too.
+     *
+     * @param line Receives the line.
+     * @return False at the end of the input.
+     * @throws std::runtime_error on a read error.
+     *
+     * Time Complexity: O(length of the line), amortized.
+     */
+    bool next(std::string_view& line);
+
+    /**
+     * @return True if the input is memory-mapped.
+     */
+    bool mapped() const { return mapping != nullptr; }
+
+    /**
+     * @return The number of input bytes returned so far, line terminators included.
+     */
+    std::uint64_t bytesConsumed() const { return consumed; }
+
+private:
+    /**
+     * Moves the unread tail of the buffer to the front and reads another block.
+     *
+     * @return False if no more bytes could be read.
+     */
+    bool refill();
+
+    int fd = -1;                        // Input descriptor
+    bool ownsFd = false;                // False for stdin
+    const char* mapping = nullptr;      // Memory-mapped file, if any
+    std::size_t mappingSize = 0;
+    std::vector<char> buffer;           // Block buffer when the input is not mapped
+    const char* data = nullptr;         // Current window of input bytes
+    std::size_t size = 0;               // Bytes in the window
+    std::size_t position = 0;           // Start of the next line within the window
+    std::uint64_t consumed = 0;         // Bytes handed out as lines so far
+    bool eof = false;
+};
+
+/**
+ * Collects output in a large buffer and writes it in big chunks, instead of
+ * flushing a stream after every result.
+ */
+class BufferedWriter {
+public:
+    // Bytes collected before the buffer is written out
+    static constexpr std::size_t kBufferSize = 1 << 20;
+
+    /**
+     * @param out The stream to write to; it must outlive the writer.
+     */
+    explicit BufferedWriter(std::FILE* out);
+
+    /**
+     * Flushes whatever is still buffered.
+     */
+    ~BufferedWriter();
+
+    BufferedWriter(const BufferedWriter&) = delete;
+    BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+    /**
+     * Appends text.
+     *
+     * Time Complexity: O(n) where n is the length of the text, amortized.
+     */
+    void write(std::string_view text);
+
+    /**
+     * Appends one character.
+     */
+    void put(char c) {
+        if (length == buffer.size()) {
+            flush();
+        }
+        buffer[length++] = c;
+    }
+
+    /**
+     * Appends an integer in decimal.
+     *
+     * Time Complexity: O(1).
+     */
+    void writeInt(std::int64_t value);
+
+    /**
+     * Writes the buffered bytes to the stream.
+     *
+     * @throws std::runtime_error if the stream reports a write error.
+     */
+    void flush();
+
+private:
+    std::FILE* out;
+    std::vector<char> buffer;
+    std::size_t length = 0;
+};
+
+/**
+ * Totals reported by evaluateStream().
+ */
+struct StreamStats {
+    std::uint64_t lines = 0;    // Lines read
+    std::uint64_t errors = 0;   // Lines that produced an error instead of a result
+    std::uint64_t bytes = 0;    // Input bytes consumed, terminators included
+};
+
+/**
+ * Evaluates one expression per input line and writes one output line per
+ * input line: the result, or "error: <message>" if the expression fails.
+ * An error never stops the stream, so output line N always belongs to input
+ * line N.
+ *
+ * @param evaluator The evaluator to use.
+ * @param input The input lines.
+ * @param output Receives the results.
+ * @return Line, error and byte counts.
+ *
+ * Time Complexity: O(n) where n is the size of the input.
+ */
+StreamStats evaluateStream(const Evaluator& evaluator, LineReader& input, BufferedWriter& output);
+
+#endif // STREAM_EVALUATOR_H
@@ -0,0 +1,202 @@
+#ifndef SYNTAX_H
+#define SYNTAX_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include "Operators.h"
+
+/**
+ * The character classes, literal and operator rules and syntax error messages
+ * of the expression language, shared by the run-time Lexer and Evaluator and
+ * by the constexpr parser of StaticExpression.h, so the two cannot drift apart.
+ * Everything except formatting a message is constexpr.
+ */
+namespace syntax {
+
+// Whitespace as std::isspace() sees it in the C locale
+constexpr bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+constexpr bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+constexpr bool isAlpha(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+constexpr bool isIdentifierStart(char c) {
+    return isAlpha(c) || c == '_';
+}
+
+constexpr bool isIdentifierChar(char c) {
+    return isAlpha(c) || isDigit(c) || c == '_';
+}
+
+constexpr bool isDigitAt(std::string_view text, std::size_t i) {
+    return i < text.size() && isDigit(text[i]);
+}
+
+/**
+ * Returns the end of the fraction and exponent that may follow the integer
+ * digits of a literal. An 'e' only starts an exponent when digits follow it,
+ * so "2e" stays a number followed by an identifier.
+ *
+ * @param text The expression text.
+ * @param i Index just past the integer digits (or at the '.' of ".5").
+ * @return Index just past the literal; i itself if it is a plain integer.
+ */
+constexpr std::size_t scanDecimalTail(std::string_view text, std::size_t i) {
+    if (i < text.size() && text[i] == '.') {
+        i++;
+        while (isDigitAt(text, i)) {
+            i++;
+        }
+    }
+    if (i < text.size() && (text[i] == 'e' || text[i] == 'E')) {
+        std::size_t digits = i + 1;
+        if (digits < text.size() && (text[digits] == '+' || text[digits] == '-')) {
+            digits++;
+        }
+        if (isDigitAt(text, digits)) {
+            i = digits;
+            while (isDigitAt(text, i)) {
+                i++;
+            }
+        }
+    }
+    return i;
+}
+
+/**
+ * Reads the operator at position i.
+ *
+ * @param text The expression text.
+ * @param i Index of the first operator character.
+ * @param unaryContext True if an operand is expected here (start, after '(' or an operator).
+ * @param op Receives the operator.
+ * @return The number of characters the operator spans, or 0 if the characters
+ *         at i do not form an operator.
+ */
+constexpr std::uint32_t readOperator(std::string_view text, std::size_t i, bool unaryContext, Op& op) {
+    char c = text[i];
+    char next = i + 1 < text.size() ? text[i + 1] : '\0';
+
+    switch (c) {
+    case '+':
+        if (next == '+') { op = Op::Increment; return 2; }
+        op = unaryContext ? Op::Plus : Op::Add;
+        return 1;
+    case '-':
+        if (next == '-') { op = Op::Decrement; return 2; }
+        op = unaryContext ? Op::Negate : Op::Subtract;
+        return 1;
+    case '=':
+        if (next == '=') { op = Op::Equal; return 2; }
+        return 0;
+    case '!':
+        if (next == '=') { op = Op::NotEqual; return 2; }
+        op = Op::LogicalNot;
+        return 1;
+    case '>':
+        if (next == '=') { op = Op::GreaterEqual; return 2; }
+        op = Op::Greater;
+        return 1;
+    case '<':
+        if (next == '=') { op = Op::LessEqual; return 2; }
+        op = Op::Less;
+        return 1;
+    case '&':
+        if (next == '&') { op = Op::LogicalAnd; return 2; }
+        return 0;
+    case '|':
+        if (next == '|') { op = Op::LogicalOr; return 2; }
+        return 0;
+    case '*': op = Op::Multiply; return 1;
+    case '/': op = Op::Divide;   return 1;
+    case '%': op = Op::Modulo;   return 1;
+    case '^': op = Op::Power;    return 1;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * The syntax errors Evaluator::compile() and the constexpr parser both report.
+ * Values index kErrorMessages.
+ */
+enum class Error : std::uint8_t {
+    None,
+    TooLong,                        // More characters than the limit
+    StartsWithClosing,
+    StartsWithBinary,
+    TooManyClosing,
+    TwoOperands,
+    UnaryThenBinary,
+    TwoBinary,
+    SingleOperator,                 // A single '=', '&' or '|'
+    InvalidCharacter,
+    Empty,
+    UnclosedParentheses,
+    NotEnoughOperands,
+    NotEnoughOperandsAtParenthesis, // Found while closing a parenthesis
+    TooManyValues,
+    DecimalLiteral
+};
+
+/**
+ * The message of each error; each "{}" is replaced by the next argument of
+ * errorMessage().
+ */
+constexpr std::array<std::string_view, 16> kErrorMessages = {
+    "",
+    "Expression is too long: {} characters, the limit is {}",
+    "Expression can't start with a closing parenthesis @ char: {}",
+    "Expression can't start with a binary operator @ char: {}",
+    "Mismatched parentheses - too many closing @ char: {}",
+    "Two operands in a row @ char {}",
+    "A unary operand can't be followed by a binary operator @ char {}",
+    "Two binary operators in a row @ char {}",
+    "Invalid operator: single '{}' is not supported @ char {}",
+    "Invalid character in expression: {} @ char {}",
+    "Expression is empty",
+    "Mismatched parentheses - unclosed parentheses",
+    "Not enough operands for {} operator: {}",          // Arity ("unary" or "binary"), operator
+    "Invalid expression: Not enough operands for {} operator {}",
+    "Invalid expression - too many values",
+    "Decimal literal {} @ char {} needs typed evaluation (use compileTyped())"
+};
+
+static_assert(kErrorMessages.size() == static_cast<std::size_t>(Error::DecimalLiteral) + 1,
+              "Every error needs a message");
+
+/**
+ * @param error The error.
+ * @param args The values of the message's "{}" in order.
+ * @return The message.
+ *
+ * Time Complexity: O(m) where m is the length of the message.
+ */
+inline std::string errorMessage(Error error, std::initializer_list<std::string_view> args = {}) {
+    std::string_view format = kErrorMessages[static_cast<std::size_t>(error)];
+    std::string message;
+    const std::string_view* arg = args.begin();
+    for (std::size_t at = format.find("{}"); at != std::string_view::npos; at = format.find("{}")) {
+        message.append(format.substr(0, at));
+        if (arg != args.end()) {
+            message.append(*arg++);
+        }
+        format.remove_prefix(at + 2);
+    }
+    message.append(format);
+    return message;
+}
+
+} // namespace syntax
+
+#endif // SYNTAX_H
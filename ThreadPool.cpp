@@ -0,0 +1,148 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+constexpr std::size_t kNoFailure = std::numeric_limits<std::size_t>::max();
+
+} // namespace
+
+ThreadPool::ThreadPool(unsigned threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    rangeStorage = std::make_unique<Range[]>(threads);
+    for (unsigned i = 0; i < threads; i++) {
+        ranges.push_back(&rangeStorage[i]);
+    }
+
+    // The caller of parallelFor() works as thread 0
+    for (unsigned i = 1; i < threads; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallelFor(std::size_t count, const std::function<void(std::size_t)>& task) {
+    if (count == 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> submit(submitLock);
+    body = &task;
+    remaining = count;
+    firstFailure = kNoFailure;
+    error = nullptr;
+
+    // Equal contiguous ranges, so without stealing each thread touches one block of the input
+    std::size_t threads = ranges.size();
+    for (std::size_t i = 0; i < threads; i++) {
+        std::lock_guard<std::mutex> guard(ranges[i]->lock);
+        ranges[i]->next = count * i / threads;
+        ranges[i]->end = count * (i + 1) / threads;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        generation++;
+    }
+    wake.notify_all();
+
+    runTasks(0);
+
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        done.wait(guard, [this] { return remaining == 0; });
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void ThreadPool::workerLoop(unsigned index) {
+    std::uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [&] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+        }
+        runTasks(index);
+    }
+}
+
+void ThreadPool::runTasks(unsigned index) {
+    std::size_t task;
+    while (takeTask(index, task) || (steal(index) && takeTask(index, task))) {
+        // Skip tasks after a known failure; they cannot change the reported error
+        if (task < firstFailure.load(std::memory_order_relaxed)) {
+            try {
+                (*body)(task);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> guard(errorLock);
+                if (task < firstFailure) {
+                    firstFailure = task;
+                    error = std::current_exception();
+                }
+            }
+        }
+
+        if (remaining.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> guard(lock);
+            done.notify_all();
+        }
+    }
+}
+
+bool ThreadPool::takeTask(unsigned index, std::size_t& task) {
+    Range& range = *ranges[index];
+    std::lock_guard<std::mutex> guard(range.lock);
+    if (range.next == range.end) {
+        return false;
+    }
+    task = range.next++;
+    return true;
+}
+
+bool ThreadPool::steal(unsigned index) {
+    std::size_t threads = ranges.size();
+    for (std::size_t offset = 1; offset < threads; offset++) {
+        Range& victim = *ranges[(index + offset) % threads];
+        std::size_t begin, end;
+        {
+            std::lock_guard<std::mutex> guard(victim.lock);
+            std::size_t left = victim.end - victim.next;
+            if (left == 0) {
+                continue;
+            }
+            // Take the upper half, or the last task
+            begin = victim.end - (left + 1) / 2;
+            end = victim.end;
+            victim.end = begin;
+        }
+
+        Range& own = *ranges[index];
+        std::lock_guard<std::mutex> guard(own.lock);
+        own.next = begin;
+        own.end = end;
+        return true;
+    }
+    return false;
+}
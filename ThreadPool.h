@@ -0,0 +1,116 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed-size pool of threads that runs indexed parallel loops with work stealing.
+ *
+ * parallelFor() hands every thread (the calling thread included) an equal,
+ * contiguous range of task indices. A thread takes tasks from the front of
+ * its own range; when that runs out, it steals the upper half of another
+ * thread's remaining range. Uneven tasks therefore balance out without a
+ * shared queue that every task would contend on.
+ */
+class ThreadPool {
+public:
+    /**
+     * Starts the pool.
+     *
+     * @param threads Total number of threads including the caller of parallelFor();
+     *        0 uses std::thread::hardware_concurrency().
+     *
+     * Time Complexity: O(t) where t is the number of threads.
+     */
+    explicit ThreadPool(unsigned threads = 0);
+
+    /**
+     * Stops and joins the worker threads.
+     */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    /**
+     * Runs body(i) for every i in [0, count) and waits until all have finished.
+     * Calls from several threads are serialized.
+     *
+     * If tasks throw, tasks with a higher index than a failed one are skipped
+     * once the failure is seen, and the exception of the lowest failing index
+     * is rethrown, so the reported error does not depend on scheduling.
+     *
+     * @param count Number of tasks.
+     * @param body The task; called concurrently from different threads.
+     * @throws Whatever the lowest-indexed failing task threw.
+     *
+     * Time Complexity: O(count / t) per thread plus stealing overhead.
+     */
+    void parallelFor(std::size_t count, const std::function<void(std::size_t)>& body);
+
+    /**
+     * @return The number of threads that run tasks, including the caller.
+     */
+    unsigned size() const { return static_cast<unsigned>(ranges.size()); }
+
+private:
+    // The task indices a thread still has to run; padded so neighbours do not share a cache line
+    struct alignas(64) Range {
+        std::mutex lock;
+        std::size_t next = 0;
+        std::size_t end = 0;
+    };
+
+    /**
+     * Worker thread main loop: waits for a parallelFor() and helps run it.
+     */
+    void workerLoop(unsigned index);
+
+    /**
+     * Runs tasks from the given thread's range, stealing when it is empty,
+     * until no range has work left.
+     */
+    void runTasks(unsigned index);
+
+    /**
+     * Takes the next task of a range.
+     *
+     * @return True if a task was taken.
+     */
+    bool takeTask(unsigned index, std::size_t& task);
+
+    /**
+     * Moves the upper half of another thread's range into this thread's range.
+     *
+     * @return True if anything was stolen.
+     */
+    bool steal(unsigned index);
+
+    std::vector<std::thread> workers;
+    std::unique_ptr<Range[]> rangeStorage;
+    std::vector<Range*> ranges;                     // One per thread; ranges[0] belongs to the caller
+
+    std::mutex submitLock;                          // Serializes parallelFor() calls
+    std::mutex lock;                                // Guards generation, stopping and the wake-ups
+    std::condition_variable wake;                   // Signals workers that a loop started
+    std::condition_variable done;                   // Signals the caller that all tasks finished
+    std::uint64_t generation = 0;                   // Incremented for every parallelFor()
+    bool stopping = false;
+
+    const std::function<void(std::size_t)>* body = nullptr;
+    std::atomic<std::size_t> remaining{0};          // Tasks not yet finished (or skipped)
+    std::atomic<std::size_t> firstFailure{0};       // Lowest failing task index, or SIZE_MAX
+    std::mutex errorLock;
+    std::exception_ptr error;                       // Exception of the task at firstFailure
+};
+
+#endif // THREAD_POOL_H
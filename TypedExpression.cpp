@@ -0,0 +1,515 @@
+#include "TypedExpression.h"
+#include "Arithmetic.h"
+#include "BatchKernels.h"
+#include "TypedKernels.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace {
+
+// One value stack entry; Bool values are stored in i as 0 or 1
+union Slot {
+    std::int32_t i;
+    double d;
+};
+
+[[noreturn]] void throwDivisionByZero(const TypedInstruction& ins) {
+    throw std::runtime_error(std::string(ins.op == TypedOp::DivideInt ? "Division" : "Modulo") +
+                             " by zero @ char " + std::to_string(ins.offset));
+}
+
+/**
+ * Runs a typed program on a caller-provided value stack.
+ *
+ * @return The value left on top of the stack.
+ */
+Slot executeTyped(const std::vector<TypedInstruction>& code, const double* constants, const TypedValue* values,
+                  Slot* stack) {
+    Slot* top = stack - 1;  // Points at the current top of the value stack
+
+    for (std::size_t pc = 0; pc < code.size(); pc++) {
+        const TypedInstruction& ins = code[pc];
+
+        switch (ins.op) {
+        case TypedOp::ConstInt:           (++top)->i = ins.operand; break;
+        case TypedOp::ConstDouble:        (++top)->d = constants[ins.operand]; break;
+        case TypedOp::LoadInt:            (++top)->i = values[ins.operand].i; break;
+        case TypedOp::LoadDouble:         (++top)->d = values[ins.operand].d; break;
+
+        case TypedOp::IntToDouble:        top->d = top->i; break;
+        case TypedOp::BoolToInt:          break;
+        case TypedOp::BoolToDouble:       top->d = top->i; break;
+        case TypedOp::IntToBool:          top->i = top->i != 0; break;
+        case TypedOp::DoubleToBool:       top->i = top->d != 0.0; break;
+
+        // Binary operators: the right operand is on top, the left one below it
+        case TypedOp::AddInt:             top[-1].i = wrappingAdd(top[-1].i, top[0].i); --top; break;
+        case TypedOp::SubtractInt:        top[-1].i = wrappingSubtract(top[-1].i, top[0].i); --top; break;
+        case TypedOp::MultiplyInt:        top[-1].i = wrappingMultiply(top[-1].i, top[0].i); --top; break;
+        case TypedOp::DivideInt:
+            if (top[0].i == 0) {
+                throwDivisionByZero(ins);
+            }
+            top[-1].i = wrappingDivide(top[-1].i, top[0].i);
+            --top;
+            break;
+        case TypedOp::ModuloInt:
+            if (top[0].i == 0) {
+                throwDivisionByZero(ins);
+            }
+            top[-1].i = wrappingModulo(top[-1].i, top[0].i);
+            --top;
+            break;
+        case TypedOp::PowerInt:           top[-1].i = integerPower(top[-1].i, top[0].i); --top; break;
+        case TypedOp::NegateInt:          top->i = wrappingNegate(top->i); break;
+
+        case TypedOp::AddDouble:          top[-1].d = top[-1].d + top[0].d; --top; break;
+        case TypedOp::SubtractDouble:     top[-1].d = top[-1].d - top[0].d; --top; break;
+        case TypedOp::MultiplyDouble:     top[-1].d = top[-1].d * top[0].d; --top; break;
+        case TypedOp::DivideDouble:       top[-1].d = top[-1].d / top[0].d; --top; break;
+        case TypedOp::ModuloDouble:       top[-1].d = std::fmod(top[-1].d, top[0].d); --top; break;
+        case TypedOp::PowerDouble:        top[-1].d = std::pow(top[-1].d, top[0].d); --top; break;
+        case TypedOp::NegateDouble:       top->d = -top->d; break;
+
+        // Three operands [a, b, c] with c on top
+        case TypedOp::MultiplyAdd:        top[-2].d = std::fma(top[-2].d, top[-1].d, top[0].d); top -= 2; break;
+        case TypedOp::MultiplySubtract:   top[-2].d = std::fma(top[-2].d, top[-1].d, -top[0].d); top -= 2; break;
+        case TypedOp::AddMultiply:        top[-2].d = std::fma(top[-1].d, top[0].d, top[-2].d); top -= 2; break;
+        case TypedOp::SubtractMultiply:   top[-2].d = std::fma(-top[-1].d, top[0].d, top[-2].d); top -= 2; break;
+
+        case TypedOp::GreaterInt:         top[-1].i = top[-1].i > top[0].i; --top; break;
+        case TypedOp::GreaterEqualInt:    top[-1].i = top[-1].i >= top[0].i; --top; break;
+        case TypedOp::LessInt:            top[-1].i = top[-1].i < top[0].i; --top; break;
+        case TypedOp::LessEqualInt:       top[-1].i = top[-1].i <= top[0].i; --top; break;
+        case TypedOp::EqualInt:           top[-1].i = top[-1].i == top[0].i; --top; break;
+        case TypedOp::NotEqualInt:        top[-1].i = top[-1].i != top[0].i; --top; break;
+        case TypedOp::GreaterDouble:      top[-1].i = top[-1].d > top[0].d; --top; break;
+        case TypedOp::GreaterEqualDouble: top[-1].i = top[-1].d >= top[0].d; --top; break;
+        case TypedOp::LessDouble:         top[-1].i = top[-1].d < top[0].d; --top; break;
+        case TypedOp::LessEqualDouble:    top[-1].i = top[-1].d <= top[0].d; --top; break;
+        case TypedOp::EqualDouble:        top[-1].i = top[-1].d == top[0].d; --top; break;
+        case TypedOp::NotEqualDouble:     top[-1].i = top[-1].d != top[0].d; --top; break;
+
+        case TypedOp::Not:                top->i = !top->i; break;
+        case TypedOp::And:                top[-1].i = top[-1].i & top[0].i; --top; break;
+        case TypedOp::Or:                 top[-1].i = top[-1].i | top[0].i; --top; break;
+
+        // The operand is already a Bool, so it is the result as it stands
+        case TypedOp::JumpIfFalse:
+            if (top->i == 0) {
+                pc = static_cast<std::size_t>(ins.operand) - 1;
+            }
+            else {
+                --top;
+            }
+            break;
+        case TypedOp::JumpIfTrue:
+            if (top->i != 0) {
+                pc = static_cast<std::size_t>(ins.operand) - 1;
+            }
+            else {
+                --top;
+            }
+            break;
+        }
+    }
+
+    return *top;
+}
+
+// The batch:: opcode for an Int arithmetic instruction
+OpCode intOpCode(TypedOp op) {
+    switch (op) {
+    case TypedOp::AddInt:      return OpCode::Add;
+    case TypedOp::SubtractInt: return OpCode::Subtract;
+    case TypedOp::MultiplyInt: return OpCode::Multiply;
+    case TypedOp::DivideInt:   return OpCode::Divide;
+    case TypedOp::ModuloInt:   return OpCode::Modulo;
+    default:                   return OpCode::Power;
+    }
+}
+
+bool bitSet(const std::uint64_t* mask, std::size_t i) {
+    return (mask[i / 64] >> (i % 64)) & 1;
+}
+
+} // namespace
+
+const char* typeName(ValueType type) {
+    switch (type) {
+    case ValueType::Int:    return "int";
+    case ValueType::Double: return "double";
+    case ValueType::Bool:   return "bool";
+    }
+    return "?";
+}
+
+TypedValue TypedExpression::evaluate() const {
+    if (!vars.empty()) {
+        throw std::runtime_error("Expression uses " + std::to_string(vars.size()) +
+                                 " variable(s); pass their values to evaluate()");
+    }
+    return evaluate(static_cast<const TypedValue*>(nullptr));
+}
+
+TypedValue TypedExpression::evaluate(const TypedValue* values) const {
+    Slot top;
+    if (stackDepth <= kInlineStackSize) {
+        Slot stack[kInlineStackSize];
+        top = executeTyped(code, constants.data(), values, stack);
+    }
+    else {
+        // Very deep expressions: fall back to a heap-allocated stack
+        std::vector<Slot> stack(stackDepth);
+        top = executeTyped(code, constants.data(), values, stack.data());
+    }
+
+    switch (result) {
+    case ValueType::Int:    return TypedValue::ofInt(top.i);
+    case ValueType::Double: return TypedValue::ofDouble(top.d);
+    case ValueType::Bool:   return TypedValue::ofBool(top.i != 0);
+    }
+    return {};
+}
+
+TypedValue TypedExpression::evaluate(const std::vector<TypedValue>& values) const {
+    if (values.size() < vars.size()) {
+        throw std::runtime_error("Expected " + std::to_string(vars.size()) + " variable value(s), got " +
+                                 std::to_string(values.size()));
+    }
+    for (std::size_t s = 0; s < vars.size(); s++) {
+        if (vars[s].type == ValueType::Int && values[s].type == ValueType::Double) {
+            throw std::runtime_error("Variable " + vars[s].name + " is int; got a double value");
+        }
+    }
+    return evaluate(values.data());
+}
+
+std::size_t TypedExpression::fusedOperations() const {
+    return static_cast<std::size_t>(std::count_if(code.begin(), code.end(), [](const TypedInstruction& ins) {
+        return ins.op == TypedOp::MultiplyAdd || ins.op == TypedOp::MultiplySubtract ||
+               ins.op == TypedOp::AddMultiply || ins.op == TypedOp::SubtractMultiply;
+    }));
+}
+
+template <typename Sink>
+void TypedExpression::runBatch(const TypedColumn* columns, std::size_t rows, Sink sink) const {
+    const std::size_t block = kBatchBlockSize;
+    const std::size_t words = block / 64;
+
+    for (std::size_t s = 0; s < vars.size(); s++) {
+        if (columns[s].type != vars[s].type) {
+            throw std::runtime_error("Column " + std::to_string(s) + " (" + vars[s].name + ") must hold " +
+                                     typeName(vars[s].type) + " values");
+        }
+    }
+
+    // Two scratch blocks per stack position, each wide enough for doubles, plus
+    // one pre-filled block per constant. Widening conversions cannot run in
+    // place, so they write to whichever block of the position is not their input.
+    const std::size_t blockBytes = block * sizeof(double);
+    std::vector<unsigned char> scratch(2 * stackDepth * blockBytes);
+    std::vector<std::int32_t> intConstants;
+    std::vector<double> doubleConstants;
+    std::vector<std::size_t> constantIndex(code.size());
+    std::size_t jumps = 0;
+    for (std::size_t pc = 0; pc < code.size(); pc++) {
+        if (code[pc].op == TypedOp::ConstInt) {
+            constantIndex[pc] = intConstants.size();
+            intConstants.insert(intConstants.end(), block, code[pc].operand);
+        }
+        else if (code[pc].op == TypedOp::ConstDouble) {
+            constantIndex[pc] = doubleConstants.size();
+            doubleConstants.insert(doubleConstants.end(), block, constants[code[pc].operand]);
+        }
+        else if (code[pc].op == TypedOp::JumpIfFalse || code[pc].op == TypedOp::JumpIfTrue) {
+            jumps++;
+        }
+    }
+
+    // Each stack entry points at a block: a column slice, a constant block or the
+    // scratch block owned by that stack position. The instruction says how to read it.
+    std::vector<const void*> stack(stackDepth);
+    auto ints = [&](std::size_t i) { return static_cast<const std::int32_t*>(stack[i]); };
+    auto doubles = [&](std::size_t i) { return static_cast<const double*>(stack[i]); };
+    auto masks = [&](std::size_t i) { return static_cast<const std::uint64_t*>(stack[i]); };
+    auto output = [&](std::size_t i) { return static_cast<void*>(scratch.data() + blockBytes * i); };
+    auto widened = [&](std::size_t i) {
+        void* primary = output(i);
+        return stack[i] == primary ? static_cast<void*>(scratch.data() + blockBytes * (stackDepth + i)) : primary;
+    };
+
+    // A && / || whose right operand is being evaluated for part of the block; as
+    // in CompiledExpression::evalBatchRange(), rows outside 'mask' must not fail
+    struct ShortCircuit {
+        std::size_t target;     // Instruction index where the operator completes
+        bool isAnd;
+        std::uint64_t* left;    // Copy of the left operand's mask
+        std::uint64_t* mask;    // Active rows inside the right operand
+    };
+    std::vector<ShortCircuit> pending(jumps);
+    std::vector<std::uint64_t> leftMasks(jumps * words), activeMasks(jumps * words);
+    std::vector<std::int32_t> divisors(block);
+
+    for (std::size_t start = 0; start < rows; start += block) {
+        std::size_t n = std::min(block, rows - start);
+        std::size_t top = 0;                    // Number of entries on the stack
+        std::size_t levels = 0;                 // Number of open short-circuits
+        const std::uint64_t* active = nullptr;  // Rows that are evaluated, or null for all
+
+        for (std::size_t pc = 0; pc <= code.size(); pc++) {
+            // Complete the && / || operators whose right operand ends here
+            while (levels > 0 && pending[levels - 1].target == pc) {
+                const ShortCircuit& sc = pending[--levels];
+                auto* out = static_cast<std::uint64_t*>(output(top - 1));
+                (sc.isAnd ? typed::andMask : typed::orMask)(sc.left, masks(top - 1), out, n);
+                stack[top - 1] = out;
+                active = levels > 0 ? pending[levels - 1].mask : nullptr;
+            }
+            if (pc == code.size()) {
+                break;
+            }
+
+            const TypedInstruction& ins = code[pc];
+            switch (ins.op) {
+            case TypedOp::ConstInt:
+                stack[top++] = intConstants.data() + constantIndex[pc];
+                break;
+            case TypedOp::ConstDouble:
+                stack[top++] = doubleConstants.data() + constantIndex[pc];
+                break;
+            case TypedOp::LoadInt:
+                stack[top++] = static_cast<const std::int32_t*>(columns[ins.operand].data) + start;
+                break;
+            case TypedOp::LoadDouble:
+                stack[top++] = static_cast<const double*>(columns[ins.operand].data) + start;
+                break;
+
+            case TypedOp::IntToDouble: {
+                void* out = widened(top - 1);
+                typed::intToDouble(ints(top - 1), static_cast<double*>(out), n);
+                stack[top - 1] = out;
+                break;
+            }
+            case TypedOp::BoolToInt: {
+                void* out = widened(top - 1);
+                typed::maskToInt(masks(top - 1), static_cast<std::int32_t*>(out), n);
+                stack[top - 1] = out;
+                break;
+            }
+            case TypedOp::BoolToDouble: {
+                void* out = widened(top - 1);
+                typed::maskToDouble(masks(top - 1), static_cast<double*>(out), n);
+                stack[top - 1] = out;
+                break;
+            }
+            case TypedOp::IntToBool: {
+                void* out = output(top - 1);
+                typed::intToMask(ints(top - 1), static_cast<std::uint64_t*>(out), n);
+                stack[top - 1] = out;
+                break;
+            }
+            case TypedOp::DoubleToBool: {
+                void* out = output(top - 1);
+                typed::doubleToMask(doubles(top - 1), static_cast<std::uint64_t*>(out), n);
+                stack[top - 1] = out;
+                break;
+            }
+
+            case TypedOp::NegateInt: {
+                void* out = output(top - 1);
+                batch::applyUnary(OpCode::Negate, ints(top - 1), static_cast<std::int32_t*>(out), n);
+                stack[top - 1] = out;
+                break;
+            }
+            case TypedOp::NegateDouble: {
+                void* out = output(top - 1);
+                typed::negateDouble(doubles(top - 1), static_cast<double*>(out), n);
+                stack[top - 1] = out;
+                break;
+            }
+            case TypedOp::Not: {
+                void* out = output(top - 1);
+                typed::notMask(masks(top - 1), static_cast<std::uint64_t*>(out), n);
+                stack[top - 1] = out;
+                break;
+            }
+
+            case TypedOp::AddInt:
+            case TypedOp::SubtractInt:
+            case TypedOp::MultiplyInt:
+            case TypedOp::DivideInt:
+            case TypedOp::ModuloInt:
+            case TypedOp::PowerInt: {
+                auto* result = static_cast<std::int32_t*>(output(top - 2));
+                const std::int32_t* rhs = ints(top - 1);
+                OpCode op = intOpCode(ins.op);
+                std::size_t zero = batch::applyBinary(op, ints(top - 2), rhs, result, n);
+
+                if (zero != n && active) {
+                    // Only rows that actually evaluate this operator may fail;
+                    // give the others a harmless divisor and try again
+                    zero = n;
+                    for (std::size_t i = 0; i < n; i++) {
+                        if (rhs[i] == 0 && bitSet(active, i)) {
+                            zero = i;
+                            break;
+                        }
+                        divisors[i] = rhs[i] == 0 ? 1 : rhs[i];
+                    }
+                    if (zero == n) {
+                        zero = batch::applyBinary(op, ints(top - 2), divisors.data(), result, n);
+                    }
+                }
+                if (zero != n) {
+                    throw std::runtime_error(std::string(ins.op == TypedOp::DivideInt ? "Division" : "Modulo") +
+                                             " by zero @ char " + std::to_string(ins.offset) +
+                                             " (row " + std::to_string(start + zero) + ")");
+                }
+                stack[--top - 1] = result;
+                break;
+            }
+
+            case TypedOp::AddDouble:
+            case TypedOp::SubtractDouble:
+            case TypedOp::MultiplyDouble:
+            case TypedOp::DivideDouble:
+            case TypedOp::ModuloDouble:
+            case TypedOp::PowerDouble: {
+                auto* result = static_cast<double*>(output(top - 2));
+                typed::applyDouble(ins.op, doubles(top - 2), doubles(top - 1), result, n);
+                stack[--top - 1] = result;
+                break;
+            }
+
+            case TypedOp::MultiplyAdd:
+            case TypedOp::MultiplySubtract:
+            case TypedOp::AddMultiply:
+            case TypedOp::SubtractMultiply: {
+                auto* result = static_cast<double*>(output(top - 3));
+                typed::applyFused(ins.op, doubles(top - 3), doubles(top - 2), doubles(top - 1), result, n);
+                top -= 2;
+                stack[top - 1] = result;
+                break;
+            }
+
+            case TypedOp::GreaterInt:
+            case TypedOp::GreaterEqualInt:
+            case TypedOp::LessInt:
+            case TypedOp::LessEqualInt:
+            case TypedOp::EqualInt:
+            case TypedOp::NotEqualInt: {
+                auto* result = static_cast<std::uint64_t*>(output(top - 2));
+                typed::compareInt(ins.op, ints(top - 2), ints(top - 1), result, n);
+                stack[--top - 1] = result;
+                break;
+            }
+
+            case TypedOp::GreaterDouble:
+            case TypedOp::GreaterEqualDouble:
+            case TypedOp::LessDouble:
+            case TypedOp::LessEqualDouble:
+            case TypedOp::EqualDouble:
+            case TypedOp::NotEqualDouble: {
+                auto* result = static_cast<std::uint64_t*>(output(top - 2));
+                typed::compareDouble(ins.op, doubles(top - 2), doubles(top - 1), result, n);
+                stack[--top - 1] = result;
+                break;
+            }
+
+            case TypedOp::And:
+            case TypedOp::Or: {
+                auto* result = static_cast<std::uint64_t*>(output(top - 2));
+                (ins.op == TypedOp::And ? typed::andMask : typed::orMask)(masks(top - 2), masks(top - 1), result, n);
+                stack[--top - 1] = result;
+                break;
+            }
+
+            case TypedOp::JumpIfFalse:
+            case TypedOp::JumpIfTrue: {
+                const std::uint64_t* left = masks(top - 1);
+                bool isAnd = ins.op == TypedOp::JumpIfFalse;
+
+                // Rows that still need the right operand: left true for &&, false for ||
+                ShortCircuit& sc = pending[levels];
+                sc.target = static_cast<std::size_t>(ins.operand);
+                sc.isAnd = isAnd;
+                sc.left = leftMasks.data() + words * levels;
+                sc.mask = activeMasks.data() + words * levels;
+                if (isAnd) {
+                    std::copy(left, left + typed::maskWords(n), sc.mask);
+                }
+                else {
+                    typed::notMask(left, sc.mask, n);
+                }
+                if (active) {
+                    typed::andMask(active, sc.mask, sc.mask, n);
+                }
+
+                if (typed::countMask(sc.mask, n) == 0) {
+                    // The left operand decides every active row and is already the result
+                    pc = sc.target - 1;
+                    break;
+                }
+
+                std::copy(left, left + typed::maskWords(n), sc.left);
+                --top;
+                levels++;
+                active = sc.mask;
+                break;
+            }
+            }
+        }
+
+        sink(stack[0], start, n);
+    }
+}
+
+void TypedExpression::evalBatch(const TypedColumn* columns, std::size_t rows, double* out) const {
+    runBatch(columns, rows, [&](const void* values, std::size_t start, std::size_t n) {
+        switch (result) {
+        case ValueType::Int:
+            typed::intToDouble(static_cast<const std::int32_t*>(values), out + start, n);
+            break;
+        case ValueType::Double:
+            std::copy_n(static_cast<const double*>(values), n, out + start);
+            break;
+        case ValueType::Bool:
+            typed::maskToDouble(static_cast<const std::uint64_t*>(values), out + start, n);
+            break;
+        }
+    });
+}
+
+void TypedExpression::evalBatch(const TypedColumn* columns, std::size_t rows, std::int32_t* out) const {
+    if (result == ValueType::Double) {
+        throw std::runtime_error("Expression result is double; evaluate it into a double array");
+    }
+    runBatch(columns, rows, [&](const void* values, std::size_t start, std::size_t n) {
+        if (result == ValueType::Int) {
+            std::copy_n(static_cast<const std::int32_t*>(values), n, out + start);
+        }
+        else {
+            typed::maskToInt(static_cast<const std::uint64_t*>(values), out + start, n);
+        }
+    });
+}
+
+void TypedExpression::evalBatchMask(const TypedColumn* columns, std::size_t rows, std::uint64_t* mask) const {
+    // Blocks hold a multiple of 64 rows, so each one starts on a word boundary
+    runBatch(columns, rows, [&](const void* values, std::size_t start, std::size_t n) {
+        std::uint64_t* words = mask + start / 64;
+        switch (result) {
+        case ValueType::Int:
+            typed::intToMask(static_cast<const std::int32_t*>(values), words, n);
+            break;
+        case ValueType::Double:
+            typed::doubleToMask(static_cast<const double*>(values), words, n);
+            break;
+        case ValueType::Bool:
+            std::copy_n(static_cast<const std::uint64_t*>(values), typed::maskWords(n), words);
+            break;
+        }
+    });
+}
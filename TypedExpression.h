@@ -0,0 +1,289 @@
+#ifndef TYPED_EXPRESSION_H
+#define TYPED_EXPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * The static type of a value in a typed expression.
+ */
+enum class ValueType : std::uint8_t {
+    Int,        // 32-bit two's complement, wrapping exactly like eval()
+    Double,     // IEEE 754 double precision
+    Bool        // Result of a comparison, '!', '&&' or '||'
+};
+
+/**
+ * @return "int", "double" or "bool".
+ */
+const char* typeName(ValueType type);
+
+/**
+ * A variable of a typed expression: its name and whether it holds an Int or a Double.
+ */
+struct TypedVariable {
+    std::string name;
+    ValueType type;
+};
+
+/**
+ * A single value passed to or returned by TypedExpression::evaluate().
+ * Int and Bool values also fill d, so they can be bound to Double variables.
+ */
+struct TypedValue {
+    ValueType type = ValueType::Int;
+    std::int32_t i = 0;     // Int value, or 0/1 for Bool
+    double d = 0;           // Double value (and the converted Int or Bool value)
+
+    static TypedValue ofInt(std::int32_t value) { return {ValueType::Int, value, static_cast<double>(value)}; }
+    static TypedValue ofDouble(double value) { return {ValueType::Double, 0, value}; }
+    static TypedValue ofBool(bool value) { return {ValueType::Bool, value, value ? 1.0 : 0.0}; }
+};
+
+/**
+ * One input column for TypedExpression::evalBatch(): the values of one
+ * variable for every row, as std::int32_t or double.
+ */
+struct TypedColumn {
+    ValueType type;     // Int or Double
+    const void* data;   // const std::int32_t* or const double*
+
+    static TypedColumn ints(const std::int32_t* values) { return {ValueType::Int, values}; }
+    static TypedColumn doubles(const double* values) { return {ValueType::Double, values}; }
+};
+
+/**
+ * Opcodes of a typed program. The types of every operand are fixed at compile
+ * time, so each opcode names the exact operation (AddInt, AddDouble, ...) and
+ * neither the interpreter nor the batch kernels look at type tags while running.
+ */
+enum class TypedOp : std::uint8_t {
+    ConstInt,           // Push the operand as an Int
+    ConstDouble,        // Push constant <operand> of the double pool
+    LoadInt,            // Push Int variable slot <operand>
+    LoadDouble,         // Push Double variable slot <operand>
+
+    // Conversions of the top value
+    IntToDouble,
+    BoolToInt,
+    BoolToDouble,
+    IntToBool,          // x != 0
+    DoubleToBool,       // x != 0.0 (NaN is true)
+
+    // Int arithmetic, wrapping like eval(); division and modulo by zero throw
+    AddInt,
+    SubtractInt,
+    MultiplyInt,
+    DivideInt,
+    ModuloInt,
+    PowerInt,
+    NegateInt,
+
+    // Double arithmetic with IEEE 754 semantics (x / 0.0 is infinite or NaN)
+    AddDouble,
+    SubtractDouble,
+    MultiplyDouble,
+    DivideDouble,
+    ModuloDouble,       // std::fmod
+    PowerDouble,        // std::pow
+    NegateDouble,
+
+    // Fused multiply-add on the top three Double values [a, b, c], rounded once
+    MultiplyAdd,        // a * b + c
+    MultiplySubtract,   // a * b - c
+    AddMultiply,        // a + b * c
+    SubtractMultiply,   // a - b * c
+
+    // Comparisons (pop right, pop left, push Bool)
+    GreaterInt,
+    GreaterEqualInt,
+    LessInt,
+    LessEqualInt,
+    EqualInt,
+    NotEqualInt,
+    GreaterDouble,
+    GreaterEqualDouble,
+    LessDouble,
+    LessEqualDouble,
+    EqualDouble,
+    NotEqualDouble,
+
+    // Bool logic
+    Not,
+    And,                // Both operands evaluated (short circuit disabled)
+    Or,
+
+    // Short-circuit jumps on a Bool; operand is the target instruction index
+    JumpIfFalse,        // If top is false keep it as the result and jump, else pop it (&&)
+    JumpIfTrue          // If top is true keep it as the result and jump, else pop it (||)
+};
+
+/**
+ * A single typed instruction.
+ */
+struct TypedInstruction {
+    TypedOp op;
+    std::int32_t operand;   // Int constant, double pool index, slot or jump target
+    std::uint32_t offset;   // Position of the operator in the expression (for error messages)
+};
+
+/**
+ * A compiled expression over Int, Double and Bool values, produced by
+ * Evaluator::compileTyped().
+ *
+ * Types are inferred per node at compile time: literals with a '.' or an
+ * exponent are Double, arithmetic with a Double operand is Double, comparisons
+ * and logical operators are Bool, and Bool operands of arithmetic count as the
+ * Int 0 or 1. Conversions are explicit instructions, and a Double product
+ * feeding an addition or subtraction becomes one fused multiply-add (see
+ * Evaluator::setFusedMultiplyAdd()).
+ *
+ * evalBatch() represents Bool blocks as bitmasks, one bit per row, so the
+ * comparisons and logic of a filter touch 1/64 of the memory of an int per row,
+ * and evalBatchMask() hands that mask straight to the caller.
+ */
+class TypedExpression {
+public:
+    /**
+     * Number of value stack slots evaluate() keeps on the native stack.
+     */
+    static constexpr std::size_t kInlineStackSize = 64;
+
+    /**
+     * Number of rows evalBatch() processes per instruction (a multiple of 64,
+     * so a block's bitmask is a whole number of words).
+     */
+    static constexpr std::size_t kBatchBlockSize = 1024;
+
+    TypedExpression() = default;
+
+    /**
+     * Executes a program that has no variables.
+     *
+     * @return The result, of type resultType().
+     * @throws std::runtime_error on Int division or modulo by zero, or if the
+     *         expression uses variables.
+     *
+     * Time Complexity: O(k) where k is the number of instructions.
+     */
+    TypedValue evaluate() const;
+
+    /**
+     * Executes the program with variable slot i bound to values[i]. Int
+     * variables read values[i].i and Double variables values[i].d; types are
+     * not checked here (use the vector overload for that).
+     *
+     * @param values The variable values, at least variableCount() of them.
+     * @return The result, of type resultType().
+     * @throws std::runtime_error on Int division or modulo by zero.
+     *
+     * Time Complexity: O(k) where k is the number of instructions.
+     */
+    TypedValue evaluate(const TypedValue* values) const;
+
+    /**
+     * Executes the program after checking the number and types of the values.
+     *
+     * @param values The variable values, in slot order.
+     * @return The result, of type resultType().
+     * @throws std::runtime_error if values are missing, a Double is given for an
+     *         Int variable, or on Int division or modulo by zero.
+     *
+     * Time Complexity: O(k + v) where v is the number of variables.
+     */
+    TypedValue evaluate(const std::vector<TypedValue>& values) const;
+
+    /**
+     * Evaluates the program over columnar input, block by block, converting
+     * the result to double (Bool results become 0.0 or 1.0).
+     *
+     * @param columns columns[s] holds variable slot s for every row; its type
+     *        must match the variable's.
+     * @param rows Number of rows.
+     * @param out Receives the result for every row.
+     * @throws std::runtime_error on a column type mismatch, or on Int division or
+     *         modulo by zero, naming the first failing row.
+     *
+     * Time Complexity: O(k * rows) where k is the number of instructions.
+     */
+    void evalBatch(const TypedColumn* columns, std::size_t rows, double* out) const;
+
+    /**
+     * evalBatch() for Int and Bool results (Bool results become 0 or 1).
+     *
+     * @throws std::runtime_error if resultType() is Double, or as for the double overload.
+     */
+    void evalBatch(const TypedColumn* columns, std::size_t rows, std::int32_t* out) const;
+
+    /**
+     * Evaluates the program over columnar input and returns the truth of each
+     * row as a bitmask: bit (r % 64) of mask[r / 64] is set when row r is true
+     * (non-zero for Int and Double results). Bits past the last row are cleared.
+     *
+     * @param columns columns[s] holds variable slot s for every row.
+     * @param rows Number of rows.
+     * @param mask Receives (rows + 63) / 64 words.
+     * @throws std::runtime_error as for evalBatch().
+     *
+     * Time Complexity: O(k * rows) where k is the number of instructions.
+     */
+    void evalBatchMask(const TypedColumn* columns, std::size_t rows, std::uint64_t* mask) const;
+
+    /**
+     * @return The type of the expression's value.
+     */
+    ValueType resultType() const { return result; }
+
+    /**
+     * @return The variables, in slot order.
+     */
+    const std::vector<TypedVariable>& variables() const { return vars; }
+
+    /**
+     * @return The number of variable slots the program reads.
+     */
+    std::size_t variableCount() const { return vars.size(); }
+
+    /**
+     * @return The instruction stream of the program.
+     */
+    const std::vector<TypedInstruction>& instructions() const { return code; }
+
+    /**
+     * @return The maximum number of values live on the stack during evaluation.
+     */
+    std::size_t maxStackDepth() const { return stackDepth; }
+
+    /**
+     * @return The number of fused multiply-add instructions in the program.
+     */
+    std::size_t fusedOperations() const;
+
+    /**
+     * @return The expression text this program was compiled from.
+     */
+    const std::string& source() const { return text; }
+
+private:
+    friend class Evaluator;
+
+    /**
+     * Runs the program over blocks of rows and hands each block's result to sink.
+     *
+     * @param sink Called as sink(const void* block, start, n) with the result
+     *        block (std::int32_t, double or bitmask per resultType()).
+     */
+    template <typename Sink>
+    void runBatch(const TypedColumn* columns, std::size_t rows, Sink sink) const;
+
+    std::vector<TypedInstruction> code;     // Postfix instruction stream
+    std::vector<double> constants;          // Operands of ConstDouble
+    std::size_t stackDepth = 0;             // Required value stack size
+    ValueType result = ValueType::Int;      // Type of the final value
+    std::vector<TypedVariable> vars;        // Variables, indexed by slot
+    std::string text;                       // Original expression
+};
+
+#endif // TYPED_EXPRESSION_H
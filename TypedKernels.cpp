@@ -0,0 +1,440 @@
+#include "TypedKernels.h"
+#include <algorithm>
+#include <cmath>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define TYPED_HAVE_AVX2 1
+#endif
+
+namespace typed {
+
+namespace {
+
+// Builds the mask of n rows from a per-row predicate, 64 rows per word
+template <typename F>
+inline void maskLoop(std::uint64_t* mask, std::size_t n, F f) {
+    for (std::size_t base = 0; base < n; base += 64) {
+        std::size_t count = std::min<std::size_t>(64, n - base);
+        std::uint64_t bits = 0;
+        for (std::size_t j = 0; j < count; j++) {
+            bits |= static_cast<std::uint64_t>(f(base + j)) << j;
+        }
+        mask[base / 64] = bits;
+    }
+}
+
+template <typename F>
+inline void doubleLoop(const double* a, const double* b, double* out, std::size_t n, F f) {
+    for (std::size_t i = 0; i < n; i++) {
+        out[i] = f(a[i], b[i]);
+    }
+}
+
+template <typename F>
+inline void fusedLoop(const double* a, const double* b, const double* c, double* out, std::size_t n, F f) {
+    for (std::size_t i = 0; i < n; i++) {
+        out[i] = f(a[i], b[i], c[i]);
+    }
+}
+
+void applyDoubleScalar(TypedOp op, const double* a, const double* b, double* out, std::size_t n) {
+    switch (op) {
+    case TypedOp::AddDouble:      doubleLoop(a, b, out, n, [](double x, double y) { return x + y; }); break;
+    case TypedOp::SubtractDouble: doubleLoop(a, b, out, n, [](double x, double y) { return x - y; }); break;
+    case TypedOp::MultiplyDouble: doubleLoop(a, b, out, n, [](double x, double y) { return x * y; }); break;
+    case TypedOp::DivideDouble:   doubleLoop(a, b, out, n, [](double x, double y) { return x / y; }); break;
+    case TypedOp::ModuloDouble:   doubleLoop(a, b, out, n, [](double x, double y) { return std::fmod(x, y); }); break;
+    case TypedOp::PowerDouble:    doubleLoop(a, b, out, n, [](double x, double y) { return std::pow(x, y); }); break;
+    default:
+        break;
+    }
+}
+
+// std::fma rounds once, exactly like the vfmadd family, so both kernel sets agree
+void applyFusedScalar(TypedOp op, const double* a, const double* b, const double* c, double* out, std::size_t n) {
+    using D = double;
+
+    switch (op) {
+    case TypedOp::MultiplyAdd:      fusedLoop(a, b, c, out, n, [](D x, D y, D z) { return std::fma(x, y, z); }); break;
+    case TypedOp::MultiplySubtract: fusedLoop(a, b, c, out, n, [](D x, D y, D z) { return std::fma(x, y, -z); }); break;
+    case TypedOp::AddMultiply:      fusedLoop(a, b, c, out, n, [](D x, D y, D z) { return std::fma(y, z, x); }); break;
+    case TypedOp::SubtractMultiply: fusedLoop(a, b, c, out, n, [](D x, D y, D z) { return std::fma(-y, z, x); }); break;
+    default:
+        break;
+    }
+}
+
+void negateDoubleScalar(const double* a, double* out, std::size_t n) {
+    for (std::size_t i = 0; i < n; i++) {
+        out[i] = -a[i];
+    }
+}
+
+void compareDoubleScalar(TypedOp op, const double* a, const double* b, std::uint64_t* mask, std::size_t n) {
+    switch (op) {
+    case TypedOp::GreaterDouble:      maskLoop(mask, n, [&](std::size_t i) { return a[i] > b[i]; }); break;
+    case TypedOp::GreaterEqualDouble: maskLoop(mask, n, [&](std::size_t i) { return a[i] >= b[i]; }); break;
+    case TypedOp::LessDouble:         maskLoop(mask, n, [&](std::size_t i) { return a[i] < b[i]; }); break;
+    case TypedOp::LessEqualDouble:    maskLoop(mask, n, [&](std::size_t i) { return a[i] <= b[i]; }); break;
+    case TypedOp::EqualDouble:        maskLoop(mask, n, [&](std::size_t i) { return a[i] == b[i]; }); break;
+    case TypedOp::NotEqualDouble:     maskLoop(mask, n, [&](std::size_t i) { return a[i] != b[i]; }); break;
+    default:
+        break;
+    }
+}
+
+void compareIntScalar(TypedOp op, const std::int32_t* a, const std::int32_t* b, std::uint64_t* mask, std::size_t n) {
+    switch (op) {
+    case TypedOp::GreaterInt:      maskLoop(mask, n, [&](std::size_t i) { return a[i] > b[i]; }); break;
+    case TypedOp::GreaterEqualInt: maskLoop(mask, n, [&](std::size_t i) { return a[i] >= b[i]; }); break;
+    case TypedOp::LessInt:         maskLoop(mask, n, [&](std::size_t i) { return a[i] < b[i]; }); break;
+    case TypedOp::LessEqualInt:    maskLoop(mask, n, [&](std::size_t i) { return a[i] <= b[i]; }); break;
+    case TypedOp::EqualInt:        maskLoop(mask, n, [&](std::size_t i) { return a[i] == b[i]; }); break;
+    case TypedOp::NotEqualInt:     maskLoop(mask, n, [&](std::size_t i) { return a[i] != b[i]; }); break;
+    default:
+        break;
+    }
+}
+
+void intToDoubleScalar(const std::int32_t* a, double* out, std::size_t n) {
+    for (std::size_t i = 0; i < n; i++) {
+        out[i] = a[i];
+    }
+}
+
+void intToMaskScalar(const std::int32_t* a, std::uint64_t* mask, std::size_t n) {
+    maskLoop(mask, n, [&](std::size_t i) { return a[i] != 0; });
+}
+
+void doubleToMaskScalar(const double* a, std::uint64_t* mask, std::size_t n) {
+    maskLoop(mask, n, [&](std::size_t i) { return a[i] != 0.0; });
+}
+
+#ifdef TYPED_HAVE_AVX2
+
+// Everything up to the matching pop is compiled for AVX2 and FMA (lambdas
+// included) and only ever called after CPUID has confirmed support for both
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2,fma"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+
+// Applies f to 4 rows at a time; the tail goes to the scalar kernel
+template <typename F>
+inline void doubleLoopAvx2(TypedOp op, const double* a, const double* b, double* out, std::size_t n, F f) {
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(out + i, f(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+    applyDoubleScalar(op, a + i, b + i, out + i, n - i);
+}
+
+template <typename F>
+inline void fusedLoopAvx2(TypedOp op, const double* a, const double* b, const double* c, double* out,
+                          std::size_t n, F f) {
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(out + i, f(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), _mm256_loadu_pd(c + i)));
+    }
+    applyFusedScalar(op, a + i, b + i, c + i, out + i, n - i);
+}
+
+// Builds whole mask words from f, which returns the bits of 'step' rows starting
+// at a row index; returns the number of rows covered
+template <std::size_t Step, typename F>
+inline std::size_t maskLoopAvx2(std::uint64_t* mask, std::size_t n, F f) {
+    std::size_t words = n / 64;
+    for (std::size_t w = 0; w < words; w++) {
+        std::uint64_t bits = 0;
+        for (std::size_t k = 0; k < 64; k += Step) {
+            bits |= static_cast<std::uint64_t>(f(w * 64 + k)) << k;
+        }
+        mask[w] = bits;
+    }
+    return words * 64;
+}
+
+// The predicate of _mm256_cmp_pd must be a constant, hence the template
+template <int Predicate>
+void compareDoubleAvx2(TypedOp op, const double* a, const double* b, std::uint64_t* mask, std::size_t n) {
+    std::size_t done = maskLoopAvx2<4>(mask, n, [&](std::size_t i) {
+        return _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), Predicate));
+    });
+    compareDoubleScalar(op, a + done, b + done, mask + done / 64, n - done);
+}
+
+inline int lanes(__m256i m) {
+    return _mm256_movemask_ps(_mm256_castsi256_ps(m));
+}
+
+// f maps 8 left and right lanes to their 8 result bits
+template <typename F>
+void compareIntAvx2(TypedOp op, const std::int32_t* a, const std::int32_t* b, std::uint64_t* mask,
+                    std::size_t n, F f) {
+    std::size_t done = maskLoopAvx2<8>(mask, n, [&](std::size_t i) {
+        return f(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)),
+                 _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)));
+    });
+    compareIntScalar(op, a + done, b + done, mask + done / 64, n - done);
+}
+
+void applyDoubleAvx2(TypedOp op, const double* a, const double* b, double* out, std::size_t n) {
+    switch (op) {
+    case TypedOp::AddDouble:
+        doubleLoopAvx2(op, a, b, out, n, [&](__m256d x, __m256d y) { return _mm256_add_pd(x, y); });
+        break;
+    case TypedOp::SubtractDouble:
+        doubleLoopAvx2(op, a, b, out, n, [&](__m256d x, __m256d y) { return _mm256_sub_pd(x, y); });
+        break;
+    case TypedOp::MultiplyDouble:
+        doubleLoopAvx2(op, a, b, out, n, [&](__m256d x, __m256d y) { return _mm256_mul_pd(x, y); });
+        break;
+    case TypedOp::DivideDouble:
+        doubleLoopAvx2(op, a, b, out, n, [&](__m256d x, __m256d y) { return _mm256_div_pd(x, y); });
+        break;
+    default:
+        // No vector form (fmod, pow); use the scalar kernel
+        applyDoubleScalar(op, a, b, out, n);
+        break;
+    }
+}
+
+void applyFusedAvx2(TypedOp op, const double* a, const double* b, const double* c, double* out, std::size_t n) {
+    switch (op) {
+    case TypedOp::MultiplyAdd:
+        fusedLoopAvx2(op, a, b, c, out, n, [&](__m256d x, __m256d y, __m256d z) { return _mm256_fmadd_pd(x, y, z); });
+        break;
+    case TypedOp::MultiplySubtract:
+        fusedLoopAvx2(op, a, b, c, out, n, [&](__m256d x, __m256d y, __m256d z) { return _mm256_fmsub_pd(x, y, z); });
+        break;
+    case TypedOp::AddMultiply:
+        fusedLoopAvx2(op, a, b, c, out, n, [&](__m256d x, __m256d y, __m256d z) { return _mm256_fmadd_pd(y, z, x); });
+        break;
+    case TypedOp::SubtractMultiply:
+        fusedLoopAvx2(op, a, b, c, out, n, [&](__m256d x, __m256d y, __m256d z) { return _mm256_fnmadd_pd(y, z, x); });
+        break;
+    default:
+        break;
+    }
+}
+
+void negateDoubleAvx2(const double* a, double* out, std::size_t n) {
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(out + i, _mm256_xor_pd(_mm256_loadu_pd(a + i), sign));
+    }
+    negateDoubleScalar(a + i, out + i, n - i);
+}
+
+// Ordered predicates match C++ (false when either side is NaN), except != which is true for NaN
+void compareDoubleDispatchAvx2(TypedOp op, const double* a, const double* b, std::uint64_t* mask, std::size_t n) {
+    switch (op) {
+    case TypedOp::GreaterDouble:      compareDoubleAvx2<_CMP_GT_OQ>(op, a, b, mask, n); break;
+    case TypedOp::GreaterEqualDouble: compareDoubleAvx2<_CMP_GE_OQ>(op, a, b, mask, n); break;
+    case TypedOp::LessDouble:         compareDoubleAvx2<_CMP_LT_OQ>(op, a, b, mask, n); break;
+    case TypedOp::LessEqualDouble:    compareDoubleAvx2<_CMP_LE_OQ>(op, a, b, mask, n); break;
+    case TypedOp::EqualDouble:        compareDoubleAvx2<_CMP_EQ_OQ>(op, a, b, mask, n); break;
+    case TypedOp::NotEqualDouble:     compareDoubleAvx2<_CMP_NEQ_UQ>(op, a, b, mask, n); break;
+    default:
+        break;
+    }
+}
+
+// AVX2 only has signed > and ==; the other comparisons swap or invert them
+void compareIntDispatchAvx2(TypedOp op, const std::int32_t* a, const std::int32_t* b, std::uint64_t* mask,
+                            std::size_t n) {
+    switch (op) {
+    case TypedOp::GreaterInt:
+        compareIntAvx2(op, a, b, mask, n, [&](__m256i x, __m256i y) { return lanes(_mm256_cmpgt_epi32(x, y)); });
+        break;
+    case TypedOp::GreaterEqualInt:
+        compareIntAvx2(op, a, b, mask, n, [&](__m256i x, __m256i y) { return ~lanes(_mm256_cmpgt_epi32(y, x)) & 0xFF; });
+        break;
+    case TypedOp::LessInt:
+        compareIntAvx2(op, a, b, mask, n, [&](__m256i x, __m256i y) { return lanes(_mm256_cmpgt_epi32(y, x)); });
+        break;
+    case TypedOp::LessEqualInt:
+        compareIntAvx2(op, a, b, mask, n, [&](__m256i x, __m256i y) { return ~lanes(_mm256_cmpgt_epi32(x, y)) & 0xFF; });
+        break;
+    case TypedOp::EqualInt:
+        compareIntAvx2(op, a, b, mask, n, [&](__m256i x, __m256i y) { return lanes(_mm256_cmpeq_epi32(x, y)); });
+        break;
+    case TypedOp::NotEqualInt:
+        compareIntAvx2(op, a, b, mask, n, [&](__m256i x, __m256i y) { return ~lanes(_mm256_cmpeq_epi32(x, y)) & 0xFF; });
+        break;
+    default:
+        break;
+    }
+}
+
+void intToDoubleAvx2(const std::int32_t* a, double* out, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(out + i, _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i))));
+    }
+    intToDoubleScalar(a + i, out + i, n - i);
+}
+
+void intToMaskAvx2(const std::int32_t* a, std::uint64_t* mask, std::size_t n) {
+    const __m256i zero = _mm256_setzero_si256();
+    std::size_t done = maskLoopAvx2<8>(mask, n, [&](std::size_t i) {
+        return ~lanes(_mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)), zero)) & 0xFF;
+    });
+    intToMaskScalar(a + done, mask + done / 64, n - done);
+}
+
+void doubleToMaskAvx2(const double* a, std::uint64_t* mask, std::size_t n) {
+    const __m256d zero = _mm256_setzero_pd();
+    std::size_t done = maskLoopAvx2<4>(mask, n, [&](std::size_t i) {
+        return _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(a + i), zero, _CMP_NEQ_UQ));
+    });
+    doubleToMaskScalar(a + done, mask + done / 64, n - done);
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#endif // TYPED_HAVE_AVX2
+
+// The kernel set in use, chosen once from CPUID on first use
+struct KernelSet {
+    void (*applyDouble)(TypedOp, const double*, const double*, double*, std::size_t);
+    void (*applyFused)(TypedOp, const double*, const double*, const double*, double*, std::size_t);
+    void (*negateDouble)(const double*, double*, std::size_t);
+    void (*compareDouble)(TypedOp, const double*, const double*, std::uint64_t*, std::size_t);
+    void (*compareInt)(TypedOp, const std::int32_t*, const std::int32_t*, std::uint64_t*, std::size_t);
+    void (*intToDouble)(const std::int32_t*, double*, std::size_t);
+    void (*intToMask)(const std::int32_t*, std::uint64_t*, std::size_t);
+    void (*doubleToMask)(const double*, std::uint64_t*, std::size_t);
+    const char* name;
+};
+
+const KernelSet kScalarKernels = {
+    applyDoubleScalar, applyFusedScalar, negateDoubleScalar, compareDoubleScalar, compareIntScalar,
+    intToDoubleScalar, intToMaskScalar, doubleToMaskScalar, "scalar"
+};
+
+#ifdef TYPED_HAVE_AVX2
+const KernelSet kAvx2Kernels = {
+    applyDoubleAvx2, applyFusedAvx2, negateDoubleAvx2, compareDoubleDispatchAvx2, compareIntDispatchAvx2,
+    intToDoubleAvx2, intToMaskAvx2, doubleToMaskAvx2, "avx2+fma"
+};
+#endif
+
+const KernelSet* detectKernels() {
+#ifdef TYPED_HAVE_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return &kAvx2Kernels;
+    }
+#endif
+    return &kScalarKernels;
+}
+
+const KernelSet* bestKernels() {
+    static const KernelSet* best = detectKernels();
+    return best;
+}
+
+const KernelSet* activeKernels = bestKernels();
+
+// Clears the bits past row n in the last word of a mask
+inline void clearTail(std::uint64_t* mask, std::size_t n) {
+    if (n % 64 != 0) {
+        mask[n / 64] &= (std::uint64_t(1) << (n % 64)) - 1;
+    }
+}
+
+} // namespace
+
+void applyDouble(TypedOp op, const double* a, const double* b, double* out, std::size_t n) {
+    activeKernels->applyDouble(op, a, b, out, n);
+}
+
+void applyFused(TypedOp op, const double* a, const double* b, const double* c, double* out, std::size_t n) {
+    activeKernels->applyFused(op, a, b, c, out, n);
+}
+
+void negateDouble(const double* a, double* out, std::size_t n) {
+    activeKernels->negateDouble(a, out, n);
+}
+
+void compareDouble(TypedOp op, const double* a, const double* b, std::uint64_t* mask, std::size_t n) {
+    activeKernels->compareDouble(op, a, b, mask, n);
+}
+
+void compareInt(TypedOp op, const std::int32_t* a, const std::int32_t* b, std::uint64_t* mask, std::size_t n) {
+    activeKernels->compareInt(op, a, b, mask, n);
+}
+
+void intToDouble(const std::int32_t* a, double* out, std::size_t n) {
+    activeKernels->intToDouble(a, out, n);
+}
+
+void intToMask(const std::int32_t* a, std::uint64_t* mask, std::size_t n) {
+    activeKernels->intToMask(a, mask, n);
+}
+
+void doubleToMask(const double* a, std::uint64_t* mask, std::size_t n) {
+    activeKernels->doubleToMask(a, mask, n);
+}
+
+void maskToInt(const std::uint64_t* mask, std::int32_t* out, std::size_t n) {
+    for (std::size_t i = 0; i < n; i++) {
+        out[i] = static_cast<std::int32_t>((mask[i / 64] >> (i % 64)) & 1);
+    }
+}
+
+void maskToDouble(const std::uint64_t* mask, double* out, std::size_t n) {
+    for (std::size_t i = 0; i < n; i++) {
+        out[i] = static_cast<double>((mask[i / 64] >> (i % 64)) & 1);
+    }
+}
+
+void andMask(const std::uint64_t* a, const std::uint64_t* b, std::uint64_t* out, std::size_t n) {
+    for (std::size_t w = 0; w < maskWords(n); w++) {
+        out[w] = a[w] & b[w];
+    }
+}
+
+void orMask(const std::uint64_t* a, const std::uint64_t* b, std::uint64_t* out, std::size_t n) {
+    for (std::size_t w = 0; w < maskWords(n); w++) {
+        out[w] = a[w] | b[w];
+    }
+}
+
+void notMask(const std::uint64_t* a, std::uint64_t* out, std::size_t n) {
+    for (std::size_t w = 0; w < maskWords(n); w++) {
+        out[w] = ~a[w];
+    }
+    clearTail(out, n);
+}
+
+std::size_t countMask(const std::uint64_t* mask, std::size_t n) {
+    std::size_t count = 0;
+    for (std::size_t w = 0; w < maskWords(n); w++) {
+        count += static_cast<std::size_t>(__builtin_popcountll(mask[w]));
+    }
+    return count;
+}
+
+bool simdAvailable() {
+    return bestKernels() != &kScalarKernels;
+}
+
+void setSimdEnabled(bool enabled) {
+    activeKernels = enabled ? bestKernels() : &kScalarKernels;
+}
+
+const char* kernelName() {
+    return activeKernels->name;
+}
+
+} // namespace typed
@@ -0,0 +1,109 @@
+#ifndef TYPED_KERNELS_H
+#define TYPED_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include "TypedExpression.h"
+
+/**
+ * Block-at-a-time kernels for the Double and Bool instructions of a
+ * TypedExpression; Int arithmetic reuses the batch:: kernels.
+ *
+ * Bool blocks are bitmasks: row i is bit (i % 64) of word i / 64, and bits past
+ * the last row are always zero. On CPUs with AVX2 and FMA (detected at runtime)
+ * the kernels process 4 doubles or 8 ints per instruction and build masks with
+ * vector compares and movemask; otherwise plain loops are used. Both produce
+ * bit-identical results. Output may alias an input of the same type.
+ */
+namespace typed {
+
+/**
+ * @return The number of mask words covering n rows.
+ */
+inline std::size_t maskWords(std::size_t n) {
+    return (n + 63) / 64;
+}
+
+/**
+ * Applies AddDouble ... PowerDouble row by row: out[i] = a[i] op b[i].
+ *
+ * Time Complexity: O(n).
+ */
+void applyDouble(TypedOp op, const double* a, const double* b, double* out, std::size_t n);
+
+/**
+ * Applies a fused multiply-add opcode to the stack operands a, b, c.
+ *
+ * Time Complexity: O(n).
+ */
+void applyFused(TypedOp op, const double* a, const double* b, const double* c, double* out, std::size_t n);
+
+/**
+ * out[i] = -a[i].
+ *
+ * Time Complexity: O(n).
+ */
+void negateDouble(const double* a, double* out, std::size_t n);
+
+/**
+ * Compares two Double blocks (GreaterDouble ... NotEqualDouble) into a mask.
+ *
+ * Time Complexity: O(n).
+ */
+void compareDouble(TypedOp op, const double* a, const double* b, std::uint64_t* mask, std::size_t n);
+
+/**
+ * Compares two Int blocks (GreaterInt ... NotEqualInt) into a mask.
+ *
+ * Time Complexity: O(n).
+ */
+void compareInt(TypedOp op, const std::int32_t* a, const std::int32_t* b, std::uint64_t* mask, std::size_t n);
+
+/**
+ * Conversions between Int, Double and Bool blocks.
+ *
+ * Time Complexity: O(n).
+ */
+void intToDouble(const std::int32_t* a, double* out, std::size_t n);
+void intToMask(const std::int32_t* a, std::uint64_t* mask, std::size_t n);
+void doubleToMask(const double* a, std::uint64_t* mask, std::size_t n);
+void maskToInt(const std::uint64_t* mask, std::int32_t* out, std::size_t n);
+void maskToDouble(const std::uint64_t* mask, double* out, std::size_t n);
+
+/**
+ * Word-wise logic on masks of n rows.
+ *
+ * Time Complexity: O(n / 64).
+ */
+void andMask(const std::uint64_t* a, const std::uint64_t* b, std::uint64_t* out, std::size_t n);
+void orMask(const std::uint64_t* a, const std::uint64_t* b, std::uint64_t* out, std::size_t n);
+void notMask(const std::uint64_t* a, std::uint64_t* out, std::size_t n);
+
+/**
+ * @return The number of set bits among the first n rows.
+ *
+ * Time Complexity: O(n / 64).
+ */
+std::size_t countMask(const std::uint64_t* mask, std::size_t n);
+
+/**
+ * @return True if this CPU supports the AVX2/FMA kernels.
+ */
+bool simdAvailable();
+
+/**
+ * Switches between the best kernels for this CPU and the scalar fallback.
+ * Not thread-safe; intended for benchmarks and tests run before evaluating.
+ *
+ * @param enabled False to force the scalar kernels.
+ */
+void setSimdEnabled(bool enabled);
+
+/**
+ * @return The name of the kernel set in use ("avx2+fma" or "scalar").
+ */
+const char* kernelName();
+
+} // namespace typed
+
+#endif // TYPED_KERNELS_H
@@ -0,0 +1,2033 @@
+#include "Evaluator.h"
+#include "BatchKernels.h"
+#include "DependencyGraph.h"
+#include "EvalServer.h"
+#include "ExpressionCache.h"
+#include "Jit.h"
+#include "ParallelEvaluator.h"
+#include "PredicateIndex.h"
+#include "Profiler.h"
+#include "RuleSet.h"
+#include "ProgramFile.h"
+#include "Scanner.h"
+#include "StaticExpression.h"
+#include "StreamEvaluator.h"
+#include "TypedKernels.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Benchmarks for the Evaluator class.
+ *
+ * Usage: benchmark [section [args...]]
+ * Runs every section when no section name is given.
+ */
+
+// Every heap allocation in the process is counted, so sections can report allocations per call.
+// The replacements must not be inlined: GCC would then see memory from operator new reach free().
+static std::atomic<std::uint64_t> gAllocations{0};
+
+#if defined(__GNUC__)
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+
+BENCH_NOINLINE void* operator new(std::size_t size) {
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+BENCH_NOINLINE void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+BENCH_NOINLINE void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+BENCH_NOINLINE void operator delete[](void* memory) noexcept {
+    std::free(memory);
+}
+
+BENCH_NOINLINE void operator delete(void* memory, std::size_t) noexcept {
+    operator delete(memory);
+}
+
+BENCH_NOINLINE void operator delete[](void* memory, std::size_t) noexcept {
+    operator delete[](memory);
+}
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Keeps the optimizer from discarding results we never print
+volatile int sink;
+
+// Set by a section whose check failed; main() then exits with status 1
+bool gFailed = false;
+
+/**
+ * Runs fn repeatedly for roughly the given duration and returns calls per second.
+ *
+ * Time Complexity: O(k) where k is the number of calls that fit in the duration.
+ */
+template <typename Fn>
+double callsPerSecond(Fn fn, double seconds = 0.25) {
+    size_t calls = 0;
+    size_t batch = 1;
+    auto start = Clock::now();
+    double elapsed = 0;
+
+    while (elapsed < seconds) {
+        for (size_t i = 0; i < batch; i++) {
+            sink = fn();
+        }
+        calls += batch;
+        batch *= 2;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    return calls / elapsed;
+}
+
+// The valid expressions demonstrated in main.cpp
+const std::vector<std::string> kMainExpressions = {
+    "1+2*3",
+    "2+2^2*3",
+    "1==2",
+    "1+3 > 2",
+    "(4>=4) && 0",
+    "(1+2)*3"
+};
+
+/**
+ * Compares eval() against evaluating a program produced once by compile().
+ */
+void benchCompile(const std::vector<std::string>&) {
+    Evaluator evaluator;
+
+    std::cout << "=== eval() vs. compile() + evaluate() ===" << std::endl << std::endl;
+    std::cout << std::left << std::setw(20) << "Expression"
+              << std::right << std::setw(16) << "eval/s"
+              << std::setw(16) << "compiled/s"
+              << std::setw(10) << "speedup" << std::endl;
+    std::cout << std::string(62, '-') << std::endl;
+
+    for (const auto& expr : kMainExpressions) {
+        CompiledExpression program = evaluator.compile(expr);
+
+        double interpreted = callsPerSecond([&] { return evaluator.eval(expr); });
+        double compiled = callsPerSecond([&] { return program.evaluate(); });
+
+        std::cout << std::left << std::setw(20) << expr << std::right << std::fixed
+                  << std::setprecision(0) << std::setw(16) << interpreted
+                  << std::setw(16) << compiled
+                  << std::setprecision(1) << std::setw(9) << compiled / interpreted << "x"
+                  << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+/**
+ * Measures the per-request pattern: construct an Evaluator, evaluate one expression.
+ */
+void benchConstruct(const std::vector<std::string>&) {
+    std::cout << "=== Evaluator per request ===" << std::endl << std::endl;
+    std::cout << std::left << std::setw(20) << "Expression"
+              << std::right << std::setw(16) << "shared/s"
+              << std::setw(16) << "per-request/s" << std::endl;
+    std::cout << std::string(52, '-') << std::endl;
+
+    Evaluator shared;
+    for (const auto& expr : kMainExpressions) {
+        double reused = callsPerSecond([&] { return shared.eval(expr); });
+        double fresh = callsPerSecond([&] {
+            Evaluator evaluator;
+            return evaluator.eval(expr);
+        });
+
+        std::cout << std::left << std::setw(20) << expr << std::right << std::fixed
+                  << std::setprecision(0) << std::setw(16) << reused << std::setw(16) << fresh << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+/**
+ * Compares evalBatch() against calling evaluate() once per row.
+ * Row counts default to 1M and 10M; pass e.g. "batch 100000000" for larger runs.
+ */
+void benchBatch(const std::vector<std::string>& args) {
+    std::vector<size_t> rowCounts = {1000000, 10000000};
+    if (!args.empty()) {
+        rowCounts.clear();
+        for (const auto& arg : args) {
+            rowCounts.push_back(std::stoull(arg));
+        }
+    }
+
+    Evaluator evaluator;
+    const std::string expr = "price * qty - discount > limit && qty != 0";
+    CompiledExpression program = evaluator.compile(expr, {"price", "qty", "discount", "limit"});
+
+    std::cout << "=== evalBatch() vs. per-row evaluate() ===" << std::endl;
+    std::cout << "Expression: " << expr << std::endl << std::endl;
+    std::cout << std::left << std::setw(14) << "Rows"
+              << std::right << std::setw(16) << "per-row rows/s"
+              << std::setw(16) << "batch rows/s"
+              << std::setw(10) << "speedup" << std::endl;
+    std::cout << std::string(56, '-') << std::endl;
+
+    for (size_t rows : rowCounts) {
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<int> dist(0, 1000);
+
+        std::vector<std::vector<std::int32_t>> data(4, std::vector<std::int32_t>(rows));
+        for (auto& column : data) {
+            for (auto& value : column) {
+                value = dist(rng);
+            }
+        }
+        const std::int32_t* columns[4] = {data[0].data(), data[1].data(), data[2].data(), data[3].data()};
+        std::vector<std::int32_t> perRow(rows), batched(rows);
+
+        auto start = Clock::now();
+        for (size_t r = 0; r < rows; r++) {
+            int record[4] = {columns[0][r], columns[1][r], columns[2][r], columns[3][r]};
+            perRow[r] = program.evaluate(record);
+        }
+        double perRowSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        start = Clock::now();
+        program.evalBatch(columns, rows, batched.data());
+        double batchSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        if (perRow != batched) {
+            std::cerr << "Mismatch between per-row and batch results" << std::endl;
+        }
+
+        std::cout << std::left << std::setw(14) << rows << std::right << std::fixed
+                  << std::setprecision(0) << std::setw(16) << rows / perRowSeconds
+                  << std::setw(16) << rows / batchSeconds
+                  << std::setprecision(1) << std::setw(9) << perRowSeconds / batchSeconds << "x"
+                  << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+/**
+ * Compares the scalar and SIMD batch kernels, one operator at a time and on a
+ * whole expression. Reports only scalar numbers on CPUs without AVX2.
+ */
+void benchSimd(const std::vector<std::string>&) {
+    const size_t rows = CompiledExpression::kBatchBlockSize;
+    const size_t passes = 20000;
+
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> dist(-1000, 1000);
+    std::vector<std::int32_t> a(rows), b(rows), out(rows);
+    for (size_t i = 0; i < rows; i++) {
+        a[i] = dist(rng);
+        b[i] = dist(rng) | 1;  // Never zero, so Divide/Modulo run to completion
+    }
+
+    struct Kernel {
+        const char* name;
+        OpCode op;
+        bool binary;
+    };
+    const Kernel kernels[] = {
+        {"+", OpCode::Add, true}, {"b-", OpCode::Subtract, true}, {"*", OpCode::Multiply, true},
+        {"/", OpCode::Divide, true}, {"%", OpCode::Modulo, true},
+        {">", OpCode::Greater, true}, {">=", OpCode::GreaterEqual, true},
+        {"<", OpCode::Less, true}, {"<=", OpCode::LessEqual, true},
+        {"==", OpCode::Equal, true}, {"!=", OpCode::NotEqual, true},
+        {"&&", OpCode::LogicalAnd, true}, {"||", OpCode::LogicalOr, true},
+        {"!", OpCode::LogicalNot, false}, {"++", OpCode::Increment, false},
+        {"--", OpCode::Decrement, false}, {"u-", OpCode::Negate, false},
+        {"bool", OpCode::ToBool, false},
+    };
+
+    // Rows per second for one kernel with the currently selected kernel set
+    auto measure = [&](const Kernel& kernel) {
+        auto start = Clock::now();
+        for (size_t p = 0; p < passes; p++) {
+            if (kernel.binary) {
+                batch::applyBinary(kernel.op, a.data(), b.data(), out.data(), rows);
+            }
+            else {
+                batch::applyUnary(kernel.op, a.data(), out.data(), rows);
+            }
+            sink = out[p % rows];
+        }
+        return rows * passes / std::chrono::duration<double>(Clock::now() - start).count();
+    };
+
+    bool simd = batch::simdAvailable();
+    std::cout << "=== Batch kernels: scalar vs. SIMD (" << (simd ? "avx2" : "not available") << ") ==="
+              << std::endl << std::endl;
+    std::cout << std::left << std::setw(12) << "Operator"
+              << std::right << std::setw(16) << "scalar rows/s"
+              << std::setw(16) << "simd rows/s"
+              << std::setw(10) << "speedup" << std::endl;
+    std::cout << std::string(54, '-') << std::endl;
+
+    for (const Kernel& kernel : kernels) {
+        batch::setSimdEnabled(false);
+        double scalar = measure(kernel);
+        batch::setSimdEnabled(true);
+        double vector = simd ? measure(kernel) : scalar;
+
+        std::cout << std::left << std::setw(12) << kernel.name << std::right << std::fixed
+                  << std::setprecision(0) << std::setw(16) << scalar << std::setw(16) << vector
+                  << std::setprecision(1) << std::setw(9) << vector / scalar << "x" << std::endl;
+    }
+
+    // Whole expression through evalBatch()
+    Evaluator evaluator;
+    CompiledExpression program = evaluator.compile("price * qty - discount > limit && qty != 0",
+                                                   {"price", "qty", "discount", "limit"});
+    const size_t exprRows = 4000000;
+    std::vector<std::vector<std::int32_t>> data(4, std::vector<std::int32_t>(exprRows));
+    for (auto& column : data) {
+        for (auto& value : column) {
+            value = dist(rng);
+        }
+    }
+    const std::int32_t* columns[4] = {data[0].data(), data[1].data(), data[2].data(), data[3].data()};
+    std::vector<std::int32_t> results(exprRows);
+
+    auto timeBatch = [&] {
+        auto start = Clock::now();
+        program.evalBatch(columns, exprRows, results.data());
+        return exprRows / std::chrono::duration<double>(Clock::now() - start).count();
+    };
+
+    batch::setSimdEnabled(false);
+    double scalar = timeBatch();
+    batch::setSimdEnabled(true);
+    double vector = timeBatch();
+
+    std::cout << std::left << std::setw(12) << "expression" << std::right << std::fixed
+              << std::setprecision(0) << std::setw(16) << scalar << std::setw(16) << vector
+              << std::setprecision(1) << std::setw(9) << vector / scalar << "x" << std::endl;
+    std::cout << std::endl;
+}
+
+/**
+ * Shows how constant folding shrinks programs and speeds up evaluation.
+ */
+void benchFold(const std::vector<std::string>&) {
+    const std::vector<std::string> expressions = {
+        "2^10 * x",
+        "!(0) && y",
+        "(4>=4) && flag",
+        "+++2-5*(3^2)",
+        "x*1 + 0 - (y - y*1)",
+        "++ ++ ++x - 3",
+        "(1+2)*3 + x"
+    };
+
+    std::cout << "=== Constant folding ===" << std::endl << std::endl;
+    std::cout << std::left << std::setw(24) << "Expression"
+              << std::right << std::setw(8) << "instr"
+              << std::setw(8) << "folded"
+              << std::setw(16) << "plain/s"
+              << std::setw(16) << "folded/s" << std::endl;
+    std::cout << std::string(72, '-') << std::endl;
+
+    Evaluator evaluator;
+    const int values[] = {3, 5, 1};
+    for (const auto& expr : expressions) {
+        evaluator.setConstantFolding(false);
+        CompiledExpression plain = evaluator.compile(expr);
+        evaluator.setConstantFolding(true);
+        CompiledExpression folded = evaluator.compile(expr);
+
+        double plainRate = callsPerSecond([&] { return plain.evaluate(values); });
+        double foldedRate = callsPerSecond([&] { return folded.evaluate(values); });
+
+        std::cout << std::left << std::setw(24) << expr << std::right
+                  << std::setw(8) << plain.instructions().size()
+                  << std::setw(8) << folded.instructions().size() << std::fixed << std::setprecision(0)
+                  << std::setw(16) << plainRate << std::setw(16) << foldedRate << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+/**
+ * Selectivity sweep for short-circuit && / ||: the left operand "sel < T" is true
+ * for T% of the rows, so the expensive right operand is skipped for the rest.
+ * Compares strict evaluation (both operands always run) with conditional jumps,
+ * per row and in batches, for random and clustered row orders.
+ *
+ * Args: [rows] (default 2000000)
+ */
+void benchShortCircuit(const std::vector<std::string>& args) {
+    const size_t rows = args.empty() ? 2000000 : std::stoul(args[0]);
+    const std::vector<std::string> variables = {"sel", "a", "b", "c", "d"};
+    const std::string expensive = "(a * b + c) / d % 97 > (a - c) * (b + d) / 7 + (a % d) * (c % d)";
+
+    std::mt19937 rng(11);
+    std::uniform_int_distribution<int> dist(-1000, 1000);
+    std::uniform_int_distribution<int> percent(0, 99);
+    std::vector<std::vector<std::int32_t>> data(variables.size(), std::vector<std::int32_t>(rows));
+    for (size_t i = 0; i < rows; i++) {
+        data[0][i] = percent(rng);
+        for (size_t v = 1; v < variables.size(); v++) {
+            data[v][i] = dist(rng) | 1;  // Never zero, so strict evaluation cannot fail
+        }
+    }
+    std::vector<std::int32_t> sorted = data[0];
+    std::sort(sorted.begin(), sorted.end());
+
+    std::vector<const std::int32_t*> columns(variables.size());
+    for (size_t v = 0; v < variables.size(); v++) {
+        columns[v] = data[v].data();
+    }
+    std::vector<std::int32_t> results(rows);
+
+    auto batchRate = [&](const CompiledExpression& program, BatchStats* stats) {
+        auto start = Clock::now();
+        program.evalBatch(columns.data(), rows, results.data(), stats);
+        return rows / std::chrono::duration<double>(Clock::now() - start).count();
+    };
+
+    // Per-row evaluation cycles through the first rows; enough to cover every selectivity
+    const size_t sampleRows = std::min<size_t>(rows, 4096);
+    std::vector<std::vector<int>> records(sampleRows, std::vector<int>(variables.size()));
+    auto rowRate = [&](const CompiledExpression& program) {
+        for (size_t i = 0; i < sampleRows; i++) {
+            for (size_t v = 0; v < variables.size(); v++) {
+                records[i][v] = columns[v][i];
+            }
+        }
+        size_t row = 0;
+        return callsPerSecond([&] {
+            row = row + 1 == sampleRows ? 0 : row + 1;
+            return program.evaluate(records[row].data());
+        });
+    };
+
+    std::cout << "=== Short-circuit && / || (" << rows << " rows, " << batch::kernelName() << ") ==="
+              << std::endl << std::endl;
+    std::cout << "Right operand: " << expensive << std::endl << std::endl;
+    std::cout << std::left << std::setw(14) << "Expression"
+              << std::setw(11) << "order"
+              << std::right << std::setw(9) << "skip"
+              << std::setw(12) << "blk skip"
+              << std::setw(14) << "strict/s"
+              << std::setw(14) << "jump/s"
+              << std::setw(15) << "strict rows/s"
+              << std::setw(15) << "jump rows/s" << std::endl;
+    std::cout << std::string(104, '-') << std::endl;
+
+    Evaluator evaluator;
+    for (const char* op : {"&&", "||"}) {
+        for (int threshold : {0, 1, 10, 50, 90, 99, 100}) {
+            std::string expr = "sel < " + std::to_string(threshold) + " " + op + " " + expensive;
+            evaluator.setShortCircuit(false);
+            CompiledExpression strict = evaluator.compile(expr, variables);
+            evaluator.setShortCircuit(true);
+            CompiledExpression jumps = evaluator.compile(expr, variables);
+
+            for (bool clustered : {false, true}) {
+                columns[0] = clustered ? sorted.data() : data[0].data();
+
+                BatchStats stats;
+                double strictBatch = batchRate(strict, nullptr);
+                double jumpBatch = batchRate(jumps, &stats);
+                double strictRows = clustered ? 0 : rowRate(strict);
+                double jumpRows = clustered ? 0 : rowRate(jumps);
+
+                std::cout << std::left << std::setw(14) << ("sel<" + std::to_string(threshold) + " " + op)
+                          << std::setw(11) << (clustered ? "clustered" : "random")
+                          << std::right << std::fixed << std::setprecision(1)
+                          << std::setw(8) << 100.0 * stats.rowsSkipped / stats.rowsChecked << "%"
+                          << std::setw(11) << 100.0 * stats.shortCircuitSkips / stats.shortCircuitChecks << "%"
+                          << std::setprecision(0);
+                if (clustered) {
+                    std::cout << std::setw(14) << "-" << std::setw(14) << "-";
+                }
+                else {
+                    std::cout << std::setw(14) << strictRows << std::setw(14) << jumpRows;
+                }
+                std::cout << std::setw(15) << strictBatch << std::setw(15) << jumpBatch << std::endl;
+            }
+        }
+    }
+    std::cout << std::endl;
+
+    // The guard itself: rows with d == 0 never reach the division
+    std::vector<std::int32_t> n(rows), d(rows);
+    for (size_t i = 0; i < rows; i++) {
+        n[i] = dist(rng);
+        d[i] = i % 4 == 0 ? 0 : dist(rng);
+    }
+    const std::int32_t* guardColumns[2] = {n.data(), d.data()};
+    CompiledExpression guard = evaluator.compile("d != 0 && n / d > 3", {"n", "d"});
+    guard.evalBatch(guardColumns, rows, results.data());
+    std::cout << "d != 0 && n / d > 3 over " << rows << " rows (25% zero divisors): "
+              << std::count(results.begin(), results.end(), 1) << " matches, no errors" << std::endl
+              << std::endl;
+}
+
+/**
+ * Many threads evaluating a few thousand distinct rules: compiling on every
+ * call versus looking the program up in a shared ExpressionCache, with a cache
+ * large enough for every rule and one that has to evict.
+ *
+ * Args: [threads] (default: hardware concurrency)
+ */
+void benchCache(const std::vector<std::string>& args) {
+    const unsigned threads = args.empty() ? std::max(1u, std::thread::hardware_concurrency())
+                                          : static_cast<unsigned>(std::stoul(args[0]));
+    const size_t ruleCount = 3000;
+    const size_t lookupsPerThread = 200000;
+
+    std::vector<std::string> rules;
+    for (size_t i = 0; i < ruleCount; i++) {
+        rules.push_back("x * " + std::to_string(i % 97 + 1) + " + y > " + std::to_string(i) +
+                        " && y % " + std::to_string(i % 13 + 2) + " != 0");
+    }
+    const std::vector<std::string> variables = {"x", "y"};
+
+    // Runs fn(thread, lookup) on every thread and returns lookups per second
+    auto run = [&](auto fn) {
+        auto start = Clock::now();
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; t++) {
+            workers.emplace_back([&, t] {
+                std::mt19937 rng(t);
+                std::uniform_int_distribution<size_t> pick(0, ruleCount - 1);
+                int total = 0;
+                for (size_t i = 0; i < lookupsPerThread; i++) {
+                    const int values[] = {static_cast<int>(i % 100), static_cast<int>(i % 37)};
+                    total += fn(rules[pick(rng)], values);
+                }
+                sink = total;
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        return threads * lookupsPerThread / std::chrono::duration<double>(Clock::now() - start).count();
+    };
+
+    std::cout << "=== Expression cache (" << threads << " threads, " << ruleCount << " rules) ==="
+              << std::endl << std::endl;
+    std::cout << std::left << std::setw(24) << "Mode"
+              << std::right << std::setw(16) << "lookups/s"
+              << std::setw(12) << "hits"
+              << std::setw(10) << "misses"
+              << std::setw(12) << "evictions" << std::endl;
+    std::cout << std::string(74, '-') << std::endl;
+
+    const Evaluator evaluator;
+    double compileRate = run([&](const std::string& rule, const int* values) {
+        return evaluator.compile(rule, variables).evaluate(values);
+    });
+    std::cout << std::left << std::setw(24) << "compile every call" << std::right << std::fixed
+              << std::setprecision(0) << std::setw(16) << compileRate << std::endl;
+
+    for (size_t capacity : {size_t(4096), size_t(1024)}) {
+        ExpressionCache cache(capacity);
+        double rate = run([&](const std::string& rule, const int* values) {
+            return cache.get(rule, variables)->evaluate(values);
+        });
+        CacheStats stats = cache.stats();
+        std::cout << std::left << std::setw(24) << ("cache, capacity " + std::to_string(capacity))
+                  << std::right << std::setw(16) << rate << std::setw(12) << stats.hits
+                  << std::setw(10) << stats.misses << std::setw(12) << stats.evictions << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+/**
+ * Scaling of ParallelEvaluator from one thread to every hardware thread, for a
+ * single expression and for a list of expressions sharing the input columns.
+ * Also checks that results and the reported error do not depend on the thread count.
+ *
+ * Args: [rows] (default 20000000)
+ */
+void benchParallel(const std::vector<std::string>& args) {
+    const size_t rows = args.empty() ? 20000000 : std::stoul(args[0]);
+    const unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+    const std::vector<std::string> variables = {"price", "qty", "discount", "limit"};
+
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<int> dist(-1000, 1000);
+    std::vector<std::vector<std::int32_t>> data(variables.size(), std::vector<std::int32_t>(rows));
+    for (auto& column : data) {
+        for (auto& value : column) {
+            value = dist(rng) | 1;
+        }
+    }
+    std::vector<const std::int32_t*> columns;
+    for (const auto& column : data) {
+        columns.push_back(column.data());
+    }
+
+    Evaluator evaluator;
+    std::vector<CompiledExpression> programs = {
+        evaluator.compile("price * qty - discount > limit && qty != 0", variables),
+        evaluator.compile("(price + discount) % 7 == qty % 7 || limit < -900", variables),
+        evaluator.compile("price / qty + discount / limit", variables),
+    };
+    std::vector<const CompiledExpression*> programList;
+    for (const auto& program : programs) {
+        programList.push_back(&program);
+    }
+
+    std::vector<std::vector<std::int32_t>> results(programs.size(), std::vector<std::int32_t>(rows));
+    std::vector<std::int32_t*> outs;
+    for (auto& result : results) {
+        outs.push_back(result.data());
+    }
+
+    // Single-threaded reference results
+    std::vector<std::vector<std::int32_t>> expected(programs.size(), std::vector<std::int32_t>(rows));
+    for (size_t p = 0; p < programs.size(); p++) {
+        programs[p].evalBatch(columns.data(), rows, expected[p].data());
+    }
+
+    std::cout << "=== Parallel batch evaluation (" << rows << " rows, " << hardware << " hardware threads, "
+              << batch::kernelName() << ") ===" << std::endl << std::endl;
+    std::cout << std::left << std::setw(10) << "Threads"
+              << std::right << std::setw(16) << "1 expr rows/s"
+              << std::setw(10) << "speedup"
+              << std::setw(16) << "3 expr rows/s"
+              << std::setw(10) << "speedup"
+              << std::setw(12) << "identical" << std::endl;
+    std::cout << std::string(74, '-') << std::endl;
+
+    std::vector<unsigned> threadCounts;
+    for (unsigned t = 1; t < hardware; t *= 2) {
+        threadCounts.push_back(t);
+    }
+    threadCounts.push_back(hardware);
+
+    double single = 0, multi = 0;
+    for (unsigned threads : threadCounts) {
+        ParallelEvaluator parallel(threads);
+
+        auto start = Clock::now();
+        parallel.evalBatch(programs[0], columns.data(), rows, outs[0]);
+        double oneRate = rows / std::chrono::duration<double>(Clock::now() - start).count();
+
+        start = Clock::now();
+        parallel.evalBatch(programList, columns.data(), rows, outs.data());
+        double allRate = rows / std::chrono::duration<double>(Clock::now() - start).count();
+
+        if (threads == 1) {
+            single = oneRate;
+            multi = allRate;
+        }
+
+        std::cout << std::left << std::setw(10) << threads << std::right << std::fixed
+                  << std::setprecision(0) << std::setw(16) << oneRate
+                  << std::setprecision(2) << std::setw(9) << oneRate / single << "x"
+                  << std::setprecision(0) << std::setw(16) << allRate
+                  << std::setprecision(2) << std::setw(9) << allRate / multi << "x"
+                  << std::setw(12) << (results == expected ? "yes" : "NO") << std::endl;
+    }
+    std::cout << std::endl;
+
+    // Zero divisors scattered through the input: every thread count must report the same row
+    std::vector<std::int32_t> divisors(data[1]);
+    for (size_t i = rows / 3; i < rows; i += rows / 7 + 1) {
+        divisors[i] = 0;
+    }
+    const std::int32_t* errorColumns[4] = {data[0].data(), divisors.data(), data[2].data(), data[3].data()};
+    for (unsigned threads : {1u, hardware}) {
+        ParallelEvaluator parallel(threads);
+        try {
+            parallel.evalBatch(programs[2], errorColumns, rows, outs[2]);
+            std::cout << threads << " thread(s): no error" << std::endl;
+        }
+        catch (const std::exception& e) {
+            std::cout << threads << " thread(s): " << e.what() << std::endl;
+        }
+    }
+    std::cout << std::endl;
+}
+
+/**
+ * Interpreter versus JIT-compiled native code for single evaluations.
+ */
+void benchJit(const std::vector<std::string>&) {
+    const std::vector<std::string> expressions = {
+        "1+2*3",
+        "price * qty - discount > limit && qty != 0",
+        "(price + discount) % 7 == qty % 7 || limit < -900",
+        "price / qty + discount / limit",
+        "price ^ 2 + qty ^ 2 < limit * limit",
+        "!(price < 0) && (qty > 10 || discount == 0) && -price != limit"
+    };
+    const std::vector<std::string> variables = {"price", "qty", "discount", "limit"};
+    const int values[] = {120, 7, 15, 900};
+
+    std::cout << "=== JIT (" << (jit::available() ? "x86-64" : "not available on this platform")
+              << ", promotion after " << jit::threshold() << " calls) ===" << std::endl << std::endl;
+    std::cout << std::left << std::setw(56) << "Expression"
+              << std::right << std::setw(8) << "bytes"
+              << std::setw(14) << "interp/s"
+              << std::setw(14) << "native/s"
+              << std::setw(10) << "speedup" << std::endl;
+    std::cout << std::string(102, '-') << std::endl;
+
+    Evaluator evaluator;
+    for (const auto& expr : expressions) {
+        CompiledExpression program = evaluator.compile(expr, variables);
+
+        jit::setEnabled(false);
+        double interpreted = callsPerSecond([&] { return program.evaluate(values); });
+
+        // A fresh copy starts cold; the timing loop promotes it within its first batches
+        jit::setEnabled(true);
+        CompiledExpression hot = program;
+        double native = callsPerSecond([&] { return hot.evaluate(values); });
+        std::unique_ptr<jit::Code> code = jit::Code::compile(program.instructions(), program.maxStackDepth());
+
+        std::cout << std::left << std::setw(56) << expr << std::right << std::setw(8)
+                  << (code ? std::to_string(code->size()) : "-") << std::fixed << std::setprecision(0)
+                  << std::setw(14) << interpreted << std::setw(14) << native
+                  << std::setprecision(1) << std::setw(9) << native / interpreted << "x"
+                  << (hot.isNative() ? "" : "  (interpreted)") << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+/**
+ * Streaming evaluation of an expression file: the getline / std::endl loop of the
+ * interactive mode versus LineReader + BufferedWriter, both writing to /dev/null.
+ *
+ * Args: [lines] (default 2000000)
+ */
+void benchStream(const std::vector<std::string>& args) {
+    const size_t lines = args.empty() ? 2000000 : std::stoul(args[0]);
+    const std::string path = "/tmp/evaluator_stream_bench.txt";
+
+    // Mixed expressions, with an error on every 50th line
+    {
+        std::mt19937 rng(5);
+        std::ofstream file(path);
+        for (size_t i = 0; i < lines; i++) {
+            if (i % 50 == 0) {
+                file << (rng() % 100) << " / 0\n";
+            }
+            else {
+                file << kMainExpressions[i % kMainExpressions.size()] << " + " << (rng() % 1000) << "\n";
+            }
+        }
+    }
+    std::FILE* devNull = std::fopen("/dev/null", "w");
+    std::ofstream nullStream("/dev/null");
+    Evaluator evaluator;
+
+    std::cout << "=== Streaming mode (" << lines << " lines) ===" << std::endl << std::endl;
+    std::cout << std::left << std::setw(28) << "Reader"
+              << std::right << std::setw(14) << "lines/s"
+              << std::setw(12) << "MB/s" << std::endl;
+    std::cout << std::string(54, '-') << std::endl;
+
+    auto report = [&](const char* name, double seconds, double bytes) {
+        std::cout << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(14) << lines / seconds << std::setprecision(1)
+                  << std::setw(12) << bytes / seconds / 1e6 << std::endl;
+    };
+
+    // Baseline: std::getline into a std::string and a flush after every result
+    {
+        std::ifstream in(path);
+        std::string line;
+        double bytes = 0;
+        auto start = Clock::now();
+        while (std::getline(in, line)) {
+            bytes += line.size() + 1;
+            try {
+                nullStream << evaluator.eval(line) << std::endl;
+            }
+            catch (const std::exception& e) {
+                nullStream << "error: " << e.what() << std::endl;
+            }
+        }
+        report("getline + std::endl", std::chrono::duration<double>(Clock::now() - start).count(), bytes);
+    }
+
+    // Memory-mapped input through the buffered writer
+    {
+        auto start = Clock::now();
+        LineReader input(path);
+        BufferedWriter output(devNull);
+        StreamStats stats = evaluateStream(evaluator, input, output);
+        output.flush();
+        report(input.mapped() ? "mmap + buffered writer" : "block reads + buffered writer",
+               std::chrono::duration<double>(Clock::now() - start).count(), static_cast<double>(stats.bytes));
+    }
+
+    std::fclose(devNull);
+    std::remove(path.c_str());
+    std::cout << std::endl;
+}
+
+/**
+ * Heap allocations per eval() call with a fresh EvalContext each time (what every
+ * call used to pay), with the thread's own context, and with a warmed-up explicit
+ * context, plus multi-threaded throughput with fresh versus reused contexts.
+ * The reused paths must not allocate at all.
+ *
+ * Args: [threads] (default: hardware concurrency)
+ */
+void benchAlloc(const std::vector<std::string>& args) {
+    const unsigned threads = args.empty() ? std::max(1u, std::thread::hardware_concurrency())
+                                          : static_cast<unsigned>(std::stoul(args[0]));
+    Evaluator evaluator;
+
+    // The demo expressions plus ones deep and long enough to need arena storage
+    std::vector<std::string> expressions = kMainExpressions;
+    expressions.push_back(std::string(200, '(') + "1" + std::string(200, ')'));
+    std::string sum = "1";
+    for (int i = 0; i < 500; i++) {
+        sum += " + " + std::to_string(i) + " * 2";
+    }
+    expressions.push_back(sum);
+
+    // Allocations made by 1000 calls, after warming up
+    const int calls = 1000;
+    auto allocations = [](auto&& call) -> std::uint64_t {
+
+        // Warm up; an arena that overflowed grows at the start of the following call
+        call();
+        call();
+        std::uint64_t before = gAllocations.load();
+        for (int i = 0; i < calls; i++) {
+            call();
+        }
+        return gAllocations.load() - before;
+    };
+
+    std::cout << "=== Heap allocations per eval() ===" << std::endl << std::endl;
+    std::cout << std::left << std::setw(20) << "Expression"
+              << std::right << std::setw(14) << "fresh ctx"
+              << std::setw(14) << "eval()"
+              << std::setw(14) << "reused ctx" << std::endl;
+    std::cout << std::string(62, '-') << std::endl;
+
+    std::uint64_t steadyState = 0;
+    EvalContext context;
+    for (const auto& expr : expressions) {
+        std::uint64_t fresh = allocations([&] {
+            EvalContext scratch;
+            sink = evaluator.eval(expr, scratch);
+        });
+        std::uint64_t threadLocal = allocations([&] { sink = evaluator.eval(expr); });
+        std::uint64_t reused = allocations([&] { sink = evaluator.eval(expr, context); });
+        steadyState += threadLocal + reused;
+
+        std::string label = expr.size() > 18 ? expr.substr(0, 15) + "..." : expr;
+        std::cout << std::left << std::setw(20) << label << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(14) << static_cast<double>(fresh) / calls
+                  << std::setw(14) << static_cast<double>(threadLocal) / calls
+                  << std::setw(14) << static_cast<double>(reused) / calls << std::endl;
+    }
+    std::cout << std::endl << "Allocations with a reused context: " << steadyState
+              << (steadyState == 0 ? " (OK)" : " (FAIL)") << std::endl << std::endl;
+    gFailed |= steadyState != 0;
+
+    // Fresh scratch memory on every call contends on the allocator across threads
+    std::cout << "=== Multi-threaded eval() (" << threads << " threads) ===" << std::endl << std::endl;
+    std::cout << std::left << std::setw(20) << "Context"
+              << std::right << std::setw(16) << "evals/s" << std::endl;
+    std::cout << std::string(36, '-') << std::endl;
+
+    for (bool reuse : {false, true}) {
+        std::atomic<std::uint64_t> total{0};
+        std::vector<std::thread> workers;
+        auto start = Clock::now();
+        for (unsigned t = 0; t < threads; t++) {
+            workers.emplace_back([&] {
+                EvalContext shared;
+                std::uint64_t calls = 0;
+                while (std::chrono::duration<double>(Clock::now() - start).count() < 0.25) {
+                    for (const auto& expr : kMainExpressions) {
+                        if (reuse) {
+                            sink = evaluator.eval(expr, shared);
+                        }
+                        else {
+                            EvalContext scratch;
+                            sink = evaluator.eval(expr, scratch);
+                        }
+                    }
+                    calls += kMainExpressions.size();
+                }
+                total += calls;
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        std::cout << std::left << std::setw(20) << (reuse ? "reused" : "fresh per call")
+                  << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(16) << total / seconds << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+/**
+ * Exponentiation by squaring against the old pow() round trip through double,
+ * then eval() throughput in each numeric mode.
+ */
+void benchNumeric(const std::vector<std::string>&) {
+    // Bases and exponents whose results fit in 64 bits, where pow() should be exact but is not
+    std::vector<std::pair<std::int64_t, std::int64_t>> inputs;
+    for (std::int64_t base = 2; base <= 40; base++) {
+        for (std::int64_t exponent = 0; std::pow(double(base), double(exponent)) < 9.2e18; exponent++) {
+            inputs.push_back({base, exponent});
+        }
+    }
+
+    size_t inexact = 0;
+    for (const auto& [base, exponent] : inputs) {
+        inexact += static_cast<std::int64_t>(std::pow(double(base), double(exponent))) != integerPower(base, exponent);
+    }
+
+    size_t next = 0;
+    auto viaDouble = [&] {
+        const auto& [base, exponent] = inputs[next++ % inputs.size()];
+        return static_cast<int>(static_cast<std::int64_t>(std::pow(double(base), double(exponent))));
+    };
+    auto bySquaring = [&] {
+        const auto& [base, exponent] = inputs[next++ % inputs.size()];
+        return static_cast<int>(integerPower(base, exponent));
+    };
+
+    std::cout << "=== int64 ^: pow() round trip vs. exponentiation by squaring ===" << std::endl << std::endl;
+    std::cout << std::left << std::setw(24) << "Method" << std::right << std::setw(16) << "calls/s"
+              << std::setw(12) << "inexact" << std::endl;
+    std::cout << std::string(52, '-') << std::endl;
+    std::cout << std::left << std::setw(24) << "pow() in double" << std::right << std::fixed << std::setprecision(0)
+              << std::setw(16) << callsPerSecond(viaDouble) << std::setw(12) << inexact << std::endl;
+    std::cout << std::left << std::setw(24) << "integerPower()" << std::right
+              << std::setw(16) << callsPerSecond(bySquaring) << std::setw(12) << 0 << std::endl;
+    std::cout << std::endl << "(" << inexact << " of " << inputs.size()
+              << " in-range powers come out wrong through double)" << std::endl << std::endl;
+
+    const std::vector<std::string> expressions = {
+        "1+2*3",
+        "125000000 * 10000 + 375 * 86400",
+        "(2^40 - 1) / 3 % 1000007",
+        "3^39 - 3^38 * 2 > 0"
+    };
+    Evaluator evaluator;
+
+    std::cout << "=== eval() per numeric mode (evals/s) ===" << std::endl << std::endl;
+    std::cout << std::left << std::setw(34) << "Expression"
+              << std::right << std::setw(12) << "int32"
+              << std::setw(12) << "int64"
+              << std::setw(12) << "checked"
+              << std::setw(12) << "bigint" << std::endl;
+    std::cout << std::string(82, '-') << std::endl;
+
+    for (const auto& expr : expressions) {
+        std::cout << std::left << std::setw(34) << expr << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(12) << callsPerSecond([&] { return evaluator.evalAs<Int32Arithmetic>(expr); })
+                  << std::setw(12) << callsPerSecond([&] {
+                         return static_cast<int>(evaluator.evalAs<Int64Arithmetic>(expr));
+                     })
+                  << std::setw(12) << callsPerSecond([&] {
+                         return static_cast<int>(evaluator.evalAs<CheckedInt64Arithmetic>(expr));
+                     })
+                  << std::setw(12) << callsPerSecond([&] {
+                         return static_cast<int>(evaluator.evalAs<BigIntArithmetic>(expr).isOdd());
+                     })
+                  << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+/**
+ * Typed evaluation of a floating-point scoring filter: one row at a time with
+ * evaluate(), then block-wise with the scalar and the AVX2/FMA kernels, writing
+ * either a bitmask or a double per row. Also compares fused and separately
+ * rounded multiply-add on the score alone.
+ *
+ * Args: [rows] (default 4000000)
+ */
+void benchTyped(const std::vector<std::string>& args) {
+    const size_t rows = args.empty() ? 4000000 : std::stoul(args[0]);
+    const std::string filter = "0.75 * score + 0.25 * bias >= 0.5";
+    const std::string score = "0.75 * score + 0.25 * bias";
+    const std::vector<TypedVariable> variables = {{"score", ValueType::Double}, {"bias", ValueType::Double}};
+
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    std::vector<double> scores(rows), biases(rows);
+    for (size_t i = 0; i < rows; i++) {
+        scores[i] = dist(rng);
+        biases[i] = dist(rng);
+    }
+    const TypedColumn columns[2] = {TypedColumn::doubles(scores.data()), TypedColumn::doubles(biases.data())};
+
+    Evaluator evaluator;
+    TypedExpression program = evaluator.compileTyped(filter, variables);
+    std::vector<std::uint64_t> mask(typed::maskWords(rows));
+    std::vector<double> values(rows);
+
+    // Rows per second of fn, which evaluates every row
+    auto rowsPerSecond = [&](auto fn) {
+        auto start = Clock::now();
+        fn();
+        return rows / std::chrono::duration<double>(Clock::now() - start).count();
+    };
+
+    auto perRow = [&] {
+        size_t selected = 0;
+        std::vector<TypedValue> row(2);
+        for (size_t i = 0; i < rows; i++) {
+            row[0] = TypedValue::ofDouble(scores[i]);
+            row[1] = TypedValue::ofDouble(biases[i]);
+            selected += static_cast<size_t>(program.evaluate(row.data()).i);
+        }
+        return selected;
+    };
+
+    bool simd = typed::simdAvailable();
+    std::cout << "=== Typed evaluation: " << filter << " (" << rows << " rows, "
+              << (simd ? "avx2+fma" : "no avx2/fma") << ") ===" << std::endl << std::endl;
+    std::cout << std::left << std::setw(30) << "Method"
+              << std::right << std::setw(16) << "rows/s"
+              << std::setw(14) << "bytes/row"
+              << std::setw(12) << "selected" << std::endl;
+    std::cout << std::string(72, '-') << std::endl;
+
+    auto report = [&](const char* name, double rate, double bytes, size_t selected) {
+        std::cout << std::left << std::setw(30) << name << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(16) << rate << std::setprecision(3) << std::setw(14);
+        if (bytes > 0) {
+            std::cout << bytes;
+        }
+        else {
+            std::cout << "-";
+        }
+        std::cout << std::setw(12) << selected << std::endl;
+    };
+
+    size_t selected = 0;
+    double rate = rowsPerSecond([&] { selected = perRow(); });
+    report("evaluate() per row", rate, 0, selected);
+
+    for (bool vector : {false, true}) {
+        if (vector && !simd) {
+            continue;
+        }
+        typed::setSimdEnabled(vector);
+        rate = rowsPerSecond([&] { program.evalBatchMask(columns, rows, mask.data()); });
+        report(vector ? "evalBatchMask (avx2+fma)" : "evalBatchMask (scalar)", rate, 1.0 / 8,
+               typed::countMask(mask.data(), rows));
+
+        rate = rowsPerSecond([&] { program.evalBatch(columns, rows, values.data()); });
+        report(vector ? "evalBatch double (avx2+fma)" : "evalBatch double (scalar)", rate, sizeof(double),
+               static_cast<size_t>(std::count(values.begin(), values.end(), 1.0)));
+    }
+    typed::setSimdEnabled(true);
+
+    // The score alone: one fused multiply-add per row against a multiply, a multiply and an add
+    std::cout << std::endl << "=== " << score << ": fused vs. separate multiply-add ===" << std::endl << std::endl;
+    std::cout << std::left << std::setw(30) << "Program" << std::right << std::setw(16) << "rows/s"
+              << std::setw(14) << "instructions" << std::endl;
+    std::cout << std::string(60, '-') << std::endl;
+    for (bool fuse : {false, true}) {
+        evaluator.setFusedMultiplyAdd(fuse);
+        TypedExpression scoring = evaluator.compileTyped(score, variables);
+        rate = rowsPerSecond([&] { scoring.evalBatch(columns, rows, values.data()); });
+        std::cout << std::left << std::setw(30) << (fuse ? "fused" : "separate") << std::right << std::fixed
+                  << std::setprecision(0) << std::setw(16) << rate << std::setw(14)
+                  << scoring.instructions().size() << std::endl;
+        sink = static_cast<int>(values[rows / 2] * 100);
+    }
+    std::cout << std::endl;
+}
+
+/**
+ * eval() throughput on the main.cpp expressions, then the recorded profile:
+ * where the time went per phase, the operators applied and the most expensive
+ * expressions. Run it from a build with and without -DEVALUATOR_PROFILE=1 to
+ * see the instrumentation's overhead.
+ */
+void benchProfile(const std::vector<std::string>&) {
+    Evaluator evaluator;
+    profile::reset();
+
+    std::cout << "=== eval() with profiling " << (profile::kEnabled ? "enabled" : "compiled out")
+              << " ===" << std::endl << std::endl;
+    std::cout << std::left << std::setw(20) << "Expression" << std::right << std::setw(16) << "eval/s" << std::endl;
+    std::cout << std::string(36, '-') << std::endl;
+    for (const auto& expr : kMainExpressions) {
+        std::cout << std::left << std::setw(20) << expr << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(16) << callsPerSecond([&] { return evaluator.eval(expr); }) << std::endl;
+    }
+    std::cout << std::endl;
+
+    if (!profile::kEnabled) {
+        std::cout << "(rebuild with -DEVALUATOR_PROFILE=1 for the profile)" << std::endl << std::endl;
+        return;
+    }
+
+    profile::ProfileStats stats = profile::snapshot();
+    std::uint64_t total = 0;
+    for (std::uint64_t ns : stats.phaseNanoseconds) {
+        total += ns;
+    }
+
+    std::cout << "=== Profile of " << stats.evaluations << " evaluations ===" << std::endl << std::endl;
+    std::cout << std::left << std::setw(12) << "Phase" << std::right << std::setw(14) << "ns/eval"
+              << std::setw(10) << "share" << std::endl;
+    std::cout << std::string(36, '-') << std::endl;
+    for (size_t i = 0; i < profile::kPhaseCount; i++) {
+        std::cout << std::left << std::setw(12) << profile::phaseName(static_cast<profile::Phase>(i))
+                  << std::right << std::setprecision(1)
+                  << std::setw(14) << double(stats.phaseNanoseconds[i]) / double(stats.evaluations)
+                  << std::setw(9) << 100.0 * double(stats.phaseNanoseconds[i]) / double(total) << "%" << std::endl;
+    }
+    std::cout << std::endl << "Operators applied:";
+    for (size_t i = 0; i < profile::kOperatorCount; i++) {
+        if (stats.operatorCounts[i]) {
+            std::cout << " " << kOperatorTable[i].name << "=" << stats.operatorCounts[i];
+        }
+    }
+    std::cout << std::endl << "Stack high-water marks: values " << stats.maxValueStack
+              << ", operators " << stats.maxOperatorStack << std::endl << std::endl;
+    std::cout << profile::toJson(stats, 3) << std::endl << std::endl;
+}
+
+/**
+ * eval() on single expressions from 1 MB up to 100 MB in the shapes generated
+ * rules take: long flat sums, deep parentheses, long unary chains and
+ * right-nested groups. Throughput should stay flat as the size grows tenfold,
+ * and the arena (the only scratch memory) should track nesting depth, not
+ * length. Then the same deep input against the default limits, which must
+ * reject it without reading it all.
+ *
+ * Args: [max MB] (default: 100)
+ */
+void benchScaling(const std::vector<std::string>& args) {
+    const size_t maxMegabytes = args.empty() ? 100 : std::stoul(args[0]);
+
+    // Builds an expression of about 'bytes' characters by repeating a prefix
+    // around a core, then closing whatever the prefix opened
+    auto build = [](size_t bytes, const std::string& prefix, const std::string& core, const std::string& suffix) {
+        size_t repeats = (bytes - core.size()) / (prefix.size() + suffix.size());
+        std::string text;
+        text.reserve(repeats * (prefix.size() + suffix.size()) + core.size());
+        for (size_t i = 0; i < repeats; i++) {
+            text += prefix;
+        }
+        text += core;
+        for (size_t i = 0; i < repeats; i++) {
+            text += suffix;
+        }
+        return text;
+    };
+
+    struct Shape {
+        const char* name;
+        std::string prefix, core, suffix;
+    };
+    const Shape shapes[] = {
+        {"flat", "12 + 34 * 5 - ", "1", ""},
+        {"nested (((1)))", "(", "1", ")"},
+        {"unary !!!!1", "!", "1", ""},
+        {"unary ++++2", "+", "2", ""},
+        {"1+(1+(...))", "1+(", "1", ")"},
+    };
+
+    Evaluator unbounded;
+    unbounded.setLimits({UINT32_MAX, SIZE_MAX, SIZE_MAX});
+    EvalContext context;
+
+    std::cout << "=== eval() scaling with expression size ===" << std::endl << std::endl;
+    std::cout << std::left << std::setw(18) << "Shape" << std::right << std::setw(10) << "MB"
+              << std::setw(12) << "seconds" << std::setw(10) << "MB/s" << std::setw(14) << "arena MB" << std::endl;
+    std::cout << std::string(64, '-') << std::endl;
+
+    for (const Shape& shape : shapes) {
+        for (size_t megabytes = 1; megabytes <= maxMegabytes; megabytes *= 10) {
+            std::string text = build(megabytes << 20, shape.prefix, shape.core, shape.suffix);
+
+            // The first call sizes the arena; the second runs in it
+            sink = unbounded.eval(text, context);
+            auto start = Clock::now();
+            sink = unbounded.eval(text, context);
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+            std::cout << std::left << std::setw(18) << shape.name << std::right << std::fixed
+                      << std::setw(10) << megabytes << std::setprecision(3)
+                      << std::setw(12) << seconds << std::setprecision(1)
+                      << std::setw(10) << text.size() / seconds / 1e6
+                      << std::setw(14) << context.arenaCapacity() / 1e6 << std::endl;
+        }
+    }
+    std::cout << std::endl;
+
+    // Default limits fail at the first parenthesis past the nesting limit
+    Evaluator bounded;
+    std::string deep = build(maxMegabytes << 20, "(", "1", ")");
+    auto start = Clock::now();
+    try {
+        sink = bounded.eval(deep);
+    }
+    catch (const std::exception& e) {
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        std::cout << "Default limits on " << maxMegabytes << " MB of parentheses: rejected in "
+                  << std::setprecision(3) << seconds * 1e3 << " ms (" << e.what() << ")" << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+/**
+ * A DependencyGraph of derived values in three layers over a set of inputs,
+ * updated one input at a time and in batches, against re-evaluating every
+ * formula after each update. Also checks the graph against that full
+ * recomputation.
+ *
+ * Args: [formulas] (default: 5000)
+ */
+void benchGraph(const std::vector<std::string>& args) {
+    const size_t formulaCount = args.empty() ? 5000 : std::stoul(args[0]);
+    const size_t inputCount = 1000;
+    const size_t updates = 2000;
+    const size_t batchSize = 100;
+
+    // Layer 1 reads inputs, layers 2 and 3 read the layer below; definitions
+    // come in topological order, so evaluating them in order is a full recomputation
+    std::mt19937 rng(7);
+    std::vector<std::pair<std::string, std::string>> definitions;
+    for (size_t i = 0; i < formulaCount; i++) {
+        size_t layer = i * 5 / formulaCount;    // 0-1: layer 1, 2-3: layer 2, 4: layer 3
+        std::string expression;
+        if (layer < 2) {
+            expression = "in" + std::to_string(rng() % inputCount) + " * 3 + in" + std::to_string(rng() % inputCount) +
+                         " > " + std::to_string(rng() % 2000);
+        }
+        else {
+            size_t below = layer < 4 ? formulaCount * 2 / 5 : formulaCount * 4 / 5;
+            size_t start = layer < 4 ? 0 : formulaCount * 2 / 5;
+            std::string a = definitions[start + rng() % (below - start)].first;
+            std::string b = definitions[start + rng() % (below - start)].first;
+            expression = layer < 4 ? a + " + " + b + " * 2" : "(" + a + " || " + b + ") && " + a + " != " + b;
+        }
+        definitions.push_back({"f" + std::to_string(i), expression});
+    }
+
+    const Evaluator evaluator;
+    DependencyGraph graph(evaluator);
+    std::vector<std::string> inputs;
+    for (size_t i = 0; i < inputCount; i++) {
+        inputs.push_back("in" + std::to_string(i));
+        graph.set(inputs.back(), static_cast<int>(rng() % 1000));
+    }
+    for (const auto& [name, expression] : definitions) {
+        graph.define(name, expression);
+    }
+    graph.recompute();
+
+    // The baseline keeps every value in one array and re-evaluates all formulas in order
+    std::unordered_map<std::string, size_t> index;
+    std::vector<int> values(inputCount + formulaCount);
+    for (size_t i = 0; i < inputCount; i++) {
+        index[inputs[i]] = i;
+        values[i] = graph.value(inputs[i]);
+    }
+    std::vector<CompiledExpression> programs;
+    std::vector<std::vector<size_t>> operands;
+    for (size_t i = 0; i < formulaCount; i++) {
+        index[definitions[i].first] = inputCount + i;
+        programs.push_back(evaluator.compile(definitions[i].second));
+        operands.emplace_back();
+        for (const std::string& name : programs.back().variables()) {
+            operands.back().push_back(index.at(name));
+        }
+    }
+    auto recomputeAll = [&] {
+        int slots[2];
+        for (size_t i = 0; i < formulaCount; i++) {
+            for (size_t s = 0; s < operands[i].size(); s++) {
+                slots[s] = values[operands[i][s]];
+            }
+            values[inputCount + i] = programs[i].evaluate(slots);
+        }
+    };
+
+    std::vector<std::pair<size_t, int>> changes;
+    for (size_t i = 0; i < updates; i++) {
+        changes.push_back({rng() % inputCount, static_cast<int>(rng() % 1000)});
+    }
+
+    std::cout << "=== Dependency graph (" << inputCount << " inputs, " << formulaCount << " formulas, "
+              << updates << " input changes) ===" << std::endl << std::endl;
+    std::cout << std::left << std::setw(30) << "Mode" << std::right << std::setw(14) << "changes/s"
+              << std::setw(16) << "evals/change" << std::setw(10) << "passes" << std::endl;
+    std::cout << std::string(70, '-') << std::endl;
+
+    auto report = [&](const char* mode, double seconds, double evaluations, std::uint64_t passes) {
+        std::cout << std::left << std::setw(30) << mode << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(14) << updates / seconds << std::setprecision(1)
+                  << std::setw(16) << evaluations / updates << std::setw(10) << passes << std::endl;
+    };
+
+    auto start = Clock::now();
+    for (const auto& [input, value] : changes) {
+        values[input] = value;
+        recomputeAll();
+    }
+    report("re-evaluate every formula", std::chrono::duration<double>(Clock::now() - start).count(),
+           static_cast<double>(formulaCount) * updates, updates);
+
+    // Each change read back at once, then the same changes coalesced into batches
+    for (size_t batch : {size_t(1), batchSize}) {
+        GraphStats before = graph.stats();
+        start = Clock::now();
+        for (size_t i = 0; i < updates; i += batch) {
+            for (size_t j = i; j < std::min(i + batch, updates); j++) {
+                graph.set(inputs[changes[j].first], changes[j].second);
+            }
+            graph.recompute();
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        GraphStats after = graph.stats();
+        report(batch == 1 ? "graph, recompute per change" : "graph, batches of 100", seconds,
+               static_cast<double>(after.evaluations - before.evaluations), after.passes - before.passes);
+    }
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < formulaCount; i++) {
+        mismatches += graph.value(definitions[i].first) != values[inputCount + i];
+    }
+    std::cout << std::endl << "Graph vs. full recomputation: " << mismatches << " mismatch(es)" << std::endl
+              << std::endl;
+    gFailed |= mismatches != 0;
+}
+
+/**
+ * Cold start over a rule set: compiling every rule from its text versus
+ * mapping a program file written once, with and without verifying its
+ * checksum. Then evaluates every rule through the mapping and checks the
+ * results against the compiled programs.
+ *
+ * Args: [rules] (default: 200000)
+ */
+void benchProgramFile(const std::vector<std::string>& args) {
+    const size_t ruleCount = args.empty() ? 200000 : std::stoul(args[0]);
+    const std::string path = "/tmp/evaluator_programs_bench.bin";
+
+    std::mt19937 rng(11);
+    std::vector<std::string> rules;
+    for (size_t i = 0; i < ruleCount; i++) {
+        rules.push_back("(price * " + std::to_string(rng() % 97 + 1) + " + qty) * 3 > limit + " +
+                        std::to_string(rng() % 1000) + " && qty % " + std::to_string(rng() % 13 + 2) + " != 0");
+    }
+    const std::vector<std::string> variables = {"price", "qty", "limit"};
+    const Evaluator evaluator;
+
+    std::cout << "=== Program file (" << ruleCount << " rules) ===" << std::endl << std::endl;
+    std::cout << std::left << std::setw(30) << "Startup" << std::right << std::setw(12) << "ms"
+              << std::setw(14) << "allocations" << std::endl;
+    std::cout << std::string(56, '-') << std::endl;
+
+    auto report = [](const char* name, Clock::time_point start, std::uint64_t allocations) {
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        std::cout << std::left << std::setw(30) << name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << ms << std::setw(14) << allocations << std::endl;
+    };
+
+    std::uint64_t before = gAllocations.load();
+    auto start = Clock::now();
+    std::vector<CompiledExpression> programs;
+    programs.reserve(ruleCount);
+    for (const std::string& rule : rules) {
+        programs.push_back(evaluator.compile(rule, variables));
+    }
+    report("compile every rule", start, gAllocations.load() - before);
+
+    before = gAllocations.load();
+    start = Clock::now();
+    ProgramFile::write(path, programs);
+    report("write the file (once)", start, gAllocations.load() - before);
+
+    for (bool verify : {false, true}) {
+        before = gAllocations.load();
+        start = Clock::now();
+        ProgramFile file(path, verify);
+        report(verify ? "map + verify checksum" : "map", start, gAllocations.load() - before);
+    }
+
+    ProgramFile file(path, false);
+    std::cout << std::endl << "File: " << file.bytes() / 1e6 << " MB, " << file.bytes() / ruleCount
+              << " bytes per rule" << std::endl;
+
+    // Every rule on one record, from the mapping and from the compiled programs
+    const int record[] = {42, 17, 900};
+    size_t mismatches = 0;
+    int matched = 0;
+    start = Clock::now();
+    for (size_t i = 0; i < ruleCount; i++) {
+        matched += file.program(i).evaluate(record);
+    }
+    double mappedSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+    for (size_t i = 0; i < ruleCount; i++) {
+        mismatches += file.program(i).evaluate(record) != programs[i].evaluate(record);
+    }
+    sink = matched;
+    std::cout << "Evaluating every rule from the mapping: " << std::setprecision(0) << ruleCount / mappedSeconds
+              << " rules/s, " << mismatches << " mismatch(es)" << std::endl << std::endl;
+    gFailed |= mismatches != 0;
+
+    std::remove(path.c_str());
+}
+
+/**
+ * Many rules sharing sub-expressions, evaluated per record: eval() on every
+ * rule with the record's values written in, every rule compiled on its own,
+ * and one RuleSet computing each shared sub-expression once. Reports the
+ * operators executed per record and checks the three agree.
+ *
+ * Args: [rules] (default: 5000)
+ */
+void benchRuleSet(const std::vector<std::string>& args) {
+    const size_t ruleCount = args.empty() ? 5000 : std::stoul(args[0]);
+    const size_t records = 2000;
+    const size_t evalRecords = 20;     // eval() re-parses every rule, so it gets fewer records
+    const std::vector<std::string> variables = {"a", "b", "c", "d", "x", "y", "z"};
+
+    // Rules built from a small pool of shared terms, like generated rule sets
+    std::mt19937 rng(21);
+    const std::vector<std::string> terms = {"(a+b)*3", "(b+a)*3", "c*d", "a-c", "(x+y)%7", "d*d+1", "b*c-a", "z/2"};
+    const char* comparisons[] = {">", ">=", "<", "<=", "==", "!="};
+    auto comparison = [&] {
+        return terms[rng() % terms.size()] + " " + comparisons[rng() % 6] + " " +
+               (rng() % 2 ? variables[4 + rng() % 3] : std::to_string(rng() % 100));
+    };
+    std::vector<std::string> rules;
+    for (size_t i = 0; i < ruleCount; i++) {
+        std::string rule = comparison();
+        if (rng() % 2) {
+            rule += (rng() % 2 ? " && " : " || ") + comparison();
+        }
+        rules.push_back(rule);
+    }
+
+    std::vector<std::vector<int>> rows(records, std::vector<int>(variables.size()));
+    for (std::vector<int>& row : rows) {
+        for (int& value : row) {
+            value = static_cast<int>(rng() % 50);
+        }
+    }
+
+    const Evaluator evaluator;
+    std::vector<CompiledExpression> programs;
+    for (const std::string& rule : rules) {
+        programs.push_back(evaluator.compile(rule, variables));
+    }
+    RuleSet ruleSet(rules, variables, evaluator);
+    const RuleSetStats& stats = ruleSet.stats();
+
+    // eval() needs literals: each rule with the record's values written in, prepared untimed
+    std::vector<std::string> substituted;
+    for (size_t r = 0; r < evalRecords; r++) {
+        for (const std::string& rule : rules) {
+            std::string text;
+            for (char ch : rule) {
+                auto it = std::find(variables.begin(), variables.end(), std::string(1, ch));
+                text += it == variables.end() ? std::string(1, ch) : std::to_string(rows[r][it - variables.begin()]);
+            }
+            substituted.push_back(text);
+        }
+    }
+
+    std::cout << "=== Rule set (" << ruleCount << " rules, " << variables.size() << " variables) ===" << std::endl
+              << std::endl;
+    std::cout << std::left << std::setw(26) << "Mode" << std::right << std::setw(14) << "records/s"
+              << std::setw(16) << "operators/rec" << std::endl;
+    std::cout << std::string(56, '-') << std::endl;
+
+    auto report = [](const char* mode, size_t count, double seconds, size_t operators) {
+        std::cout << std::left << std::setw(26) << mode << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(14) << count / seconds << std::setw(16) << operators << std::endl;
+    };
+
+    std::vector<int> expected(evalRecords * ruleCount);
+    auto start = Clock::now();
+    for (size_t i = 0; i < substituted.size(); i++) {
+        expected[i] = evaluator.eval(substituted[i]);
+    }
+    report("eval() per rule", evalRecords, std::chrono::duration<double>(Clock::now() - start).count(),
+           stats.ruleOperators);
+
+    std::vector<int> perRule(records * ruleCount);
+    start = Clock::now();
+    for (size_t r = 0; r < records; r++) {
+        for (size_t i = 0; i < ruleCount; i++) {
+            perRule[r * ruleCount + i] = programs[i].evaluate(rows[r].data());
+        }
+    }
+    report("compile() per rule", records, std::chrono::duration<double>(Clock::now() - start).count(),
+           stats.ruleOperators);
+
+    std::vector<int> fused(records * ruleCount);
+    start = Clock::now();
+    for (size_t r = 0; r < records; r++) {
+        ruleSet.evaluate(rows[r].data(), fused.data() + r * ruleCount);
+    }
+    report("RuleSet", records, std::chrono::duration<double>(Clock::now() - start).count(), stats.sharedOperators);
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < fused.size(); i++) {
+        mismatches += fused[i] != perRule[i] || (i < expected.size() && expected[i] != fused[i]);
+    }
+    std::cout << std::endl << stats.constants << " distinct constants; RuleSet vs. per-rule results: "
+              << mismatches << " mismatch(es)" << std::endl << std::endl;
+    gFailed |= mismatches != 0;
+}
+
+/**
+ * Matching records against many conjunction rules ("price > 100 && qty <= 5"),
+ * with a few rules of other shapes: every rule compiled and evaluated, against
+ * one PredicateIndex. Reports the rules examined per record (every rule, or the
+ * index's candidates plus the rules it cannot index) and checks both agree.
+ *
+ * Args: [rules] (default: 100000)
+ */
+void benchPredicate(const std::vector<std::string>& args) {
+    const size_t ruleCount = args.empty() ? 100000 : std::stoul(args[0]);
+    const size_t records = 5000;
+    const size_t perRuleRecords = 100;  // Evaluating every rule is slow, so it gets fewer records
+    const std::vector<std::string> variables = {"price", "qty", "region", "age", "score", "flag", "tier", "size"};
+
+    // Selective conjunctions like generated alerting or routing rules: a category
+    // (region or tier, 50 values each) and one or two windows or thresholds over
+    // values 0..999, plus one rule in a hundred that needs arithmetic
+    std::mt19937 rng(22);
+    auto value = [&] { return std::to_string(rng() % 1000); };
+    const std::vector<std::string> categories = {"region", "tier"};
+    const std::vector<std::string> measures = {"price", "qty", "age", "score", "size"};
+    std::vector<std::string> rules;
+    for (size_t i = 0; i < ruleCount; i++) {
+        if (rng() % 100 == 0) {
+            rules.push_back(measures[rng() % 5] + " + " + measures[rng() % 5] + " > " + value() + " && " +
+                            measures[rng() % 5] + " % " + std::to_string(2 + rng() % 9) + " == 0");
+            continue;
+        }
+        std::string rule = rng() % 2 ? categories[rng() % 2] + " == " + std::to_string(rng() % 50)
+                                     : std::to_string(rng() % 50) + " == " + categories[rng() % 2];
+        size_t terms = 1 + rng() % 2;
+        size_t first = rng() % 5;
+        for (size_t t = 0; t < terms; t++) {
+            const std::string& name = measures[(first + t) % 5];
+            int lo = static_cast<int>(rng() % 1000);
+            switch (rng() % 5) {
+            case 0:  rule += " && " + name + " > " + std::to_string(lo); break;
+            case 1:  rule += " && " + value() + " >= " + name; break;
+            case 2:  rule += " && flag != " + std::to_string(rng() % 4); break;
+            default: rule += " && " + name + " >= " + std::to_string(lo) + " && " + name + " < " +
+                             std::to_string(lo + 100); break;
+            }
+        }
+        rules.push_back(rule);
+    }
+
+    std::vector<std::vector<int>> rows(records, std::vector<int>(variables.size()));
+    for (std::vector<int>& row : rows) {
+        for (size_t v = 0; v < row.size(); v++) {
+            row[v] = static_cast<int>(v == 2 || v == 6 ? rng() % 50 : v == 5 ? rng() % 4 : rng() % 1000);
+        }
+    }
+
+    const Evaluator evaluator;
+    std::vector<CompiledExpression> programs;
+    for (const std::string& rule : rules) {
+        programs.push_back(evaluator.compile(rule, variables));
+    }
+    auto start = Clock::now();
+    PredicateIndex index(rules, variables, evaluator);
+    double buildSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::cout << "=== Predicate index (" << ruleCount << " rules, " << index.indexedCount() << " indexed) ==="
+              << std::endl << std::endl;
+    std::cout << std::left << std::setw(26) << "Mode" << std::right << std::setw(14) << "records/s"
+              << std::setw(16) << "rules/record" << std::endl;
+    std::cout << std::string(56, '-') << std::endl;
+
+    auto report = [](const char* mode, size_t count, double seconds, double work) {
+        std::cout << std::left << std::setw(26) << mode << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(14) << count / seconds << std::setw(16) << work << std::endl;
+    };
+
+    std::vector<std::vector<std::uint32_t>> expected(perRuleRecords);
+    start = Clock::now();
+    for (size_t r = 0; r < perRuleRecords; r++) {
+        for (size_t i = 0; i < ruleCount; i++) {
+            try {
+                if (programs[i].evaluate(rows[r].data()) != 0) {
+                    expected[r].push_back(static_cast<std::uint32_t>(i));
+                }
+            }
+            catch (const std::exception&) {
+                // Division by zero: no match
+            }
+        }
+    }
+    report("compile() per rule", perRuleRecords, std::chrono::duration<double>(Clock::now() - start).count(),
+           static_cast<double>(ruleCount));
+
+    std::vector<std::uint32_t> matches;
+    MatchStats stats;
+    size_t work = 0;
+    size_t matched = 0;
+    size_t mismatches = 0;
+    start = Clock::now();
+    for (size_t r = 0; r < records; r++) {
+        index.match(rows[r].data(), matches, &stats);
+        work += stats.candidates + stats.fallbackEvaluations;
+        matched += matches.size();
+        if (r < perRuleRecords) {
+            mismatches += matches != expected[r];
+        }
+    }
+    report("PredicateIndex", records, std::chrono::duration<double>(Clock::now() - start).count(),
+           static_cast<double>(work) / records);
+
+    std::cout << std::endl << std::setprecision(1) << static_cast<double>(matched) / records
+              << " matches per record; index built in " << buildSeconds * 1000 << " ms; "
+              << "index vs. per-rule results: " << mismatches << " mismatch(es)" << std::endl << std::endl;
+    gFailed |= mismatches != 0;
+}
+
+/**
+ * Load generator for EvalServer: client threads, one connection each, keep a
+ * number of requests in flight over a Unix domain socket. A handful of shared
+ * expressions lets concurrent requests batch. Reports requests/s and latency
+ * percentiles for one connection without and with pipelining and for many
+ * connections, and checks every response against evaluating the request here.
+ *
+ * Args: [connections] [pipeline depth] [seconds per run] [socket]
+ *       (default: 8 32 1; without a socket an in-process server is started)
+ */
+void benchServer(const std::vector<std::string>& args) {
+    const unsigned connections = args.size() > 0 ? static_cast<unsigned>(std::stoul(args[0])) : 8;
+    const size_t depth = args.size() > 1 ? std::stoul(args[1]) : 32;
+    const double seconds = args.size() > 2 ? std::stod(args[2]) : 1.0;
+    const unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+
+    const std::vector<std::string> expressions = {
+        "a*b+c>100", "(a+b)*(a-b)", "a%7==b%7||c<10", "a/(b%5)", "a^2+b^2-c^2", "(a>b)+(b>c)+(c>a)",
+        "a*3-b*2+c", "!(a==b)&&c!=0",
+    };
+    const size_t width = 3;
+
+    // A fixed cycle of requests with their expected outcomes, computed locally
+    struct Request {
+        size_t expression;
+        int values[3];
+        bool ok;
+        int value;
+        std::string error;
+    };
+    const Evaluator evaluator;
+    std::vector<CompiledExpression> programs;
+    for (const std::string& expression : expressions) {
+        programs.push_back(evaluator.compile(expression));
+    }
+    std::mt19937 rng(23);
+    std::vector<Request> requests(4096);
+    for (Request& request : requests) {
+        request.expression = rng() % expressions.size();
+        for (int& value : request.values) {
+            value = static_cast<int>(rng() % 200) - 50;
+        }
+        try {
+            request.value = programs[request.expression].evaluate(request.values);
+            request.ok = true;
+        }
+        catch (const std::exception& e) {
+            request.ok = false;
+            request.error = e.what();
+        }
+    }
+
+    std::string path = args.size() > 3 ? args[3] : "/tmp/evaluator-bench-" + std::to_string(getpid()) + ".sock";
+    std::unique_ptr<EvalServer> server;
+    std::thread serverThread;
+    if (args.size() <= 3) {
+        ServerOptions options;
+        options.socketPath = path;
+        options.threads = std::max(1u, hardware / 2);   // The other half runs the clients
+        server = std::make_unique<EvalServer>(options);
+        serverThread = std::thread([&] { server->run(); });
+    }
+
+    std::cout << "=== Evaluation server (" << (server ? std::to_string(server->threadCount()) + " worker thread(s)"
+                                                        : "external server at " + path)
+              << ", " << expressions.size() << " expressions) ===" << std::endl << std::endl;
+    std::cout << std::left << std::setw(26) << "Mode" << std::right << std::setw(14) << "requests/s"
+              << std::setw(10) << "p50 us" << std::setw(10) << "p99 us" << std::setw(10) << "max us"
+              << std::setw(12) << "per batch" << std::endl;
+    std::cout << std::string(82, '-') << std::endl;
+
+    size_t mismatches = 0;
+    auto runLoad = [&](const char* mode, unsigned clients, size_t inFlight) {
+        std::vector<std::vector<std::uint32_t>> latencies(clients);     // Nanoseconds
+        std::vector<size_t> wrong(clients, 0);
+        ServerStats before = server ? server->stats() : ServerStats();
+        auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+
+        auto start = Clock::now();
+        std::vector<std::thread> threads;
+        for (unsigned c = 0; c < clients; c++) {
+            threads.emplace_back([&, c] {
+                EvalClient client(path);
+                latencies[c].reserve(1 << 20);
+
+                // A request's id is the slot it occupies, reused once its response arrives
+                std::vector<Clock::time_point> sentAt(inFlight);
+                std::vector<size_t> sentRequest(inFlight);
+                size_t next = c * 997;
+                auto issue = [&](std::uint32_t slot) {
+                    const Request& request = requests[next++ % requests.size()];
+                    sentAt[slot] = Clock::now();
+                    sentRequest[slot] = &request - requests.data();
+                    client.send(slot, expressions[request.expression], request.values, width);
+                };
+                for (std::uint32_t slot = 0; slot < inFlight; slot++) {
+                    issue(slot);
+                }
+                client.flush();
+
+                size_t outstanding = inFlight;
+                EvalResponse response;
+                while (outstanding > 0) {
+                    // Answer every response already received with one write
+                    do {
+                        if (!client.receive(response)) {
+                            throw std::runtime_error("The server closed the connection");
+                        }
+                        auto now = Clock::now();
+                        latencies[c].push_back(static_cast<std::uint32_t>(
+                            std::chrono::duration_cast<std::chrono::nanoseconds>(now - sentAt[response.id]).count()));
+                        const Request& request = requests[sentRequest[response.id]];
+                        wrong[c] += response.ok != request.ok || (request.ok ? response.value != request.value
+                                                                             : response.error != request.error);
+                        if (now < deadline) {
+                            issue(response.id);
+                        }
+                        else {
+                            outstanding--;
+                        }
+                    } while (outstanding > 0 && client.hasResponse());
+                    client.flush();
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+        std::vector<std::uint32_t> all;
+        for (unsigned c = 0; c < clients; c++) {
+            all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+            mismatches += wrong[c];
+        }
+        std::sort(all.begin(), all.end());
+        auto percentile = [&](double p) { return all[std::min(all.size() - 1, static_cast<size_t>(p * all.size()))] / 1000.0; };
+
+        std::cout << std::left << std::setw(26) << mode << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(14) << all.size() / elapsed << std::setprecision(1) << std::setw(10) << percentile(0.5)
+                  << std::setw(10) << percentile(0.99) << std::setw(10) << all.back() / 1000.0;
+        if (server) {
+            ServerStats after = server->stats();
+            std::cout << std::setw(12) << static_cast<double>(after.requests - before.requests) /
+                                              std::max<std::uint64_t>(1, after.batches - before.batches);
+        }
+        else {
+            std::cout << std::setw(12) << "-";
+        }
+        std::cout << std::endl;
+    };
+
+    runLoad("1 connection, depth 1", 1, 1);
+    runLoad(("1 connection, depth " + std::to_string(depth)).c_str(), 1, depth);
+    runLoad((std::to_string(connections) + " connections, depth " + std::to_string(depth)).c_str(), connections, depth);
+
+    std::cout << std::endl;
+    if (server) {
+        ServerStats stats = server->stats();
+        server->stop();
+        serverThread.join();
+        std::cout << stats.requests << " requests (" << stats.errors << " errors) in " << stats.batches
+                  << " batches, " << stats.columnarBatches << " evaluated column-wise; ";
+    }
+    std::cout << "server vs. local results: " << mismatches << " mismatch(es)" << std::endl << std::endl;
+    gFailed |= mismatches != 0;
+}
+
+struct Section {
+    const char* name;
+    void (*run)(const std::vector<std::string>& args);
+};
+
+/**
+ * Expressions fixed in the source: eval() and compile() parse the text on
+ * every run, a StaticExpression was parsed by the compiler. Expressions of
+ * literals are compared with eval(), where a StaticExpression is a constant;
+ * expressions over variables with a program compiled once, evaluated over a
+ * table of records. Checks that every path gives the same results.
+ */
+void benchStatic(const std::vector<std::string>&) {
+    const Evaluator evaluator;
+    size_t mismatches = 0;
+
+    std::cout << "=== Static expressions ===" << std::endl << std::endl;
+    std::cout << std::left << std::setw(34) << "Expression" << std::right << std::setw(14) << "eval/s"
+              << std::setw(16) << "compile+run/s" << std::setw(16) << "static/s" << std::endl;
+    std::cout << std::string(80, '-') << std::endl;
+
+    auto constant = [&](auto expression) {
+        static_assert(decltype(expression)::isConstant, "literals only");
+        std::string text(expression.text());
+        mismatches += evaluator.eval(text) != expression.value();
+
+        double interpreted = callsPerSecond([&] { return evaluator.eval(text); });
+        double compiled = callsPerSecond([&] { return evaluator.compile(text).evaluate(); });
+        double parsedByCompiler = callsPerSecond([&] { return expression(); });
+        std::cout << std::left << std::setw(34) << text << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(14) << interpreted << std::setw(16) << compiled << std::setw(16) << parsedByCompiler
+                  << std::endl;
+    };
+    constant(STATIC_EXPRESSION("1+2*3"));
+    constant(STATIC_EXPRESSION("2+2^2*3"));
+    constant(STATIC_EXPRESSION("(4>=4) && 0"));
+    constant(STATIC_EXPRESSION("(1 + 2) * 3 - 40 / 7 % 3 > 2 || 0"));
+
+    // Over variables, per record; the compiled program is built once, untimed
+    const size_t records = 4096;
+    std::mt19937 rng(24);
+    std::vector<int> table(records * 4);
+    for (int& value : table) {
+        value = static_cast<int>(rng() % 200) - 50;
+    }
+
+    std::cout << std::endl << std::left << std::setw(34) << "Expression (per record)" << std::right
+              << std::setw(14) << "compiled/s" << std::setw(16) << "static/s" << std::setw(16) << "speedup"
+              << std::endl;
+    std::cout << std::string(80, '-') << std::endl;
+
+    auto overRecords = [&](auto expression) {
+        static_assert(decltype(expression)::variableCount <= 4, "the table has four columns");
+        std::string text(expression.text());
+        CompiledExpression program = evaluator.compile(text);
+        for (size_t r = 0; r < records; r++) {
+            mismatches += program.evaluate(&table[r * 4]) != expression.evaluate(&table[r * 4]);
+        }
+
+        size_t next = 0;
+        double compiled = callsPerSecond([&] {
+            next = next + 1 == records ? 0 : next + 1;
+            return program.evaluate(&table[next * 4]);
+        });
+        double parsedByCompiler = callsPerSecond([&] {
+            next = next + 1 == records ? 0 : next + 1;
+            return expression.evaluate(&table[next * 4]);
+        });
+        std::cout << std::left << std::setw(34) << text << std::right << std::fixed << std::setprecision(0)
+                  << std::setw(14) << compiled << std::setw(16) << parsedByCompiler
+                  << std::setprecision(1) << std::setw(15) << parsedByCompiler / compiled << "x" << std::endl;
+    };
+    overRecords(STATIC_EXPRESSION("price * qty > limit || !flag"));
+    overRecords(STATIC_EXPRESSION("(a + b) * 3 - c % 7"));
+    overRecords(STATIC_EXPRESSION("x*x + 2*x*y + y*y"));
+    overRecords(STATIC_EXPRESSION("d != 0 && n / d > 3 && n % d == 0"));
+
+    std::cout << std::endl << "Static vs. eval()/compile() results: " << mismatches << " mismatch(es)" << std::endl
+              << std::endl;
+    gFailed |= mismatches != 0;
+}
+
+/**
+ * Lexing and validating large expressions with the 64-byte block classifier
+ * against the byte-at-a-time lexer: scanExpression(), tokenize() and the
+ * whole pipeline (eval(), or compile() for the shape with identifiers), in
+ * GB/s of expression text. Also checks that both lexers produce the same tokens.
+ *
+ * Args: [MB] (default: 16)
+ */
+void benchLexer(const std::vector<std::string>& args) {
+    const size_t megabytes = args.empty() ? 16 : std::stoul(args[0]);
+    const size_t bytes = megabytes << 20;
+
+    struct Shape {
+        const char* name;
+        std::string prefix, core, suffix;
+        bool identifiers;
+    };
+    const Shape shapes[] = {
+        {"flat", "12 + 34 * 5 - ", "1", "", false},
+        {"rules", "(order_total_cents >= 2500 && item_count != 0) ||\n    ", "flag", "", true},
+        {"whitespace", "1 +                                                             ", "1", "", false},
+        {"nested", "(", "1", ")", false},
+    };
+
+    auto build = [&](const Shape& shape) {
+        size_t repeats = (bytes - shape.core.size()) / (shape.prefix.size() + shape.suffix.size());
+        std::string text;
+        text.reserve(repeats * (shape.prefix.size() + shape.suffix.size()) + shape.core.size());
+        for (size_t i = 0; i < repeats; i++) {
+            text += shape.prefix;
+        }
+        text += shape.core;
+        for (size_t i = 0; i < repeats; i++) {
+            text += shape.suffix;
+        }
+        return text;
+    };
+
+    // GB/s of the fastest of five runs each way; the runs alternate between the
+    // scalar path and the block path, so both see the same machine
+    auto gigabytesPerSecond = [](size_t size, double (&best)[2], auto fn) {
+        best[0] = best[1] = 0;
+        for (int run = 0; run < 10; run++) {
+            int vector = run % 2;
+            scan::setSimdEnabled(vector != 0);
+            auto start = Clock::now();
+            fn();
+            best[vector] = std::max(best[vector],
+                                    size / std::chrono::duration<double>(Clock::now() - start).count() / 1e9);
+        }
+        scan::setSimdEnabled(true);
+    };
+
+    Evaluator evaluator;
+    evaluator.setLimits({UINT32_MAX, SIZE_MAX, SIZE_MAX});
+    EvalContext context;
+    std::vector<Token> tokens;
+    bool simd = scan::simdAvailable();
+
+    std::cout << "=== Lexing large expressions: bytes vs. 64-byte blocks (" << megabytes << " MB, "
+              << (simd ? "avx2" : "avx2 not available") << ") ===" << std::endl << std::endl;
+    std::cout << std::left << std::setw(12) << "Shape" << std::right
+              << std::setw(10) << "scan" << std::setw(10) << "scan"
+              << std::setw(12) << "tokenize" << std::setw(12) << "tokenize" << std::setw(9) << ""
+              << std::setw(10) << "eval" << std::setw(10) << "eval" << std::setw(9) << "" << std::endl;
+    std::cout << std::left << std::setw(12) << "" << std::right
+              << std::setw(10) << "scalar" << std::setw(10) << "simd"
+              << std::setw(12) << "bytes" << std::setw(12) << "blocks" << std::setw(9) << "speedup"
+              << std::setw(10) << "bytes" << std::setw(10) << "blocks" << std::setw(9) << "speedup" << std::endl;
+    std::cout << std::string(94, '-') << std::endl;
+
+    size_t mismatches = 0;
+    for (const Shape& shape : shapes) {
+        std::string text = build(shape);
+        double scan[2], lex[2], whole[2];
+        std::vector<Token> reference;
+
+        gigabytesPerSecond(text.size(), scan, [&] {
+            sink = static_cast<int>(scan::scanExpression(text).maxDepth);
+        });
+        gigabytesPerSecond(text.size(), lex, [&] {
+            tokenize(text, tokens);
+            sink = static_cast<int>(tokens.size());
+        });
+        gigabytesPerSecond(text.size(), whole, [&] {
+            sink = shape.identifiers ? static_cast<int>(evaluator.compile(text).variableCount())
+                                     : evaluator.eval(text, context);
+        });
+
+        scan::setSimdEnabled(false);
+        tokenize(text, reference);
+        scan::setSimdEnabled(true);
+        tokenize(text, tokens);
+        if (tokens.size() != reference.size() ||
+            !std::equal(tokens.begin(), tokens.end(), reference.begin(), [](const Token& a, const Token& b) {
+                return a.kind == b.kind && a.offset == b.offset && a.length == b.length;
+            })) {
+            mismatches++;
+        }
+
+        std::cout << std::left << std::setw(12) << shape.name << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(10) << scan[0] << std::setw(10) << scan[1]
+                  << std::setw(12) << lex[0] << std::setw(12) << lex[1]
+                  << std::setprecision(1) << std::setw(8) << lex[1] / lex[0] << "x"
+                  << std::setprecision(2) << std::setw(10) << whole[0] << std::setw(10) << whole[1]
+                  << std::setprecision(1) << std::setw(8) << whole[1] / whole[0] << "x" << std::endl;
+    }
+    std::cout << std::endl << "GB/s of expression text; 'rules' has identifiers, so its eval column is compile(). "
+              << "Token mismatches between the two lexers: " << mismatches << std::endl << std::endl;
+    gFailed |= mismatches != 0;
+}
+
+const Section kSections[] = {
+    {"compile", benchCompile},
+    {"construct", benchConstruct},
+    {"batch", benchBatch},
+    {"simd", benchSimd},
+    {"fold", benchFold},
+    {"shortcircuit", benchShortCircuit},
+    {"cache", benchCache},
+    {"parallel", benchParallel},
+    {"jit", benchJit},
+    {"stream", benchStream},
+    {"alloc", benchAlloc},
+    {"numeric", benchNumeric},
+    {"typed", benchTyped},
+    {"profile", benchProfile},
+    {"scaling", benchScaling},
+    {"graph", benchGraph},
+    {"programfile", benchProgramFile},
+    {"ruleset", benchRuleSet},
+    {"predicate", benchPredicate},
+    {"server", benchServer},
+    {"static", benchStatic},
+    {"lexer", benchLexer},
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool ranAny = false;
+    std::vector<std::string> args(argv + std::min(argc, 2), argv + argc);
+
+    for (const Section& section : kSections) {
+        if (argc < 2 || std::strcmp(argv[1], section.name) == 0) {
+            section.run(args);
+            ranAny = true;
+        }
+    }
+
+    if (!ranAny) {
+        std::cerr << "Unknown section: " << argv[1] << std::endl;
+        return 1;
+    }
+
+    return gFailed ? 1 : 0;
+}
@@ -1,17 +1,159 @@
 
 #include "Evaluator.h"
+#include "EvalServer.h"
+#include "StreamEvaluator.h"
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <thread>
 #include <vector>
 #include <string>
 #include <iomanip>
 
+/**
+ * Streaming mode: evaluates one expression per line of a file (or stdin for "-")
+ * and writes one result or error line per input line to stdout.
+ *
+ * @param path The input file, or "-" for stdin.
+ * @param profilePath If not null, the profile is written there as JSON at the end
+ *        (requires a build with -DEVALUATOR_PROFILE=1).
+ *
+ * Time Complexity: O(n) where n is the size of the input.
+ */
+int runStream(const std::string& path, const char* profilePath) {
+    Evaluator eval;
+    try {
+        LineReader input(path);
+        BufferedWriter output(stdout);
+        StreamStats stats = evaluateStream(eval, input, output);
+        output.flush();
+        std::cerr << stats.lines << " line(s), " << stats.errors << " error(s), " << stats.bytes << " byte(s)"
+                  << std::endl;
+
+        if (profilePath) {
+            if (!profile::kEnabled) {
+                std::cerr << "Warning: built without EVALUATOR_PROFILE, the profile is empty" << std::endl;
+            }
+            std::ofstream profileOut(profilePath);
+            profileOut << profile::toJson(profile::snapshot()) << std::endl;
+            if (!profileOut) {
+                throw std::runtime_error("Cannot write profile to " + std::string(profilePath));
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Server mode: serves evaluation requests on a Unix domain socket until
+ * SIGINT or SIGTERM (see EvalServer.h for the protocol).
+ *
+ * @param socketPath The socket to listen on.
+ * @param threads Worker threads; 0 uses every hardware thread.
+ */
+int runServer(const std::string& socketPath, unsigned threads) {
+    // Block the signals before any thread starts, so only the waiting thread receives them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    try {
+        ServerOptions options;
+        options.socketPath = socketPath;
+        options.threads = threads;
+        EvalServer server(options);
+        std::thread([&server, signals] {
+            int received;
+            sigwait(&signals, &received);
+            server.stop();
+        }).detach();
+
+        std::cerr << "Serving on " << socketPath << " with " << server.threadCount() << " worker thread(s)"
+                  << std::endl;
+        server.run();
+        ServerStats stats = server.stats();
+        std::cerr << stats.connections << " connection(s), " << stats.requests << " request(s), " << stats.errors
+                  << " error(s), " << stats.batches << " batch(es)";
+        if (stats.rejected != 0 || stats.acceptErrors != 0) {
+            std::cerr << ", " << stats.rejected << " connection(s) rejected for lack of descriptors, "
+                      << stats.acceptErrors << " accept error(s)";
+        }
+        std::cerr << std::endl;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
 /**
  * Main function to demonstrate the Evaluator class.
+ * Run with "--stream [file] [--profile out.json]" to evaluate a file or stdin
+ * line by line instead, or "--serve <socket> [--threads n]" to serve requests
+ * on a Unix domain socket.
  *
  * Time Complexity: O(n*m) where n is the number of test expressions
  * and m is the average length of each expression.
  */
-int main() {
+int main(int argc, char** argv) {
+    if (argc >= 2 && std::strcmp(argv[1], "--stream") == 0) {
+        std::string path = "-";
+        const char* profilePath = nullptr;
+        bool pathGiven = false;
+        for (int i = 2; i < argc; i++) {
+            // "-" is stdin; any other argument starting with '-' must be --profile with its value
+            bool ok = true;
+            if (std::strcmp(argv[i], "--profile") == 0) {
+                ok = i + 1 < argc;
+                profilePath = ok ? argv[++i] : nullptr;
+            }
+            else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+                ok = false;
+            }
+            else {
+                ok = !pathGiven;
+                path = argv[i];
+                pathGiven = true;
+            }
+            if (!ok) {
+                std::cerr << "Usage: evaluator --stream [file] [--profile out.json]   (no file or - reads stdin)"
+                          << std::endl;
+                return 1;
+            }
+        }
+        return runStream(path, profilePath);
+    }
+    if (argc >= 3 && std::strcmp(argv[1], "--serve") == 0) {
+        unsigned threads = 0;
+        for (int i = 3; i < argc; i++) {
+            bool ok = std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc;
+            if (ok) {
+                const char* text = argv[++i];
+                char* end = nullptr;
+                errno = 0;
+                unsigned long value = std::strtoul(text, &end, 10);
+                ok = text[0] >= '0' && text[0] <= '9' && *end == '\0' && errno == 0 && value <= 4096;
+                threads = static_cast<unsigned>(value);
+            }
+            if (!ok) {
+                std::cerr << "Usage: evaluator --serve <socket> [--threads n]   (n from 0 to 4096; 0 uses every "
+                          << "hardware thread)" << std::endl;
+                return 1;
+            }
+        }
+        return runServer(argv[2], threads);
+    }
+
     Evaluator eval;
 
     // Test expressions from the requirements
@@ -22,7 +164,7 @@ int main() {
         "1+3 > 2",           // 1 (true)
         "(4>=4) && 0",       // 0 (false)
         "(1+2)*3",           // 9
-        "+++2-5*(3^2)"       // -41
+        "+++2-5*(3^2)"       // -42: ++(+2) - 45
     };
 
     std::cout << "=== Testing expressions from requirements ===" << std::endl << std::endl;
@@ -75,15 +217,79 @@ int main() {
         }
     }
 
+    std::cout << std::endl << "=== Numeric modes ===" << std::endl << std::endl;
+    std::cout << std::left << std::setw(26) << "Expression" << std::setw(14) << "int32" << std::setw(22) << "int64"
+              << std::setw(38) << "checked int64" << "bigint" << std::endl;
+    std::cout << std::string(120, '-') << std::endl;
+
+    // Results that do not fit in 32 (or 64) bits
+    std::vector<std::string> wideExpressions = {
+        "3000000000 * 4",
+        "2^40",
+        "9223372036854775807 + 1",
+        "2^100"
+    };
+
+    // Prints one mode's result, or its error message
+    auto showMode = [](int width, auto evaluate) {
+        std::cout << std::setw(width);
+        try {
+            std::cout << evaluate();
+        }
+        catch (const std::exception& e) {
+            std::cout << e.what();
+        }
+    };
+
+    for (const auto& expr : wideExpressions) {
+        std::cout << std::left << std::setw(26) << expr;
+        showMode(14, [&] { return eval.evalAs<Int32Arithmetic>(expr); });
+        showMode(22, [&] { return eval.evalAs<Int64Arithmetic>(expr); });
+        showMode(38, [&] { return eval.evalAs<CheckedInt64Arithmetic>(expr); });
+        showMode(0, [&] { return eval.evalAs<BigIntArithmetic>(expr); });
+        std::cout << std::endl;
+    }
+
+    std::cout << std::endl << "=== Typed expressions ===" << std::endl << std::endl;
+    std::cout << std::left << std::setw(36) << "Expression" << std::setw(8) << "Type" << "Result" << std::endl;
+    std::cout << "----------------------------------------------------" << std::endl;
+
+    // Decimal literals and Double variables need compileTyped()
+    std::vector<TypedVariable> scoreVariables = {{"score", ValueType::Double}, {"bias", ValueType::Double}};
+    std::vector<TypedValue> scoreValues = {TypedValue::ofDouble(0.8), TypedValue::ofDouble(0.2)};
+    std::vector<std::string> typedExpressions = {
+        "1/2",
+        "1/2.0",
+        "1.5e3 + 2 * 3",
+        "0.75 * score + 0.25 * bias",
+        "0.75 * score + 0.25 * bias >= 0.5"
+    };
+
+    for (const auto& expr : typedExpressions) {
+        std::cout << std::left << std::setw(36) << expr;
+        try {
+            TypedExpression program = eval.compileTyped(expr, scoreVariables);
+            TypedValue value = program.evaluate(scoreValues);
+            std::cout << std::setw(8) << typeName(value.type);
+            if (value.type == ValueType::Double) {
+                std::cout << value.d << std::endl;
+            }
+            else {
+                std::cout << value.i << std::endl;
+            }
+        }
+        catch (const std::exception& e) {
+            std::cout << "Error: " << e.what() << std::endl;
+        }
+    }
+
     std::cout << std::endl << "=== Interactive Mode ===" << std::endl;
     std::cout << "Enter expressions to evaluate (type 'exit' to quit)" << std::endl;
 
     std::string userExpr;
     while (true) {
         std::cout << std::endl << "Expression: ";
-        std::getline(std::cin, userExpr);
-
-        if (userExpr == "exit") {
+        if (!std::getline(std::cin, userExpr) || userExpr == "exit") {
             break;
         }
 
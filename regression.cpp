@@ -0,0 +1,1148 @@
+#include "Evaluator.h"
+#include "ExpressionCache.h"
+#include "ExpressionGenerator.h"
+#include "Jit.h"
+#include "Lexer.h"
+#include "ParallelEvaluator.h"
+#include "PredicateIndex.h"
+#include "ProgramFile.h"
+#include "RuleSet.h"
+#include "Scanner.h"
+#include "StaticExpression.h"
+#include "StreamEvaluator.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Benchmark suite and regression harness for the Evaluator.
+ *
+ * Usage:
+ *   regression bench [--json FILE] [--seed N] [--time SECONDS] [--repetitions N]
+ *                    [--max-length BYTES] [--samples N]
+ *   regression fuzz [--iterations N] [--seed N] [--ops MIX] [--depth N] [--digits N]
+ *   regression compare BASELINE.json CURRENT.json [--tolerance PERCENT]
+ *
+ * "bench" measures eval() throughput on generated workloads, per-call latency
+ * percentiles and how eval() and compile() scale with expression length, and
+ * can write the results as JSON. "compare" reports the differences between two
+ * such files and fails if anything got slower than the tolerance allows.
+ * "fuzz" runs random expressions through every evaluation path and fails if
+ * any of them disagrees with eval().
+ */
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Keeps the optimizer from discarding results we never print
+volatile int sink;
+
+/**
+ * Command-line options of the form "--name value" after the mode.
+ */
+class Options {
+public:
+    Options(int argc, char** argv, int first) {
+        for (int i = first; i < argc; i++) {
+            if (std::strncmp(argv[i], "--", 2) == 0 && i + 1 < argc) {
+                values[argv[i] + 2] = argv[i + 1];
+                i++;
+            }
+            else {
+                positional.push_back(argv[i]);
+            }
+        }
+    }
+
+    std::string get(const std::string& name, const std::string& fallback) const {
+        auto it = values.find(name);
+        return it == values.end() ? fallback : it->second;
+    }
+
+    double number(const std::string& name, double fallback) const {
+        auto it = values.find(name);
+        return it == values.end() ? fallback : std::stod(it->second);
+    }
+
+    std::vector<std::string> positional;
+
+private:
+    std::map<std::string, std::string> values;
+};
+
+// ---------------------------------------------------------------------------
+// bench
+// ---------------------------------------------------------------------------
+
+/**
+ * One measurement, as written to the JSON report.
+ */
+struct Result {
+    std::string name;       // e.g. "eval/arithmetic" or "latency/nested/p99"
+    double value;
+    std::string unit;
+    bool higherIsBetter;
+    bool gated = true;      // Whether "compare" fails on a regression (false for noisy extremes)
+};
+
+/**
+ * A named generator configuration for the throughput and latency benchmarks.
+ * All of them are safe, so no call throws.
+ */
+struct Workload {
+    const char* name;
+    GeneratorOptions options;
+};
+
+std::vector<Workload> workloads() {
+    auto make = [](const char* mix, std::size_t depth, double nest, std::size_t digits) {
+        GeneratorOptions options;
+        options.binaryOperators = ExpressionGenerator::parseOperatorMix(mix);
+        options.maxDepth = depth;
+        options.nestProbability = nest;
+        options.maxLiteralDigits = digits;
+        options.safe = true;
+        return options;
+    };
+    return {
+        {"arithmetic", make("arithmetic", 2, 0.2, 3)},
+        {"predicates", make("comparison,logical,+,*", 3, 0.3, 3)},
+        {"nested", make("all", 8, 0.5, 2)},
+        {"wide-literals", make("+,-,*,/", 2, 0.2, 9)},
+        {"mixed", make("all", 4, 0.3, 4)},
+    };
+}
+
+/**
+ * Runs fn over and over for roughly the given duration, several times.
+ *
+ * @param repetitions Number of timed runs; the fastest one counts, since
+ *        interference only ever slows a run down.
+ * @return Calls per second.
+ *
+ * Time Complexity: O(k) where k is the number of calls that fit in the duration.
+ */
+template <typename Fn>
+double callsPerSecond(Fn fn, double seconds, int repetitions) {
+    double best = 0;
+    for (int repetition = 0; repetition < repetitions; repetition++) {
+        std::size_t calls = 0;
+        std::size_t batch = 1;
+        auto start = Clock::now();
+        double elapsed = 0;
+
+        while (elapsed < seconds) {
+            for (std::size_t i = 0; i < batch; i++) {
+                sink = fn();
+            }
+            calls += batch;
+            batch *= 2;
+            elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        }
+        best = std::max(best, calls / elapsed);
+    }
+    return best;
+}
+
+// The value at quantile q of sorted samples
+double percentile(const std::vector<double>& sorted, double q) {
+    std::size_t index = static_cast<std::size_t>(q * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+void printResult(const Result& result) {
+    std::cout << std::left << std::setw(40) << result.name << std::right << std::fixed
+              << std::setprecision(result.value < 100 ? 2 : 0) << std::setw(18) << result.value
+              << "  " << result.unit << std::endl;
+}
+
+std::string toJson(const std::vector<Result>& results, std::uint64_t seed) {
+    std::ostringstream out;
+    out << "{\n  \"version\": 1,\n  \"seed\": " << seed << ",\n  \"results\": [\n";
+    for (std::size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"value\": " << std::setprecision(17) << r.value
+            << ", \"unit\": \"" << r.unit << "\", \"higherIsBetter\": " << (r.higherIsBetter ? "true" : "false")
+            << ", \"gated\": " << (r.gated ? "true" : "false") << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return out.str();
+}
+
+/**
+ * Throughput per workload, latency percentiles and length scaling.
+ */
+int runBench(const Options& options) {
+    const std::uint64_t seed = static_cast<std::uint64_t>(options.number("seed", 1));
+    const double seconds = options.number("time", 0.2);
+    const int repetitions = static_cast<int>(options.number("repetitions", 3));
+    const std::size_t maxLength = static_cast<std::size_t>(options.number("max-length", 1000000));
+    const std::size_t samples = static_cast<std::size_t>(options.number("samples", 200000));
+    const std::string jsonPath = options.get("json", "");
+
+    Evaluator evaluator;
+    std::vector<Result> results;
+    auto record = [&](Result result) {
+        printResult(result);
+        results.push_back(std::move(result));
+    };
+
+    std::cout << "=== Throughput (1024 generated expressions per workload) ===" << std::endl << std::endl;
+    for (const Workload& workload : workloads()) {
+        ExpressionGenerator generator(seed, workload.options);
+        std::vector<std::string> pool;
+        std::size_t bytes = 0;
+        for (int i = 0; i < 1024; i++) {
+            pool.push_back(generator.next());
+            bytes += pool.back().size();
+        }
+        std::vector<CompiledExpression> programs;
+        for (const std::string& expr : pool) {
+            programs.push_back(evaluator.compile(expr));
+        }
+
+        std::size_t next = 0;
+        double evals = callsPerSecond([&] { return evaluator.eval(pool[next++ & 1023]); }, seconds, repetitions);
+        double compiles = callsPerSecond([&] {
+            return static_cast<int>(evaluator.compile(pool[next++ & 1023]).instructions().size());
+        }, seconds, repetitions);
+        double evaluates = callsPerSecond([&] { return programs[next++ & 1023].evaluate(); }, seconds, repetitions);
+
+        std::string name = workload.name;
+        record({"eval/" + name, evals, "calls/s", true});
+        record({"eval/" + name + "/bytes", evals * static_cast<double>(bytes) / 1024 / 1e6, "MB/s", true});
+        record({"compile/" + name, compiles, "calls/s", true});
+        record({"evaluate/" + name, evaluates, "calls/s", true});
+    }
+
+    std::cout << std::endl << "=== eval() latency (" << samples << " calls per workload) ===" << std::endl << std::endl;
+
+    // What reading the clock twice costs, included in every sample below
+    std::vector<double> overhead(1000);
+    for (double& sample : overhead) {
+        auto start = Clock::now();
+        sample = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+    std::sort(overhead.begin(), overhead.end());
+    record({"latency/timer-overhead", percentile(overhead, 0.5), "ns", false, false});
+
+    for (const Workload& workload : workloads()) {
+        ExpressionGenerator generator(seed + 1, workload.options);
+        std::vector<std::string> pool;
+        for (int i = 0; i < 4096; i++) {
+            pool.push_back(generator.next());
+        }
+
+        std::vector<double> latencies(samples);
+        for (std::size_t i = 0; i < samples; i++) {
+            const std::string& expr = pool[i & 4095];
+            auto start = Clock::now();
+            sink = evaluator.eval(expr);
+            latencies[i] = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        }
+        std::sort(latencies.begin(), latencies.end());
+
+        std::string name = std::string("latency/") + workload.name;
+        record({name + "/p50", percentile(latencies, 0.5), "ns", false});
+        record({name + "/p99", percentile(latencies, 0.99), "ns", false});
+        record({name + "/p999", percentile(latencies, 0.999), "ns", false});
+        record({name + "/max", latencies.back(), "ns", false, false});
+    }
+
+    std::cout << std::endl << "=== Scaling with expression length ===" << std::endl << std::endl;
+    GeneratorOptions scalingOptions;
+    scalingOptions.binaryOperators = ExpressionGenerator::parseOperatorMix("arithmetic,comparison");
+    scalingOptions.safe = true;
+    for (std::size_t length = 10; length <= maxLength; length *= 10) {
+        ExpressionGenerator generator(seed + 2, scalingOptions);
+        std::string expr = generator.next(length);
+        double megabytes = static_cast<double>(expr.size()) / 1e6;
+
+        double evals = callsPerSecond([&] { return evaluator.eval(expr); }, seconds, repetitions);
+        double compiles = callsPerSecond([&] {
+            return static_cast<int>(evaluator.compile(expr).instructions().size());
+        }, seconds, repetitions);
+
+        std::string name = "scaling/" + std::to_string(length);
+        record({name + "/eval", evals * megabytes, "MB/s", true});
+        record({name + "/compile", compiles * megabytes, "MB/s", true});
+    }
+
+    if (!jsonPath.empty()) {
+        std::ofstream out(jsonPath);
+        out << toJson(results, seed);
+        if (!out) {
+            std::cerr << "Cannot write " << jsonPath << std::endl;
+            return 1;
+        }
+        std::cout << std::endl << "Wrote " << results.size() << " results to " << jsonPath << std::endl;
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// compare
+// ---------------------------------------------------------------------------
+
+/**
+ * Reads the results of a report written by runBench(). Only that format is
+ * understood: one result object per line.
+ */
+std::map<std::string, Result> readReport(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Cannot read " + path);
+    }
+
+    // Returns the text after "key": on the line, or an empty view
+    auto field = [](const std::string& line, const char* key) {
+        std::string pattern = std::string("\"") + key + "\": ";
+        std::size_t at = line.find(pattern);
+        return at == std::string::npos ? std::string() : line.substr(at + pattern.size());
+    };
+
+    std::map<std::string, Result> results;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::string name = field(line, "name");
+        if (name.empty()) {
+            continue;
+        }
+        Result result;
+        result.name = name.substr(1, name.find('"', 1) - 1);
+        result.value = std::stod(field(line, "value"));
+        std::string unit = field(line, "unit");
+        result.unit = unit.substr(1, unit.find('"', 1) - 1);
+        result.higherIsBetter = field(line, "higherIsBetter").compare(0, 4, "true") == 0;
+        result.gated = field(line, "gated").compare(0, 5, "false") != 0;
+        results[result.name] = result;
+    }
+    return results;
+}
+
+int runCompare(const Options& options) {
+    if (options.positional.size() != 2) {
+        std::cerr << "Usage: regression compare BASELINE.json CURRENT.json [--tolerance PERCENT]" << std::endl;
+        return 2;
+    }
+    const double tolerance = options.number("tolerance", 10);
+    std::map<std::string, Result> baseline = readReport(options.positional[0]);
+    std::map<std::string, Result> current = readReport(options.positional[1]);
+
+    std::cout << std::left << std::setw(40) << "Benchmark" << std::right << std::setw(16) << "baseline"
+              << std::setw(16) << "current" << std::setw(10) << "change" << std::endl;
+    std::cout << std::string(82, '-') << std::endl;
+
+    std::size_t regressions = 0;
+    for (const auto& [name, before] : baseline) {
+        auto it = current.find(name);
+        if (it == current.end()) {
+            std::cout << std::left << std::setw(40) << name << "  missing from the current report" << std::endl;
+            continue;
+        }
+        const Result& after = it->second;
+
+        // Positive change is an improvement whichever direction is better
+        double change = before.value == 0 ? 0 : (after.value - before.value) / before.value * 100;
+        if (!before.higherIsBetter) {
+            change = -change;
+        }
+        bool regressed = change < -tolerance && before.gated;
+        regressions += regressed;
+
+        std::cout << std::left << std::setw(40) << name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(16) << before.value << std::setw(16) << after.value
+                  << std::setw(9) << std::showpos << change << std::noshowpos << "%"
+                  << (regressed ? "  REGRESSION" : before.gated ? "" : "  (not gated)") << std::endl;
+    }
+
+    std::cout << std::endl << regressions << " regression(s) beyond " << tolerance << "%" << std::endl;
+    return regressions ? 1 : 0;
+}
+
+// ---------------------------------------------------------------------------
+// fuzz
+// ---------------------------------------------------------------------------
+
+/**
+ * The result of evaluating one row: a value or an error message.
+ */
+struct Outcome {
+    bool ok = false;
+    std::int64_t value = 0;
+    std::string error;
+};
+
+// Runs fn and captures its result or error
+template <typename Fn>
+Outcome capture(Fn fn) {
+    Outcome outcome;
+    try {
+        outcome.value = static_cast<std::int64_t>(fn());
+        outcome.ok = true;
+    }
+    catch (const std::exception& e) {
+        outcome.error = e.what();
+    }
+    return outcome;
+}
+
+// The error without its position: "Division by zero @ char 3" -> "Division by zero"
+std::string errorKind(const std::string& error) {
+    return error.substr(0, error.find(" @"));
+}
+
+// What scan::scanExpression() must find, worked out from the lexer's tokens:
+// its Invalid tokens other than a stray '.', and the depth of its parentheses
+scan::ScanSummary scanByTokens(std::string_view text) {
+    scan::ScanSummary summary;
+    for (const Token& token : tokenize(text)) {
+        if (token.kind == TokenKind::Invalid && text[token.offset] != '.' &&
+            summary.firstInvalid == scan::ScanSummary::npos) {
+            summary.firstInvalid = token.offset;
+        }
+        else if (token.kind == TokenKind::LeftParen) {
+            summary.maxDepth = std::max(summary.maxDepth, ++summary.depth);
+        }
+        else if (token.kind == TokenKind::RightParen && --summary.depth < 0 &&
+                 summary.firstUnmatchedClose == scan::ScanSummary::npos) {
+            summary.firstUnmatchedClose = token.offset;
+        }
+    }
+    return summary;
+}
+
+// A scan summary as an outcome, so FuzzReport can compare and print it
+Outcome describe(const scan::ScanSummary& summary) {
+    auto position = [](std::size_t at) {
+        return at == scan::ScanSummary::npos ? std::string("none") : std::to_string(at);
+    };
+    Outcome outcome;
+    outcome.error = "invalid " + position(summary.firstInvalid) + ", unmatched ) " +
+                    position(summary.firstUnmatchedClose) + ", depth " + std::to_string(summary.depth) +
+                    ", max depth " + std::to_string(summary.maxDepth);
+    return outcome;
+}
+
+/**
+ * One fuzz case: a literal-only expression, the same expression with every
+ * distinct literal replaced by a variable of the same length (so error
+ * positions stay the same), and rows of values for those variables. Row 0
+ * holds the original literal values; expected[r] is eval() of the expression
+ * with row r's values substituted.
+ */
+struct Case {
+    std::string expression;
+    std::string withVariables;
+    std::vector<std::string> names;
+    std::vector<std::vector<std::int32_t>> columns;     // columns[v][row]
+    std::vector<Outcome> expected;                      // Per row
+    std::size_t firstFailingRow = 0;                    // Or rows() when no row fails
+
+    std::size_t rows() const { return expected.size(); }
+};
+
+/**
+ * Builds a case from a generated expression, with rows - 1 rows of random values.
+ */
+Case makeCase(const Evaluator& evaluator, const std::string& expression, std::size_t rows, std::mt19937_64& rng) {
+    Case c;
+    c.expression = expression;
+    c.withVariables = expression;
+
+    std::vector<Token> tokens = tokenize(expression);
+    std::vector<std::size_t> literalSlot;       // Per Number token, its variable
+    std::map<std::string, std::size_t> slots;
+    for (const Token& token : tokens) {
+        if (token.kind != TokenKind::Number) {
+            continue;
+        }
+        std::string text(tokenText(token, expression));
+        auto inserted = slots.emplace(text, c.names.size());
+        if (inserted.second) {
+            // "7" -> "h", "123" -> "b23": distinct literals get distinct names of the same length
+            std::string name = text;
+            name[0] = static_cast<char>('a' + (text[0] - '0'));
+            c.names.push_back(name);
+            c.columns.push_back({token.value});
+        }
+        literalSlot.push_back(inserted.first->second);
+        c.withVariables.replace(token.offset, token.length, c.names[inserted.first->second]);
+    }
+
+    // Small values hit zero divisors and both sides of && / ||; a few extremes test wrapping
+    std::uniform_int_distribution<int> small(-3, 9);
+    const std::int32_t extremes[] = {INT32_MIN, INT32_MAX, -1, 0, 1 << 30};
+    for (std::vector<std::int32_t>& column : c.columns) {
+        for (std::size_t r = 1; r < rows; r++) {
+            column.push_back(rng() % 16 == 0 ? extremes[rng() % 5] : small(rng));
+        }
+    }
+
+    c.expected.push_back(capture([&] { return evaluator.eval(expression); }));
+    for (std::size_t r = 1; r < rows; r++) {
+        std::string substituted;
+        std::size_t copied = 0;
+        std::size_t literal = 0;
+        for (const Token& token : tokens) {
+            if (token.kind != TokenKind::Number) {
+                continue;
+            }
+            std::int32_t value = c.columns[literalSlot[literal++]][r];
+            substituted.append(expression, copied, token.offset - copied);
+            // INT32_MIN has no literal; write it as a wrapping difference
+            substituted += value == INT32_MIN ? "(-2147483647-1)"
+                         : value < 0 ? "(" + std::to_string(value) + ")" : std::to_string(value);
+            copied = token.offset + token.length;
+        }
+        substituted.append(expression, copied, std::string::npos);
+        c.expected.push_back(capture([&] { return evaluator.eval(substituted); }));
+    }
+
+    c.firstFailingRow = rows;
+    for (std::size_t r = 0; r < rows && c.firstFailingRow == rows; r++) {
+        if (!c.expected[r].ok) {
+            c.firstFailingRow = r;
+        }
+    }
+    return c;
+}
+
+/**
+ * Counts checks and mismatches per evaluation path and prints the first few mismatches.
+ */
+class FuzzReport {
+public:
+    // Compares one row. Errors of rows other than 0 are compared by kind only,
+    // since their expected messages come from a differently positioned text;
+    // so are those of paths that do not promise exact positions.
+    void check(const std::string& path, const Case& c, std::size_t row, const Outcome& got, bool exact = true) {
+        const Outcome& want = c.expected[row];
+        bool same = want.ok == got.ok &&
+                    (want.ok ? want.value == got.value
+                             : row == 0 && exact ? want.error == got.error
+                                                 : errorKind(want.error) == errorKind(got.error));
+        record(path, c.expression, same, row, want, got);
+    }
+
+    // Compares a whole batch: the values of every row, or an error naming a
+    // failing row. Batches run one instruction over all rows at a time, so the
+    // row named is the first to fail at the earliest failing instruction, which
+    // need not be the lowest failing row.
+    void checkBatch(const std::string& path, const Case& c, const Outcome& thrown,
+                    const std::vector<std::int32_t>& out) {
+        if (c.firstFailingRow < c.rows()) {
+            std::size_t at = thrown.ok ? std::string::npos : thrown.error.rfind(" (row ");
+            std::size_t row = at == std::string::npos ? c.firstFailingRow
+                                                      : std::strtoul(thrown.error.c_str() + at + 6, nullptr, 10);
+            row = row < c.rows() ? row : c.firstFailingRow;
+            const Outcome& want = c.expected[row];
+            bool same = at != std::string::npos && !want.ok && errorKind(thrown.error) == errorKind(want.error);
+            record(path, c.expression, same, row, want, thrown);
+            return;
+        }
+        if (!thrown.ok) {
+            record(path, c.expression, false, 0, c.expected[0], thrown);
+            return;
+        }
+        for (std::size_t r = 0; r < c.rows(); r++) {
+            if (out[r] != c.expected[r].value) {
+                Outcome got;
+                got.ok = true;
+                got.value = out[r];
+                record(path, c.expression, false, r, c.expected[r], got);
+                return;
+            }
+        }
+        record(path, c.expression, true, 0, c.expected[0], thrown);
+    }
+
+    // Compares a result with one computed by another path than eval(), exactly
+    void expect(const std::string& path, const std::string& input, const Outcome& want, const Outcome& got) {
+        bool same = want.ok == got.ok && (want.ok ? want.value == got.value : want.error == got.error);
+        record(path, input, same, 0, want, got);
+    }
+
+    // Records a result that must be an error, whichever error it is
+    void expectError(const std::string& path, const std::string& input, const Outcome& got) {
+        Outcome want;
+        want.error = "any error";
+        record(path, input, !got.ok, 0, want, got);
+    }
+
+    bool print() const {
+        std::cout << std::left << std::setw(28) << "Path" << std::right << std::setw(12) << "checks"
+                  << std::setw(12) << "mismatches" << std::endl;
+        std::cout << std::string(52, '-') << std::endl;
+        std::size_t total = 0;
+        for (const auto& [path, counts] : paths) {
+            std::cout << std::left << std::setw(28) << path << std::right << std::setw(12) << counts.first
+                      << std::setw(12) << counts.second << std::endl;
+            total += counts.second;
+        }
+        std::cout << std::endl << (total ? "FAILED: " : "OK: ") << total << " mismatch(es)" << std::endl;
+        return total == 0;
+    }
+
+private:
+    void record(const std::string& path, const std::string& expression, bool same, std::size_t row,
+                const Outcome& want, const Outcome& got) {
+        std::pair<std::size_t, std::size_t>& counts = paths[path];
+        counts.first++;
+        if (same) {
+            return;
+        }
+        counts.second++;
+        if (shown++ < 10) {
+            auto describe = [](const Outcome& o) { return o.ok ? std::to_string(o.value) : "error: " + o.error; };
+            std::string text = expression.size() > 200 ? expression.substr(0, 200) + "..." : expression;
+            std::cout << "MISMATCH [" << path << "] row " << row << ": " << text << std::endl
+                      << "  expected: " << describe(want) << std::endl
+                      << "  got:      " << describe(got) << std::endl;
+        }
+    }
+
+    std::map<std::string, std::pair<std::size_t, std::size_t>> paths;     // Checks and mismatches
+    std::size_t shown = 0;
+};
+
+/**
+ * Differential testing: every evaluation path must agree with eval().
+ */
+int runFuzz(const Options& options) {
+    const std::size_t iterations = static_cast<std::size_t>(options.number("iterations", 20000));
+    const std::uint64_t seed = static_cast<std::uint64_t>(options.number("seed", 1));
+    const std::size_t rows = 64;
+    const std::size_t parallelCopies = 40;  // Parallel batches repeat the rows over several chunks
+
+    GeneratorOptions generatorOptions;
+    generatorOptions.binaryOperators = ExpressionGenerator::parseOperatorMix(options.get("ops", "all"));
+    generatorOptions.maxDepth = static_cast<std::size_t>(options.number("depth", 4));
+    generatorOptions.maxLiteralDigits = static_cast<std::size_t>(options.number("digits", 2));
+    generatorOptions.unaryProbability = 0.2;
+    ExpressionGenerator generator(seed, generatorOptions);
+    std::mt19937_64 rng(seed);
+
+    Evaluator evaluator;
+    Evaluator unfolded;
+    unfolded.setConstantFolding(false);
+    ExpressionCache cache;
+    ParallelEvaluator parallel(4, 1024);
+    EvalContext context;
+    FuzzReport report;
+    std::vector<Case> streamCases;      // Row 0 of every case, checked by one streaming run at the end
+
+    bool jitWasEnabled = jit::enabled();
+    std::uint32_t jitThreshold = jit::threshold();
+
+    // An empty fixed variable list is its own cache entry: a program whose slots were
+    // assigned by first use must not answer for it, nor the other way round
+    for (bool fixedFirst : {false, true}) {
+        ExpressionCache fresh;
+        Outcome fixed;
+        auto getFixed = [&] { fixed = capture([&] { return fresh.get("x + 1", {})->evaluate(); }); };
+        if (fixedFirst) {
+            getFixed();
+        }
+        Outcome byFirstUse = capture([&] { return fresh.get("x + 1")->variableCount(); });
+        if (!fixedFirst) {
+            getFixed();
+        }
+        report.expect("cache(variables)", "x + 1", capture([&] { return evaluator.compile("x + 1", {}).evaluate(); }),
+                      fixed);
+        report.expect("cache(variables)", "x + 1", capture([&] { return evaluator.compile("x + 1").variableCount(); }),
+                      byFirstUse);
+    }
+
+    for (std::size_t iteration = 0; iteration < iterations; iteration++) {
+        Case c = makeCase(evaluator, generator.next(), rows, rng);
+        const std::string& expr = c.expression;
+        std::vector<const std::int32_t*> columns;
+        for (const std::vector<std::int32_t>& column : c.columns) {
+            columns.push_back(column.data());
+        }
+
+        jit::setEnabled(false);
+        report.check("eval(context)", c, 0, capture([&] { return evaluator.eval(expr, context); }));
+        report.check("compile", c, 0, capture([&] { return evaluator.compile(expr).evaluate(); }));
+        report.check("compile(unfolded)", c, 0, capture([&] { return unfolded.compile(expr).evaluate(); }));
+        // A miss compiles the expression as given, so its errors are exact; a hit may
+        // return a program compiled from another spelling, whose positions differ
+        std::uint64_t misses = cache.stats().misses;
+        Outcome cached = capture([&] { return cache.get(expr)->evaluate(); });
+        report.check("cache", c, 0, cached, cache.stats().misses > misses);
+        report.check("compileTyped", c, 0, capture([&] { return evaluator.compileTyped(expr).evaluate().i; }));
+
+        // The constexpr parser, run at run time: its errors are compile()'s
+        static constexpr std::size_t kStaticCapacity = 4096;
+        if (expr.size() <= kStaticCapacity) {
+            auto ast = staticexpr::parse<kStaticCapacity>(expr);
+            report.check("static parse", c, 0, capture([&] {
+                if (!ast.ok()) {
+                    throw std::runtime_error(staticexpr::errorMessage(ast, expr));
+                }
+                return staticexpr::evaluate(ast, nullptr);
+            }));
+        }
+
+        // Padded with spaces to whole 64-byte blocks, so every token is lexed
+        // through the block classifier; trailing spaces move no error position
+        std::string padded = expr + std::string(2 * scan::kBlockBytes - expr.size() % scan::kBlockBytes, ' ');
+        report.check("eval(64-byte blocks)", c, 0, capture([&] { return evaluator.eval(padded, context); }));
+
+        // scanExpression() against the lexer, on the expression and on copies with a
+        // run of '=', '&' or '|' (after a '!', '<' or '>' at times) laid across a
+        // block boundary, where its carries cross from one 64-bit mask to the next.
+        // Whatever it finds, eval() must reject
+        std::vector<std::string> scanned = {expr, padded, c.withVariables};
+        for (int copy = 0; copy < 4; copy++) {
+            std::string left = "(" + expr + ") ";
+            left.append(2 * scan::kBlockBytes - left.size() % scan::kBlockBytes, ' ');
+            std::size_t length = rng() % 4 == 0 ? 60 + rng() % 10 : 1 + rng() % 8;
+            left.resize(left.size() - rng() % std::min<std::size_t>(length, 8));   // The run's last byte is past the boundary
+            const char* lead[] = {"", "", "", "!", "<", ">"};
+            scanned.push_back(left + lead[rng() % 6] + std::string(length, "=&|"[rng() % 3]) + " (" + expr + ")");
+        }
+        for (const std::string& text : scanned) {
+            Outcome want = describe(scanByTokens(text));
+            report.expect("scanExpression", text, want, describe(scan::scanExpression(text)));
+            scan::setSimdEnabled(false);
+            report.expect("scanExpression(scalar)", text, want, describe(scan::scanExpression(text)));
+            scan::setSimdEnabled(true);
+            scan::ScanSummary found = scan::scanExpression(text);
+            if (found.firstInvalid != scan::ScanSummary::npos ||
+                found.firstUnmatchedClose != scan::ScanSummary::npos || found.depth != 0) {
+                report.expectError("scanExpression finds", text, capture([&] { return evaluator.eval(text); }));
+            }
+        }
+
+        // The wider numeric modes agree with eval() whenever checked int32
+        // arithmetic neither overflows nor meets an out-of-range literal
+        Outcome checked = capture([&] { return evaluator.evalAs<CheckedArithmetic<std::int32_t>>(expr); });
+        if (checked.ok || checked.error.compare(0, 8, "Integer ") != 0) {
+            report.check("evalAs<checked int32>", c, 0, checked);
+            report.check("evalAs<int64>", c, 0, capture([&] { return evaluator.evalAs<Int64Arithmetic>(expr); }));
+            report.check("evalAs<bigint>", c, 0, capture([&] {
+                BigInt value = evaluator.evalAs<BigIntArithmetic>(expr);
+                return value.fitsInt64() ? value.toInt64() : INT64_MAX;
+            }));
+        }
+
+        // A short-circuited operand is never computed, so overflow or an oversized
+        // literal inside it is no error in the checked modes either: they agree
+        // with eval() exactly
+        for (const std::string& decided : {"0 && (2147483647 + 1 + 2^62 * 4 * (" + expr + "))",
+                                           "1 || (2^100 - (" + expr + "))",
+                                           "1 || 99999999999999999999 * (" + expr + ")",
+                                           "0 && (" + expr + ") + 99999999999999999999"}) {
+            Outcome want = capture([&] { return evaluator.eval(decided); });
+            report.expect("evalAs<checked> skipped", decided, want, capture([&] {
+                return evaluator.evalAs<CheckedArithmetic<std::int32_t>>(decided);
+            }));
+            report.expect("evalAs<checked> skipped", decided, want, capture([&] {
+                return evaluator.evalAs<CheckedInt64Arithmetic>(decided);
+            }));
+        }
+
+        // Programs with variables, row by row, then as batches
+        bool compiles = true;
+        for (const Evaluator* e : {&evaluator, &unfolded}) {
+            const char* path = e == &evaluator ? "compile(vars)" : "compile(vars, unfolded)";
+            CompiledExpression program;
+            Outcome built = capture([&] {
+                program = e->compile(c.withVariables, c.names);
+                return 0;
+            });
+            if (!built.ok) {
+                report.check(path, c, 0, built);
+                compiles = false;
+                continue;
+            }
+
+            std::vector<int> slots(c.names.size());
+            for (std::size_t r = 0; r < rows; r++) {
+                for (std::size_t v = 0; v < slots.size(); v++) {
+                    slots[v] = c.columns[v][r];
+                }
+                report.check(path, c, r, capture([&] { return program.evaluate(slots); }));
+            }
+
+            std::vector<std::int32_t> out(rows);
+            report.checkBatch(std::string(path) + " batch", c, capture([&] {
+                program.evalBatch(columns.data(), rows, out.data());
+                return 0;
+            }), out);
+        }
+        if (!compiles) {
+            streamCases.push_back(std::move(c));
+            continue;
+        }
+
+        // The same rows repeated over several chunks of a parallel batch
+        CompiledExpression program = evaluator.compile(c.withVariables, c.names);
+        std::vector<std::vector<std::int32_t>> repeated(c.columns.size());
+        std::vector<const std::int32_t*> repeatedColumns;
+        for (std::size_t v = 0; v < c.columns.size(); v++) {
+            for (std::size_t copy = 0; copy < parallelCopies; copy++) {
+                repeated[v].insert(repeated[v].end(), c.columns[v].begin(), c.columns[v].end());
+            }
+            repeatedColumns.push_back(repeated[v].data());
+        }
+        std::vector<std::int32_t> parallelOut(rows * parallelCopies);
+        Outcome parallelThrown = capture([&] {
+            parallel.evalBatch(program, repeatedColumns.data(), rows * parallelCopies, parallelOut.data());
+            return 0;
+        });
+        bool copiesMatch = true;
+        for (std::size_t r = 0; r < parallelOut.size() && parallelThrown.ok; r++) {
+            copiesMatch = copiesMatch && parallelOut[r] == parallelOut[r % rows];
+        }
+        parallelOut.resize(rows);
+        if (!copiesMatch) {
+            parallelOut[0] = ~parallelOut[0];   // Reported as a row 0 mismatch
+        }
+        report.checkBatch("parallel batch", c, parallelThrown, parallelOut);
+
+        // Native code: promoted on the second call
+        if (jit::available()) {
+            jit::setEnabled(true);
+            jit::setThreshold(1);
+            CompiledExpression native = evaluator.compile(c.withVariables, c.names);
+            std::vector<int> slots(c.names.size());
+            for (std::size_t r = 0; r < rows; r++) {
+                for (std::size_t v = 0; v < slots.size(); v++) {
+                    slots[v] = c.columns[v][r];
+                }
+                Outcome got = capture([&] { return native.evaluate(slots); });
+                if (r > 0) {
+                    report.check(native.isNative() ? "jit" : "jit (not promoted)", c, r, got);
+                }
+            }
+            jit::setThreshold(jitThreshold);
+            jit::setEnabled(jitWasEnabled);
+        }
+
+        // A rule set holding the expression twice, so the second rule is entirely shared;
+        // both must agree, and a failing rule throws eval()'s message behind "Rule 0: "
+        RuleSet ruleSet({c.withVariables, c.withVariables}, c.names);
+        for (std::size_t r = 0; r < rows; r++) {
+            std::vector<int> slots(c.names.size());
+            for (std::size_t v = 0; v < slots.size(); v++) {
+                slots[v] = c.columns[v][r];
+            }
+            Outcome got = capture([&] {
+                int out[2];
+                std::uint8_t failed[2];
+                ruleSet.evaluate(slots.data(), out, failed);
+                if (failed[0] || failed[1]) {
+                    ruleSet.evaluate(slots.data(), out);
+                }
+                return failed[0] == failed[1] && out[0] == out[1] ? out[0] : ~out[0];
+            });
+            if (!got.ok && got.error.compare(0, 8, "Rule 0: ") == 0) {
+                got.error.erase(0, 8);
+            }
+            report.check("rule set", c, r, got);
+        }
+
+        // The constexpr parser over the variables, which it numbers in order of first use
+        if (c.withVariables.size() <= kStaticCapacity) {
+            auto ast = staticexpr::parse<kStaticCapacity>(c.withVariables);
+            std::vector<std::size_t> column(ast.variableCount);
+            for (std::size_t slot = 0; slot < column.size(); slot++) {
+                column[slot] = std::find(c.names.begin(), c.names.end(), ast.names[slot]) - c.names.begin();
+            }
+            std::vector<int> slots(column.size());
+            for (std::size_t r = 0; r < rows; r++) {
+                for (std::size_t slot = 0; slot < slots.size(); slot++) {
+                    slots[slot] = c.columns[column[slot]][r];
+                }
+                report.check("static parse(vars)", c, r, capture([&] {
+                    if (!ast.ok()) {
+                        throw std::runtime_error(staticexpr::errorMessage(ast, c.withVariables));
+                    }
+                    return staticexpr::evaluate(ast, slots.data());
+                }));
+            }
+        }
+
+        // Typed programs over int variables
+        std::vector<TypedVariable> typedVariables;
+        for (const std::string& name : c.names) {
+            typedVariables.push_back({name, ValueType::Int});
+        }
+        TypedExpression typed = evaluator.compileTyped(c.withVariables, typedVariables);
+        std::vector<TypedValue> values(c.names.size());
+        std::vector<TypedColumn> typedColumns;
+        for (std::size_t v = 0; v < c.columns.size(); v++) {
+            typedColumns.push_back(TypedColumn::ints(c.columns[v].data()));
+        }
+        for (std::size_t r = 0; r < rows; r++) {
+            for (std::size_t v = 0; v < values.size(); v++) {
+                values[v] = TypedValue::ofInt(c.columns[v][r]);
+            }
+            report.check("compileTyped(vars)", c, r, capture([&] { return typed.evaluate(values.data()).i; }));
+        }
+        std::vector<std::int32_t> typedOut(rows);
+        report.checkBatch("compileTyped(vars) batch", c, capture([&] {
+            typed.evalBatch(typedColumns.data(), rows, typedOut.data());
+            return 0;
+        }), typedOut);
+
+        streamCases.push_back(std::move(c));
+    }
+
+    // Streaming: one file with every expression, evaluated in one run
+    char path[] = "/tmp/regression-fuzz-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0) {
+        close(fd);
+        {
+            std::ofstream input(path);
+            for (const Case& c : streamCases) {
+                input << c.expression << '\n';
+            }
+        }
+        std::FILE* output = std::tmpfile();
+        LineReader reader(path);
+        BufferedWriter writer(output);
+        evaluateStream(evaluator, reader, writer);
+        writer.flush();
+        std::rewind(output);
+
+        char line[4096];
+        for (const Case& c : streamCases) {
+            if (!std::fgets(line, sizeof(line), output)) {
+                report.check("stream", c, 0, capture([]() -> int { throw std::runtime_error("missing line"); }));
+                continue;
+            }
+            std::string text(line, std::strcspn(line, "\n"));
+            Outcome got;
+            if (text.compare(0, 7, "error: ") == 0) {
+                got.error = text.substr(7);
+            }
+            else {
+                got.ok = true;
+                got.value = std::stoll(text);
+            }
+            report.check("stream", c, 0, got);
+        }
+        std::fclose(output);
+        std::remove(path);
+    }
+
+    // Program files: every case's program in one file, run from the mapping,
+    // then records damaged in ways a forged checksum would let through
+    std::vector<CompiledExpression> programs;
+    std::vector<const Case*> programCases;
+    for (const Case& c : streamCases) {
+        try {
+            programs.push_back(evaluator.compile(c.withVariables, c.names));
+            programCases.push_back(&c);
+        }
+        catch (const std::exception&) {
+            // Covered by the compile(vars) path
+        }
+    }
+    char programPath[] = "/tmp/regression-programs-XXXXXX";
+    fd = mkstemp(programPath);
+    if (fd >= 0) {
+        close(fd);
+        ProgramFile::write(programPath, programs);
+        {
+            ProgramFile file(programPath);
+            for (std::size_t i = 0; i < programs.size(); i++) {
+                const Case& c = *programCases[i];
+                ProgramView view = file.program(i);
+                std::vector<int> slots(c.names.size());
+                for (std::size_t r = 0; r < rows; r++) {
+                    for (std::size_t v = 0; v < slots.size(); v++) {
+                        slots[v] = c.columns[v][r];
+                    }
+                    report.check("program file", c, r, capture([&] { return view.evaluate(slots.data()); }));
+                }
+            }
+        }
+
+        const std::string contents = ProgramFile::serialize(programs);
+        programfile::Header header;
+        std::memcpy(&header, contents.data(), sizeof(header));
+        const std::size_t damagedPrograms = std::min<std::size_t>(programs.size(), 500);
+        for (std::size_t i = 0; i < damagedPrograms; i++) {
+            std::size_t recordAt = header.indexOffset + i * sizeof(programfile::ProgramRecord);
+            programfile::ProgramRecord record;
+            std::memcpy(&record, contents.data() + recordAt, sizeof(record));
+            auto instructionAt = [&](std::size_t pc) {
+                return header.codeOffset + (record.firstInstruction + pc) * sizeof(Instruction);
+            };
+            auto firstOf = [&](std::initializer_list<OpCode> ops) {
+                for (std::size_t pc = 0; pc < record.instructionCount; pc++) {
+                    if (std::find(ops.begin(), ops.end(), programs[i].instructions()[pc].op) != ops.end()) {
+                        return pc;
+                    }
+                }
+                return std::size_t(record.instructionCount);
+            };
+
+            // Each damage rewrites part of the copy and reports whether it applies to this program
+            const std::function<bool(std::string&)> damages[] = {
+                [&](std::string& bytes) {
+                    record.stackDepth = 0;
+                    std::memcpy(&bytes[recordAt], &record, sizeof(record));
+                    return true;
+                },
+                [&](std::string& bytes) {
+                    record.stackDepth = UINT32_MAX;
+                    std::memcpy(&bytes[recordAt], &record, sizeof(record));
+                    return true;
+                },
+                [&](std::string& bytes) {
+                    bytes[instructionAt(0) + offsetof(Instruction, op)] = '\xff';
+                    return true;
+                },
+                [&](std::string& bytes) {
+                    std::size_t pc = firstOf({OpCode::PushVar});
+                    std::int32_t slot = static_cast<std::int32_t>(record.nameCount);
+                    std::memcpy(&bytes[instructionAt(pc) + offsetof(Instruction, operand)], &slot, sizeof(slot));
+                    return pc < record.instructionCount;
+                },
+                [&](std::string& bytes) {
+                    std::size_t pc = firstOf({OpCode::JumpIfZero, OpCode::JumpIfNonZero});
+                    std::int32_t target = static_cast<std::int32_t>(pc);
+                    std::memcpy(&bytes[instructionAt(pc) + offsetof(Instruction, operand)], &target, sizeof(target));
+                    return pc < record.instructionCount;
+                },
+                [&](std::string& bytes) {
+                    // Only pushes: the stack outgrows any depth the record can claim
+                    for (std::size_t pc = 0; pc < record.instructionCount; pc++) {
+                        bytes[instructionAt(pc) + offsetof(Instruction, op)] = static_cast<char>(OpCode::PushConst);
+                    }
+                    return record.instructionCount > 1;
+                },
+            };
+
+            const Case& c = *programCases[i];
+            for (const std::function<bool(std::string&)>& damage : damages) {
+                std::string bytes = contents;
+                std::memcpy(&record, contents.data() + recordAt, sizeof(record));
+                if (!damage(bytes)) {
+                    continue;
+                }
+                std::ofstream(programPath, std::ios::binary | std::ios::trunc) << bytes;
+                ProgramFile file(programPath, false);
+                Outcome want;
+                want.error = "Program " + std::to_string(i) + " has an invalid record";
+                report.expect("program file (damaged)", c.withVariables, want, capture([&] {
+                    return file.program(i).maxStackDepth();
+                }));
+            }
+        }
+        std::remove(programPath);
+    }
+
+    // Predicate index: rule sets of random conjunctions of comparisons, bare and
+    // negated variables, constants and rules that can only be evaluated (some
+    // dividing by zero), matched against records of boundary values. A rule
+    // matches exactly when its compiled program gives a non-zero result
+    const std::vector<std::string> predicateNames = {"p", "q", "r", "s"};
+    const std::vector<std::string> bounds = {"(-2147483647 - 1)", "-2147483647", "2147483646", "2147483647",
+                                             "-1", "0", "1", "2", "-3", "5"};
+    const std::int32_t recordValues[] = {INT32_MIN, INT32_MIN + 1, INT32_MAX - 1, INT32_MAX, -3, -2, -1, 0, 1, 2, 3, 5, 6};
+    const char* comparisons[] = {"<", "<=", ">", ">=", "==", "!="};
+    auto conjunct = [&]() -> std::string {
+        const std::string& x = predicateNames[rng() % predicateNames.size()];
+        const std::string& y = predicateNames[rng() % predicateNames.size()];
+        const std::string& bound = bounds[rng() % bounds.size()];
+        const char* comparison = comparisons[rng() % 6];
+        switch (rng() % 12) {
+        case 0:  return x;
+        case 1:  return "!" + x;
+        case 2:  return std::string(rng() % 2 ? "1" : "0");
+        case 3:  return std::string(rng() % 2 ? "(2 > 1)" : "(3 == 4)");
+        case 4:  return x + " / (" + y + " - " + y + ") > 0";
+        case 5:  return x + " % " + y + " " + comparison + " " + bound;
+        case 6:  return x + " + 1 " + comparison + " " + bound;
+        case 7:
+        case 8:  return bound + " " + comparison + " " + x;
+        default: return x + " " + comparison + " " + bound;
+        }
+    };
+    for (std::size_t set = 0; set < std::max<std::size_t>(1, iterations / 100); set++) {
+        std::vector<std::string> rules(40);
+        std::vector<CompiledExpression> compiled;
+        for (std::string& rule : rules) {
+            rule = conjunct();
+            for (std::size_t extra = rng() % 4; extra > 0; extra--) {
+                rule += " && " + conjunct();
+            }
+            compiled.push_back(evaluator.compile(rule, predicateNames));
+        }
+        PredicateIndex index(rules, predicateNames, evaluator);
+        std::vector<std::uint32_t> matches;
+        for (std::size_t r = 0; r < rows; r++) {
+            std::vector<std::int32_t> slots;
+            std::string record;
+            for (const std::string& name : predicateNames) {
+                slots.push_back(recordValues[rng() % (sizeof(recordValues) / sizeof(recordValues[0]))]);
+                record += " " + name + "=" + std::to_string(slots.back());
+            }
+            index.match(slots.data(), matches);
+            for (std::size_t rule = 0; rule < rules.size(); rule++) {
+                Outcome want = capture([&] { return compiled[rule].evaluate(slots.data()); });
+                want.value = want.ok && want.value != 0;
+                want.ok = true;
+                Outcome got;
+                got.ok = true;
+                got.value = std::binary_search(matches.begin(), matches.end(), static_cast<std::uint32_t>(rule));
+                report.expect("predicate index", rules[rule] + " with" + record, want, got);
+            }
+        }
+    }
+
+    std::cout << "=== Differential fuzzing: " << iterations << " expressions, seed " << seed << " ===" << std::endl
+              << std::endl;
+    return report.print() ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: regression bench|fuzz|compare [options]" << std::endl;
+        return 2;
+    }
+
+    Options options(argc, argv, 2);
+    try {
+        if (std::strcmp(argv[1], "bench") == 0) {
+            return runBench(options);
+        }
+        if (std::strcmp(argv[1], "fuzz") == 0) {
+            return runFuzz(options);
+        }
+        if (std::strcmp(argv[1], "compare") == 0) {
+            return runCompare(options);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 2;
+    }
+
+    std::cerr << "Unknown mode: " << argv[1] << std::endl;
+    return 2;
+}